@@ -24,13 +24,15 @@ Usage:
 
 from __future__ import annotations
 
+import contextlib
 import enum
+import struct
 import threading
 import time
 from dataclasses import dataclass, field
-from typing import Callable, Optional
+from typing import Callable, Iterator, Optional
 
-from pythonosc import osc_message_builder, osc_server, udp_client
+from pythonosc import osc_bundle_builder, osc_message_builder, osc_server, udp_client
 from pythonosc.dispatcher import Dispatcher
 
 
@@ -100,6 +102,31 @@ class PendingOp:
     description: str = ""
 
 
+@dataclass
+class PerfState:
+    """Audio callback timing. Times in microseconds, loads as fractions of
+    the buffer period; window figures cover about the last second."""
+    period_us: float = 0.0
+    mean_us: float = 0.0
+    p99_us: float = 0.0
+    max_us: float = 0.0
+    mean_load: float = 0.0
+    p99_load: float = 0.0
+    max_load: float = 0.0
+    ingest_us: float = 0.0
+    ops_us: float = 0.0
+    mix_us: float = 0.0
+    stretch_us: float = 0.0
+    host_mean_us: float = 0.0
+    host_max_us: float = 0.0
+    callbacks: int = 0
+    missed_deadlines: int = 0
+    late_callbacks: int = 0
+    device_xruns: int = -1
+    audio_memory_bytes: int = 0
+    locked_bytes: int = 0
+
+
 @dataclass
 class EngineState:
     metronome: MetronomeState = field(default_factory=MetronomeState)
@@ -111,13 +138,54 @@ class EngineState:
     lookback_bars: int = 1
     click_enabled: bool = True
     sample_rate: int = 44100
+    perf: PerfState = field(default_factory=PerfState)
     messages: list[str] = field(default_factory=list)
+    # Waveform overviews answered to query_loop_peaks / query_input_peaks:
+    # (min, max) pairs in -1..1, per loop (with the peaks' revision) and per
+    # input channel
+    loop_peaks: dict[int, tuple[int, list[tuple[float, float]]]] = field(default_factory=dict)
+    input_peaks: dict[int, list[tuple[float, float]]] = field(default_factory=dict)
 
     @property
     def active_loop_count(self) -> int:
         return sum(1 for lp in self.loops if not lp.is_empty)
 
 
+# Fields of /retro/state/metronome and (after the index) /retro/state/loop,
+# in order; bit n of a .../delta mask stands for field n
+_METRONOME_FIELDS = (
+    ("bar", int),
+    ("beat", int),
+    ("beat_fraction", float),
+    ("bpm", float),
+    ("beats_per_bar", int),
+    ("running", bool),
+)
+_LOOP_FIELDS = (
+    ("state", LoopState),
+    ("length_in_bars", float),
+    ("layers", int),
+    ("active_layers", int),
+    ("speed", float),
+    ("reversed", bool),
+    ("play_position_pct", float),
+    ("length_samples", int),
+)
+
+
+def _apply_fields(target, fields, values, mask: Optional[int] = None) -> None:
+    """Set `fields` of `target` from `values`: all of them, or with `mask`
+    only those whose bit is set (the changed fields of a delta message)."""
+    values = iter(values)
+    for bit, (name, convert) in enumerate(fields):
+        if mask is not None and not mask & (1 << bit):
+            continue
+        value = next(values, None)
+        if value is None:
+            return
+        setattr(target, name, convert(value))
+
+
 # ---------------------------------------------------------------------------
 # Client
 # ---------------------------------------------------------------------------
@@ -125,10 +193,18 @@ class EngineState:
 class RetrospectClient:
     """OSC client for controlling a Retrospect looper server.
 
+    State arrives in bundles carrying only what changed: loops and the
+    metronome as .../delta messages (a mask of the changed fields, then
+    those fields), everything else when it changes. A periodic keyframe
+    resends it all, starting with /retro/state/keyframe, which resets every
+    loop slot to empty.
+
     Args:
         host: Server hostname or IP address.
         port: Server OSC port (default 7770).
         listen_port: Local port for receiving state pushes. 0 = auto-assign.
+        rate: State pushes per second to ask the server for. None = the
+            server's default (30). Changes go out at once regardless.
     """
 
     def __init__(
@@ -136,10 +212,12 @@ class RetrospectClient:
         host: str = "127.0.0.1",
         port: int = 7770,
         listen_port: int = 0,
+        rate: Optional[float] = None,
     ) -> None:
         self._host = host
         self._port = port
         self._listen_port = listen_port
+        self._rate = rate
 
         self._state = EngineState()
         self._lock = threading.Lock()
@@ -148,6 +226,7 @@ class RetrospectClient:
         self._server: Optional[osc_server.ThreadingOSCUDPServer] = None
         self._server_thread: Optional[threading.Thread] = None
         self._running = False
+        self._batch: Optional[list] = None  # Messages of the open batch()
 
         # Callbacks
         self._on_state_update: Optional[Callable[[EngineState], None]] = None
@@ -155,13 +234,19 @@ class RetrospectClient:
 
         # Build dispatcher
         self._dispatcher = Dispatcher()
+        self._dispatcher.map("/retro/state/keyframe", self._handle_keyframe)
         self._dispatcher.map("/retro/state/metronome", self._handle_metronome)
+        self._dispatcher.map("/retro/state/metronome/delta", self._handle_metronome_delta)
         self._dispatcher.map("/retro/state/loop", self._handle_loop)
+        self._dispatcher.map("/retro/state/loop/delta", self._handle_loop_delta)
         self._dispatcher.map("/retro/state/recording", self._handle_recording)
         self._dispatcher.map("/retro/state/settings", self._handle_settings)
+        self._dispatcher.map("/retro/state/perf", self._handle_perf)
         self._dispatcher.map("/retro/state/pending_clear", self._handle_pending_clear)
         self._dispatcher.map("/retro/state/pending_op", self._handle_pending_op)
         self._dispatcher.map("/retro/state/log", self._handle_log)
+        self._dispatcher.map("/retro/peaks/loop", self._handle_loop_peaks)
+        self._dispatcher.map("/retro/peaks/input", self._handle_input_peaks)
 
     # -- Lifecycle ------------------------------------------------------------
 
@@ -247,47 +332,47 @@ class RetrospectClient:
             lookback_bars: How many bars back to capture. 0 uses the current
                 lookback_bars setting.
         """
-        self._client.send_message("/retro/loop/capture", [loop, int(quantize), lookback_bars])
+        self._send("/retro/loop/capture", [loop, int(quantize), lookback_bars])
 
     def record(self, loop: int, quantize: Quantize = Quantize.BAR) -> None:
         """Start classic recording on a loop."""
-        self._client.send_message("/retro/loop/record", [loop, int(quantize)])
+        self._send("/retro/loop/record", [loop, int(quantize)])
 
     def stop_record(self, loop: int, quantize: Quantize = Quantize.BAR) -> None:
         """Stop classic recording on a loop."""
-        self._client.send_message("/retro/loop/stop_record", [loop, int(quantize)])
+        self._send("/retro/loop/stop_record", [loop, int(quantize)])
 
     def mute(self, loop: int, quantize: Quantize = Quantize.BAR) -> None:
         """Mute a loop."""
-        self._client.send_message("/retro/loop/mute", [loop, int(quantize)])
+        self._send("/retro/loop/mute", [loop, int(quantize)])
 
     def unmute(self, loop: int, quantize: Quantize = Quantize.BAR) -> None:
         """Unmute a loop."""
-        self._client.send_message("/retro/loop/unmute", [loop, int(quantize)])
+        self._send("/retro/loop/unmute", [loop, int(quantize)])
 
     def toggle_mute(self, loop: int, quantize: Quantize = Quantize.BAR) -> None:
         """Toggle mute on a loop."""
-        self._client.send_message("/retro/loop/toggle_mute", [loop, int(quantize)])
+        self._send("/retro/loop/toggle_mute", [loop, int(quantize)])
 
     def reverse(self, loop: int, quantize: Quantize = Quantize.BAR) -> None:
         """Toggle reverse playback on a loop."""
-        self._client.send_message("/retro/loop/reverse", [loop, int(quantize)])
+        self._send("/retro/loop/reverse", [loop, int(quantize)])
 
     def overdub_start(self, loop: int, quantize: Quantize = Quantize.BAR) -> None:
         """Start overdubbing on a loop."""
-        self._client.send_message("/retro/loop/overdub/start", [loop, int(quantize)])
+        self._send("/retro/loop/overdub/start", [loop, int(quantize)])
 
     def overdub_stop(self, loop: int, quantize: Quantize = Quantize.BAR) -> None:
         """Stop overdubbing on a loop."""
-        self._client.send_message("/retro/loop/overdub/stop", [loop, int(quantize)])
+        self._send("/retro/loop/overdub/stop", [loop, int(quantize)])
 
     def undo(self, loop: int) -> None:
         """Undo the last overdub layer on a loop."""
-        self._client.send_message("/retro/loop/undo", [loop])
+        self._send("/retro/loop/undo", [loop])
 
     def redo(self, loop: int) -> None:
         """Redo the last undone layer on a loop."""
-        self._client.send_message("/retro/loop/redo", [loop])
+        self._send("/retro/loop/redo", [loop])
 
     def set_speed(
         self,
@@ -296,41 +381,117 @@ class RetrospectClient:
         quantize: Quantize = Quantize.FREE,
     ) -> None:
         """Set playback speed for a loop (0.25 - 4.0)."""
-        self._client.send_message("/retro/loop/speed", [loop, float(speed), int(quantize)])
+        self._send("/retro/loop/speed", [loop, float(speed), int(quantize)])
 
     def clear(self, loop: int) -> None:
         """Clear a loop (delete all audio)."""
-        self._client.send_message("/retro/loop/clear", [loop])
+        self._send("/retro/loop/clear", [loop])
 
     # -- Global commands ------------------------------------------------------
 
     def set_bpm(self, bpm: float) -> None:
         """Set the metronome BPM."""
-        self._client.send_message("/retro/metronome/bpm", [float(bpm)])
+        self._send("/retro/metronome/bpm", [float(bpm)])
 
     def set_click(self, enabled: bool) -> None:
         """Enable or disable the metronome click."""
-        self._client.send_message("/retro/metronome/click", [1 if enabled else 0])
+        self._send("/retro/metronome/click", [1 if enabled else 0])
 
     def set_quantize(self, quantize: Quantize) -> None:
         """Set the default quantization mode."""
-        self._client.send_message("/retro/settings/quantize", [int(quantize)])
+        self._send("/retro/settings/quantize", [int(quantize)])
 
     def set_lookback_bars(self, bars: int) -> None:
         """Set the number of lookback bars for capture."""
-        self._client.send_message("/retro/settings/lookback_bars", [bars])
+        self._send("/retro/settings/lookback_bars", [bars])
 
     def cancel_pending(self) -> None:
         """Cancel all pending (queued) operations."""
-        self._client.send_message("/retro/cancel_pending", [])
+        self._send("/retro/cancel_pending", [])
 
-    # -- Internal: subscription -----------------------------------------------
+    # -- Batches --------------------------------------------------------------
 
-    def _subscribe(self) -> None:
+    @contextlib.contextmanager
+    def batch(self, at: Optional[float] = None) -> Iterator[None]:
+        """Send the commands issued inside the block as one OSC bundle.
+
+        The server hands a bundle to the engine as one batch, so its
+        quantized ops land on the same boundary, e.g. to launch a scene.
+
+        at: When the batch should act, as a time.time() timestamp. Free ops
+            then land on that exact sample and quantized ops on the first
+            boundary at or after it. None = as soon as it arrives.
+        """
+        if self._batch is not None:
+            # Inside another batch: join it
+            yield
+            return
+        self._batch = []
+        try:
+            yield
+            messages = self._batch
+        finally:
+            self._batch = None
+        bundle = osc_bundle_builder.OscBundleBuilder(
+            osc_bundle_builder.IMMEDIATELY if at is None else at
+        )
+        for message in messages:
+            bundle.add_content(message)
+        self._client.send(bundle.build())
+
+    # -- Sessions -------------------------------------------------------------
+
+    def save_session(self, path: str) -> None:
+        """Save every loop to a session file (a path on the server's machine).
+
+        The save runs in the background; the outcome arrives as a log message.
+        """
+        self._send("/retro/session/save", [path])
+
+    def load_session(self, path: str) -> None:
+        """Replace every loop with a saved session (a path on the server's machine)."""
+        self._send("/retro/session/load", [path])
+
+    # -- Waveforms ------------------------------------------------------------
+
+    def query_loop_peaks(self, loop: int, columns: int) -> None:
+        """Ask for a loop's waveform as `columns` min/max pairs over its length.
+
+        The answer lands in state.loop_peaks[loop] as (revision, peaks); the
+        revision changes whenever the loop's audio does, so a view only needs
+        to redraw when it moves. A loop with no audio answers revision 0.
+        """
+        self._client.send_message(
+            "/retro/query/loop_peaks", ["localhost", self._listen_port, loop, columns]
+        )
+
+    def query_input_peaks(self, channel: int, columns: int, seconds: float) -> None:
+        """Ask for the last `seconds` of an input channel's lookback history
+        as `columns` min/max pairs, oldest first (state.input_peaks[channel])."""
         self._client.send_message(
-            "/retro/client/subscribe", ["localhost", self._listen_port]
+            "/retro/query/input_peaks",
+            ["localhost", self._listen_port, channel, columns, float(seconds)],
         )
 
+    # -- Internal: sending ----------------------------------------------------
+
+    def _send(self, address: str, args: list) -> None:
+        if self._batch is None:
+            self._client.send_message(address, args)
+            return
+        builder = osc_message_builder.OscMessageBuilder(address=address)
+        for arg in args:
+            builder.add_arg(arg)
+        self._batch.append(builder.build())
+
+    # -- Internal: subscription -----------------------------------------------
+
+    def _subscribe(self) -> None:
+        args = ["localhost", self._listen_port]
+        if self._rate is not None:
+            args.append(float(self._rate))
+        self._client.send_message("/retro/client/subscribe", args)
+
     def _unsubscribe(self) -> None:
         self._client.send_message(
             "/retro/client/unsubscribe", ["localhost", self._listen_port]
@@ -344,34 +505,40 @@ class RetrospectClient:
 
     # -- Internal: OSC handlers -----------------------------------------------
 
+    def _handle_keyframe(self, address: str, *args) -> None:
+        with self._lock:
+            self._state.loops = [LoopInfo() for _ in range(max(0, args[0]))]
+
     def _handle_metronome(self, address: str, *args) -> None:
         with self._lock:
-            m = self._state.metronome
-            m.bar = args[0]
-            m.beat = args[1]
-            m.beat_fraction = args[2]
-            m.bpm = args[3]
-            m.beats_per_bar = args[4]
-            m.running = bool(args[5])
+            _apply_fields(self._state.metronome, _METRONOME_FIELDS, args)
         if self._on_state_update:
             self._on_state_update(self._state)
 
+    def _handle_metronome_delta(self, address: str, *args) -> None:
+        if not args:
+            return
+        with self._lock:
+            _apply_fields(self._state.metronome, _METRONOME_FIELDS, args[1:], args[0])
+        if self._on_state_update:
+            self._on_state_update(self._state)
+
+    def _loop_slot(self, idx: int) -> LoopInfo:
+        if idx >= len(self._state.loops):
+            self._state.loops.extend(
+                LoopInfo() for _ in range(idx + 1 - len(self._state.loops))
+            )
+        return self._state.loops[idx]
+
     def _handle_loop(self, address: str, *args) -> None:
-        idx = args[0]
         with self._lock:
-            if idx >= len(self._state.loops):
-                self._state.loops.extend(
-                    LoopInfo() for _ in range(idx + 1 - len(self._state.loops))
-                )
-            lp = self._state.loops[idx]
-            lp.state = LoopState(args[1])
-            lp.length_in_bars = args[2]
-            lp.layers = args[3]
-            lp.active_layers = args[4]
-            lp.speed = args[5]
-            lp.reversed = bool(args[6])
-            lp.play_position_pct = args[7]
-            lp.length_samples = args[8]
+            _apply_fields(self._loop_slot(args[0]), _LOOP_FIELDS, args[1:])
+
+    def _handle_loop_delta(self, address: str, *args) -> None:
+        if len(args) < 2:
+            return
+        with self._lock:
+            _apply_fields(self._loop_slot(args[0]), _LOOP_FIELDS, args[2:], args[1])
 
     def _handle_recording(self, address: str, *args) -> None:
         with self._lock:
@@ -385,6 +552,10 @@ class RetrospectClient:
             self._state.click_enabled = bool(args[2])
             self._state.sample_rate = args[3]
 
+    def _handle_perf(self, address: str, *args) -> None:
+        with self._lock:
+            self._state.perf = PerfState(*args[:19])
+
     def _handle_pending_clear(self, address: str, *args) -> None:
         with self._lock:
             self._state.pending_ops.clear()
@@ -398,6 +569,23 @@ class RetrospectClient:
         with self._lock:
             self._state.pending_ops.append(op)
 
+    @staticmethod
+    def _decode_peaks(blob: bytes) -> list[tuple[float, float]]:
+        # int8 min/max pairs, full scale at 127
+        n = len(blob) // 2 * 2
+        values = struct.unpack(f"{n}b", blob[:n])
+        return [(values[i] / 127.0, values[i + 1] / 127.0) for i in range(0, len(values), 2)]
+
+    def _handle_loop_peaks(self, address: str, *args) -> None:
+        peaks = self._decode_peaks(args[2])
+        with self._lock:
+            self._state.loop_peaks[args[0]] = (args[1], peaks)
+
+    def _handle_input_peaks(self, address: str, *args) -> None:
+        peaks = self._decode_peaks(args[1])
+        with self._lock:
+            self._state.input_peaks[args[0]] = peaks
+
     def _handle_log(self, address: str, *args) -> None:
         msg = args[0]
         with self._lock:
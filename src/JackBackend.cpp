@@ -0,0 +1,174 @@
+#include "JackBackend.h"
+#include "core/LoopEngine.h"
+#include "core/MonotonicClock.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace retrospect {
+
+JackBackend::~JackBackend() {
+    close();
+}
+
+bool JackBackend::open(const Settings& settings) {
+    if (client_) return true;  // already open
+
+    jack_status_t status{};
+    client_ = jack_client_open("Retrospect", JackNoStartServer, &status);
+    if (!client_) {
+        fprintf(stderr, "JackBackend: could not open JACK client (status 0x%x)\n",
+                static_cast<unsigned>(status));
+        return false;
+    }
+    sampleRate_ = static_cast<double>(jack_get_sample_rate(client_));
+    bufferSize_.store(static_cast<int>(jack_get_buffer_size(client_)), std::memory_order_relaxed);
+
+    auto registerPort = [this](const char* prefix, int number, unsigned long flags) {
+        char portName[32];
+        snprintf(portName, sizeof(portName), "%s_%d", prefix, number);
+        return jack_port_register(client_, portName, JACK_DEFAULT_AUDIO_TYPE, flags, 0);
+    };
+    bool registered = true;
+    for (int ch = 0; ch < settings.inputs && registered; ++ch) {
+        jack_port_t* port = registerPort("in", ch + 1, JackPortIsInput);
+        registered = port != nullptr;
+        inputPorts_.push_back(port);
+    }
+    outputPort_ = jack_port_register(client_, "out", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+    registered = registered && outputPort_ != nullptr;
+    for (int i = 0; i < settings.loopOutputs && registered; ++i) {
+        jack_port_t* port = registerPort("loop", i + 1, JackPortIsOutput);
+        registered = port != nullptr;
+        loopPorts_.push_back(port);
+    }
+    if (!registered) {
+        fprintf(stderr, "JackBackend: failed to register ports\n");
+        close();
+        return false;
+    }
+    inputBuffers_.assign(inputPorts_.size(), nullptr);
+    loopBuffers_.assign(loopPorts_.size(), nullptr);
+
+    jack_set_process_callback(client_, processCallback, this);
+    jack_set_xrun_callback(client_, xrunCallback, this);
+    jack_set_buffer_size_callback(client_, bufferSizeCallback, this);
+    jack_on_shutdown(client_, shutdownCallback, this);
+
+    if (jack_activate(client_) != 0) {
+        fprintf(stderr, "JackBackend: failed to activate JACK client\n");
+        close();
+        return false;
+    }
+    if (settings.autoConnect) connectPhysical();
+    return true;
+}
+
+void JackBackend::close() {
+    if (!client_) return;
+
+    // Deactivating waits for the current cycle, so the engine is left alone
+    // from here on
+    jack_deactivate(client_);
+    jack_client_close(client_);
+    client_ = nullptr;
+    engine_.store(nullptr, std::memory_order_release);
+    inputPorts_.clear();
+    outputPort_ = nullptr;
+    loopPorts_.clear();
+}
+
+std::string JackBackend::name() const {
+    return client_ ? std::string("JACK (") + jack_get_client_name(client_) + ")" : std::string();
+}
+
+int JackBackend::inputLatency() const {
+    jack_latency_range_t range{0, 0};
+    if (!inputPorts_.empty()) jack_port_get_latency_range(inputPorts_[0], JackCaptureLatency, &range);
+    return static_cast<int>(range.max);
+}
+
+int JackBackend::outputLatency() const {
+    jack_latency_range_t range{0, 0};
+    if (outputPort_) jack_port_get_latency_range(outputPort_, JackPlaybackLatency, &range);
+    return static_cast<int>(range.max);
+}
+
+void JackBackend::connectPhysical() {
+    // Physical capture ports are outputs from JACK's point of view
+    if (const char** capture = jack_get_ports(client_, nullptr, JACK_DEFAULT_AUDIO_TYPE,
+                                              JackPortIsPhysical | JackPortIsOutput)) {
+        for (size_t ch = 0; ch < inputPorts_.size() && capture[ch]; ++ch) {
+            jack_connect(client_, capture[ch], jack_port_name(inputPorts_[ch]));
+        }
+        jack_free(capture);
+    }
+    // The mix is mono: it goes to both sides of a stereo pair
+    if (const char** playback = jack_get_ports(client_, nullptr, JACK_DEFAULT_AUDIO_TYPE,
+                                               JackPortIsPhysical | JackPortIsInput)) {
+        for (int i = 0; i < 2 && playback[i]; ++i) {
+            jack_connect(client_, jack_port_name(outputPort_), playback[i]);
+        }
+        jack_free(playback);
+    }
+}
+
+int JackBackend::processCallback(jack_nframes_t nframes, void* arg) {
+    return static_cast<JackBackend*>(arg)->process(nframes);
+}
+
+int JackBackend::xrunCallback(void* arg) {
+    static_cast<JackBackend*>(arg)->xruns_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+int JackBackend::bufferSizeCallback(jack_nframes_t nframes, void* arg) {
+    // Nothing in the engine is sized by the period: blocks are cut into
+    // sub-blocks of at most LoopEngine::kMaxSubBlock, and the DSP load meter
+    // takes each callback's period from its length. So there is nothing to
+    // re-prepare here; the control thread picks up the new latencies.
+    auto* self = static_cast<JackBackend*>(arg);
+    int previous = self->bufferSize_.exchange(static_cast<int>(nframes), std::memory_order_relaxed);
+    if (previous != 0 && previous != static_cast<int>(nframes)) {
+        self->bufferSizeChanges_.fetch_add(1, std::memory_order_release);
+    }
+    return 0;
+}
+
+void JackBackend::shutdownCallback(void* arg) {
+    static_cast<JackBackend*>(arg)->serverLost_.store(true, std::memory_order_release);
+}
+
+int JackBackend::process(jack_nframes_t nframes) {
+    int64_t startNanos = monotonicNanos();
+    int numSamples = static_cast<int>(nframes);
+
+    // Port buffers are only valid for this cycle, so they are fetched each
+    // time; the engine reads and writes them in place
+    auto* output = static_cast<float*>(jack_port_get_buffer(outputPort_, nframes));
+    LoopEngine* engine = engine_.load(std::memory_order_acquire);
+    if (!engine) {
+        std::memset(output, 0, sizeof(float) * nframes);
+        for (jack_port_t* port : loopPorts_) {
+            std::memset(jack_port_get_buffer(port, nframes), 0, sizeof(float) * nframes);
+        }
+        return 0;
+    }
+
+    for (size_t ch = 0; ch < inputPorts_.size(); ++ch) {
+        inputBuffers_[ch] = static_cast<const float*>(jack_port_get_buffer(inputPorts_[ch], nframes));
+    }
+    for (size_t i = 0; i < loopPorts_.size(); ++i) {
+        loopBuffers_[i] = static_cast<float*>(jack_port_get_buffer(loopPorts_[i], nframes));
+    }
+
+    engine->processBlock(inputBuffers_.data(), numInputs(), output, numSamples,
+                         loopBuffers_.data(), numLoopOutputs());
+
+    // Whole-callback time and the server's xrun count, for the DSP stats
+    engine->noteHostCallback(monotonicNanos() - startNanos,
+                             xruns_.load(std::memory_order_relaxed));
+    return 0;
+}
+
+} // namespace retrospect
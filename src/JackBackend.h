@@ -0,0 +1,102 @@
+#pragma once
+
+#include <jack/jack.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace retrospect {
+
+class LoopEngine;
+
+/// Native JACK audio backend: a JACK client whose process callback hands
+/// the port buffers straight to LoopEngine::processBlock, with no device
+/// layer in between copying or re-marshalling channels.
+///
+/// The client registers one input port per engine input channel, a mono
+/// mix output and, optionally, an output per loop slot. It is opened and
+/// activated before the engine exists (its sample rate sizes the engine),
+/// playing silence until setEngine() hands it one. The same client can
+/// then take the timebase role (JackTransport::attach).
+class JackBackend {
+public:
+    struct Settings {
+        int inputs = 2;            // Input ports (engine input channels)
+        int loopOutputs = 0;       // Per-loop output ports (0 = none)
+        bool autoConnect = true;   // Connect to the physical ports on start
+    };
+
+    JackBackend() = default;
+    ~JackBackend();
+
+    JackBackend(const JackBackend&) = delete;
+    JackBackend& operator=(const JackBackend&) = delete;
+
+    /// Open the JACK client, register its ports and activate it, then
+    /// connect it to the physical ports if asked. Returns true on success.
+    bool open(const Settings& settings);
+
+    /// Deactivate and close the client. The engine is not called after this
+    /// returns, so it must be called before the engine is destroyed.
+    void close();
+
+    /// Start (or, with nullptr, stop) processing through `engine`. Control
+    /// thread; takes effect from the next JACK cycle.
+    void setEngine(LoopEngine* engine) { engine_.store(engine, std::memory_order_release); }
+
+    jack_client_t* client() const { return client_; }
+    bool isOpen() const { return client_ != nullptr; }
+
+    /// Whether the JACK server shut down or dropped the client
+    bool serverLost() const { return serverLost_.load(std::memory_order_acquire); }
+
+    std::string name() const;
+    double sampleRate() const { return sampleRate_; }
+
+    /// Frames per JACK period, following changes made while running (e.g.
+    /// with jack_bufsize)
+    int bufferSize() const { return bufferSize_.load(std::memory_order_relaxed); }
+
+    /// Bumped each time the period changes while running. The port
+    /// latencies move with it, so whoever derived anything from them
+    /// (latency compensation) should read them again.
+    uint32_t bufferSizeChanges() const { return bufferSizeChanges_.load(std::memory_order_acquire); }
+    int numInputs() const { return static_cast<int>(inputPorts_.size()); }
+    int numLoopOutputs() const { return static_cast<int>(loopPorts_.size()); }
+
+    /// Worst-case latency of the input and mix output ports' connections,
+    /// in samples (as JACK reports it; follows the current connections)
+    int inputLatency() const;
+    int outputLatency() const;
+
+private:
+    static int processCallback(jack_nframes_t nframes, void* arg);
+    static int xrunCallback(void* arg);
+    static int bufferSizeCallback(jack_nframes_t nframes, void* arg);
+    static void shutdownCallback(void* arg);
+
+    int process(jack_nframes_t nframes);
+
+    /// Connect inputs to capture ports, and the mix output to the first two
+    /// playback ports, in order
+    void connectPhysical();
+
+    jack_client_t* client_ = nullptr;
+    double sampleRate_ = 0.0;
+    std::vector<jack_port_t*> inputPorts_;
+    jack_port_t* outputPort_ = nullptr;
+    std::vector<jack_port_t*> loopPorts_;
+
+    // Buffer pointers for the current cycle (process thread only)
+    std::vector<const float*> inputBuffers_;
+    std::vector<float*> loopBuffers_;
+
+    std::atomic<LoopEngine*> engine_{nullptr};
+    std::atomic<int64_t> xruns_{0};
+    std::atomic<int> bufferSize_{0};
+    std::atomic<uint32_t> bufferSizeChanges_{0};
+    std::atomic<bool> serverLost_{false};
+};
+
+} // namespace retrospect
@@ -43,6 +43,22 @@ bool JackTransport::init() {
     }
 
     active_ = true;
+    ownsClient_ = true;
+    fprintf(stderr, "JackTransport: active as timebase master\n");
+    return true;
+}
+
+bool JackTransport::attach(jack_client_t* client) {
+    if (client_) return client_ == client;
+
+    if (jack_set_timebase_callback(client, /*conditional=*/0, timebaseCallback, this) != 0) {
+        fprintf(stderr, "JackTransport: failed to become timebase master\n");
+        return false;
+    }
+
+    client_ = client;
+    active_ = true;
+    ownsClient_ = false;
     fprintf(stderr, "JackTransport: active as timebase master\n");
     return true;
 }
@@ -52,10 +68,10 @@ void JackTransport::shutdown() {
 
     if (active_) {
         jack_release_timebase(client_);
-        jack_deactivate(client_);
+        if (ownsClient_) jack_deactivate(client_);
         active_ = false;
     }
-    jack_client_close(client_);
+    if (ownsClient_) jack_client_close(client_);
     client_ = nullptr;
 }
 
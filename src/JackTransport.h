@@ -10,10 +10,12 @@ namespace retrospect {
 /// JACK transport master — broadcasts BBT position and tempo so that other
 /// JACK clients can follow this application's timeline.
 ///
-/// Opens its own lightweight JACK client (no audio ports) and registers as
-/// the unconditional timebase master.  BPM and time-signature changes are
-/// propagated through atomic variables so the timebase callback (called from
-/// the JACK process thread) always sees a consistent snapshot.
+/// Either opens its own lightweight JACK client (no audio ports) or takes
+/// the timebase role on a client that already exists (the native JACK
+/// audio backend's), and registers as the unconditional timebase master.
+/// BPM and time-signature changes are propagated through atomic variables
+/// so the timebase callback (called from the JACK process thread) always
+/// sees a consistent snapshot.
 class JackTransport {
 public:
     explicit JackTransport(double sampleRate);
@@ -27,7 +29,12 @@ public:
     /// Returns true on success.
     bool init();
 
-    /// Deactivate and close the JACK client.
+    /// Become timebase master on `client`, which stays owned by the caller
+    /// (and must outlive this). Returns true on success.
+    bool attach(jack_client_t* client);
+
+    /// Release the timebase, and deactivate and close the JACK client if
+    /// init() opened it.
     void shutdown();
 
     /// Whether the JACK client is connected and active.
@@ -70,6 +77,7 @@ private:
 
     jack_client_t* client_ = nullptr;
     bool active_ = false;
+    bool ownsClient_ = false;
     double sampleRate_;
 
     std::atomic<double> bpm_{120.0};
@@ -1,10 +1,14 @@
 #include "config/Config.h"
 #include "core/LoopEngine.h"
 #include "core/Metronome.h"
+#include "core/MidiClockSender.h"
+#include "core/MonotonicClock.h"
 #include "tui/Tui.h"
 #include "client/LocalEngineClient.h"
 #include "client/OscEngineClient.h"
 #include "server/OscServer.h"
+#include "server/TimelineSync.h"
+#include "JackBackend.h"
 #include "JackTransport.h"
 
 #include <juce_audio_devices/juce_audio_devices.h>
@@ -23,7 +27,8 @@ static void signalHandler(int) {
     g_running = false;
 }
 
-/// Bridges JUCE audio I/O to the LoopEngine
+/// Bridges JUCE audio I/O to the LoopEngine (ALSA and auto-selected
+/// devices; --jack uses JackBackend instead)
 class AudioCallback : public juce::AudioIODeviceCallback {
 public:
     explicit AudioCallback(retrospect::LoopEngine& engine) : engine_(engine) {}
@@ -35,6 +40,7 @@ public:
             int numOutputChannels,
             int numSamples,
             const juce::AudioIODeviceCallbackContext&) override {
+        int64_t startNanos = retrospect::monotonicNanos();
 
         // Pass all input channels to the engine for per-channel ring
         // buffering and live-activity detection.
@@ -50,9 +56,14 @@ public:
                             sizeof(float) * static_cast<size_t>(numSamples));
             }
         }
+
+        // Whole-callback time and the device's xrun count, for the DSP stats
+        engine_.noteHostCallback(retrospect::monotonicNanos() - startNanos,
+                                 device_ ? device_->getXRunCount() : -1);
     }
 
     void audioDeviceAboutToStart(juce::AudioIODevice* device) override {
+        device_ = device;
         fprintf(stderr, "Audio device starting: %s\n",
                 device->getName().toRawUTF8());
         fprintf(stderr, "  Sample rate: %.0f Hz\n", device->getCurrentSampleRate());
@@ -61,11 +72,13 @@ public:
     }
 
     void audioDeviceStopped() override {
+        device_ = nullptr;
         fprintf(stderr, "Audio device stopped\n");
     }
 
 private:
     retrospect::LoopEngine& engine_;
+    juce::AudioIODevice* device_ = nullptr;  // Set before callbacks start
 };
 
 enum class RunMode {
@@ -100,11 +113,13 @@ static retrospect::Quantize quantizeFromString(const std::string& s) {
 static void printUsage(const retrospect::Config& cfg) {
     fprintf(stdout, "Usage: retrospect [OPTIONS] [PORT]\n");
     fprintf(stdout, "Options:\n");
-    fprintf(stdout, "  --jack                Use JACK audio backend\n");
+    fprintf(stdout, "  --jack                Use the native JACK audio backend\n");
     fprintf(stdout, "  --alsa                Use ALSA audio backend\n");
     fprintf(stdout, "  --headless            Run without TUI (server only)\n");
     fprintf(stdout, "  --connect HOST:PORT   Connect TUI to a remote server\n");
     fprintf(stdout, "  --midi-out NAME       Use specific MIDI output device (substring match)\n");
+    fprintf(stdout, "  --sync-lead           Lead the tempo and beat of other instances\n");
+    fprintf(stdout, "  --sync-follow HOST[:PORT]  Follow a leading instance's tempo and beat\n");
     fprintf(stdout, "  --list-midi           List available MIDI output devices\n");
     fprintf(stdout, "\nA virtual MIDI output device named 'Retrospect' is created automatically.\n");
     fprintf(stdout, "  --help                Show this help message\n");
@@ -118,6 +133,32 @@ static void printUsage(const retrospect::Config& cfg) {
     fprintf(stdout, "  retrospect --connect localhost:7770  TUI-only, connect to remote\n");
     fprintf(stdout, "  retrospect --jack                    TUI + server using JACK\n");
     fprintf(stdout, "  retrospect --midi-out \"USB MIDI\"     Enable MIDI sync output\n");
+    fprintf(stdout, "  retrospect --sync-follow studio-a    Play in time with studio-a (--sync-lead)\n");
+}
+
+/// Start the network timeline sync the config asks for, if any. Returns
+/// false if it was asked for and could not start.
+static bool startTimelineSync(const retrospect::Config& cfg, retrospect::LoopEngine& engine,
+                              int64_t outputLatencyNanos,
+                              std::unique_ptr<retrospect::TimelineSync>& sync) {
+    if (cfg.syncRole == "off") return true;
+
+    retrospect::TimelineSync::Settings settings;
+    settings.port = cfg.syncPort;
+    settings.leaderPort = cfg.syncPort;
+    settings.outputLatencyNanos = outputLatencyNanos;
+    if (cfg.syncRole == "follower") {
+        if (cfg.syncLeader.empty()) {
+            fprintf(stderr, "Timeline sync: following needs sync.leader (or --sync-follow HOST)\n");
+            return false;
+        }
+        settings.role = retrospect::TimelineSync::Role::Follower;
+        auto colonPos = cfg.syncLeader.rfind(':');
+        settings.leaderHost = cfg.syncLeader.substr(0, colonPos);
+        if (colonPos != std::string::npos) settings.leaderPort = cfg.syncLeader.substr(colonPos + 1);
+    }
+    sync = std::make_unique<retrospect::TimelineSync>(engine, settings);
+    return sync->start();
 }
 
 int main(int argc, char* argv[]) {
@@ -205,58 +246,124 @@ int main(int argc, char* argv[]) {
     juce::ScopedJuceInitialiser_GUI juceInit;
     juce::AudioDeviceManager deviceManager;
 
-    // Set preferred audio backend if specified
-    if (!cfg.audioBackend.empty()) {
-        juce::String preferredBackend(cfg.audioBackend);
-        auto& deviceTypes = deviceManager.getAvailableDeviceTypes();
-        bool found = false;
-        for (auto* deviceType : deviceTypes) {
-            if (deviceType->getTypeName().containsIgnoreCase(preferredBackend)) {
-                deviceManager.setCurrentAudioDeviceType(deviceType->getTypeName(), true);
-                fprintf(stderr, "Selected audio backend: %s\n", deviceType->getTypeName().toRawUTF8());
-                found = true;
-                break;
-            }
+    // JACK runs as a client of its own: port buffers go straight to the
+    // engine, and the same client is the timebase master. Other backends
+    // go through JUCE's device layer.
+    bool nativeJack = cfg.audioBackend == "jack";
+    retrospect::JackBackend jackBackend;
+
+    double sampleRate = 0.0;
+    int bufferSize = 0;
+    int numInputChannels = 1;
+    int outputLatency = 0;
+    int inputLatency = 0;
+    std::string deviceName;
+
+    if (nativeJack) {
+        retrospect::JackBackend::Settings settings;
+        settings.inputs = cfg.jackInputs;
+        settings.loopOutputs = cfg.jackLoopOutputs ? cfg.maxLoops : 0;
+        settings.autoConnect = cfg.jackAutoConnect;
+        if (!jackBackend.open(settings)) {
+            fprintf(stderr, "Audio device error: cannot start the JACK backend (is the JACK server running?)\n");
+            return 1;
         }
-        if (!found) {
-            fprintf(stderr, "Warning: %s audio backend not found, using default\n",
-                    preferredBackend.toRawUTF8());
+        sampleRate = jackBackend.sampleRate();
+        bufferSize = jackBackend.bufferSize();
+        numInputChannels = jackBackend.numInputs();
+        outputLatency = jackBackend.outputLatency();
+        inputLatency = jackBackend.inputLatency();
+        deviceName = jackBackend.name();
+    } else {
+        // Set preferred audio backend if specified
+        if (!cfg.audioBackend.empty()) {
+            juce::String preferredBackend(cfg.audioBackend);
+            auto& deviceTypes = deviceManager.getAvailableDeviceTypes();
+            bool found = false;
+            for (auto* deviceType : deviceTypes) {
+                if (deviceType->getTypeName().containsIgnoreCase(preferredBackend)) {
+                    deviceManager.setCurrentAudioDeviceType(deviceType->getTypeName(), true);
+                    fprintf(stderr, "Selected audio backend: %s\n", deviceType->getTypeName().toRawUTF8());
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "Warning: %s audio backend not found, using default\n",
+                        preferredBackend.toRawUTF8());
+            }
         }
-    }
 
-    // Request up to 64 input channels; the device will provide what it supports
-    auto error = deviceManager.initialise(64, 1, nullptr, true);
-    if (error.isNotEmpty()) {
-        fprintf(stderr, "Audio device error: %s\n", error.toRawUTF8());
-        return 1;
-    }
+        // Request up to 64 input channels; the device will provide what it supports
+        auto error = deviceManager.initialise(64, 1, nullptr, true);
+        if (error.isNotEmpty()) {
+            fprintf(stderr, "Audio device error: %s\n", error.toRawUTF8());
+            return 1;
+        }
 
-    auto* device = deviceManager.getCurrentAudioDevice();
-    if (!device) {
-        fprintf(stderr, "No audio device available\n");
-        return 1;
-    }
+        auto* device = deviceManager.getCurrentAudioDevice();
+        if (!device) {
+            fprintf(stderr, "No audio device available\n");
+            return 1;
+        }
 
-    double sampleRate = device->getCurrentSampleRate();
-    int bufferSize = device->getCurrentBufferSizeSamples();
-    int numInputChannels = device->getActiveInputChannels().countNumberOfSetBits();
-    if (numInputChannels < 1) numInputChannels = 1;
+        sampleRate = device->getCurrentSampleRate();
+        bufferSize = device->getCurrentBufferSizeSamples();
+        numInputChannels = device->getActiveInputChannels().countNumberOfSetBits();
+        if (numInputChannels < 1) numInputChannels = 1;
 
-    int outputLatency = device->getOutputLatencyInSamples();
-    int inputLatency = device->getInputLatencyInSamples();
+        outputLatency = device->getOutputLatencyInSamples();
+        inputLatency = device->getInputLatencyInSamples();
+        deviceName = device->getName().toStdString();
+    }
     int roundTripLatency = outputLatency + inputLatency;
 
-    fprintf(stderr, "Using audio device: %s\n", device->getName().toRawUTF8());
+    fprintf(stderr, "Using audio device: %s\n", deviceName.c_str());
     fprintf(stderr, "  Sample rate: %.0f Hz\n", sampleRate);
     fprintf(stderr, "  Buffer size: %d samples\n", bufferSize);
     fprintf(stderr, "  Input channels: %d\n", numInputChannels);
+    if (jackBackend.numLoopOutputs() > 0) {
+        fprintf(stderr, "  Loop outputs: %d\n", jackBackend.numLoopOutputs());
+    }
     fprintf(stderr, "  Latency: %d in + %d out = %d samples (%.1f ms)\n",
             inputLatency, outputLatency, roundTripLatency,
             1000.0 * roundTripLatency / sampleRate);
 
     // Create engine with per-channel ring buffers and live detection
+    retrospect::LookbackStorage storage;
+    storage.format = retrospect::sampleFormatFromName(cfg.lookbackFormat)
+                         .value_or(retrospect::SampleFormat::Float32);
+    storage.spillDirectory = cfg.lookbackSpillDir;
+    storage.spillRamSeconds = cfg.lookbackRamSeconds;
+    retrospect::setAudioMemoryLocking(cfg.lockMemory);
     retrospect::LoopEngine engine(cfg.maxLoops, cfg.maxLookbackBars, sampleRate, cfg.minBpm,
-                                  numInputChannels, cfg.liveThreshold, cfg.liveWindowMs);
+                                  numInputChannels, cfg.liveThreshold, cfg.liveWindowMs, storage);
+    if (engine.lookbackSpillFailed()) {
+        fprintf(stderr, "Warning: cannot create lookback spill files in '%s', keeping lookback in RAM\n",
+                cfg.lookbackSpillDir.c_str());
+    }
+    if (cfg.lockMemory) {
+        auto mem = retrospect::audioMemoryStats();
+        if (mem.lockedBytes < mem.bytes) {
+            fprintf(stderr, "Warning: locked %.1f of %.1f MB of audio buffers in RAM "
+                            "(raise the memlock limit to lock them all)\n",
+                    static_cast<double>(mem.lockedBytes) / 1048576.0,
+                    static_cast<double>(mem.bytes) / 1048576.0);
+        }
+    }
+    if (!cfg.archiveDir.empty()) {
+        retrospect::ArchiveSettings archive;
+        archive.directory = cfg.archiveDir;
+        archive.format = retrospect::sampleFormatFromName(cfg.archiveFormat)
+                             .value_or(retrospect::SampleFormat::Int24);
+        archive.rotateSeconds = cfg.archiveRotateMinutes * 60.0;
+        if (engine.startArchive(archive)) {
+            fprintf(stderr, "  Archiving to: %s\n", cfg.archiveDir.c_str());
+        } else {
+            fprintf(stderr, "Warning: cannot create archive files in '%s', archive disabled\n",
+                    cfg.archiveDir.c_str());
+        }
+    }
     if (cfg.latencyCompensation) {
         engine.setLatencyCompensation(static_cast<int64_t>(roundTripLatency));
     }
@@ -268,6 +375,10 @@ int main(int argc, char* argv[]) {
     engine.setMetronomeClickEnabled(cfg.clickEnabled);
     engine.setMetronomeClickVolume(cfg.clickVolume);
     engine.setCrossfadeSamples(cfg.crossfadeSamples);
+    engine.setRenderThreads(cfg.renderThreads);
+    engine.setStretchCache(cfg.stretchCache);
+    engine.setStretcherCount(cfg.stretchers);
+    engine.setUndoDepth(cfg.undoDepth);
     engine.setLookbackBars(cfg.lookbackBars);
     engine.setMidiSyncEnabled(cfg.midiSyncEnabled);
     engine.setDefaultQuantize(quantizeFromString(cfg.defaultQuantize));
@@ -293,22 +404,31 @@ int main(int argc, char* argv[]) {
             fprintf(stderr, "Warning: could not create virtual MIDI output\n");
         }
     }
+    // Clock bytes leave the audio thread timestamped; the sender thread puts
+    // them on the wire at their due time. Declared after midiOutput so it
+    // stops (sending a final Stop) before the device closes.
+    std::unique_ptr<retrospect::MidiClockSender> midiSender;
     if (midiOutput) {
         juce::MidiOutput* rawPtr = midiOutput.get();
-        engine.midiSync().setSendCallback([rawPtr](uint8_t statusByte) {
-            rawPtr->sendMessageNow(juce::MidiMessage(statusByte));
-        });
+        midiSender = std::make_unique<retrospect::MidiClockSender>(
+            engine.midiSync(), [rawPtr](uint8_t statusByte) {
+                rawPtr->sendMessageNow(juce::MidiMessage(statusByte));
+            });
+        midiSender->start();
     }
 
-    // JACK transport: act as timebase master when using the JACK backend
+    // JACK transport: act as timebase master when using a JACK backend
+    // (the native one's own client, or a client of its own next to JUCE's)
     std::unique_ptr<retrospect::JackTransport> jackTransport;
     {
         auto* currentDevice = deviceManager.getCurrentAudioDevice();
-        bool isJackBackend = currentDevice &&
-            currentDevice->getTypeName().containsIgnoreCase("jack");
+        bool isJackBackend = nativeJack || (currentDevice &&
+            currentDevice->getTypeName().containsIgnoreCase("jack"));
         if (isJackBackend) {
             jackTransport = std::make_unique<retrospect::JackTransport>(sampleRate);
-            if (jackTransport->init()) {
+            bool master = nativeJack ? jackTransport->attach(jackBackend.client())
+                                     : jackTransport->init();
+            if (master) {
                 jackTransport->setBpm(cfg.bpm);
                 jackTransport->setBeatsPerBar(cfg.beatsPerBar);
                 jackTransport->rewind();
@@ -316,6 +436,9 @@ int main(int argc, char* argv[]) {
                 engine.setBpmChangedCallback([&jackTransport](double bpm) {
                     if (jackTransport) jackTransport->setBpm(bpm);
                 });
+                engine.setBeatsPerBarChangedCallback([&jackTransport](int beats) {
+                    if (jackTransport) jackTransport->setBeatsPerBar(beats);
+                });
             } else {
                 jackTransport.reset();
             }
@@ -324,15 +447,60 @@ int main(int argc, char* argv[]) {
 
     // Create and register audio callback
     AudioCallback audioCallback(engine);
-    deviceManager.addAudioCallback(&audioCallback);
+    if (nativeJack) {
+        jackBackend.setEngine(&engine);
+    } else {
+        deviceManager.addAudioCallback(&audioCallback);
+    }
+    // Audio stops before the engine goes (the timebase goes with a JACK client)
+    auto stopAudio = [&] {
+        if (!nativeJack) {
+            deviceManager.removeAudioCallback(&audioCallback);
+            return;
+        }
+        if (jackTransport) jackTransport->shutdown();
+        jackBackend.close();
+    };
+
+    // The timeline sync goes before the OSC server, which reads bundle
+    // timetags through it, and so outlives it
+    auto outputLatencyNanos = static_cast<int64_t>(outputLatency * 1e9 / sampleRate);
+    std::unique_ptr<retrospect::TimelineSync> timelineSync;
+    if (!startTimelineSync(cfg, engine, outputLatencyNanos, timelineSync)) {
+        stopAudio();
+        return 1;
+    }
+
+    // A JACK period change (jack_bufsize) moves the port latencies with it:
+    // returns a log line after one, with latency compensation following
+    uint32_t jackPeriodChanges = jackBackend.bufferSizeChanges();
+    auto followJackPeriod = [&]() -> std::string {
+        if (!nativeJack || jackBackend.bufferSizeChanges() == jackPeriodChanges) return {};
+        jackPeriodChanges = jackBackend.bufferSizeChanges();
+        bufferSize = jackBackend.bufferSize();
+        outputLatency = jackBackend.outputLatency();
+        inputLatency = jackBackend.inputLatency();
+        roundTripLatency = outputLatency + inputLatency;
+        if (cfg.latencyCompensation) {
+            engine.setLatencyCompensation(static_cast<int64_t>(roundTripLatency));
+        }
+        if (timelineSync) {
+            timelineSync->setOutputLatencyNanos(static_cast<int64_t>(outputLatency * 1e9 / sampleRate));
+        }
+        char buf[128];
+        snprintf(buf, sizeof(buf), "JACK period now %d frames, latency %d samples (%.1fms)",
+                 bufferSize, roundTripLatency, 1000.0 * roundTripLatency / sampleRate);
+        return buf;
+    };
 
     // --- Headless mode (no TUI) ---
     if (mode == RunMode::Headless) {
         retrospect::OscServer oscServer(engine, cfg.oscPort);
         if (!oscServer.start()) {
-            deviceManager.removeAudioCallback(&audioCallback);
+            stopAudio();
             return 1;
         }
+        oscServer.setTimelineSync(timelineSync.get());
 
         fprintf(stderr, "Running headless on port %s\n", cfg.oscPort.c_str());
         if (midiOutput) {
@@ -343,34 +511,35 @@ int main(int argc, char* argv[]) {
         }
         fprintf(stderr, "Press Ctrl+C to stop\n");
 
-        while (g_running) {
-            auto frameStart = std::chrono::steady_clock::now();
-
-            oscServer.pushState();
-
-            auto frameEnd = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                frameEnd - frameStart);
-            auto sleepTime = std::chrono::milliseconds(cfg.tuiRefreshMs) - elapsed;
-            if (sleepTime.count() > 0) {
-                std::this_thread::sleep_for(sleepTime);
+        // State goes out from the OSC server's publisher thread
+        while (g_running && !jackBackend.serverLost()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(cfg.tuiRefreshMs));
+            if (timelineSync) {
+                for (const auto& msg : timelineSync->takeMessages()) fprintf(stderr, "%s\n", msg.c_str());
             }
+            std::string period = followJackPeriod();
+            if (!period.empty()) fprintf(stderr, "%s\n", period.c_str());
+        }
+        if (jackBackend.serverLost()) {
+            fprintf(stderr, "JACK server shut down\n");
         }
 
         // Stop MIDI sync and JACK transport before shutting down
         engine.setMidiSyncEnabled(false);
         if (jackTransport) jackTransport->shutdown();
         oscServer.stop();
-        deviceManager.removeAudioCallback(&audioCallback);
+        if (timelineSync) timelineSync->stop();
+        stopAudio();
         return 0;
     }
 
     // --- TUI mode (default): audio + OSC server + TUI ---
     retrospect::OscServer oscServer(engine, cfg.oscPort);
     if (!oscServer.start()) {
-        deviceManager.removeAudioCallback(&audioCallback);
+        stopAudio();
         return 1;
     }
+    oscServer.setTimelineSync(timelineSync.get());
 
     retrospect::LocalEngineClient client(engine);
     retrospect::Tui tui(client);
@@ -378,12 +547,13 @@ int main(int argc, char* argv[]) {
     if (!tui.init()) {
         fprintf(stderr, "Failed to initialize TUI\n");
         oscServer.stop();
-        deviceManager.removeAudioCallback(&audioCallback);
+        stopAudio();
         return 1;
     }
 
-    tui.addMessage("Retrospect started - JUCE audio active");
-    tui.addMessage("Device: " + device->getName().toStdString());
+    tui.addMessage(nativeJack ? "Retrospect started - JACK audio active"
+                              : "Retrospect started - JUCE audio active");
+    tui.addMessage("Device: " + deviceName);
     {
         char buf[128];
         snprintf(buf, sizeof(buf), "SR: %.0fHz  Buffer: %d  Latency: %d samples (%.1fms)",
@@ -398,18 +568,26 @@ int main(int argc, char* argv[]) {
     if (jackTransport) {
         tui.addMessage("JACK transport: master");
     }
+    if (timelineSync) {
+        tui.addMessage(timelineSync->role() == retrospect::TimelineSync::Role::Leader
+                           ? "Timeline sync: leading on port " + cfg.syncPort
+                           : "Timeline sync: following " + cfg.syncLeader);
+    }
     tui.addMessage("Press 'q' to quit");
 
     // Main loop: TUI at ~30fps
-    while (g_running) {
+    while (g_running && !jackBackend.serverLost()) {
         auto frameStart = std::chrono::steady_clock::now();
 
+        if (timelineSync) {
+            for (const auto& msg : timelineSync->takeMessages()) tui.addMessage(msg);
+        }
+        std::string period = followJackPeriod();
+        if (!period.empty()) tui.addMessage(period);
         if (!tui.update()) {
             break;
         }
 
-        oscServer.pushState();
-
         auto frameEnd = std::chrono::steady_clock::now();
         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
             frameEnd - frameStart);
@@ -423,7 +601,8 @@ int main(int argc, char* argv[]) {
     engine.setMidiSyncEnabled(false);
     if (jackTransport) jackTransport->shutdown();
     oscServer.stop();
-    deviceManager.removeAudioCallback(&audioCallback);
+    if (timelineSync) timelineSync->stop();
+    stopAudio();
     tui.shutdown();
 
     return 0;
@@ -0,0 +1,451 @@
+// Offline render benchmark for retrospect_core.
+//
+// Builds a LoopEngine per configuration, fills its loops with captures and
+// overdub layers from synthetic input, then times processBlock while a
+// script of captures, overdubs, speed changes and (in the stretched
+// scenario) BPM changes runs against it. The steady and varispeed
+// scenarios run no script: every loop just plays at unit speed, or at a
+// fixed varispeed with every other loop reversed, which isolates the
+// playback kernels. Prints one JSON object per configuration so results
+// can be diffed across commits and machines.
+
+#include "core/LoopEngine.h"
+#include "core/SimdKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using retrospect::LoopEngine;
+using retrospect::OpType;
+using retrospect::Quantize;
+using retrospect::SampleFormat;
+
+namespace {
+
+constexpr double kSampleRate = 48000.0;
+constexpr double kBaseBpm = 120.0;
+constexpr double kTwoPi = 6.283185307179586;
+
+struct BenchConfig {
+    std::vector<int> loops{1, 8, 32};
+    std::vector<int> layers{1, 4};
+    std::vector<int> channels{2, 8};
+    std::vector<int> buffers{64, 256, 1024};
+    std::vector<std::string> scenarios{"direct", "stretched", "steady", "varispeed"};
+    double seconds = 10.0;      // Measured audio per configuration
+    bool syncWorker = false;    // Run worker jobs inline (deterministic, but timed)
+    int renderThreads = 0;      // LoopEngine::setRenderThreads
+    bool stretchCache = true;   // LoopEngine::setStretchCache
+    int stretchers = -1;        // LoopEngine::setStretcherCount (-1 = one per loop)
+    SampleFormat lookbackFormat = SampleFormat::Float32;  // LookbackStorage::format
+    std::string label;
+};
+
+struct Result {
+    int64_t blocks = 0;
+    int64_t samples = 0;
+    double nsPerSample = 0.0;
+    double meanNs = 0.0;
+    double p99Ns = 0.0;
+    double maxNs = 0.0;
+    double maxLoad = 0.0;       // Worst callback as a fraction of the buffer period
+    int stretchedLoops = 0;     // Loops time-stretching at the end of the run
+    int cachedLoops = 0;        // ... of which playing a stretch cache
+    int stretchers = 0;         // Size of the engine's stretcher pool
+};
+
+const char* arch() {
+#if defined(__aarch64__)
+    return "aarch64";
+#elif defined(__x86_64__)
+    return "x86_64";
+#else
+    return "unknown";
+#endif
+}
+
+bool parseList(const char* text, std::vector<int>& out) {
+    out.clear();
+    std::string s(text);
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t comma = s.find(',', start);
+        std::string item = s.substr(start, comma == std::string::npos ? std::string::npos
+                                                                       : comma - start);
+        char* end = nullptr;
+        long v = std::strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || v <= 0) return false;
+        out.push_back(static_cast<int>(v));
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return !out.empty();
+}
+
+void printUsage() {
+    fprintf(stderr,
+        "Usage: retrospect_bench [options]\n"
+        "  --loops LIST       Loop counts (default 1,8,32)\n"
+        "  --layers LIST      Layers per loop (default 1,4)\n"
+        "  --channels LIST    Input channel counts (default 2,8)\n"
+        "  --buffers LIST     Buffer sizes in samples (default 64,256,1024)\n"
+        "  --scenario NAME    direct, stretched, steady, varispeed or all (default all)\n"
+        "  --seconds N        Measured audio per configuration (default 10)\n"
+        "  --sync-worker      Run worker jobs inline on the audio thread\n"
+        "  --render-threads N Extra loop render threads (default 0, serial)\n"
+        "  --no-stretch-cache Always stretch live (no background tempo renders)\n"
+        "  --stretchers N     Shared live stretchers (default one per loop)\n"
+        "  --lookback-format F  float32, int24 or float16 ring storage (default float32)\n"
+        "  --label TEXT       Tag every result (e.g. a commit hash)\n"
+        "Lists are comma-separated. Prints one JSON object per configuration.\n");
+}
+
+bool parseArgs(int argc, char* argv[], BenchConfig& cfg, int& exitCode) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            printUsage();
+            exitCode = 0;
+            return false;
+        } else if (arg == "--sync-worker") {
+            cfg.syncWorker = true;
+        } else if (arg == "--no-stretch-cache") {
+            cfg.stretchCache = false;
+        } else if (!hasValue) {
+            fprintf(stderr, "%s requires an argument\n", argv[i]);
+            exitCode = 1;
+            return false;
+        } else if (arg == "--loops" || arg == "--layers" || arg == "--channels" ||
+                   arg == "--buffers") {
+            std::vector<int>& list = arg == "--loops"    ? cfg.loops
+                                   : arg == "--layers"   ? cfg.layers
+                                   : arg == "--channels" ? cfg.channels
+                                                         : cfg.buffers;
+            if (!parseList(argv[++i], list)) {
+                fprintf(stderr, "%s expects a comma-separated list of positive integers\n",
+                        arg.c_str());
+                exitCode = 1;
+                return false;
+            }
+        } else if (arg == "--scenario") {
+            std::string name(argv[++i]);
+            if (name == "all") {
+                cfg.scenarios = {"direct", "stretched", "steady", "varispeed"};
+            } else if (name == "direct" || name == "stretched" || name == "steady" ||
+                       name == "varispeed") {
+                cfg.scenarios = {name};
+            } else {
+                fprintf(stderr, "Unknown scenario: %s\n", name.c_str());
+                exitCode = 1;
+                return false;
+            }
+        } else if (arg == "--seconds") {
+            cfg.seconds = std::atof(argv[++i]);
+            if (cfg.seconds <= 0.0) {
+                fprintf(stderr, "--seconds must be positive\n");
+                exitCode = 1;
+                return false;
+            }
+        } else if (arg == "--render-threads") {
+            char* end = nullptr;
+            long v = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || v < 0 || v > 32) {
+                fprintf(stderr, "--render-threads expects 0-32\n");
+                exitCode = 1;
+                return false;
+            }
+            cfg.renderThreads = static_cast<int>(v);
+        } else if (arg == "--stretchers") {
+            char* end = nullptr;
+            long v = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || v < 0 || v > 64) {
+                fprintf(stderr, "--stretchers expects 0-64\n");
+                exitCode = 1;
+                return false;
+            }
+            cfg.stretchers = static_cast<int>(v);
+        } else if (arg == "--lookback-format") {
+            auto format = retrospect::sampleFormatFromName(argv[++i]);
+            if (!format) {
+                fprintf(stderr, "--lookback-format expects float32, int24 or float16\n");
+                exitCode = 1;
+                return false;
+            }
+            cfg.lookbackFormat = *format;
+        } else if (arg == "--label") {
+            cfg.label = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            exitCode = 1;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Deterministic synthetic input: one second per channel of a channel-
+/// specific tone plus noise, replayed cyclically
+class SyntheticInput {
+public:
+    SyntheticInput(int numChannels, int maxBlock)
+        : source_(static_cast<size_t>(numChannels))
+        , block_(static_cast<size_t>(numChannels), std::vector<float>(static_cast<size_t>(maxBlock)))
+        , ptrs_(static_cast<size_t>(numChannels))
+    {
+        const size_t len = static_cast<size_t>(kSampleRate);
+        uint32_t rng = 0x12345678u;
+        for (size_t ch = 0; ch < source_.size(); ++ch) {
+            auto& buf = source_[ch];
+            buf.resize(len);
+            double freq = 110.0 * static_cast<double>(ch + 1);
+            for (size_t i = 0; i < len; ++i) {
+                rng = rng * 1664525u + 1013904223u;
+                float noise = static_cast<float>(rng >> 8) / 16777216.0f - 0.5f;
+                buf[i] = 0.3f * static_cast<float>(std::sin(kTwoPi * freq * static_cast<double>(i) / kSampleRate)) +
+                         0.05f * noise;
+            }
+            ptrs_[ch] = block_[ch].data();
+        }
+    }
+
+    /// Input for the next `n` samples
+    const float* const* next(int n) {
+        const size_t len = source_.empty() ? 0 : source_[0].size();
+        for (size_t ch = 0; ch < source_.size(); ++ch) {
+            for (int i = 0; i < n; ++i) {
+                block_[ch][static_cast<size_t>(i)] = source_[ch][(pos_ + static_cast<size_t>(i)) % len];
+            }
+        }
+        pos_ = (pos_ + static_cast<size_t>(n)) % len;
+        return ptrs_.data();
+    }
+
+    int numChannels() const { return static_cast<int>(source_.size()); }
+
+private:
+    std::vector<std::vector<float>> source_;
+    std::vector<std::vector<float>> block_;
+    std::vector<const float*> ptrs_;
+    size_t pos_ = 0;
+};
+
+class Bench {
+public:
+    Bench(int loops, int layers, int channels, int buffer, const std::string& scenario, bool syncWorker,
+          int renderThreads, bool stretchCache, int stretchers, SampleFormat lookbackFormat)
+        : loops_(loops)
+        , layers_(layers)
+        , buffer_(buffer)
+        , stretched_(scenario == "stretched")
+        , varispeed_(scenario == "varispeed")
+        , scripted_(scenario == "direct" || stretched_)
+        , engine_(std::max(loops, 8), 4, kSampleRate, 60.0, channels, 0.0f, 50,
+                  retrospect::LookbackStorage{lookbackFormat, {}, 8.0})
+        , input_(channels, buffer)
+        , output_(static_cast<size_t>(buffer))
+    {
+        if (syncWorker) engine_.setSynchronousWorker(true);
+        engine_.setRenderThreads(renderThreads);
+        engine_.setStretchCache(stretchCache);
+        if (stretchers >= 0) engine_.setStretcherCount(stretchers);
+        engine_.setCommandTimestamps(false);
+        engine_.setMetronomeClickEnabled(true);
+        engine_.metronome().setBpm(kBaseBpm);
+        engine_.midiSync().setBpm(kBaseBpm);
+    }
+
+    /// Fill the loops (untimed). Returns false if the engine never loaded them.
+    bool setUp() {
+        const int64_t bar = static_cast<int64_t>(std::llround(engine_.metronome().samplesPerBar()));
+        render(bar);  // History to capture from
+
+        for (int i = 0; i < loops_; ++i) {
+            engine_.scheduleCaptureLoop(i, Quantize::Free, 1);
+            if (!renderUntilLoaded(i)) return false;
+        }
+        for (int i = 0; i < loops_; ++i) {
+            for (int layer = 1; layer < layers_; ++layer) {
+                engine_.scheduleOp(OpType::StartOverdub, i, Quantize::Free);
+                render(engine_.loop(i).lengthSamples());
+                engine_.scheduleOp(OpType::StopOverdub, i, Quantize::Free);
+                render(buffer_);
+            }
+        }
+        if (stretched_) setBpm(kBaseBpm * 0.9);
+        if (varispeed_) {
+            static const double kSpeeds[] = {0.5, 1.5, 0.75, 2.0};
+            for (int i = 0; i < loops_; ++i) {
+                engine_.scheduleSetSpeed(i, kSpeeds[i % 4], Quantize::Free);
+                if (i % 2) engine_.scheduleOp(OpType::Reverse, i, Quantize::Free);
+            }
+        }
+        render(bar);  // Let mix caches and stretchers settle
+        return true;
+    }
+
+    /// Time processBlock over `seconds` of audio while the script runs
+    Result run(double seconds) {
+        const int64_t bar = static_cast<int64_t>(std::llround(engine_.metronome().samplesPerBar()));
+        const int64_t totalBlocks = static_cast<int64_t>(std::ceil(seconds * kSampleRate / buffer_));
+        std::vector<double> times;
+        times.reserve(static_cast<size_t>(totalBlocks));
+
+        int64_t rendered = 0;
+        int64_t nextEvent = bar / 2;  // Off the bar line, away from setup ops
+        int step = 0;
+        for (int64_t b = 0; b < totalBlocks; ++b) {
+            if (scripted_ && rendered >= nextEvent) {
+                scriptStep(step++);
+                nextEvent += bar;
+            }
+            const float* const* in = input_.next(buffer_);
+            auto start = std::chrono::steady_clock::now();
+            engine_.processBlock(in, input_.numChannels(), output_.data(), buffer_);
+            auto end = std::chrono::steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+            rendered += buffer_;
+        }
+
+        Result r;
+        r.blocks = totalBlocks;
+        r.samples = rendered;
+        r.stretchers = engine_.stretcherCount();
+        double total = 0.0;
+        for (double t : times) total += t;
+        r.nsPerSample = total / static_cast<double>(rendered);
+        r.meanNs = total / static_cast<double>(times.size());
+        std::vector<double> sorted = times;
+        std::sort(sorted.begin(), sorted.end());
+        r.p99Ns = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+        r.maxNs = sorted.back();
+        r.maxLoad = r.maxNs / (1e9 * buffer_ / kSampleRate);
+        for (int i = 0; i < loops_; ++i) {
+            if (engine_.loop(i).isTimeStretchActive()) ++r.stretchedLoops;
+            if (engine_.loop(i).isStretchCached()) ++r.cachedLoops;
+        }
+        return r;
+    }
+
+private:
+    /// One scripted change per bar, rotating through the loops
+    void scriptStep(int step) {
+        int target = step % loops_;
+        switch (step % 4) {
+            case 0: {
+                static const double kSpeeds[] = {0.5, 1.5, 1.0};
+                engine_.scheduleSetSpeed(target, kSpeeds[(step / 4) % 3], Quantize::Free);
+                break;
+            }
+            case 1:
+                engine_.scheduleOp(OpType::StartOverdub, target, Quantize::Beat);
+                break;
+            case 2:
+                engine_.scheduleOp(OpType::StopOverdub, (step - 1) % loops_, Quantize::Beat);
+                break;
+            case 3:
+                engine_.scheduleCaptureLoop(target, Quantize::Bar, 1);
+                if (stretched_) {
+                    // Alternate tempos so stretchers keep re-targeting
+                    setBpm((step / 4) % 2 ? kBaseBpm * 0.9 : kBaseBpm * 1.1);
+                }
+                break;
+        }
+    }
+
+    void setBpm(double bpm) {
+        retrospect::EngineCommand cmd;
+        cmd.commandType = retrospect::CommandType::SetBpm;
+        cmd.value = bpm;
+        engine_.enqueueCommand(cmd);
+    }
+
+    void render(int64_t samples) {
+        for (int64_t done = 0; done < samples; done += buffer_) {
+            engine_.processBlock(input_.next(buffer_), input_.numChannels(), output_.data(), buffer_);
+        }
+    }
+
+    bool renderUntilLoaded(int loop) {
+        // The threaded worker may need a few blocks (and real time) to land it
+        for (int tries = 0; tries < 100000; ++tries) {
+            render(buffer_);
+            if (!engine_.isLoopLoading(loop) && !engine_.loop(loop).isEmpty()) return true;
+            if (tries > 1000) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return false;
+    }
+
+    int loops_;
+    int layers_;
+    int buffer_;
+    bool stretched_;
+    bool varispeed_;
+    bool scripted_;
+    LoopEngine engine_;
+    SyntheticInput input_;
+    std::vector<float> output_;
+};
+
+std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+}
+
+void printResult(const BenchConfig& cfg, const std::string& scenario, int loops, int layers,
+                 int channels, int buffer, const Result& r) {
+    printf("{\"label\":\"%s\",\"arch\":\"%s\",\"isa\":\"%s\",\"scenario\":\"%s\","
+           "\"loops\":%d,\"layers\":%d,\"channels\":%d,\"buffer\":%d,\"sample_rate\":%.0f,"
+           "\"sync_worker\":%s,\"render_threads\":%d,\"stretch_cache\":%s,\"stretchers\":%d,"
+           "\"lookback_format\":\"%s\",\"blocks\":%lld,\"ns_per_sample\":%.3f,\"mean_callback_ns\":%.0f,"
+           "\"p99_callback_ns\":%.0f,\"max_callback_ns\":%.0f,\"max_load\":%.4f,"
+           "\"stretched_loops\":%d,\"stretch_cached_loops\":%d}\n",
+           jsonEscape(cfg.label).c_str(), arch(), retrospect::simd::activeIsa(), scenario.c_str(),
+           loops, layers, channels, buffer, kSampleRate, cfg.syncWorker ? "true" : "false",
+           cfg.renderThreads, cfg.stretchCache ? "true" : "false", r.stretchers,
+           retrospect::sampleFormatName(cfg.lookbackFormat),
+           static_cast<long long>(r.blocks), r.nsPerSample, r.meanNs, r.p99Ns, r.maxNs,
+           r.maxLoad, r.stretchedLoops, r.cachedLoops);
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    int exitCode = 0;
+    if (!parseArgs(argc, argv, cfg, exitCode)) return exitCode;
+
+    for (const auto& scenario : cfg.scenarios) {
+        for (int loops : cfg.loops) {
+            for (int layers : cfg.layers) {
+                for (int channels : cfg.channels) {
+                    for (int buffer : cfg.buffers) {
+                        Bench bench(loops, layers, channels, buffer, scenario,
+                                    cfg.syncWorker, cfg.renderThreads, cfg.stretchCache,
+                                    cfg.stretchers, cfg.lookbackFormat);
+                        if (!bench.setUp()) {
+                            fprintf(stderr, "Setup failed: %d loops, %d layers, %d ch, buffer %d\n",
+                                    loops, layers, channels, buffer);
+                            return 1;
+                        }
+                        printResult(cfg, scenario, loops, layers, channels, buffer,
+                                    bench.run(cfg.seconds));
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
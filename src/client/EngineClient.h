@@ -55,6 +55,31 @@ struct InputChannelSnapshot {
     bool live = false;
 };
 
+/// Snapshot of audio callback timing for display. Window figures cover
+/// about the last second of audio; counters run from engine start.
+struct PerfSnapshot {
+    bool valid = false;             // At least one window has completed
+    double periodUs = 0.0;          // Buffer period
+    double meanUs = 0.0;            // Engine time per callback
+    double p99Us = 0.0;
+    double maxUs = 0.0;
+    double meanLoad = 0.0;          // Fractions of the buffer period
+    double p99Load = 0.0;
+    double maxLoad = 0.0;
+    double ingestUs = 0.0;          // Mean per callback, by stage
+    double opsUs = 0.0;
+    double mixUs = 0.0;
+    double stretchUs = 0.0;
+    double hostMeanUs = 0.0;        // Whole device callback (0 if not reported)
+    double hostMaxUs = 0.0;
+    int64_t callbacks = 0;
+    int64_t missedDeadlines = 0;
+    int64_t lateCallbacks = 0;
+    int64_t deviceXruns = -1;       // -1 if the device does not report them
+    int64_t audioMemoryBytes = 0;   // Held in audio buffers (rings, pools)
+    int64_t lockedBytes = 0;        // Locked in RAM, process-wide
+};
+
 /// Complete engine state snapshot, updated once per TUI frame
 struct EngineSnapshot {
     MetronomeSnapshot metronome;
@@ -75,6 +100,8 @@ struct EngineSnapshot {
     int maxLoops = 8;
     int activeLoopCount = 0;
 
+    PerfSnapshot perf;
+
     /// Messages received since last poll
     std::vector<std::string> messages;
 };
@@ -143,6 +170,19 @@ public:
     virtual void setMidiSyncEnabled(bool on) = 0;
     virtual void setBpm(double bpm) = 0;
 
+    // --- Sessions ---
+    /// Save every loop to a session file, or replace them all with one.
+    /// Both run in the background; the outcome arrives as a message.
+    virtual void saveSession(const std::string& path) = 0;
+    virtual void loadSession(const std::string& path) = 0;
+
+    // --- Batches ---
+    /// Issue the commands from here to endBatch() as one: the engine takes
+    /// them in together, so their quantized ops land on the same boundary
+    /// (e.g. launching a scene). Batches begun inside one join it.
+    virtual void beginBatch() = 0;
+    virtual void endBatch() = 0;
+
     // --- State ---
     virtual const EngineSnapshot& snapshot() const = 0;
 
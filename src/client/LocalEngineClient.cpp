@@ -1,4 +1,5 @@
 #include "client/LocalEngineClient.h"
+#include "core/AudioMemory.h"
 #include <algorithm>
 
 namespace retrospect {
@@ -10,17 +11,6 @@ LocalEngineClient::LocalEngineClient(LoopEngine& engine)
     snap_.maxLoops = engine_.maxLoops();
     snap_.loops.resize(static_cast<size_t>(snap_.maxLoops));
     snap_.sampleRate = engine_.sampleRate();
-
-    // Wire engine message callback to buffer messages for poll()
-    EngineCallbacks callbacks;
-    callbacks.onMessage = [this](const std::string& msg) {
-        std::lock_guard<std::mutex> lock(msgMutex_);
-        pendingMessages_.push_back(msg);
-    };
-    callbacks.onStateChanged = []() {};
-    callbacks.onBeat = [](const MetronomePosition&) {};
-    callbacks.onBar = [](const MetronomePosition&) {};
-    engine_.setCallbacks(std::move(callbacks));
 }
 
 void LocalEngineClient::scheduleCaptureLoop(int loopIndex, Quantize quantize,
@@ -78,79 +68,78 @@ void LocalEngineClient::setBpm(double bpm) {
     engine_.enqueueCommand(cmd);
 }
 
+void LocalEngineClient::saveSession(const std::string& path) {
+    SessionError error = engine_.saveSession(path);
+    if (error != SessionError::None) {
+        notices_.push_back(std::string("Session save failed: ") + sessionErrorText(error));
+    }
+}
+
+void LocalEngineClient::loadSession(const std::string& path) {
+    SessionError error = engine_.loadSession(path);
+    if (error != SessionError::None) {
+        notices_.push_back(std::string("Session load failed: ") + sessionErrorText(error));
+    }
+}
+
+void LocalEngineClient::beginBatch() {
+    engine_.beginBatch();
+}
+
+void LocalEngineClient::endBatch() {
+    // A dropped batch is reported with the other dropped commands in poll()
+    engine_.endBatch();
+}
+
 void LocalEngineClient::poll() {
+    // Everything comes from the state the audio thread last published, never
+    // from engine objects it may be mutating
+    const EngineState& st = engine_.readState();
+
     // Metronome
-    const auto& met = engine_.metronome();
-    auto pos = met.position();
-    snap_.metronome.bar = pos.bar;
-    snap_.metronome.beat = pos.beat;
-    snap_.metronome.beatFraction = pos.beatFraction;
-    snap_.metronome.bpm = met.bpm();
-    snap_.metronome.beatsPerBar = met.beatsPerBar();
-    snap_.metronome.running = met.isRunning();
+    snap_.metronome.bar = st.metronome.bar;
+    snap_.metronome.beat = st.metronome.beat;
+    snap_.metronome.beatFraction = st.metronome.beatFraction;
+    snap_.metronome.bpm = st.metronome.bpm;
+    snap_.metronome.beatsPerBar = st.metronome.beatsPerBar;
+    snap_.metronome.running = st.metronome.running;
 
     // Loops
-    int active = 0;
-    for (int i = 0; i < engine_.maxLoops(); ++i) {
-        const auto& lp = engine_.loop(i);
+    snap_.loops.resize(static_cast<size_t>(st.numLoops));
+    for (int i = 0; i < st.numLoops; ++i) {
+        const auto& lp = st.loops[static_cast<size_t>(i)];
         auto& ls = snap_.loops[static_cast<size_t>(i)];
-        ls.state = lp.state();
-        ls.lengthInBars = lp.lengthInBars();
-        ls.layers = lp.layerCount();
-        ls.activeLayers = lp.activeLayerCount();
-        ls.speed = lp.speed();
-        ls.reversed = lp.isReversed();
-        ls.playPosition = lp.playPosition();
-        ls.lengthSamples = lp.lengthSamples();
-        ls.recordedBpm = lp.recordedBpm();
-        ls.timeStretchActive = lp.isTimeStretchActive();
-        if (!lp.isEmpty()) ++active;
+        ls.state = lp.state;
+        ls.lengthInBars = lp.lengthInBars;
+        ls.layers = lp.layers;
+        ls.activeLayers = lp.activeLayers;
+        ls.speed = lp.speed;
+        ls.reversed = lp.reversed;
+        ls.playPosition = lp.playPosition;
+        ls.lengthSamples = lp.lengthSamples;
+        ls.recordedBpm = lp.recordedBpm;
+        ls.timeStretchActive = lp.timeStretchActive;
     }
-    snap_.activeLoopCount = active;
+    snap_.activeLoopCount = st.activeLoopCount;
 
     // Recording state
-    snap_.isRecording = engine_.isRecordingAtomic();
-    snap_.recordingLoopIndex = engine_.recordingLoopIdxAtomic();
+    snap_.isRecording = st.isRecording;
+    snap_.recordingLoopIndex = st.recordingLoopIndex;
 
-    // Pending ops — gathered from each loop's pending state
+    // Pending ops
     snap_.pendingOps.clear();
-    for (int i = 0; i < engine_.maxLoops(); ++i) {
-        const auto& lp = engine_.loop(i);
-        const auto& ps = lp.pendingState();
-        auto addOp = [&](const std::string& desc, Quantize q, int64_t execSample) {
+    for (int i = 0; i < st.numLoops; ++i) {
+        const auto& lp = st.loops[static_cast<size_t>(i)];
+        for (int p = 0; p < lp.numPending; ++p) {
+            const auto& op = lp.pending[static_cast<size_t>(p)];
             PendingOpSnapshot pos;
             pos.loopIndex = i;
-            pos.quantize = q;
-            pos.description = desc;
-            pos.executeSample = execSample;
+            pos.quantize = op.quantize;
+            pos.description = pendingOpName(op.kind);
+            if (op.count > 1) pos.description += " x" + std::to_string(op.count);
+            pos.executeSample = op.executeSample;
             snap_.pendingOps.push_back(std::move(pos));
-        };
-        if (ps.capture) addOp("Capture Loop", ps.capture->quantize, ps.capture->executeSample);
-        if (ps.record) {
-            std::string desc = (ps.recordOp == PendingState::RecordOp::Start) ? "Record" : "Stop Record";
-            addOp(desc, ps.record->quantize, ps.record->executeSample);
-        }
-        if (ps.mute) {
-            std::string desc;
-            switch (ps.muteOp) {
-                case PendingState::MuteOp::Mute:   desc = "Mute"; break;
-                case PendingState::MuteOp::Unmute:  desc = "Unmute"; break;
-                case PendingState::MuteOp::Toggle:  desc = "Toggle Mute"; break;
-            }
-            addOp(desc, ps.mute->quantize, ps.mute->executeSample);
-        }
-        if (ps.overdub) {
-            std::string desc = (ps.overdubOp == PendingState::OverdubOp::Start) ? "Start Overdub" : "Stop Overdub";
-            addOp(desc, ps.overdub->quantize, ps.overdub->executeSample);
         }
-        if (ps.reverse) addOp("Reverse", ps.reverse->quantize, ps.reverse->executeSample);
-        if (ps.speed) addOp("Set Speed", ps.speed->quantize, ps.speed->executeSample);
-        if (ps.undo) {
-            std::string desc = (ps.undo->direction == UndoDirection::Undo) ? "Undo Layer" : "Redo Layer";
-            if (ps.undo->count > 1) desc += " x" + std::to_string(ps.undo->count);
-            addOp(desc, ps.undo->quantize, ps.undo->executeSample);
-        }
-        if (ps.clear) addOp("Clear", ps.clear->quantize, ps.clear->executeSample);
     }
     // Sort by execution time for display consistency
     std::sort(snap_.pendingOps.begin(), snap_.pendingOps.end(),
@@ -159,32 +148,75 @@ void LocalEngineClient::poll() {
               });
 
     // Input channel live status
-    {
-        int numCh = engine_.numInputChannels();
-        uint64_t mask = engine_.liveChannelMask();
-        auto peaks = engine_.channelPeaksSnapshot();
-        snap_.inputChannels.resize(static_cast<size_t>(numCh));
-        for (int ch = 0; ch < numCh; ++ch) {
-            auto& cs = snap_.inputChannels[static_cast<size_t>(ch)];
-            cs.live = (mask >> ch) & 1;
-            cs.peakLevel = (ch < static_cast<int>(peaks.size()))
-                ? peaks[static_cast<size_t>(ch)] : 0.0f;
-        }
+    snap_.inputChannels.resize(static_cast<size_t>(st.numChannels));
+    for (int ch = 0; ch < st.numChannels; ++ch) {
+        auto& cs = snap_.inputChannels[static_cast<size_t>(ch)];
+        cs.live = (st.liveChannelMask >> ch) & 1;
+        cs.peakLevel = st.channelPeaks[static_cast<size_t>(ch)];
     }
 
     // Settings
-    snap_.defaultQuantize = engine_.defaultQuantize();
-    snap_.lookbackBars = engine_.lookbackBars();
-    snap_.clickEnabled = engine_.metronomeClickEnabled();
-    snap_.midiSyncEnabled = engine_.midiSyncEnabled();
-    snap_.midiOutputAvailable = engine_.midiSync().hasOutput();
-    snap_.liveThreshold = engine_.liveThreshold();
-
-    // Drain buffered messages
-    {
-        std::lock_guard<std::mutex> lock(msgMutex_);
-        snap_.messages = std::move(pendingMessages_);
-        pendingMessages_.clear();
+    snap_.defaultQuantize = st.defaultQuantize;
+    snap_.lookbackBars = st.lookbackBars;
+    snap_.clickEnabled = st.clickEnabled;
+    snap_.midiSyncEnabled = st.midiSyncEnabled;
+    snap_.midiOutputAvailable = st.midiOutputAvailable;
+    snap_.liveThreshold = st.liveThreshold;
+
+    // Callback timing
+    const PerfStatus& perf = st.perf;
+    auto us = [](int64_t nanos) { return static_cast<double>(nanos) / 1000.0; };
+    snap_.perf.valid = perf.windowCallbacks > 0;
+    snap_.perf.periodUs = us(perf.periodNanos);
+    snap_.perf.meanUs = us(perf.meanNanos);
+    snap_.perf.p99Us = us(perf.p99Nanos);
+    snap_.perf.maxUs = us(perf.maxNanos);
+    snap_.perf.meanLoad = perf.meanLoad;
+    snap_.perf.p99Load = perf.p99Load;
+    snap_.perf.maxLoad = perf.maxLoad;
+    snap_.perf.ingestUs = us(perf.stageMeanNanos[static_cast<size_t>(DspStage::Ingest)]);
+    snap_.perf.opsUs = us(perf.stageMeanNanos[static_cast<size_t>(DspStage::Ops)]);
+    snap_.perf.mixUs = us(perf.stageMeanNanos[static_cast<size_t>(DspStage::Mix)]);
+    snap_.perf.stretchUs = us(perf.stageMeanNanos[static_cast<size_t>(DspStage::Stretch)]);
+    snap_.perf.hostMeanUs = us(perf.hostMeanNanos);
+    snap_.perf.hostMaxUs = us(perf.hostMaxNanos);
+    snap_.perf.callbacks = static_cast<int64_t>(perf.callbacks);
+    snap_.perf.missedDeadlines = static_cast<int64_t>(perf.missedDeadlines);
+    snap_.perf.lateCallbacks = static_cast<int64_t>(perf.lateCallbacks);
+    snap_.perf.deviceXruns = perf.deviceXruns;
+    AudioMemoryStats memory = audioMemoryStats();
+    snap_.perf.audioMemoryBytes = memory.bytes;
+    snap_.perf.lockedBytes = memory.lockedBytes;
+
+    // Messages for the engine events since the last poll
+    events_.clear();
+    engine_.readEvents(eventCursor_, events_);
+    snap_.messages.clear();
+    for (const auto& ev : events_) {
+        snap_.messages.push_back(formatEngineEvent(ev));
+    }
+    snap_.messages.insert(snap_.messages.end(), notices_.begin(), notices_.end());
+    notices_.clear();
+
+    uint64_t dropped = engine_.droppedCommands();
+    if (dropped > droppedCommandsSeen_) {
+        snap_.messages.push_back(std::to_string(dropped - droppedCommandsSeen_) +
+                                 " command(s) dropped: queue full");
+        droppedCommandsSeen_ = dropped;
+    }
+
+    if (const AudioArchive* archive = engine_.archive()) {
+        AudioArchive::Stats stats = archive->stats();
+        if (stats.framesDropped > archiveSeen_.framesDropped) {
+            double ms = 1000.0 * static_cast<double>(stats.framesDropped - archiveSeen_.framesDropped) /
+                        engine_.sampleRate();
+            snap_.messages.push_back("Archive writer behind: " + std::to_string(static_cast<int>(ms)) +
+                                     " ms of audio dropped");
+        }
+        if (stats.writeErrors > archiveSeen_.writeErrors && archiveSeen_.writeErrors == 0) {
+            snap_.messages.push_back("Archive write failed: archive stopped");
+        }
+        archiveSeen_ = stats;
     }
 }
 
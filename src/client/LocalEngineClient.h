@@ -3,7 +3,6 @@
 #include "client/EngineClient.h"
 #include "core/LoopEngine.h"
 
-#include <mutex>
 #include <vector>
 #include <string>
 
@@ -33,6 +32,14 @@ public:
     void setMidiSyncEnabled(bool on) override;
     void setBpm(double bpm) override;
 
+    // Sessions
+    void saveSession(const std::string& path) override;
+    void loadSession(const std::string& path) override;
+
+    // Batches
+    void beginBatch() override;
+    void endBatch() override;
+
     // State
     const EngineSnapshot& snapshot() const override { return snap_; }
     void poll() override;
@@ -41,9 +48,14 @@ private:
     LoopEngine& engine_;
     EngineSnapshot snap_;
 
-    // Message buffer (filled from engine callback, drained in poll)
-    std::mutex msgMutex_;
-    std::vector<std::string> pendingMessages_;
+    // Engine events read so far (formatted into snap_.messages in poll)
+    uint64_t eventCursor_ = 0;
+    std::vector<EngineEvent> events_;
+    uint64_t droppedCommandsSeen_ = 0;
+    AudioArchive::Stats archiveSeen_;
+
+    // Messages from this client's own calls, for the next poll
+    std::vector<std::string> notices_;
 };
 
 } // namespace retrospect
@@ -1,10 +1,48 @@
 #include "client/OscEngineClient.h"
 #include "core/LoopEngine.h"  // For OpType
 
+#include <algorithm>
 #include <cstdio>
+#include <initializer_list>
 
 namespace retrospect {
 
+namespace {
+
+// Fields in /retro/state/metronome and (after the index) /retro/state/loop
+constexpr int kMetronomeFields = 6;
+constexpr int kLoopFields = 8;
+
+// Argument `arg` as a number, whichever numeric type it was sent as
+double argNumber(const char* types, lo_arg** argv, int arg) {
+    switch (types[arg]) {
+        case 'i': return argv[arg]->i;
+        case 'h': return static_cast<double>(argv[arg]->h);
+        case 'f': return argv[arg]->f;
+        case 'd': return argv[arg]->d;
+        default:  return 0.0;
+    }
+}
+
+int64_t argInt(const char* types, lo_arg** argv, int arg) {
+    switch (types[arg]) {
+        case 'i': return argv[arg]->i;
+        case 'h': return argv[arg]->h;
+        case 'f': return static_cast<int64_t>(argv[arg]->f);
+        case 'd': return static_cast<int64_t>(argv[arg]->d);
+        default:  return 0;
+    }
+}
+
+// A message of int32 arguments
+lo_message intMessage(std::initializer_list<int> args) {
+    lo_message msg = lo_message_new();
+    for (int arg : args) lo_message_add_int32(msg, arg);
+    return msg;
+}
+
+} // namespace
+
 OscEngineClient::OscEngineClient(const std::string& host, const std::string& port)
     : host_(host)
     , port_(port)
@@ -30,12 +68,20 @@ OscEngineClient::OscEngineClient(const std::string& host, const std::string& por
     // Register state handlers
     lo_server_add_method(server_, "/retro/state/metronome", "iiddii",
                          handleMetronome, this);
-    lo_server_add_method(server_, "/retro/state/loop", "iidiiddih",
+    lo_server_add_method(server_, "/retro/state/metronome/delta", nullptr,
+                         handleMetronomeDelta, this);
+    lo_server_add_method(server_, "/retro/state/keyframe", "i",
+                         handleKeyframe, this);
+    lo_server_add_method(server_, "/retro/state/loop", "iidiididh",
                          handleLoop, this);
+    lo_server_add_method(server_, "/retro/state/loop/delta", nullptr,
+                         handleLoopDelta, this);
     lo_server_add_method(server_, "/retro/state/recording", "ii",
                          handleRecording, this);
     lo_server_add_method(server_, "/retro/state/settings", "iiiiii",
                          handleSettings, this);
+    lo_server_add_method(server_, "/retro/state/perf", "dddddddddddddhhhhhh",
+                         handlePerf, this);
     lo_server_add_method(server_, "/retro/state/pending_clear", "",
                          handlePendingClear, this);
     lo_server_add_method(server_, "/retro/state/pending_op", "iis",
@@ -55,6 +101,8 @@ OscEngineClient::OscEngineClient(const std::string& host, const std::string& por
 }
 
 OscEngineClient::~OscEngineClient() {
+    if (batch_) lo_bundle_free_recursive(batch_);
+
     // Unsubscribe
     if (serverAddr_ && server_) {
         lo_send(serverAddr_, "/retro/client/unsubscribe", "si",
@@ -93,23 +141,42 @@ void OscEngineClient::poll() {
 
 // --- Commands ---
 
+void OscEngineClient::send(const char* path, lo_message msg) {
+    if (batch_) {
+        // The bundle frees it
+        lo_bundle_add_message(batch_, path, msg);
+        return;
+    }
+    lo_send_message(serverAddr_, path, msg);
+    lo_message_free(msg);
+}
+
+void OscEngineClient::beginBatch() {
+    if (!serverAddr_) return;
+    if (batchDepth_++ == 0) batch_ = lo_bundle_new(LO_TT_IMMEDIATE);
+}
+
+void OscEngineClient::endBatch() {
+    if (batchDepth_ == 0 || --batchDepth_ > 0) return;
+    lo_send_bundle(serverAddr_, batch_);
+    lo_bundle_free_recursive(batch_);
+    batch_ = nullptr;
+}
+
 void OscEngineClient::scheduleCaptureLoop(int loopIndex, Quantize quantize,
                                            int lookbackBars) {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/loop/capture", "iii",
-            loopIndex, quantizeToInt(quantize), lookbackBars);
+    send("/retro/loop/capture", intMessage({loopIndex, quantizeToInt(quantize), lookbackBars}));
 }
 
 void OscEngineClient::scheduleRecord(int loopIndex, Quantize quantize) {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/loop/record", "ii",
-            loopIndex, quantizeToInt(quantize));
+    send("/retro/loop/record", intMessage({loopIndex, quantizeToInt(quantize)}));
 }
 
 void OscEngineClient::scheduleStopRecord(int loopIndex, Quantize quantize) {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/loop/stop_record", "ii",
-            loopIndex, quantizeToInt(quantize));
+    send("/retro/loop/stop_record", intMessage({loopIndex, quantizeToInt(quantize)}));
 }
 
 void OscEngineClient::scheduleOp(OpType type, int loopIndex, Quantize quantize) {
@@ -124,13 +191,13 @@ void OscEngineClient::scheduleOp(OpType type, int loopIndex, Quantize quantize)
         case OpType::StartOverdub: path = "/retro/loop/overdub/start"; break;
         case OpType::StopOverdub:  path = "/retro/loop/overdub/stop"; break;
         case OpType::UndoLayer:
-            lo_send(serverAddr_, "/retro/loop/undo", "i", loopIndex);
+            send("/retro/loop/undo", intMessage({loopIndex}));
             return;
         case OpType::RedoLayer:
-            lo_send(serverAddr_, "/retro/loop/redo", "i", loopIndex);
+            send("/retro/loop/redo", intMessage({loopIndex}));
             return;
         case OpType::ClearLoop:
-            lo_send(serverAddr_, "/retro/loop/clear", "i", loopIndex);
+            send("/retro/loop/clear", intMessage({loopIndex}));
             return;
         case OpType::CaptureLoop:
             scheduleCaptureLoop(loopIndex, quantize);
@@ -146,16 +213,17 @@ void OscEngineClient::scheduleOp(OpType type, int loopIndex, Quantize quantize)
     }
 
     if (path) {
-        lo_send(serverAddr_, path, "ii",
-                loopIndex, quantizeToInt(quantize));
+        send(path, intMessage({loopIndex, quantizeToInt(quantize)}));
     }
 }
 
 void OscEngineClient::scheduleSetSpeed(int loopIndex, double speed,
                                         Quantize quantize) {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/loop/speed", "idi",
-            loopIndex, speed, quantizeToInt(quantize));
+    lo_message msg = intMessage({loopIndex});
+    lo_message_add_double(msg, speed);
+    lo_message_add_int32(msg, quantizeToInt(quantize));
+    send("/retro/loop/speed", msg);
 }
 
 void OscEngineClient::executeOpNow(OpType type, int loopIndex) {
@@ -164,85 +232,165 @@ void OscEngineClient::executeOpNow(OpType type, int loopIndex) {
 
 void OscEngineClient::cancelPending() {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/cancel_pending", "");
+    send("/retro/cancel_pending", lo_message_new());
 }
 
 void OscEngineClient::setDefaultQuantize(Quantize q) {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/settings/quantize", "i", quantizeToInt(q));
+    send("/retro/settings/quantize", intMessage({quantizeToInt(q)}));
     // Also update local snapshot for immediate UI feedback
     snap_.defaultQuantize = q;
 }
 
 int OscEngineClient::setLookbackBars(int bars) {
     if (!serverAddr_) return snap_.lookbackBars;
-    lo_send(serverAddr_, "/retro/settings/lookback_bars", "i", bars);
+    send("/retro/settings/lookback_bars", intMessage({bars}));
     snap_.lookbackBars = bars;
     return bars;
 }
 
 void OscEngineClient::setMetronomeClickEnabled(bool on) {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/metronome/click", "i", on ? 1 : 0);
+    send("/retro/metronome/click", intMessage({on ? 1 : 0}));
     snap_.clickEnabled = on;
 }
 
 void OscEngineClient::setMidiSyncEnabled(bool on) {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/settings/midi_sync", "i", on ? 1 : 0);
+    send("/retro/settings/midi_sync", intMessage({on ? 1 : 0}));
     snap_.midiSyncEnabled = on;
 }
 
 void OscEngineClient::setBpm(double bpm) {
     if (!serverAddr_) return;
-    lo_send(serverAddr_, "/retro/metronome/bpm", "d", bpm);
+    lo_message msg = lo_message_new();
+    lo_message_add_double(msg, bpm);
+    send("/retro/metronome/bpm", msg);
+}
+
+void OscEngineClient::saveSession(const std::string& path) {
+    if (!serverAddr_) return;
+    lo_message msg = lo_message_new();
+    lo_message_add_string(msg, path.c_str());
+    send("/retro/session/save", msg);
+}
+
+void OscEngineClient::loadSession(const std::string& path) {
+    if (!serverAddr_) return;
+    lo_message msg = lo_message_new();
+    lo_message_add_string(msg, path.c_str());
+    send("/retro/session/load", msg);
 }
 
 // --- State handlers ---
 
-int OscEngineClient::handleMetronome(const char*, const char*, lo_arg** argv,
+int OscEngineClient::handleMetronome(const char*, const char* types, lo_arg** argv,
                                       int, lo_message, void* user) {
     auto* self = static_cast<OscEngineClient*>(user);
-    auto& met = self->snap_.metronome;
-    met.bar = argv[0]->i;
-    met.beat = argv[1]->i;
-    met.beatFraction = argv[2]->d;
-    met.bpm = argv[3]->d;
-    met.beatsPerBar = argv[4]->i;
-    met.running = argv[5]->i != 0;
+    for (int f = 0; f < kMetronomeFields; ++f) {
+        self->setMetronomeField(f, types, argv, f);
+    }
     return 0;
 }
 
-int OscEngineClient::handleLoop(const char*, const char*, lo_arg** argv,
+int OscEngineClient::handleMetronomeDelta(const char*, const char* types, lo_arg** argv,
+                                           int argc, lo_message, void* user) {
+    auto* self = static_cast<OscEngineClient*>(user);
+    if (argc < 1 || types[0] != 'i') return 0;
+    int mask = argv[0]->i;
+    int arg = 1;
+    for (int f = 0; f < kMetronomeFields && arg < argc; ++f) {
+        if (mask & (1 << f)) self->setMetronomeField(f, types, argv, arg++);
+    }
+    return 0;
+}
+
+int OscEngineClient::handleKeyframe(const char*, const char*, lo_arg** argv,
+                                     int, lo_message, void* user) {
+    // Everything follows in the same push; slots not sent are empty
+    auto* self = static_cast<OscEngineClient*>(user);
+    int numLoops = std::max(0, argv[0]->i);
+    self->snap_.loops.assign(static_cast<size_t>(numLoops), LoopSnapshot{});
+    self->loopPlayPos_.assign(static_cast<size_t>(numLoops), 0.0);
+    self->snap_.maxLoops = numLoops;
+    self->snap_.activeLoopCount = 0;
+    return 0;
+}
+
+int OscEngineClient::handleLoop(const char*, const char* types, lo_arg** argv,
                                  int, lo_message, void* user) {
     auto* self = static_cast<OscEngineClient*>(user);
     int idx = argv[0]->i;
+    if (idx < 0) return 0;
+    for (int f = 0; f < kLoopFields; ++f) {
+        self->setLoopField(idx, f, types, argv, f + 1);
+    }
+    self->loopUpdated(idx);
+    return 0;
+}
+
+int OscEngineClient::handleLoopDelta(const char*, const char* types, lo_arg** argv,
+                                      int argc, lo_message, void* user) {
+    auto* self = static_cast<OscEngineClient*>(user);
+    if (argc < 2 || types[0] != 'i' || types[1] != 'i') return 0;
+    int idx = argv[0]->i;
+    if (idx < 0) return 0;
+    int mask = argv[1]->i;
+    int arg = 2;
+    for (int f = 0; f < kLoopFields && arg < argc; ++f) {
+        if (mask & (1 << f)) self->setLoopField(idx, f, types, argv, arg++);
+    }
+    self->loopUpdated(idx);
+    return 0;
+}
+
+void OscEngineClient::setMetronomeField(int field, const char* types, lo_arg** argv, int arg) {
+    auto& met = snap_.metronome;
+    switch (field) {
+        case 0: met.bar = static_cast<int>(argInt(types, argv, arg)); break;
+        case 1: met.beat = static_cast<int>(argInt(types, argv, arg)); break;
+        case 2: met.beatFraction = argNumber(types, argv, arg); break;
+        case 3: met.bpm = argNumber(types, argv, arg); break;
+        case 4: met.beatsPerBar = static_cast<int>(argInt(types, argv, arg)); break;
+        case 5: met.running = argInt(types, argv, arg) != 0; break;
+    }
+}
 
-    // Resize if needed
-    if (idx >= static_cast<int>(self->snap_.loops.size())) {
-        self->snap_.loops.resize(static_cast<size_t>(idx + 1));
-        self->snap_.maxLoops = static_cast<int>(self->snap_.loops.size());
+LoopSnapshot& OscEngineClient::loopSlot(int index) {
+    if (index >= static_cast<int>(snap_.loops.size())) {
+        snap_.loops.resize(static_cast<size_t>(index + 1));
+        snap_.maxLoops = static_cast<int>(snap_.loops.size());
     }
+    if (loopPlayPos_.size() < snap_.loops.size()) loopPlayPos_.resize(snap_.loops.size(), 0.0);
+    return snap_.loops[static_cast<size_t>(index)];
+}
+
+void OscEngineClient::setLoopField(int index, int field, const char* types, lo_arg** argv,
+                                   int arg) {
+    auto& lp = loopSlot(index);
+    switch (field) {
+        case 0: lp.state = intToLoopState(static_cast<int>(argInt(types, argv, arg))); break;
+        case 1: lp.lengthInBars = argNumber(types, argv, arg); break;
+        case 2: lp.layers = static_cast<int>(argInt(types, argv, arg)); break;
+        case 3: lp.activeLayers = static_cast<int>(argInt(types, argv, arg)); break;
+        case 4: lp.speed = argNumber(types, argv, arg); break;
+        case 5: lp.reversed = argInt(types, argv, arg) != 0; break;
+        case 6: loopPlayPos_[static_cast<size_t>(index)] = argNumber(types, argv, arg); break;
+        case 7: lp.lengthSamples = argInt(types, argv, arg); break;
+    }
+}
 
-    auto& lp = self->snap_.loops[static_cast<size_t>(idx)];
-    lp.state = intToLoopState(argv[1]->i);
-    lp.lengthInBars = argv[2]->d;
-    lp.layers = argv[3]->i;
-    lp.activeLayers = argv[4]->i;
-    lp.speed = argv[5]->d;
-    lp.reversed = argv[6]->i != 0;
-    double playPosPct = argv[7]->d;
-    lp.lengthSamples = argv[8]->h;
-    lp.playPosition = static_cast<int64_t>(playPosPct * static_cast<double>(lp.lengthSamples));
+void OscEngineClient::loopUpdated(int index) {
+    auto& lp = loopSlot(index);
+    lp.playPosition = static_cast<int64_t>(loopPlayPos_[static_cast<size_t>(index)] *
+                                           static_cast<double>(lp.lengthSamples));
 
     // Update active loop count
     int active = 0;
-    for (const auto& l : self->snap_.loops) {
+    for (const auto& l : snap_.loops) {
         if (!l.isEmpty()) ++active;
     }
-    self->snap_.activeLoopCount = active;
-
-    return 0;
+    snap_.activeLoopCount = active;
 }
 
 int OscEngineClient::handleRecording(const char*, const char*, lo_arg** argv,
@@ -265,6 +413,33 @@ int OscEngineClient::handleSettings(const char*, const char*, lo_arg** argv,
     return 0;
 }
 
+int OscEngineClient::handlePerf(const char*, const char*, lo_arg** argv,
+                                 int, lo_message, void* user) {
+    auto* self = static_cast<OscEngineClient*>(user);
+    auto& perf = self->snap_.perf;
+    perf.periodUs = argv[0]->d;
+    perf.meanUs = argv[1]->d;
+    perf.p99Us = argv[2]->d;
+    perf.maxUs = argv[3]->d;
+    perf.meanLoad = argv[4]->d;
+    perf.p99Load = argv[5]->d;
+    perf.maxLoad = argv[6]->d;
+    perf.ingestUs = argv[7]->d;
+    perf.opsUs = argv[8]->d;
+    perf.mixUs = argv[9]->d;
+    perf.stretchUs = argv[10]->d;
+    perf.hostMeanUs = argv[11]->d;
+    perf.hostMaxUs = argv[12]->d;
+    perf.callbacks = argv[13]->h;
+    perf.missedDeadlines = argv[14]->h;
+    perf.lateCallbacks = argv[15]->h;
+    perf.deviceXruns = argv[16]->h;
+    perf.audioMemoryBytes = argv[17]->h;
+    perf.lockedBytes = argv[18]->h;
+    perf.valid = perf.meanUs > 0.0;
+    return 0;
+}
+
 int OscEngineClient::handlePendingClear(const char*, const char*, lo_arg**,
                                          int, lo_message, void* user) {
     auto* self = static_cast<OscEngineClient*>(user);
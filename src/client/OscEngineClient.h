@@ -4,6 +4,7 @@
 #include <lo/lo.h>
 
 #include <string>
+#include <vector>
 #include <chrono>
 
 namespace retrospect {
@@ -38,6 +39,14 @@ public:
     void setMidiSyncEnabled(bool on) override;
     void setBpm(double bpm) override;
 
+    // Sessions (paths are on the server's machine)
+    void saveSession(const std::string& path) override;
+    void loadSession(const std::string& path) override;
+
+    // Batches go out as one OSC bundle
+    void beginBatch() override;
+    void endBatch() override;
+
     // State
     const EngineSnapshot& snapshot() const override { return snap_; }
     void poll() override;
@@ -45,15 +54,26 @@ public:
 private:
     void subscribe();
 
+    /// Send a command message, or add it to the open batch (takes `msg`)
+    void send(const char* path, lo_message msg);
+
     // OSC state handlers (static trampolines)
     static int handleMetronome(const char* path, const char* types,
                                lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleMetronomeDelta(const char* path, const char* types,
+                                    lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleKeyframe(const char* path, const char* types,
+                              lo_arg** argv, int argc, lo_message msg, void* user);
     static int handleLoop(const char* path, const char* types,
                           lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleLoopDelta(const char* path, const char* types,
+                               lo_arg** argv, int argc, lo_message msg, void* user);
     static int handleRecording(const char* path, const char* types,
                                lo_arg** argv, int argc, lo_message msg, void* user);
     static int handleSettings(const char* path, const char* types,
                               lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handlePerf(const char* path, const char* types,
+                          lo_arg** argv, int argc, lo_message msg, void* user);
     static int handlePendingClear(const char* path, const char* types,
                                   lo_arg** argv, int argc, lo_message msg, void* user);
     static int handlePendingOp(const char* path, const char* types,
@@ -68,7 +88,20 @@ private:
     std::string port_;
     int localPort_ = 0;
 
+    lo_bundle batch_ = nullptr;        // Open batch (see beginBatch)
+    int batchDepth_ = 0;
+
+    /// Set metronome or loop field `field` (numbered as in the full
+    /// message) from argument `arg`
+    void setMetronomeField(int field, const char* types, lo_arg** argv, int arg);
+    void setLoopField(int index, int field, const char* types, lo_arg** argv, int arg);
+    /// Slot `index`, growing the loop list to hold it
+    LoopSnapshot& loopSlot(int index);
+    /// Recompute what follows from the loop fields after an update
+    void loopUpdated(int index);
+
     EngineSnapshot snap_;
+    std::vector<double> loopPlayPos_;  // Per slot, as a fraction of its length
 
     // Heartbeat/subscribe timer
     std::chrono::steady_clock::time_point lastSubscribe_;
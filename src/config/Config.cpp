@@ -46,6 +46,20 @@ Config Config::load() {
             fprintf(stderr, "Warning: invalid audio.backend '%s', using auto\n", v->c_str());
         }
     }
+    if (auto v = tbl["audio"]["jack_inputs"].value<int64_t>()) {
+        if (*v >= 1 && *v <= 64) {
+            cfg.jackInputs = static_cast<int>(*v);
+        } else {
+            fprintf(stderr, "Warning: invalid audio.jack_inputs %lld, using default %d\n",
+                    static_cast<long long>(*v), cfg.jackInputs);
+        }
+    }
+    if (auto v = tbl["audio"]["jack_loop_outputs"].value<bool>()) {
+        cfg.jackLoopOutputs = *v;
+    }
+    if (auto v = tbl["audio"]["jack_autoconnect"].value<bool>()) {
+        cfg.jackAutoConnect = *v;
+    }
 
     // [engine]
     if (auto v = tbl["engine"]["max_loops"].value<int64_t>()) {
@@ -99,6 +113,55 @@ Config Config::load() {
     if (auto v = tbl["engine"]["latency_compensation"].value<bool>()) {
         cfg.latencyCompensation = *v;
     }
+    if (auto v = tbl["engine"]["render_threads"].value<int64_t>()) {
+        if (*v >= 0 && *v <= 32) {
+            cfg.renderThreads = static_cast<int>(*v);
+        } else {
+            fprintf(stderr, "Warning: invalid engine.render_threads %lld, using default %d\n",
+                    static_cast<long long>(*v), cfg.renderThreads);
+        }
+    }
+    if (auto v = tbl["engine"]["stretch_cache"].value<bool>()) {
+        cfg.stretchCache = *v;
+    }
+    if (auto v = tbl["engine"]["stretchers"].value<int64_t>()) {
+        if (*v >= 0 && *v <= 64) {
+            cfg.stretchers = static_cast<int>(*v);
+        } else {
+            fprintf(stderr, "Warning: invalid engine.stretchers %lld, using default %d\n",
+                    static_cast<long long>(*v), cfg.stretchers);
+        }
+    }
+    if (auto v = tbl["engine"]["undo_depth"].value<int64_t>()) {
+        if (*v >= 0 && *v <= 63) {
+            cfg.undoDepth = static_cast<int>(*v);
+        } else {
+            fprintf(stderr, "Warning: invalid engine.undo_depth %lld, using default %d\n",
+                    static_cast<long long>(*v), cfg.undoDepth);
+        }
+    }
+    if (auto v = tbl["engine"]["lookback_format"].value<std::string>()) {
+        if (*v == "float32" || *v == "int24" || *v == "float16") {
+            cfg.lookbackFormat = *v;
+        } else {
+            fprintf(stderr, "Warning: invalid engine.lookback_format '%s', using default '%s'\n",
+                    v->c_str(), cfg.lookbackFormat.c_str());
+        }
+    }
+    if (auto v = tbl["engine"]["lookback_spill_dir"].value<std::string>()) {
+        cfg.lookbackSpillDir = *v;
+    }
+    if (auto v = tbl["engine"]["lookback_ram_seconds"].value<double>()) {
+        if (*v >= 2.0 && *v <= 600.0) {
+            cfg.lookbackRamSeconds = *v;
+        } else {
+            fprintf(stderr, "Warning: invalid engine.lookback_ram_seconds %.1f, using default %.1f\n",
+                    *v, cfg.lookbackRamSeconds);
+        }
+    }
+    if (auto v = tbl["engine"]["lock_memory"].value<bool>()) {
+        cfg.lockMemory = *v;
+    }
 
     // [input]
     if (auto v = tbl["input"]["live_threshold"].value<double>()) {
@@ -183,6 +246,47 @@ Config Config::load() {
         }
     }
 
+    // [sync]
+    if (auto v = tbl["sync"]["role"].value<std::string>()) {
+        if (*v == "off" || *v == "leader" || *v == "follower") {
+            cfg.syncRole = *v;
+        } else {
+            fprintf(stderr, "Warning: invalid sync.role '%s', using default '%s'\n",
+                    v->c_str(), cfg.syncRole.c_str());
+        }
+    }
+    if (auto node = tbl["sync"]["port"]) {
+        if (auto v = node.value<std::string>()) {
+            cfg.syncPort = *v;
+        } else if (auto v = node.value<int64_t>()) {
+            cfg.syncPort = std::to_string(*v);
+        }
+    }
+    if (auto v = tbl["sync"]["leader"].value<std::string>()) {
+        cfg.syncLeader = *v;
+    }
+
+    // [archive]
+    if (auto v = tbl["archive"]["directory"].value<std::string>()) {
+        cfg.archiveDir = *v;
+    }
+    if (auto v = tbl["archive"]["format"].value<std::string>()) {
+        if (*v == "int24" || *v == "float32") {
+            cfg.archiveFormat = *v;
+        } else {
+            fprintf(stderr, "Warning: invalid archive.format '%s', using default '%s'\n",
+                    v->c_str(), cfg.archiveFormat.c_str());
+        }
+    }
+    if (auto v = tbl["archive"]["rotate_minutes"].value<double>()) {
+        if (*v >= 0.0 && *v <= 1440.0) {
+            cfg.archiveRotateMinutes = *v;
+        } else {
+            fprintf(stderr, "Warning: invalid archive.rotate_minutes %.1f, using default %.1f\n",
+                    *v, cfg.archiveRotateMinutes);
+        }
+    }
+
     // [tui]
     if (auto v = tbl["tui"]["refresh_ms"].value<int64_t>()) {
         if (*v >= 10 && *v <= 1000) {
@@ -213,6 +317,17 @@ bool Config::parseArgs(int argc, char* argv[], int& exitCode) {
                 exitCode = 1;
                 return false;
             }
+        } else if (arg == "--sync-lead") {
+            syncRole = "leader";
+        } else if (arg == "--sync-follow") {
+            if (i + 1 < argc) {
+                syncRole = "follower";
+                syncLeader = argv[++i];
+            } else {
+                fprintf(stderr, "--sync-follow requires HOST[:PORT] argument\n");
+                exitCode = 1;
+                return false;
+            }
         } else if (arg == "--midi-out") {
             if (i + 1 < argc) {
                 midiOutputDevice = argv[++i];
@@ -7,6 +7,9 @@ namespace retrospect {
 struct Config {
     // [audio]
     std::string audioBackend;             // "" = auto, "jack", "alsa"
+    int jackInputs = 2;                   // Input ports of the native JACK backend
+    bool jackLoopOutputs = true;          // An output port per loop slot as well as the mix
+    bool jackAutoConnect = true;          // Connect to the physical ports at startup
 
     // [engine]
     int maxLoops = 8;
@@ -16,6 +19,14 @@ struct Config {
     int crossfadeSamples = 256;
     int lookbackBars = 1;
     bool latencyCompensation = true;      // Auto-compensate round-trip latency
+    int renderThreads = 0;                // Extra loop render threads (0 = serial)
+    bool stretchCache = true;             // Pre-render stretched loops at the new tempo
+    int stretchers = 8;                   // Live time stretchers shared by the loops
+    int undoDepth = 16;                   // Overdub layers kept per loop (0 = all)
+    std::string lookbackFormat = "float32"; // "float32", "int24", "float16"
+    std::string lookbackSpillDir;         // "" = keep all lookback in RAM
+    double lookbackRamSeconds = 8.0;      // In-RAM lookback per channel when spilling
+    bool lockMemory = true;               // Fault in and mlock audio buffers at startup
 
     // [input]
     float liveThreshold = 0.0f;          // 0 = disabled (all channels pass)
@@ -34,6 +45,16 @@ struct Config {
     // [osc]
     std::string oscPort = "7770";
 
+    // [sync]
+    std::string syncRole = "off";         // "off", "leader", "follower"
+    std::string syncPort = "7771";        // Port the leader listens on
+    std::string syncLeader;               // Follower: the leader's "host[:port]"
+
+    // [archive]
+    std::string archiveDir;               // "" = no archive
+    std::string archiveFormat = "int24";  // "int24", "float32"
+    double archiveRotateMinutes = 60.0;   // New file after this long (0 = only at 4 GiB)
+
     // [tui]
     int tuiRefreshMs = 33;
 
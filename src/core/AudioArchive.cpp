@@ -0,0 +1,354 @@
+#include "core/AudioArchive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace retrospect {
+
+namespace {
+
+// Sample data starts at kHeaderBytes (a JUNK chunk pads the header out), so
+// every full chunk lands on a block boundary of the file
+constexpr size_t kHeaderBytes = 4096;
+constexpr size_t kChunkBytes = size_t(1) << 20;
+constexpr size_t kFileAlignment = 4096;
+constexpr std::chrono::milliseconds kWriteInterval{20};
+
+// Largest data chunk a WAV file can describe, less a chunk of slack
+constexpr int64_t kMaxDataBytes = int64_t(0xffffffff) - int64_t(kHeaderBytes + kChunkBytes);
+
+void put16(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+void put32(uint8_t* p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+bool writeAll(int fd, const uint8_t* data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t n = ::write(fd, data, bytes);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+AudioArchive::AudioArchive(const ArchiveSettings& settings, int numInputChannels,
+                           double sampleRate)
+    : settings_(settings)
+    , numInputs_(numInputChannels)
+    , numChannels_(numInputChannels + 1)
+    , sampleRate_(static_cast<int>(sampleRate + 0.5))
+    , bytesPerFrame_(numChannels_ * bytesPerSample(settings.format))
+    , blocks_(static_cast<size_t>(kNumBlocks))
+    , chunk_(static_cast<uint8_t*>(std::aligned_alloc(kFileAlignment, kChunkBytes)), std::free)
+{
+    // WAV holds float32 and integer PCM, not half floats
+    if (settings_.format == SampleFormat::Float16) {
+        settings_.format = SampleFormat::Int24;
+        bytesPerFrame_ = numChannels_ * bytesPerSample(settings_.format);
+    }
+    for (auto& block : blocks_) {
+        block.samples.assign(static_cast<size_t>(kBlockFrames * numChannels_), 0.0f);
+    }
+    silence_.assign(static_cast<size_t>(kBlockFrames * numChannels_), 0.0f);
+    current_ = 0;
+    for (int i = 1; i < kNumBlocks; ++i) {
+        free_.push(static_cast<uint16_t>(i));
+    }
+
+    maxFileFrames_ = kMaxDataBytes / bytesPerFrame_ - kBlockFrames;
+    rotateFrames_ = maxFileFrames_;
+    if (settings_.rotateSeconds > 0.0) {
+        rotateFrames_ = std::min(rotateFrames_, std::max<int64_t>(
+            kBlockFrames, static_cast<int64_t>(settings_.rotateSeconds * sampleRate)));
+    }
+}
+
+AudioArchive::~AudioArchive() {
+    stop();
+}
+
+bool AudioArchive::start() {
+    if (thread_.joinable()) return true;
+    if (failed_) return false;
+    if (!chunk_ || !openFile()) {
+        fail();
+        return false;
+    }
+    stopping_ = false;
+    thread_ = std::thread([this] { run(); });
+    return true;
+}
+
+void AudioArchive::stop() {
+    if (!thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+
+    // The audio thread has stopped, so its partial block (and any frames
+    // it dropped at the end) can go out from here
+    uint16_t index;
+    while (filled_.pop(index)) {
+        archiveBlock(blocks_[index]);
+    }
+    if (current_ >= 0 && blocks_[static_cast<size_t>(current_)].frames > 0) {
+        archiveBlock(blocks_[static_cast<size_t>(current_)]);
+        blocks_[static_cast<size_t>(current_)].frames = 0;
+    }
+    if (writtenFrames_ < nextFrame_) {
+        appendFrames(nullptr, nextFrame_ - writtenFrames_);
+    }
+    closeFile();
+}
+
+void AudioArchive::write(const float* const* inputs, const float* output, int numSamples) {
+    int frame = 0;
+    while (frame < numSamples) {
+        if (current_ < 0) {
+            uint16_t index;
+            if (!free_.pop(index)) {
+                // Writer behind: the file gets silence for these frames
+                int dropped = numSamples - frame;
+                framesDropped_.fetch_add(dropped, std::memory_order_relaxed);
+                nextFrame_ += dropped;
+                return;
+            }
+            current_ = index;
+            blocks_[index].firstFrame = nextFrame_;
+            blocks_[index].frames = 0;
+        }
+
+        Block& block = blocks_[static_cast<size_t>(current_)];
+        int n = std::min(numSamples - frame, kBlockFrames - block.frames);
+        float* dst = block.samples.data() + static_cast<size_t>(block.frames * numChannels_);
+        for (int ch = 0; ch < numChannels_; ++ch) {
+            const float* src = ch < numInputs_ ? inputs[ch] : output;
+            if (src) {
+                src += frame;
+                for (int i = 0; i < n; ++i) dst[i * numChannels_ + ch] = src[i];
+            } else {
+                for (int i = 0; i < n; ++i) dst[i * numChannels_ + ch] = 0.0f;
+            }
+        }
+        block.frames += n;
+        frame += n;
+        nextFrame_ += n;
+
+        if (block.frames == kBlockFrames) {
+            // Cannot fail: the queue holds every block
+            filled_.push(static_cast<uint16_t>(current_));
+            current_ = -1;
+        }
+    }
+}
+
+AudioArchive::Stats AudioArchive::stats() const {
+    Stats s;
+    s.framesArchived = framesArchived_.load(std::memory_order_relaxed);
+    s.framesDropped = framesDropped_.load(std::memory_order_relaxed);
+    s.files = files_.load(std::memory_order_relaxed);
+    s.writeErrors = writeErrors_.load(std::memory_order_relaxed);
+    return s;
+}
+
+void AudioArchive::run() {
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "retro-archive");
+#endif
+    // Polled rather than woken: the audio thread must not make a system call
+    // per block, and the pool holds seconds of audio
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        bool stopping = wake_.wait_for(lock, kWriteInterval, [this] { return stopping_; });
+        lock.unlock();
+        uint16_t index;
+        while (filled_.pop(index)) {
+            archiveBlock(blocks_[index]);
+            free_.push(index);
+        }
+        if (stopping) return;
+        lock.lock();
+    }
+}
+
+void AudioArchive::archiveBlock(const Block& block) {
+    if (block.firstFrame > writtenFrames_) {
+        appendFrames(nullptr, block.firstFrame - writtenFrames_);
+    }
+    appendFrames(block.samples.data(), block.frames);
+}
+
+void AudioArchive::appendFrames(const float* interleaved, int64_t frames) {
+    const int64_t stride = bytesPerSample(settings_.format);
+
+    while (frames > 0) {
+        int64_t n = std::min<int64_t>(frames, kBlockFrames);
+        if (!failed_ && fileFrames_ >= rotateFrames_) {
+            closeFile();
+            if (!failed_ && !openFile()) fail();
+        }
+        if (!failed_) {
+            // Encode straight into the chunk, a sample at a time across its end
+            const float* src = interleaved ? interleaved : silence_.data();
+            auto samples = static_cast<size_t>(n * numChannels_);
+            while (samples > 0) {
+                size_t room = (kChunkBytes - chunkFill_) / static_cast<size_t>(stride);
+                if (room == 0) {
+                    // A sample straddles the chunk boundary
+                    uint8_t bytes[4];
+                    encodeSamples(settings_.format, bytes, src, 1);
+                    size_t first = kChunkBytes - chunkFill_;
+                    std::memcpy(chunk_.get() + chunkFill_, bytes, first);
+                    chunkFill_ = kChunkBytes;
+                    flushChunk();
+                    if (failed_) break;
+                    std::memcpy(chunk_.get(), bytes + first, static_cast<size_t>(stride) - first);
+                    chunkFill_ = static_cast<size_t>(stride) - first;
+                    ++src;
+                    --samples;
+                    continue;
+                }
+                size_t count = std::min(room, samples);
+                encodeSamples(settings_.format, chunk_.get() + chunkFill_, src, count);
+                chunkFill_ += count * static_cast<size_t>(stride);
+                src += count;
+                samples -= count;
+                if (chunkFill_ == kChunkBytes) {
+                    flushChunk();
+                    if (failed_) break;
+                }
+            }
+            fileFrames_ += n;
+        }
+        if (interleaved) interleaved += n * numChannels_;
+        writtenFrames_ += n;
+        framesArchived_.fetch_add(n, std::memory_order_relaxed);
+        frames -= n;
+    }
+}
+
+bool AudioArchive::openFile() {
+    if (fileStamp_.empty()) {
+        char stamp[32];
+        std::time_t now = std::time(nullptr);
+        std::tm local{};
+        localtime_r(&now, &local);
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+        fileStamp_ = stamp;
+    }
+    char part[24];
+    std::snprintf(part, sizeof(part), "-%03d.wav", files_.load(std::memory_order_relaxed) + 1);
+    std::string path = settings_.directory + "/retrospect-" + fileStamp_ + part;
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd_ < 0) return false;
+
+    // RIFF/WAVE with a WAVE_FORMAT_EXTENSIBLE fmt chunk, then JUNK up to the
+    // data chunk header. Sizes are filled in by updateHeader().
+    uint8_t header[kHeaderBytes] = {};
+    bool isFloat = settings_.format == SampleFormat::Float32;
+    int bits = 8 * bytesPerSample(settings_.format);
+    std::memcpy(header, "RIFF", 4);
+    std::memcpy(header + 8, "WAVE", 4);
+    std::memcpy(header + 12, "fmt ", 4);
+    put32(header + 16, 40);
+    put16(header + 20, 0xfffe);
+    put16(header + 22, static_cast<uint32_t>(numChannels_));
+    put32(header + 24, static_cast<uint32_t>(sampleRate_));
+    put32(header + 28, static_cast<uint32_t>(sampleRate_ * bytesPerFrame_));
+    put16(header + 32, static_cast<uint32_t>(bytesPerFrame_));
+    put16(header + 34, static_cast<uint32_t>(bits));
+    put16(header + 36, 22);
+    put16(header + 38, static_cast<uint32_t>(bits));
+    put32(header + 40, 0);  // No speaker positions
+    static const uint8_t kSubFormatTail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80,
+                                               0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71};
+    put16(header + 44, isFloat ? 3 : 1);
+    std::memcpy(header + 46, kSubFormatTail, sizeof(kSubFormatTail));
+    std::memcpy(header + 60, "JUNK", 4);
+    put32(header + 64, static_cast<uint32_t>(kHeaderBytes - 8 - 68));
+    std::memcpy(header + kHeaderBytes - 8, "data", 4);
+
+    fileFrames_ = 0;
+    fileDataBytes_ = 0;
+    chunkFill_ = 0;
+    if (!writeAll(fd_, header, sizeof(header))) return false;
+    updateHeader();
+    files_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void AudioArchive::closeFile() {
+    if (fd_ < 0) return;
+    if (chunkFill_ > 0) {
+        // The last, partial chunk, plus a pad byte if the data is odd-sized
+        size_t bytes = chunkFill_;
+        if ((fileDataBytes_ + static_cast<int64_t>(bytes)) & 1) chunk_.get()[bytes++] = 0;
+        if (writeAll(fd_, chunk_.get(), bytes)) {
+            fileDataBytes_ += static_cast<int64_t>(chunkFill_);
+        } else {
+            writeErrors_.fetch_add(1, std::memory_order_relaxed);
+            failed_ = true;
+        }
+        chunkFill_ = 0;
+    }
+    updateHeader();
+    ::close(fd_);
+    fd_ = -1;
+}
+
+void AudioArchive::flushChunk() {
+    if (!writeAll(fd_, chunk_.get(), chunkFill_)) {
+        fail();
+        return;
+    }
+    fileDataBytes_ += static_cast<int64_t>(chunkFill_);
+    chunkFill_ = 0;
+    updateHeader();
+}
+
+void AudioArchive::updateHeader() {
+    // RIFF size counts everything after its own field, including the pad byte
+    int64_t data = fileDataBytes_;
+    uint8_t riff[4];
+    uint8_t size[4];
+    put32(riff, static_cast<uint32_t>(kHeaderBytes - 8 + static_cast<size_t>(data + (data & 1))));
+    put32(size, static_cast<uint32_t>(data));
+    bool ok = pwrite(fd_, riff, 4, 4) == 4 &&
+              pwrite(fd_, size, 4, static_cast<off_t>(kHeaderBytes - 4)) == 4;
+    if (!ok) writeErrors_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioArchive::fail() {
+    // One error stops the archive; the writer keeps recycling blocks so the
+    // audio thread sees no difference
+    writeErrors_.fetch_add(1, std::memory_order_relaxed);
+    failed_ = true;
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+} // namespace retrospect
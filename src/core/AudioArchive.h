@@ -0,0 +1,136 @@
+#pragma once
+
+#include "core/SampleFormat.h"
+#include "core/SpscQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace retrospect {
+
+/// Where and how AudioArchive writes
+struct ArchiveSettings {
+    std::string directory;                      // "" = no archive
+    SampleFormat format = SampleFormat::Int24;  // Float32 or Int24 (WAV has no float16)
+    double rotateSeconds = 3600.0;              // Start a new file after this long (0 = only at 4 GiB)
+};
+
+/// Always-on archive of everything played in and out, streamed to WAV files.
+///
+/// The audio thread interleaves each block of every input channel, plus the
+/// engine output as the last channel, into fixed-size blocks from a pool
+/// allocated up front, and hands full blocks to a writer thread through an
+/// SPSC queue. The writer encodes them, writes the file in large chunks
+/// aligned to the disk's blocks and returns the blocks to the audio thread
+/// through a second queue. The audio thread never blocks, allocates or makes
+/// a system call: when the writer falls behind and no block is free, the
+/// audio is dropped and counted, and the file gets silence in its place so
+/// it stays in step with the engine's timeline.
+///
+/// Files are named retrospect-YYYYmmdd-HHMMSS-NNN.wav (archive start time,
+/// then the part number) and rotate after rotateSeconds (and before the
+/// 4 GiB WAV limit). Their headers are brought
+/// up to date with every chunk written, so a crash loses at most the last
+/// chunk.
+class AudioArchive {
+public:
+    /// Archive counters, readable from any thread
+    struct Stats {
+        int64_t framesArchived = 0;  // Frames the writer has put in files (including silence for drops)
+        int64_t framesDropped = 0;   // Frames the audio thread had no free block for
+        int files = 0;               // Files opened so far
+        int writeErrors = 0;         // Failed opens or writes (the archive stops at the first)
+    };
+
+    /// Frames per block, and blocks in the pool (about 5.5 s at 48 kHz)
+    static constexpr int kBlockFrames = 2048;
+    static constexpr int kNumBlocks = 128;
+
+    /// @param numInputChannels Input channels archived (the output is one more)
+    AudioArchive(const ArchiveSettings& settings, int numInputChannels, double sampleRate);
+    ~AudioArchive();
+
+    AudioArchive(const AudioArchive&) = delete;
+    AudioArchive& operator=(const AudioArchive&) = delete;
+
+    /// Start the writer thread (control thread, once). Returns false,
+    /// leaving the archive off, if the first file cannot be created.
+    bool start();
+
+    /// Write out what is queued and close the file (control thread). Call
+    /// once the audio thread has stopped writing, so the partly filled block
+    /// goes out too.
+    void stop();
+
+    /// Append `numSamples` frames: one pointer per input channel (a null
+    /// entry archives silence) and the engine output. Audio thread only.
+    void write(const float* const* inputs, const float* output, int numSamples);
+
+    Stats stats() const;
+    int numChannels() const { return numChannels_; }
+
+private:
+    struct Block {
+        std::vector<float> samples;  // kBlockFrames * numChannels_, interleaved
+        int64_t firstFrame = 0;
+        int frames = 0;
+    };
+
+    void run();
+
+    /// Write one block (preceded by silence for any frames dropped before it)
+    /// to the current file. Writer thread only.
+    void archiveBlock(const Block& block);
+    void appendFrames(const float* interleaved, int64_t frames);
+    bool openFile();
+    void closeFile();
+    void flushChunk();
+    void updateHeader();
+    void fail();
+
+    ArchiveSettings settings_;
+    int numInputs_;
+    int numChannels_;
+    int sampleRate_;
+    int bytesPerFrame_;
+
+    std::vector<Block> blocks_;
+    SpscQueue<uint16_t, kNumBlocks> filled_;  // Audio thread -> writer
+    SpscQueue<uint16_t, kNumBlocks> free_;    // Writer -> audio thread
+
+    // Audio thread
+    int current_ = -1;       // Block being filled, or -1 while none is free
+    int64_t nextFrame_ = 0;  // Frames seen so far, archived or dropped
+
+    // Writer thread: the open file and a write buffer of one chunk
+    int fd_ = -1;
+    std::string fileStamp_;  // Start time shared by every part's name
+    int64_t fileFrames_ = 0;
+    int64_t fileDataBytes_ = 0;
+    int64_t writtenFrames_ = 0;  // Next frame the file timeline expects
+    int64_t rotateFrames_ = 0;
+    int64_t maxFileFrames_ = 0;
+    std::unique_ptr<uint8_t, void (*)(void*)> chunk_;
+    size_t chunkFill_ = 0;
+    std::vector<float> silence_;  // One block, for frames that were dropped
+    bool failed_ = false;
+
+    std::atomic<int64_t> framesArchived_{0};
+    std::atomic<int64_t> framesDropped_{0};
+    std::atomic<int> files_{0};
+    std::atomic<int> writeErrors_{0};
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+} // namespace retrospect
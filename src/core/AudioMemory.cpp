@@ -0,0 +1,209 @@
+#include "core/AudioMemory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace retrospect {
+
+namespace {
+
+constexpr size_t kHugePage = size_t(2) << 20;
+// Unit of prefault work handed to a thread, and the most threads used
+constexpr size_t kPieceBytes = size_t(8) << 20;
+constexpr unsigned kMaxPrefaultThreads = 8;
+
+std::atomic<bool> lockingEnabled{false};
+std::atomic<int64_t> heldBytes{0};
+std::atomic<int64_t> lockedBlockBytes{0};
+
+size_t pageSize() {
+    static const size_t size = [] {
+        long page = sysconf(_SC_PAGESIZE);
+        return page > 0 ? static_cast<size_t>(page) : size_t(4096);
+    }();
+    return size;
+}
+
+// Fault [data, data + bytes) in, locking it if asked; returns the bytes locked
+size_t faultIn(uint8_t* data, size_t bytes, bool lock) {
+    // mlock faults the pages in itself
+    if (lock && mlock(data, bytes) == 0) return bytes;
+    // Write each page back to itself, so it gets a page of its own rather
+    // than the shared zero page, without disturbing what it holds
+    volatile uint8_t* p = data;
+    for (size_t off = 0; off < bytes; off += pageSize()) {
+        p[off] = p[off];
+    }
+    return 0;
+}
+
+// VmLck of this process, or -1 where it can't be read
+int64_t processLockedBytes() {
+#if defined(__linux__)
+    FILE* f = std::fopen("/proc/self/status", "r");
+    if (!f) return -1;
+    char line[256];
+    int64_t kb = -1;
+    while (std::fgets(line, sizeof(line), f)) {
+        if (std::sscanf(line, "VmLck: %" SCNd64 " kB", &kb) == 1) break;
+    }
+    std::fclose(f);
+    return kb < 0 ? -1 : kb * 1024;
+#else
+    return -1;
+#endif
+}
+
+} // namespace
+
+void setAudioMemoryLocking(bool enabled) {
+    lockingEnabled.store(enabled, std::memory_order_relaxed);
+#if defined(MCL_ONFAULT)
+    // Locking everything is only safe without a limit: past it, every new
+    // mapping would fail
+    rlimit limit{};
+    if (enabled && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY) {
+        mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT);
+    }
+#endif
+}
+
+bool audioMemoryLocking() {
+    return lockingEnabled.load(std::memory_order_relaxed);
+}
+
+AudioMemory::AudioMemory(size_t bytes) {
+    if (bytes == 0) return;
+
+    void* p = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    // Reserved huge pages, if the system has enough free (the mapping
+    // reserves them up front, so it fails rather than faulting later)
+    if (bytes >= kHugePage) {
+        size_t rounded = (bytes + kHugePage - 1) / kHugePage * kHugePage;
+        p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) mapped_ = rounded;
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        mapped_ = bytes;
+#if defined(MADV_HUGEPAGE)
+        if (bytes >= kHugePage) madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    }
+    data_ = static_cast<uint8_t*>(p);
+    bytes_ = bytes;
+    heldBytes.fetch_add(static_cast<int64_t>(bytes_), std::memory_order_relaxed);
+}
+
+AudioMemory::~AudioMemory() {
+    release();
+}
+
+AudioMemory::AudioMemory(AudioMemory&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , bytes_(std::exchange(other.bytes_, 0))
+    , mapped_(std::exchange(other.mapped_, 0))
+    , locked_(std::exchange(other.locked_, 0))
+{
+}
+
+AudioMemory& AudioMemory::operator=(AudioMemory&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        bytes_ = std::exchange(other.bytes_, 0);
+        mapped_ = std::exchange(other.mapped_, 0);
+        locked_ = std::exchange(other.locked_, 0);
+    }
+    return *this;
+}
+
+void AudioMemory::release() {
+    if (!data_) return;
+    munmap(data_, mapped_);  // Unlocks too
+    heldBytes.fetch_sub(static_cast<int64_t>(bytes_), std::memory_order_relaxed);
+    lockedBlockBytes.fetch_sub(static_cast<int64_t>(locked_), std::memory_order_relaxed);
+    data_ = nullptr;
+    bytes_ = mapped_ = locked_ = 0;
+}
+
+void AudioMemory::prefault() {
+    prefaultAudioMemory({this});
+}
+
+void prefaultAudioMemory(const std::vector<AudioMemory*>& blocks) {
+    struct Piece {
+        AudioMemory* block;
+        size_t offset;
+        size_t bytes;
+        size_t locked;
+    };
+    std::vector<Piece> pieces;
+    for (AudioMemory* block : blocks) {
+        // Already faulted in and locked; locking it again would count twice
+        if (!block || block->empty() || block->locked_ > 0) continue;
+        for (size_t off = 0; off < block->bytes_; off += kPieceBytes) {
+            pieces.push_back({block, off, std::min(kPieceBytes, block->bytes_ - off), 0});
+        }
+    }
+    if (pieces.empty()) return;
+
+    bool lock = audioMemoryLocking();
+    std::atomic<size_t> nextPiece{0};
+    auto work = [&] {
+        for (size_t i; (i = nextPiece.fetch_add(1, std::memory_order_relaxed)) < pieces.size();) {
+            Piece& piece = pieces[i];
+            piece.locked = faultIn(piece.block->data_ + piece.offset, piece.bytes, lock);
+        }
+    };
+    size_t threads = std::min<size_t>({pieces.size(), kMaxPrefaultThreads,
+                                       std::max(1u, std::thread::hardware_concurrency())});
+    std::vector<std::thread> helpers;
+    for (size_t t = 1; t < threads; ++t) helpers.emplace_back(work);
+    work();
+    for (auto& helper : helpers) helper.join();
+
+    for (const Piece& piece : pieces) {
+        piece.block->locked_ += piece.locked;
+        lockedBlockBytes.fetch_add(static_cast<int64_t>(piece.locked), std::memory_order_relaxed);
+    }
+}
+
+AudioMemoryStats audioMemoryStats() {
+    // /proc is read at most once a second however often the state goes out
+    static std::mutex mutex;
+    static std::chrono::steady_clock::time_point readAt;
+    static int64_t processLocked = -1;
+
+    AudioMemoryStats stats;
+    stats.bytes = heldBytes.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        if (readAt == std::chrono::steady_clock::time_point{} ||
+            now - readAt >= std::chrono::seconds(1)) {
+            processLocked = processLockedBytes();
+            readAt = now;
+        }
+        stats.lockedBytes = processLocked;
+    }
+    if (stats.lockedBytes < 0) stats.lockedBytes = lockedBlockBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace retrospect
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace retrospect {
+
+/// Turn page locking for audio memory on or off (startup, before the engine
+/// is built). When on, AudioMemory blocks are mlock'ed as they are faulted
+/// in, and if RLIMIT_MEMLOCK is unlimited the whole process is locked too
+/// (mlockall, pages locked as they are first touched), so loop layers the
+/// worker builds later can't be paged out either. File mappings (lookback
+/// spill, session files) unlock themselves, so they stay pageable.
+/// Off by default.
+void setAudioMemoryLocking(bool enabled);
+bool audioMemoryLocking();
+
+/// A block of memory the audio callback reads or writes: mapped directly,
+/// on huge pages where the system has them (reserved hugetlb pages first,
+/// otherwise transparent huge pages), zeroed, and faulted in and locked by
+/// prefault() rather than on first touch inside the callback.
+///
+/// Pages are not backed until prefault() (or first use), so several blocks
+/// can be faulted in in parallel with prefaultAudioMemory().
+class AudioMemory {
+public:
+    AudioMemory() = default;
+    explicit AudioMemory(size_t bytes);
+    ~AudioMemory();
+
+    AudioMemory(AudioMemory&& other) noexcept;
+    AudioMemory& operator=(AudioMemory&& other) noexcept;
+    AudioMemory(const AudioMemory&) = delete;
+    AudioMemory& operator=(const AudioMemory&) = delete;
+
+    uint8_t* data() const { return data_; }
+    size_t size() const { return bytes_; }
+    bool empty() const { return bytes_ == 0; }
+
+    /// Fault every page in, locking it if locking is on
+    void prefault();
+
+    size_t lockedBytes() const { return locked_; }
+
+private:
+    friend void prefaultAudioMemory(const std::vector<AudioMemory*>& blocks);
+
+    void release();
+
+    uint8_t* data_ = nullptr;
+    size_t bytes_ = 0;
+    size_t mapped_ = 0;  // Length of the mapping (rounded up for hugetlb)
+    size_t locked_ = 0;
+};
+
+/// Fault in (and lock) several blocks at once, split across threads, so a
+/// startup with many large input rings doesn't fault them one by one
+void prefaultAudioMemory(const std::vector<AudioMemory*>& blocks);
+
+/// What audio memory takes, for the perf report (any thread but the audio
+/// thread: may read /proc)
+struct AudioMemoryStats {
+    int64_t bytes = 0;        // Held in AudioMemory blocks
+    int64_t lockedBytes = 0;  // Locked in RAM, process-wide
+};
+AudioMemoryStats audioMemoryStats();
+
+} // namespace retrospect
@@ -0,0 +1,33 @@
+#include "core/BufferPool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace retrospect {
+
+BufferPool::BufferPool() {
+    free_.reserve(kMaxBuffers);
+}
+
+std::vector<float> BufferPool::take(size_t length) {
+    // Newest first: it is the most likely to still be in cache
+    for (size_t i = free_.size(); i-- > 0;) {
+        if (free_[i].size() != length) continue;
+        std::vector<float> buffer = std::move(free_[i]);
+        free_.erase(free_.begin() + static_cast<std::ptrdiff_t>(i));
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        return buffer;
+    }
+    return std::vector<float>(length, 0.0f);
+}
+
+void BufferPool::give(std::vector<float>&& buffer) {
+    if (buffer.empty()) return;
+    if (free_.size() == kMaxBuffers) {
+        free_.erase(free_.begin());
+    }
+    free_.push_back(std::move(buffer));
+    buffer = {};
+}
+
+} // namespace retrospect
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace retrospect {
+
+/// Free list of float buffers, so loop-length buffers (layers, mix caches)
+/// are reused instead of going back to the heap and being faulted in again.
+///
+/// Used by one thread at a time: the engine worker, where buffers retired by
+/// the audio thread arrive (or the audio thread itself when the worker runs
+/// synchronously). At most kMaxBuffers are kept; beyond that the oldest is
+/// freed, so the pool never holds more than a few loops' worth of memory.
+class BufferPool {
+public:
+    static constexpr size_t kMaxBuffers = 16;
+
+    BufferPool();
+
+    /// A zeroed buffer of `length` samples: a kept one of that length if
+    /// there is one, otherwise a new allocation
+    std::vector<float> take(size_t length);
+
+    /// Keep `buffer` for a later take() (empty buffers are ignored)
+    void give(std::vector<float>&& buffer);
+
+    size_t size() const { return free_.size(); }
+
+private:
+    std::vector<std::vector<float>> free_;  // Oldest first
+};
+
+} // namespace retrospect
@@ -0,0 +1,36 @@
+#include "core/CaptureSource.h"
+#include "core/SimdKernels.h"
+
+#include <algorithm>
+
+namespace retrospect {
+
+CaptureSource::CaptureSource(const std::vector<InputChannel>* channels)
+    : channels_(channels)
+{
+}
+
+void CaptureSource::begin(int64_t start, uint64_t channelMask, bool allChannels) {
+    start_ = start;
+    channelMask_ = channelMask;
+    allChannels_ = allChannels;
+}
+
+void CaptureSource::read(float* dest, int64_t first, int numSamples) const {
+    for (int off = 0; off < numSamples; off += kPiece) {
+        int n = std::min(kPiece, numSamples - off);
+        float* out = dest + off;
+        std::fill(out, out + n, 0.0f);
+        for (size_t ch = 0; ch < channels_->size(); ++ch) {
+            if (!includes(ch)) continue;
+            if (!(*channels_)[ch].ringBuffer().readRam(scratch_.data(), start_ + first + off, n)) {
+                // Overwritten before the copy landed
+                std::fill(out, out + n, 0.0f);
+                break;
+            }
+            simd::add(out, scratch_.data(), static_cast<size_t>(n));
+        }
+    }
+}
+
+} // namespace retrospect
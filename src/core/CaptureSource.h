@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core/InputChannel.h"
+#include "core/Loop.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace retrospect {
+
+/// Plays a capture straight out of the input channels' RAM rings while the
+/// worker copies it (see Loop::preview). The channels are summed in the
+/// worker's order, so the copy that replaces the preview is bit-identical to
+/// it. A region the rings have overwritten meanwhile reads as silence.
+///
+/// Read on the audio thread (or a render thread it waits for), which is the
+/// rings' writer, so nothing moves underneath a read.
+class CaptureSource : public LoopSource {
+public:
+    explicit CaptureSource(const std::vector<InputChannel>* channels);
+
+    /// Supply the history from sample `start` (see RingBuffer::readRam) on,
+    /// mixing the channels in `channelMask` (or every channel)
+    void begin(int64_t start, uint64_t channelMask, bool allChannels);
+
+    void read(float* dest, int64_t first, int numSamples) const override;
+
+private:
+    static constexpr int kPiece = 256;
+
+    bool includes(size_t ch) const {
+        return allChannels_ || (ch < 64 && (channelMask_ & (uint64_t(1) << ch)));
+    }
+
+    const std::vector<InputChannel>* channels_;
+    int64_t start_ = 0;
+    uint64_t channelMask_ = 0;
+    bool allChannels_ = false;
+    mutable std::array<float, kPiece> scratch_{};
+};
+
+} // namespace retrospect
@@ -0,0 +1,33 @@
+#include "core/ClockSync.h"
+#include <cstddef>
+
+namespace retrospect {
+
+bool ClockSync::addExchange(int64_t sent, int64_t remoteReceived, int64_t remoteSent,
+                            int64_t received) {
+    int64_t rtt = (received - sent) - (remoteSent - remoteReceived);
+    if (rtt < 0) return false;
+
+    // Halved separately so clocks far apart can't overflow the sum
+    int64_t offset = (remoteReceived - sent) / 2 + (remoteSent - received) / 2;
+    window_[static_cast<size_t>(next_)] = Exchange{offset, rtt};
+    next_ = (next_ + 1) % kWindow;
+    if (count_ < kWindow) ++count_;
+
+    const Exchange* best = &window_[0];
+    for (int i = 1; i < count_; ++i) {
+        if (window_[static_cast<size_t>(i)].rtt < best->rtt) best = &window_[static_cast<size_t>(i)];
+    }
+    offset_ = best->offset;
+    rtt_ = best->rtt;
+    return true;
+}
+
+void ClockSync::reset() {
+    count_ = 0;
+    next_ = 0;
+    offset_ = 0;
+    rtt_ = 0;
+}
+
+} // namespace retrospect
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace retrospect {
+
+/// Estimates the offset between this host's clock and a remote host's from
+/// timed request/reply exchanges, the way NTP does.
+///
+/// Each exchange has four timestamps: the request leaving here and arriving
+/// there, the reply leaving there and arriving here. Assuming the two legs
+/// take equally long, the remote clock reads offset = ((t2 - t1) + (t3 - t4)) / 2
+/// ahead of this one, and the network took rtt = (t4 - t1) - (t3 - t2). An
+/// exchange delayed on either leg (a queue, a retry) skews its offset by up
+/// to half the delay, so of the last kWindow exchanges the one with the
+/// shortest round trip is taken: it had the least room to be skewed.
+///
+/// Not thread-safe; one thread feeds and reads it.
+class ClockSync {
+public:
+    /// Add an exchange: `sent` and `received` on this clock, `remoteReceived`
+    /// and `remoteSent` on the remote one (all in ns). An exchange with a
+    /// negative round trip (a clock stepped mid-exchange) is rejected and
+    /// returns false.
+    bool addExchange(int64_t sent, int64_t remoteReceived, int64_t remoteSent, int64_t received);
+
+    /// Whether enough exchanges have come in to trust the estimate
+    bool locked() const { return count_ >= kMinExchanges; }
+
+    /// How far the remote clock reads ahead of this one, in ns
+    int64_t offsetNanos() const { return offset_; }
+
+    /// Round trip of the exchange the offset comes from, in ns
+    int64_t rttNanos() const { return rtt_; }
+
+    /// Exchanges in the window (up to kWindow)
+    int exchanges() const { return count_; }
+
+    /// A time on this clock as the remote clock reads it, and back
+    int64_t toRemote(int64_t localNanos) const { return localNanos + offset_; }
+    int64_t toLocal(int64_t remoteNanos) const { return remoteNanos - offset_; }
+
+    /// Forget every exchange (e.g. the remote host went away)
+    void reset();
+
+    static constexpr int kWindow = 16;
+    static constexpr int kMinExchanges = 4;
+
+private:
+    struct Exchange {
+        int64_t offset = 0;
+        int64_t rtt = 0;
+    };
+
+    std::array<Exchange, kWindow> window_{};
+    int count_ = 0;     // Exchanges in the window
+    int next_ = 0;      // Slot the next exchange goes into
+
+    int64_t offset_ = 0;
+    int64_t rtt_ = 0;
+};
+
+} // namespace retrospect
@@ -0,0 +1,128 @@
+#include "core/DspLoadMeter.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace retrospect {
+
+DspLoadMeter::DspLoadMeter(double sampleRate)
+    : windowLengthSamples_(std::max<int64_t>(1, std::llround(sampleRate)))
+    , nanosPerSample_(1e9 / sampleRate)
+{
+}
+
+int DspLoadMeter::bucketFor(int64_t nanos) {
+    if (nanos < kSubBuckets) return static_cast<int>(std::max<int64_t>(0, nanos));
+    // Octave from the top bit, sub-bucket from the three bits below it
+    int octave = static_cast<int>(std::bit_width(static_cast<uint64_t>(nanos))) - 1;
+    int sub = static_cast<int>((nanos >> (octave - 3)) & (kSubBuckets - 1));
+    return std::min(octave * kSubBuckets + sub, kBuckets - 1);
+}
+
+int64_t DspLoadMeter::bucketUpperNanos(int bucket) {
+    int octave = bucket / kSubBuckets;
+    int sub = bucket % kSubBuckets;
+    if (octave < 3) return bucket + 1;
+    return static_cast<int64_t>(kSubBuckets + sub + 1) << (octave - 3);
+}
+
+void DspLoadMeter::beginCallback(int64_t startNanos, int numSamples) {
+    int64_t period = std::llround(numSamples * nanosPerSample_);
+
+    // A device that delivers callbacks on time starts each one about a
+    // period after the last; a long gap means audio was missed upstream.
+    if (previousStart_ >= 0 && startNanos - previousStart_ > previousPeriod_ * 3 / 2) {
+        ++status_.lateCallbacks;
+    }
+    previousStart_ = startNanos;
+    previousPeriod_ = period;
+
+    callbackStart_ = startNanos;
+    callbackPeriod_ = period;
+    callbackMissed_ = false;
+    windowSamples_ += numSamples;
+    stageNanos_.fill(0);
+}
+
+void DspLoadMeter::endCallback(int64_t endNanos) {
+    int64_t nanos = std::max<int64_t>(0, endNanos - callbackStart_);
+    double load = callbackPeriod_ > 0
+        ? static_cast<double>(nanos) / static_cast<double>(callbackPeriod_) : 0.0;
+
+    ++histogram_[static_cast<size_t>(bucketFor(nanos))];
+    ++windowCount_;
+    windowTotalNanos_ += nanos;
+    windowMaxNanos_ = std::max(windowMaxNanos_, nanos);
+    windowTotalLoad_ += load;
+    windowMaxLoad_ = std::max(windowMaxLoad_, load);
+    for (int s = 0; s < kNumDspStages; ++s) {
+        windowStageNanos_[static_cast<size_t>(s)] += stageNanos_[static_cast<size_t>(s)];
+    }
+
+    ++status_.callbacks;
+    status_.periodNanos = callbackPeriod_;
+    status_.maxEverNanos = std::max(status_.maxEverNanos, nanos);
+    if (nanos > callbackPeriod_) {
+        ++status_.missedDeadlines;
+        callbackMissed_ = true;
+    }
+
+    if (windowSamples_ >= windowLengthSamples_) closeWindow();
+}
+
+void DspLoadMeter::noteHostCallback(int64_t nanos, int64_t deviceXruns) {
+    ++windowHostCount_;
+    windowHostTotalNanos_ += nanos;
+    windowHostMaxNanos_ = std::max(windowHostMaxNanos_, nanos);
+    status_.deviceXruns = deviceXruns;
+
+    // The engine finished in time but the callback as a whole did not
+    if (nanos > callbackPeriod_ && !callbackMissed_) {
+        ++status_.missedDeadlines;
+        callbackMissed_ = true;
+    }
+}
+
+void DspLoadMeter::closeWindow() {
+    if (windowCount_ > 0) {
+        // p99: the bucket holding the ceil(0.99 n)-th fastest callback
+        int64_t rank = (windowCount_ * 99 + 99) / 100;
+        int64_t seen = 0;
+        int bucket = 0;
+        for (; bucket < kBuckets - 1; ++bucket) {
+            seen += histogram_[static_cast<size_t>(bucket)];
+            if (seen >= rank) break;
+        }
+        int64_t p99 = std::min(bucketUpperNanos(bucket), windowMaxNanos_);
+        double period = static_cast<double>(std::max<int64_t>(1, callbackPeriod_));
+
+        status_.windowCallbacks = windowCount_;
+        status_.meanNanos = windowTotalNanos_ / windowCount_;
+        status_.p99Nanos = p99;
+        status_.maxNanos = windowMaxNanos_;
+        status_.meanLoad = windowTotalLoad_ / static_cast<double>(windowCount_);
+        status_.p99Load = static_cast<double>(p99) / period;
+        status_.maxLoad = windowMaxLoad_;
+        for (int s = 0; s < kNumDspStages; ++s) {
+            status_.stageMeanNanos[static_cast<size_t>(s)] =
+                windowStageNanos_[static_cast<size_t>(s)] / windowCount_;
+        }
+        status_.hostMeanNanos = windowHostCount_ > 0 ? windowHostTotalNanos_ / windowHostCount_ : 0;
+        status_.hostMaxNanos = windowHostMaxNanos_;
+    }
+
+    histogram_.fill(0);
+    windowSamples_ = 0;
+    windowCount_ = 0;
+    windowTotalNanos_ = 0;
+    windowMaxNanos_ = 0;
+    windowTotalLoad_ = 0.0;
+    windowMaxLoad_ = 0.0;
+    windowStageNanos_.fill(0);
+    windowHostCount_ = 0;
+    windowHostTotalNanos_ = 0;
+    windowHostMaxNanos_ = 0;
+}
+
+} // namespace retrospect
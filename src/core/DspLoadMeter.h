@@ -0,0 +1,137 @@
+#pragma once
+
+#include "core/MonotonicClock.h"
+
+#include <array>
+#include <cstdint>
+
+namespace retrospect {
+
+/// Stages of LoopEngine::processBlock timed separately
+enum class DspStage : uint8_t {
+    Ingest,   // Input ring buffer writes, peak tracking, classic recording
+    Ops,      // Command drain, pending op flush, worker results
+    Mix,      // Loop render, overdub, click, monitoring, clock advance (less Stretch)
+    Stretch,  // Time stretcher refills
+};
+
+constexpr int kNumDspStages = 4;
+
+/// Display name of a stage
+inline const char* dspStageName(DspStage stage) {
+    switch (stage) {
+        case DspStage::Ingest:  return "ingest";
+        case DspStage::Ops:     return "ops";
+        case DspStage::Mix:     return "mix";
+        case DspStage::Stretch: return "stretch";
+    }
+    return "";
+}
+
+/// Callback timing as published in EngineState. Window figures cover the
+/// last completed window (about a second of audio); counters run from
+/// engine start.
+struct PerfStatus {
+    int64_t windowCallbacks = 0;    // Callbacks in the window (0 until the first closes)
+    int64_t periodNanos = 0;        // Buffer period of the last callback
+
+    // processBlock wall time per callback
+    int64_t meanNanos = 0;
+    int64_t p99Nanos = 0;           // Histogram bucket upper bound (within 1/8 octave)
+    int64_t maxNanos = 0;
+
+    // The same as fractions of the buffer period (1.0 = deadline)
+    double meanLoad = 0.0;
+    double p99Load = 0.0;
+    double maxLoad = 0.0;
+
+    /// Mean time per callback in each DspStage
+    std::array<int64_t, kNumDspStages> stageMeanNanos{};
+
+    // Whole device callback, as reported by the host (0 if it does not)
+    int64_t hostMeanNanos = 0;
+    int64_t hostMaxNanos = 0;
+
+    uint64_t callbacks = 0;
+    uint64_t missedDeadlines = 0;   // Callbacks that ran longer than their buffer period
+    uint64_t lateCallbacks = 0;     // Started over 1.5 periods after the previous one
+    int64_t deviceXruns = -1;       // As reported by the audio device (-1 unknown)
+    int64_t maxEverNanos = 0;
+};
+
+/// Per-callback timing for the audio thread.
+///
+/// Callback durations go into a log-linear histogram (8 buckets per octave
+/// of nanoseconds), so p99 costs a bucket walk once per window rather than a
+/// sort, and recording a callback is a handful of adds. Everything is fixed
+/// storage owned by the audio thread; the engine copies status() into the
+/// state it publishes, which is how the numbers reach other threads.
+class DspLoadMeter {
+public:
+    explicit DspLoadMeter(double sampleRate);
+
+    /// Start timing a callback of numSamples (audio thread)
+    void beginCallback(int64_t startNanos, int numSamples);
+
+    /// Add time spent in a stage during the current callback
+    void addStage(DspStage stage, int64_t nanos) {
+        stageNanos_[static_cast<size_t>(stage)] += nanos;
+    }
+
+    /// Charge the time since `sinceNanos` to a stage and return the current
+    /// time, so consecutive stages cost one clock read each
+    int64_t lap(DspStage stage, int64_t sinceNanos) {
+        int64_t now = monotonicNanos();
+        addStage(stage, now - sinceNanos);
+        return now;
+    }
+
+    /// Finish the current callback
+    void endCallback(int64_t endNanos);
+
+    /// Time of the whole device callback that just ran, which includes
+    /// processBlock and whatever the host does around it. deviceXruns is the
+    /// device's own running count, or -1 if it does not keep one.
+    void noteHostCallback(int64_t nanos, int64_t deviceXruns);
+
+    const PerfStatus& status() const { return status_; }
+
+private:
+    static constexpr int kSubBuckets = 8;
+    static constexpr int kOctaves = 48;
+    static constexpr int kBuckets = kSubBuckets * kOctaves;
+
+    static int bucketFor(int64_t nanos);
+    static int64_t bucketUpperNanos(int bucket);
+
+    /// Publish the window into status_ and start a new one
+    void closeWindow();
+
+    int64_t windowLengthSamples_;
+    double nanosPerSample_;
+
+    // Current callback
+    int64_t callbackStart_ = 0;
+    int64_t callbackPeriod_ = 0;
+    bool callbackMissed_ = false;
+    int64_t previousStart_ = -1;
+    int64_t previousPeriod_ = 0;
+    std::array<int64_t, kNumDspStages> stageNanos_{};
+
+    // Current window
+    std::array<uint32_t, kBuckets> histogram_{};
+    int64_t windowSamples_ = 0;
+    int64_t windowCount_ = 0;
+    int64_t windowTotalNanos_ = 0;
+    int64_t windowMaxNanos_ = 0;
+    double windowTotalLoad_ = 0.0;
+    double windowMaxLoad_ = 0.0;
+    std::array<int64_t, kNumDspStages> windowStageNanos_{};
+    int64_t windowHostCount_ = 0;
+    int64_t windowHostTotalNanos_ = 0;
+    int64_t windowHostMaxNanos_ = 0;
+
+    PerfStatus status_;
+};
+
+} // namespace retrospect
@@ -0,0 +1,133 @@
+#include "core/EngineEvent.h"
+#include "core/LoopEngine.h"  // For OpType, opTypeDescription
+#include "core/SessionFile.h"
+
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+
+namespace retrospect {
+
+namespace {
+
+std::string pendingSuffix(Quantize quantize) {
+    if (quantize == Quantize::Free) return "";
+    return std::string(" (pending: ") +
+           (quantize == Quantize::Beat ? "next beat" : "next bar") + ")";
+}
+
+std::string loopName(int index) {
+    return "Loop " + std::to_string(index);
+}
+
+} // namespace
+
+std::string formatEngineEvent(const EngineEvent& ev) {
+    switch (ev.code) {
+        case EngineEventCode::OpScheduled:
+            return opTypeDescription(static_cast<OpType>(ev.detail)) + pendingSuffix(ev.quantize);
+        case EngineEventCode::CaptureScheduled:
+            return "Capture " + std::to_string(ev.detail) + " bar(s) -> " +
+                   loopName(ev.loopIndex) + pendingSuffix(ev.quantize);
+        case EngineEventCode::RecordScheduled:
+            return "Record -> " + loopName(ev.loopIndex) + pendingSuffix(ev.quantize);
+        case EngineEventCode::StopRecordScheduled:
+            return "Stop Record" + pendingSuffix(ev.quantize);
+        case EngineEventCode::PendingCancelled:
+            if (ev.loopIndex >= 0) return loopName(ev.loopIndex) + " pending ops cancelled";
+            return "All pending ops cancelled";
+
+        case EngineEventCode::LoopCleared:
+            return loopName(ev.loopIndex) + " cleared";
+        case EngineEventCode::LoopMuted:
+            return loopName(ev.loopIndex) + " muted";
+        case EngineEventCode::LoopUnmuted:
+            return loopName(ev.loopIndex) + " unmuted";
+        case EngineEventCode::OverdubStarted:
+            return loopName(ev.loopIndex) + " overdub started";
+        case EngineEventCode::OverdubStopped:
+            return loopName(ev.loopIndex) + " overdub stopped";
+        case EngineEventCode::LoopReversed:
+            return loopName(ev.loopIndex) + " reversed";
+        case EngineEventCode::LoopForward:
+            return loopName(ev.loopIndex) + " forward";
+        case EngineEventCode::SpeedChanged:
+            return loopName(ev.loopIndex) + " speed: " + std::to_string(ev.value) + "x";
+        case EngineEventCode::LayersUndone:
+            return loopName(ev.loopIndex) + " " + std::to_string(ev.detail) + " layer(s) undone";
+        case EngineEventCode::LayersRedone:
+            return loopName(ev.loopIndex) + " " + std::to_string(ev.detail) + " layer(s) redone";
+        case EngineEventCode::RecordingStarted:
+            return loopName(ev.loopIndex) + " recording...";
+
+        case EngineEventCode::LoopCaptured: {
+            std::ostringstream msg;
+            msg << "Loop " << ev.loopIndex << " captured ("
+                << static_cast<int>(std::round(ev.value)) << " bars, " << ev.detail << " ch)";
+            return msg.str();
+        }
+        case EngineEventCode::LoopRecorded: {
+            std::ostringstream msg;
+            msg << "Loop " << ev.loopIndex << " recorded ("
+                << std::fixed << std::setprecision(1) << ev.value << " bars, "
+                << ev.detail << " ch)";
+            return msg.str();
+        }
+
+        case EngineEventCode::CaptureNoAudio:
+            return "No audio to capture";
+        case EngineEventCode::CaptureNoLiveChannels:
+            return "No live input channels to capture";
+        case EngineEventCode::CaptureDropped:
+            return "Capture on " + loopName(ev.loopIndex) + " dropped: worker busy";
+        case EngineEventCode::CaptureFailed:
+            return "Capture on " + loopName(ev.loopIndex) +
+                   " failed: history overwritten before it was copied";
+        case EngineEventCode::RecordingCancelled:
+            return "Recording on " + loopName(ev.loopIndex) +
+                   " cancelled: exceeded max length (" + std::to_string(ev.detail) +
+                   " bars at min BPM)";
+        case EngineEventCode::AlreadyRecording:
+            return "Already recording on " + loopName(ev.loopIndex);
+        case EngineEventCode::PreviousRecordingMixing:
+            return "Previous recording still mixing down";
+        case EngineEventCode::NoActiveRecording:
+            return "No active recording";
+        case EngineEventCode::StopRecordIgnored:
+            return "Stop ignored: recording is on " + loopName(ev.loopIndex);
+        case EngineEventCode::NoAudioRecorded:
+            return "No audio recorded";
+        case EngineEventCode::NoActiveChannelsRecorded:
+            return "No active channels recorded";
+        case EngineEventCode::StopRecordDropped:
+            return "Stop Record on " + loopName(ev.loopIndex) + " dropped: worker busy";
+        case EngineEventCode::OverdubInputDropped:
+            return "Overdub on " + loopName(ev.loopIndex) +
+                   " lost input: out of recording buffer space";
+
+        case EngineEventCode::SessionSaved:
+            return "Session saved (" + std::to_string(ev.detail) + " loop(s))";
+        case EngineEventCode::SessionSaveFailed:
+            return std::string("Session save failed: ") +
+                   sessionErrorText(static_cast<SessionError>(ev.detail));
+        case EngineEventCode::SessionLoaded: {
+            std::ostringstream msg;
+            msg << "Session loaded (" << ev.detail << " loop(s), "
+                << std::fixed << std::setprecision(1) << ev.value << " BPM)";
+            return msg.str();
+        }
+        case EngineEventCode::SessionLoadFailed:
+            return std::string("Session load failed: ") +
+                   sessionErrorText(static_cast<SessionError>(ev.detail));
+
+        case EngineEventCode::TimelineJumped: {
+            std::ostringstream msg;
+            msg << "Timeline moved " << std::showpos << std::fixed << std::setprecision(1)
+                << ev.value << " ms to follow the sync leader";
+            return msg.str();
+        }
+    }
+    return "";
+}
+
+} // namespace retrospect
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "core/Metronome.h"  // For Quantize
+
+#include <cstdint>
+#include <string>
+
+namespace retrospect {
+
+/// What happened. Each code documents the EngineEvent fields it uses.
+enum class EngineEventCode : uint16_t {
+    // Command acknowledgements (emitted when the audio thread drains them)
+    OpScheduled,            // detail: OpType, quantize
+    CaptureScheduled,       // detail: lookback bars, quantize
+    RecordScheduled,        // quantize
+    StopRecordScheduled,    // quantize
+    PendingCancelled,       // loopIndex: the loop, or -1 for all loops
+
+    // Ops executed at their boundary (scheduledSample: when they were due)
+    LoopCleared,
+    LoopMuted,
+    LoopUnmuted,
+    OverdubStarted,
+    OverdubStopped,
+    LoopReversed,
+    LoopForward,
+    SpeedChanged,           // value: new speed
+    LayersUndone,           // detail: layer count
+    LayersRedone,           // detail: layer count
+    RecordingStarted,
+
+    // Loop content landed from the worker (scheduledSample: the boundary)
+    LoopCaptured,           // value: bars, detail: channels mixed
+    LoopRecorded,           // value: bars, detail: channels mixed
+
+    // Ops that could not be carried out
+    CaptureNoAudio,
+    CaptureNoLiveChannels,
+    CaptureDropped,         // Worker queue full
+    CaptureFailed,          // History overwritten before the worker copied it
+    RecordingCancelled,     // detail: max length in bars
+    AlreadyRecording,       // loopIndex: the loop being recorded
+    PreviousRecordingMixing,
+    NoActiveRecording,
+    StopRecordIgnored,      // loopIndex: the loop being recorded
+    NoAudioRecorded,
+    NoActiveChannelsRecorded,
+    StopRecordDropped,      // Worker queue full
+    OverdubInputDropped,    // Record pool ran dry: some channels lost input
+
+    // Sessions (see LoopEngine::saveSession and loadSession)
+    SessionSaved,           // detail: loops saved
+    SessionSaveFailed,      // detail: SessionError
+    SessionLoaded,          // detail: loops loaded, value: session tempo
+    SessionLoadFailed,      // detail: SessionError (the loops are unchanged)
+
+    // Network timeline sync (see LoopEngine::syncTimeline)
+    TimelineJumped          // value: ms the metronome moved (later in the bar if positive)
+};
+
+/// A compact, trivially copyable record of something the audio thread did.
+/// Written to a lock-free ring on the audio thread and turned into text (if
+/// at all) by whoever reads it.
+struct EngineEvent {
+    EngineEventCode code = EngineEventCode::OpScheduled;
+    Quantize quantize = Quantize::Free;
+    int loopIndex = -1;
+    int detail = 0;                 // Code-specific integer
+    double value = 0.0;             // Code-specific number
+    int64_t sampleTime = 0;         // Metronome sample when it happened
+    int64_t scheduledSample = -1;   // Sample it was due at, or -1
+
+    /// Samples between when the event was due and when it happened
+    /// (0 if it had no due time)
+    int64_t lateness() const { return scheduledSample < 0 ? 0 : sampleTime - scheduledSample; }
+};
+
+/// Human-readable message for an event (allocates; not for the audio thread)
+std::string formatEngineEvent(const EngineEvent& ev);
+
+} // namespace retrospect
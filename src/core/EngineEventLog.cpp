@@ -0,0 +1,30 @@
+#include "core/EngineEventLog.h"
+
+namespace retrospect {
+
+bool EngineEventLog::push(const EngineEvent& ev) {
+    if (ring_.push(ev)) return true;
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void EngineEventLog::collect() {
+    EngineEvent ev;
+    while (ring_.pop(ev)) {
+        history_[static_cast<size_t>(collected_ % kHistory)] = ev;
+        ++collected_;
+    }
+}
+
+void EngineEventLog::read(uint64_t& cursor, std::vector<EngineEvent>& out) {
+    std::lock_guard<std::mutex> lock(readMutex_);
+    collect();
+    if (collected_ > kHistory && cursor < collected_ - kHistory) {
+        cursor = collected_ - kHistory;
+    }
+    for (; cursor < collected_; ++cursor) {
+        out.push_back(history_[static_cast<size_t>(cursor % kHistory)]);
+    }
+}
+
+} // namespace retrospect
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "core/EngineEvent.h"
+#include "core/SpscQueue.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace retrospect {
+
+/// Engine events, from the audio thread to any number of readers on the
+/// control threads.
+///
+/// The audio thread pushes fixed-size records into a lock-free SPSC ring
+/// (never blocking or allocating; a full ring drops and counts). On a
+/// control thread read() moves them into a history of recent events, and
+/// each reader walks that history with its own cursor, so the TUI client and
+/// the OSC publisher both see every event.
+class EngineEventLog {
+public:
+    /// Record an event (audio thread only). Returns false if it was dropped.
+    bool push(const EngineEvent& ev);
+
+    /// Append every event after `cursor` to `out` and advance `cursor`
+    /// (control threads; readers on different threads take turns). A reader
+    /// that falls more than kHistory events behind skips the oldest ones.
+    /// Start a new reader at cursor 0.
+    void read(uint64_t& cursor, std::vector<EngineEvent>& out);
+
+    /// Events dropped because the ring was full
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kRingCapacity = 1024;
+    static constexpr size_t kHistory = 1024;
+
+    /// Move everything in the ring into history (a reader, under readMutex_)
+    void collect();
+
+    SpscQueue<EngineEvent, kRingCapacity> ring_;
+    std::atomic<uint64_t> dropped_{0};
+
+    // Readers only, under readMutex_
+    std::mutex readMutex_;
+    std::array<EngineEvent, kHistory> history_{};
+    uint64_t collected_ = 0;  // Events moved into history so far
+};
+
+} // namespace retrospect
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "core/Metronome.h"  // For Quantize
+#include "core/Loop.h"       // For LoopState
+#include "core/DspLoadMeter.h" // For PerfStatus
+
+#include <array>
+#include <cstdint>
+
+namespace retrospect {
+
+/// A pending op as published for display, one per occupied PendingState slot
+enum class PendingOpKind : uint8_t {
+    Capture,
+    Record,
+    StopRecord,
+    Mute,
+    Unmute,
+    ToggleMute,
+    StartOverdub,
+    StopOverdub,
+    Reverse,
+    SetSpeed,
+    UndoLayer,
+    RedoLayer,
+    Clear
+};
+
+/// Display name of a pending op
+inline const char* pendingOpName(PendingOpKind kind) {
+    switch (kind) {
+        case PendingOpKind::Capture:      return "Capture Loop";
+        case PendingOpKind::Record:       return "Record";
+        case PendingOpKind::StopRecord:   return "Stop Record";
+        case PendingOpKind::Mute:         return "Mute";
+        case PendingOpKind::Unmute:       return "Unmute";
+        case PendingOpKind::ToggleMute:   return "Toggle Mute";
+        case PendingOpKind::StartOverdub: return "Start Overdub";
+        case PendingOpKind::StopOverdub:  return "Stop Overdub";
+        case PendingOpKind::Reverse:      return "Reverse";
+        case PendingOpKind::SetSpeed:     return "Set Speed";
+        case PendingOpKind::UndoLayer:    return "Undo Layer";
+        case PendingOpKind::RedoLayer:    return "Redo Layer";
+        case PendingOpKind::Clear:        return "Clear";
+    }
+    return "";
+}
+
+struct PendingOpStatus {
+    PendingOpKind kind = PendingOpKind::Capture;
+    Quantize quantize = Quantize::Bar;
+    int count = 1;                  // Undo/redo repeat count
+    int64_t executeSample = 0;
+};
+
+/// One loop as seen by the audio thread at the end of a block
+struct LoopStatus {
+    /// One entry per PendingState slot, so a loop never has more than this
+    static constexpr int kMaxPending = 8;
+
+    LoopState state = LoopState::Empty;
+    double lengthInBars = 0.0;
+    int layers = 0;
+    int activeLayers = 0;
+    double speed = 1.0;
+    bool reversed = false;
+    bool timeStretchActive = false;
+    int64_t playPosition = 0;
+    int64_t lengthSamples = 0;
+    double recordedBpm = 0.0;
+
+    int numPending = 0;             // Ordered for display: capture, record, mute,
+                                    // overdub, reverse, speed, undo, clear
+    std::array<PendingOpStatus, kMaxPending> pending{};
+};
+
+struct MetronomeStatus {
+    int bar = 0;
+    int beat = 0;
+    double beatFraction = 0.0;
+    int64_t totalSamples = 0;
+    double bpm = 120.0;
+    int beatsPerBar = 4;
+    bool running = true;
+};
+
+/// Who reads published engine state (see LoopEngine::readState): each has
+/// its own buffer, so each may be on a thread of its own
+enum class StateReader : uint8_t {
+    Control,    // The main loop: TUI, local client
+    Publisher   // The OSC server's publisher thread
+};
+constexpr size_t kStateReaders = 2;
+
+/// Fixed-size, trivially copyable engine state, published by the audio
+/// thread once per block (see LoopEngine::readState). Control threads read
+/// this instead of touching Loop or Metronome objects the audio thread owns.
+struct EngineState {
+    static constexpr int kMaxLoops = 64;
+    static constexpr int kMaxChannels = 64;
+
+    uint64_t sequence = 0;          // Blocks published so far
+
+    MetronomeStatus metronome;
+
+    int numLoops = 0;
+    int activeLoopCount = 0;
+    std::array<LoopStatus, kMaxLoops> loops{};
+
+    int numChannels = 0;
+    uint64_t liveChannelMask = 0;
+    std::array<float, kMaxChannels> channelPeaks{};
+
+    bool isRecording = false;
+    int recordingLoopIndex = -1;
+
+    // Settings, as the audio thread last saw them
+    Quantize defaultQuantize = Quantize::Bar;
+    int lookbackBars = 1;
+    int maxLookbackBars = 1;
+    bool clickEnabled = true;
+    bool midiSyncEnabled = false;
+    bool midiOutputAvailable = false;
+    float liveThreshold = 0.0f;
+    double sampleRate = 44100.0;
+
+    PerfStatus perf;                // Callback timing, as of the previous block
+};
+
+} // namespace retrospect
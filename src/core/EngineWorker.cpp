@@ -0,0 +1,90 @@
+#include "core/EngineWorker.h"
+
+#include <chrono>
+
+namespace retrospect {
+
+EngineWorker::EngineWorker(Handler handler)
+    : handler_(std::move(handler))
+{
+}
+
+EngineWorker::~EngineWorker() {
+    stop();
+}
+
+void EngineWorker::start() {
+    if (thread_.joinable()) return;
+    stopping_.store(false, std::memory_order_relaxed);
+    thread_ = std::thread([this] { run(); });
+}
+
+void EngineWorker::stop() {
+    if (!thread_.joinable()) return;
+    stopping_.store(true, std::memory_order_release);
+    wakeups_.fetch_add(1, std::memory_order_release);
+    wakeups_.notify_one();
+    thread_.join();
+
+    // Finish anything posted after the worker's last pass
+    runQueued();
+}
+
+bool EngineWorker::post(WorkerJob&& job) {
+    if (!thread_.joinable()) {
+        // What stop() left goes first. A result with nowhere to go would be
+        // lost (a capture's loop would stay loading), so refuse instead.
+        if (!runQueued()) return false;
+        runJob(job);
+        return true;
+    }
+    if (!jobs_.push(std::move(job))) return false;
+    wakeups_.fetch_add(1, std::memory_order_release);
+    wakeups_.notify_one();
+    return true;
+}
+
+bool EngineWorker::poll(WorkerJob& result) {
+    if (!results_.pop(result)) return false;
+    // Inline, what stop() left may fit now
+    if (!thread_.joinable()) runQueued();
+    return true;
+}
+
+void EngineWorker::run() {
+    for (;;) {
+        uint32_t seen = wakeups_.load(std::memory_order_acquire);
+        // The audio thread drains results every sub-block, so a full queue
+        // only means it hasn't run yet; wait rather than drop. Jobs left at
+        // a stop stay queued for stop() to finish.
+        while (!runQueued()) {
+            if (stopping_.load(std::memory_order_acquire)) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (stopping_.load(std::memory_order_acquire)) break;
+        wakeups_.wait(seen, std::memory_order_acquire);
+    }
+}
+
+bool EngineWorker::runQueued() {
+    // A job only runs once its result has room, so no result is dropped
+    WorkerJob job;
+    for (;;) {
+        if (results_.full()) return false;
+        if (!jobs_.pop(job)) return true;
+        runJob(job);
+    }
+}
+
+void EngineWorker::runJob(WorkerJob& job) {
+    handler_(job);
+
+    if (job.type == WorkerJobType::Free) {
+        // Retired buffers are released here, off the audio thread
+        job = WorkerJob{};
+        return;
+    }
+    results_.push(std::move(job));
+}
+
+} // namespace retrospect
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "core/Loop.h"
+#include "core/SampleChunkPool.h"
+#include "core/SessionFile.h"
+#include "core/SpscQueue.h"
+
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <memory>
+
+namespace retrospect {
+
+/// Per-channel overdub storage plus the layer buffer the loop plays while
+/// recording, for one loop length. Channel audio lives in record pool chunks
+/// taken only as a live channel reaches them: `chunks` maps a channel and
+/// chunk-sized stretch of the loop to its pool chunk (kNoChunk until first
+/// written), and `chains` holds each channel's chunks for release. Prepared
+/// off the audio thread so starting an overdub only moves vectors.
+struct OverdubKit {
+    std::vector<uint32_t> chunks;    // [channel * chunksPerChannel + position / chunk size]
+    std::vector<ChunkChain> chains;  // One per channel
+    std::vector<float> layer;
+    int64_t length = 0;
+    int64_t chunksPerChannel = 0;
+
+    bool ready() const { return length > 0 && !chains.empty(); }
+};
+
+/// Kinds of work the audio thread hands to the EngineWorker
+enum class WorkerJobType {
+    Capture,         // Copy + mix live channels out of the ring buffers
+    RecordMixdown,   // Mix a finished classic recording's chunk chains
+    OverdubMixdown,  // Mix an overdub's per-channel chunks into a layer
+    PrepareOverdub,  // Build (or reset) an OverdubKit for a loop length
+    MixCache,        // Pre-sum a loop's layers into its playback cache
+    StretchSource,   // Sum a loop's mix for a stretch cache render
+    StretchRender,   // Stretch a whole loop to the current tempo (stretch worker)
+    SessionSnapshot, // Copy the loops for a session save
+    FoldLayers,      // Fold a loop's oldest layers into its base (undo depth)
+    Peaks,           // Take a loop's waveform peaks from its mix
+    Free             // Recycle or destroy whatever the job carries
+};
+
+/// A unit of background work. The same object travels audio -> worker as the
+/// request and worker -> audio as the result, so nothing is allocated on the
+/// audio thread to post it; heavy payloads only ever move.
+struct WorkerJob {
+    WorkerJobType type = WorkerJobType::Free;
+    int loopIndex = -1;
+    bool ok = true;
+
+    /// Metronome sample the op was quantized to. The result is swapped in
+    /// with playback phase measured from here, so timing is unchanged.
+    int64_t boundarySample = 0;
+    double bpm = 0.0;               // Tempo at the boundary
+    double samplesPerBar = 0.0;     // Bar length at the boundary
+    int liveCount = 0;              // Channels included in the mix
+
+    // Channel selection (bit N = include channel N)
+    uint64_t channelMask = 0;
+    bool allChannels = false;       // Threshold disabled: include every channel
+
+    // Capture: ring buffer region, relative to the write head at writtenAt
+    int64_t samplesAgo = 0;
+    int64_t writtenAt = 0;
+
+    // Capture / RecordMixdown: loop length; RecordMixdown: recorded length
+    int64_t length = 0;
+    int64_t trimFront = 0;          // RecordMixdown: latency-compensation trim
+    std::vector<ChunkChain> chains; // RecordMixdown: per-channel recordings
+
+    // OverdubMixdown: target layer, valid while the loop's content generation
+    // is unchanged. Capture / RecordMixdown: the engine's session load count,
+    // so a result from before a load is dropped.
+    int layerIndex = -1;
+    uint64_t generation = 0;
+
+    int foldLayers = 0;             // FoldLayers: layers above the base folded
+
+    OverdubKit kit;                 // OverdubMixdown / PrepareOverdub
+    MixCachePlan mixPlan;           // MixCache / FoldLayers / Peaks
+    StretchCachePlan stretchPlan;   // StretchSource / StretchRender
+    std::vector<float> audio;       // OverdubMixdown / MixCache / Stretch* / FoldLayers result
+    std::unique_ptr<SessionPlan> session;  // SessionSnapshot (comes back for reuse)
+    LoopStorage storage;            // Capture / RecordMixdown result, FoldLayers' folded layers, or Free
+};
+
+/// Non-realtime engine worker thread.
+///
+/// The audio thread posts WorkerJobs through a lock-free SPSC queue; the
+/// worker runs them with the engine-supplied handler and, for jobs that
+/// produce something, passes them back through a second SPSC queue that the
+/// audio thread polls. Free jobs end on the worker, which is where buffers
+/// retired by the audio thread get recycled or deallocated.
+///
+/// When not started (or after stop()), post() runs the handler inline, which
+/// gives deterministic, zero-latency results for offline rendering.
+class EngineWorker {
+public:
+    using Handler = std::function<void(WorkerJob&)>;
+
+    explicit EngineWorker(Handler handler);
+    ~EngineWorker();
+
+    EngineWorker(const EngineWorker&) = delete;
+    EngineWorker& operator=(const EngineWorker&) = delete;
+
+    /// Start the worker thread (no-op if already running)
+    void start();
+
+    /// Stop and join the worker thread. Jobs still queued are run inline,
+    /// as far as the result queue has room; the rest run ahead of the next
+    /// inline post or poll. Call while the audio thread is not posting.
+    void stop();
+
+    bool isRunning() const { return thread_.joinable(); }
+
+    /// Hand a job to the worker (audio thread only). Returns false, leaving
+    /// the job with the caller, if the queue is full (or, inline, if the
+    /// result queue is).
+    bool post(WorkerJob&& job);
+
+    /// Take the next finished job (audio thread only)
+    bool poll(WorkerJob& result);
+
+private:
+    static constexpr size_t kQueueCapacity = 64;
+
+    void run();
+    /// Run queued jobs while their results have room. Returns false if
+    /// jobs may be left (the result queue filled).
+    bool runQueued();
+    /// Run the handler and queue the result, which must have room
+    void runJob(WorkerJob& job);
+
+    Handler handler_;
+    SpscQueue<WorkerJob, kQueueCapacity> jobs_;
+    SpscQueue<WorkerJob, kQueueCapacity> results_;
+    std::atomic<uint32_t> wakeups_{0};
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+} // namespace retrospect
@@ -1,40 +1,76 @@
 #include "core/InputChannel.h"
+#include "core/SimdKernels.h"
 
 #include <algorithm>
 #include <cmath>
 
 namespace retrospect {
 
-InputChannel::InputChannel(int64_t ringCapacity, int activityWindowSamples)
-    : ringBuffer_(ringCapacity)
-    , blockPeaks_(static_cast<size_t>(
-          std::max(1, activityWindowSamples / kBlockSize)), 0.0f)
+InputChannel::InputChannel(int64_t ringCapacity, int activityWindowSamples,
+                           SampleFormat format)
+    : ringBuffer_(ringCapacity, format)
+    , windowBlocks_(std::max(1, activityWindowSamples / kBlockSize))
+    , queuePeaks_(static_cast<size_t>(windowBlocks_), 0.0f)
+    , queueBlocks_(static_cast<size_t>(windowBlocks_), 0)
 {
 }
 
 void InputChannel::writeSample(float sample) {
-    ringBuffer_.write(&sample, 1);
+    writeBlock(&sample, 1);
+}
 
-    float absSample = std::abs(sample);
-    if (absSample > currentBlockPeak_) {
-        currentBlockPeak_ = absSample;
-    }
+float InputChannel::writeBlock(const float* data, int numSamples) {
+    if (numSamples <= 0) return 0.0f;
+
+    ringBuffer_.write(data, numSamples);
 
-    if (++sampleInBlock_ >= kBlockSize) {
-        // Store completed block's peak
-        blockPeaks_[static_cast<size_t>(blockWritePos_)] = currentBlockPeak_;
-        blockWritePos_ = (blockWritePos_ + 1) %
-                         static_cast<int>(blockPeaks_.size());
+    // Peak-track a tracker block (or what is left of it) at a time. Within
+    // a span cachedPeak_ stays put and the block peak only grows, so the
+    // highest peakLevel() seen is the level at the end of the span, or the
+    // old window peak if a block completed after more than one sample.
+    float maxPeak = 0.0f;
+    int done = 0;
+    while (done < numSamples) {
+        int span = std::min(kBlockSize - sampleInBlock_, numSamples - done);
+        currentBlockPeak_ = std::max(currentBlockPeak_,
+                                     simd::absMax(data + done, static_cast<size_t>(span)));
+        sampleInBlock_ += span;
+        done += span;
 
-        // Recompute cached peak from all stored block peaks
-        cachedPeak_ = 0.0f;
-        for (float p : blockPeaks_) {
-            if (p > cachedPeak_) cachedPeak_ = p;
+        if (sampleInBlock_ >= kBlockSize) {
+            if (span > 1) maxPeak = std::max(maxPeak, cachedPeak_);
+            pushBlockPeak(currentBlockPeak_);
+            currentBlockPeak_ = 0.0f;
+            sampleInBlock_ = 0;
         }
+        maxPeak = std::max(maxPeak, peakLevel());
+    }
+    return maxPeak;
+}
 
-        currentBlockPeak_ = 0.0f;
-        sampleInBlock_ = 0;
+void InputChannel::pushBlockPeak(float peak) {
+    int capacity = windowBlocks_;
+    int64_t block = blocksDone_++;
+
+    // Earlier peaks no larger than this one can never be the maximum again
+    while (queueSize_ > 0) {
+        int back = (queueHead_ + queueSize_ - 1) % capacity;
+        if (queuePeaks_[static_cast<size_t>(back)] > peak) break;
+        --queueSize_;
+    }
+    // The oldest entry leaves once windowBlocks_ newer blocks have completed
+    if (queueSize_ > 0 &&
+        queueBlocks_[static_cast<size_t>(queueHead_)] <= block - capacity) {
+        queueHead_ = (queueHead_ + 1) % capacity;
+        --queueSize_;
     }
+
+    int slot = (queueHead_ + queueSize_) % capacity;
+    queuePeaks_[static_cast<size_t>(slot)] = peak;
+    queueBlocks_[static_cast<size_t>(slot)] = block;
+    ++queueSize_;
+
+    cachedPeak_ = queuePeaks_[static_cast<size_t>(queueHead_)];
 }
 
 float InputChannel::peakLevel() const {
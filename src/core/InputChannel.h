@@ -14,16 +14,25 @@ namespace retrospect {
 /// Activity is tracked using a block-based peak tracker: the activity window
 /// is divided into small blocks, each storing the peak absolute sample value.
 /// A channel is considered "live" if the peak over the entire window exceeds
-/// a configurable threshold.
+/// a configurable threshold. The window peak is kept in a monotonic queue of
+/// block peaks, so it costs O(1) amortized per completed block however long
+/// the window is.
 class InputChannel {
 public:
     /// @param ringCapacity  Ring buffer capacity in samples
     /// @param activityWindowSamples  Activity detection window size in samples
-    InputChannel(int64_t ringCapacity, int activityWindowSamples);
+    /// @param format  How the ring buffer stores samples
+    InputChannel(int64_t ringCapacity, int activityWindowSamples,
+                 SampleFormat format = SampleFormat::Float32);
 
     /// Write a single sample. Updates the ring buffer and peak tracker.
     void writeSample(float sample);
 
+    /// Write a block of samples. Updates the ring buffer and peak tracker.
+    /// Returns the highest peakLevel() observed after any sample of the block,
+    /// so callers can tell whether the channel was live at any point in it.
+    float writeBlock(const float* data, int numSamples);
+
     /// Current peak level over the activity window.
     float peakLevel() const;
 
@@ -36,17 +45,28 @@ public:
     const RingBuffer& ringBuffer() const { return ringBuffer_; }
 
 private:
+    /// Add a completed block's peak to the window and drop expired ones
+    void pushBlockPeak(float peak);
+
     RingBuffer ringBuffer_;
 
     // Block-based peak tracking.
     // The activity window is divided into blocks of kBlockSize samples.
     // Each block stores the peak |sample| encountered during that block.
     static constexpr int kBlockSize = 64;
-    std::vector<float> blockPeaks_;   // Circular buffer of block peaks
-    int blockWritePos_ = 0;
+    int windowBlocks_;                // Completed blocks the window covers
     float currentBlockPeak_ = 0.0f;   // Peak of the current (partial) block
     int sampleInBlock_ = 0;
-    float cachedPeak_ = 0.0f;         // Cached max of all stored block peaks
+    float cachedPeak_ = 0.0f;         // Max of the block peaks in the window
+
+    // Monotonic queue: block peaks in the window that no later block peak
+    // matches or beats, oldest (and largest) first. A ring of windowBlocks_
+    // entries, which is as many as it can ever hold.
+    std::vector<float> queuePeaks_;
+    std::vector<int64_t> queueBlocks_;  // Block number of each entry
+    int queueHead_ = 0;
+    int queueSize_ = 0;
+    int64_t blocksDone_ = 0;
 };
 
 } // namespace retrospect
@@ -1,33 +1,528 @@
 #include "core/Loop.h"
 #include "core/TimeStretcher.h"
+#include "core/SimdKernels.h"
+#include "core/MonotonicClock.h"
 #include <cmath>
 #include <algorithm>
 #include <numeric>
+#include <bit>
+#include <iterator>
 
 namespace retrospect {
 
+namespace {
+
+uint64_t layerBit(int index) {
+    return index >= 0 && index < kMaxCachedLayers ? (uint64_t(1) << index) : 0;
+}
+
+// Same gains as Loop::crossfadeGain over positions [first, first + count) of
+// a loop, one ramp per boundary region touched
+void applyBoundaryCrossfade(float* data, int64_t first, int64_t count,
+                            int64_t loopLength, int crossfadeSamples) {
+    if (crossfadeSamples <= 0 || loopLength <= int64_t(crossfadeSamples) * 2) return;
+
+    int64_t fade = crossfadeSamples;
+    float divisor = static_cast<float>(crossfadeSamples);
+    int64_t last = first + count;
+
+    // Fade in over [0, fade): gain = pos / fade
+    if (first < fade) {
+        int64_t n = std::min(last, fade) - first;
+        simd::multiplyRamp(data, static_cast<size_t>(n),
+                           static_cast<float>(first), 1.0f, divisor);
+    }
+    // Fade out over [length - fade, length): gain = (length - 1 - pos) / fade
+    int64_t fadeOutStart = loopLength - fade;
+    if (last > fadeOutStart) {
+        int64_t from = std::max(first, fadeOutStart);
+        simd::multiplyRamp(data + (from - first), static_cast<size_t>(last - from),
+                           static_cast<float>(loopLength - 1 - from), -1.0f, divisor);
+    }
+}
+
+// Input samples between feeding the stretcher and hearing the result
+double stretchLatency(const StretchKit& kit, double ratio) {
+    return kit.stretcher->inputLatency() + kit.stretcher->outputLatency() * ratio;
+}
+
+} // namespace
+
+LoopStorage::LoopStorage() = default;
+LoopStorage::~LoopStorage() = default;
+LoopStorage::LoopStorage(LoopStorage&&) noexcept = default;
+LoopStorage& LoopStorage::operator=(LoopStorage&&) noexcept = default;
+
 Loop::Loop() = default;
 Loop::~Loop() = default;
 Loop::Loop(Loop&&) noexcept = default;
 Loop& Loop::operator=(Loop&&) noexcept = default;
 
-void Loop::loadFromCapture(std::vector<float> audio) {
-    clear();
-    loopLength_ = static_cast<int64_t>(audio.size());
-    layers_.push_back({std::move(audio), 1.0f, true});
+LoopStorage Loop::prepareStorage(std::vector<float> audio) {
+    LoopStorage storage;
+    storage.layers.reserve(static_cast<size_t>(kReservedLayers));
+    storage.layers.push_back({std::move(audio), 1.0f, true});
+    return storage;
+}
+
+LoopStorage Loop::prepareStorage(std::vector<LoopLayer> layers) {
+    LoopStorage storage;
+    storage.layers = std::move(layers);
+    storage.layers.reserve(std::max(storage.layers.size(), static_cast<size_t>(kReservedLayers)));
+    return storage;
+}
+
+LoopStorage Loop::load(LoopStorage storage) {
+    LoopStorage previous = clear();
+    if (storage.layers.empty()) return previous;
+
+    layers_ = std::move(storage.layers);
+    mixCache_ = std::move(storage.mixCache);
+    mixCacheMask_ = 0;
+
+    loopLength_ = static_cast<int64_t>(layers_.front().audio.size());
     state_ = LoopState::Playing;
     playPos_ = 0;
     fractionalPos_ = 0.0;
+    stretchBufRead_ = 0;
+    stretchBufAvail_ = 0;
+    stretchRawPos_ = 0;
+    mixChanged();
+    return previous;
+}
 
-    // Pre-allocate stretch resources so we don't allocate during playback
-    stretcher_ = std::make_unique<TimeStretcher>();
-    stretcher_->configure(sampleRate_);
-    stretchBuf_.resize(static_cast<size_t>(kStretchBufCapacity), 0.0f);
-    stretchInputWork_.resize(static_cast<size_t>(kMaxStretchInput), 0.0f);
-    stretchOutputWork_.resize(static_cast<size_t>(kStretchBlockSize), 0.0f);
+void Loop::preview(const LoopSource* source, int64_t length) {
+    if (!source || length <= 0 || !layers_.empty()) return;
+    source_ = source;
+    loopLength_ = length;
+    state_ = LoopState::Playing;
+    playPos_ = 0;
+    fractionalPos_ = 0.0;
     stretchBufRead_ = 0;
     stretchBufAvail_ = 0;
     stretchRawPos_ = 0;
+    mixChanged();
+}
+
+void Loop::skipAhead(int64_t numSamples) {
+    if (loopLength_ <= 0 || numSamples <= 0) return;
+    // Called on the audio thread with however long the content took to
+    // arrive, so it can't step sample by sample. At unit speed each sample
+    // advances exactly one and the fraction stays as it is.
+    if (speed_ == 1.0) {
+        playPos_ = (playPos_ + numSamples % loopLength_) % loopLength_;
+        return;
+    }
+    // Otherwise in one go; the fraction left differs from stepping only by
+    // rounding
+    double total = fractionalPos_ + static_cast<double>(numSamples) * speed_;
+    double whole = std::floor(total);
+    fractionalPos_ = total - whole;
+    auto advance = static_cast<int64_t>(std::fmod(whole, static_cast<double>(loopLength_)));
+    playPos_ = (playPos_ + advance) % loopLength_;
+}
+
+std::vector<float> Loop::swapLayerAudio(int index, std::vector<float> audio) {
+    if (index < 0 || index >= static_cast<int>(layers_.size())) return audio;
+    auto& layer = layers_[static_cast<size_t>(index)];
+    if (audio.size() != layer.audio.size()) return audio;
+    std::swap(layer.audio, audio);
+    if (silentLayer_ == index) silentLayer_ = -1;
+    layerContentChanged(index);
+    return audio;
+}
+
+void Loop::setLayerGain(int index, float gain) {
+    if (index < 0 || index >= static_cast<int>(layers_.size())) return;
+    auto& layer = layers_[static_cast<size_t>(index)];
+    if (layer.gain == gain) return;
+    layer.gain = gain;
+    layerContentChanged(index);
+}
+
+bool Loop::mixLayerMask(uint64_t& mask) const {
+    mask = 0;
+    if (layers_.size() > static_cast<size_t>(kMaxCachedLayers)) return false;
+    for (int i = 0; i < static_cast<int>(layers_.size()); ++i) {
+        if (layers_[static_cast<size_t>(i)].active && i != silentLayer_) {
+            mask |= layerBit(i);
+        }
+    }
+    return true;
+}
+
+void Loop::refreshMixSource() {
+    mixSource_ = nullptr;
+    uint64_t mask = 0;
+    if (!mixLayerMask(mask) || mask == 0) return;
+
+    // A lone unity-gain layer already is the mix
+    if (std::has_single_bit(mask)) {
+        const auto& layer = layers_[static_cast<size_t>(std::countr_zero(mask))];
+        if (layer.gain == 1.0f) {
+            mixSource_ = layer.audio.data();
+            return;
+        }
+    }
+    if (mixCacheMask_ == mask && !mixCache_.empty()) {
+        mixSource_ = mixCache_.data();
+    }
+}
+
+void Loop::mixChanged() {
+    ++mixGeneration_;
+    refreshMixSource();
+    retireStretchCache();
+}
+
+void Loop::layerContentChanged(int index) {
+    if (index >= kMaxCachedLayers || (mixCacheMask_ & layerBit(index))) {
+        mixCacheMask_ = 0;
+    }
+    mixChanged();
+}
+
+bool Loop::needsMixCache() const {
+    if (mixSource_ || mixPendingGeneration_ == mixGeneration_) return false;
+    uint64_t mask = 0;
+    return mixLayerMask(mask) && mask != 0;
+}
+
+bool Loop::planMixCache(MixCachePlan& plan) {
+    if (!needsMixCache()) return false;
+
+    uint64_t mask = 0;
+    mixLayerMask(mask);
+    plan.generation = mixGeneration_;
+    plan.layerMask = mask;
+    plan.length = loopLength_;
+    plan.numLayers = 0;
+    plan.base = nullptr;
+
+    // Extend the current cache if every layer it lacks sits above all the
+    // layers it has (summation order is then the same as a full rebuild).
+    // Otherwise start from the lowest layer, or from silence if it is gained.
+    uint64_t remaining = mask;
+    uint64_t cached = mixCacheMask_;
+    uint64_t belowTop = cached ? (std::bit_width(cached) >= 64
+                                      ? ~uint64_t(0)
+                                      : (uint64_t(1) << std::bit_width(cached)) - 1)
+                               : 0;
+    if (cached != 0 && !mixCache_.empty() && (cached & ~mask) == 0 &&
+        (mask & ~cached & belowTop) == 0) {
+        plan.base = mixCache_.data();
+        remaining = mask & ~cached;
+    } else {
+        int lowest = std::countr_zero(mask);
+        const auto& layer = layers_[static_cast<size_t>(lowest)];
+        if (layer.gain == 1.0f) {
+            plan.base = layer.audio.data();
+            remaining = mask & ~layerBit(lowest);
+        }
+    }
+
+    while (remaining != 0) {
+        int i = std::countr_zero(remaining);
+        remaining &= remaining - 1;
+        const auto& layer = layers_[static_cast<size_t>(i)];
+        plan.layers[static_cast<size_t>(plan.numLayers++)] = {layer.audio.data(), layer.gain};
+    }
+
+    mixPendingGeneration_ = mixGeneration_;
+    return true;
+}
+
+bool Loop::needsPeaks() const {
+    if (peaksGeneration_ == mixGeneration_) return false;
+    if (isEmpty() || isPreview() || mixSource_) return true;
+    // Every layer undone: the mix is silence. Otherwise the cache is still
+    // being built, or can't cover this many layers (the peaks stay as they were)
+    uint64_t mask = 0;
+    return mixLayerMask(mask) && mask == 0;
+}
+
+bool Loop::planPeaks(MixCachePlan& plan) {
+    if (!needsPeaks()) return false;
+    plan.generation = mixGeneration_;
+    plan.layerMask = 0;
+    plan.length = (isEmpty() || isPreview()) ? 0 : loopLength_;
+    plan.base = mixSource_;
+    plan.numLayers = 0;
+    peaksGeneration_ = mixGeneration_;
+    return true;
+}
+
+std::vector<float> Loop::buildMixCache(const MixCachePlan& plan) {
+    std::vector<float> cache(static_cast<size_t>(plan.length), 0.0f);
+    sumMix(plan, cache.data());
+    return cache;
+}
+
+void Loop::sumMix(const MixCachePlan& plan, float* out) {
+    size_t len = static_cast<size_t>(plan.length);
+    if (plan.base) {
+        std::copy(plan.base, plan.base + len, out);
+    } else {
+        std::fill(out, out + len, 0.0f);
+    }
+    // Same expression as getMixedSample, so the sums are bit-identical
+    for (int l = 0; l < plan.numLayers; ++l) {
+        const LayerRef& ref = plan.layers[static_cast<size_t>(l)];
+        simd::addScaled(out, ref.audio, ref.gain, len);
+    }
+}
+
+std::vector<float> Loop::installMixCache(uint64_t generation, uint64_t layerMask,
+                                         std::vector<float> cache) {
+    if (generation != mixGeneration_ ||
+        static_cast<int64_t>(cache.size()) != loopLength_) {
+        return cache;
+    }
+    std::swap(mixCache_, cache);
+    mixCacheMask_ = layerMask;
+    refreshMixSource();
+    return cache;
+}
+
+bool Loop::needsStretchCache() const {
+    if (!isTimeStretchActive() || loopLength_ <= 0) return false;
+    if (cacheRetire_ > 0) return false;  // Until the live stretcher has taken over
+    if (stretchPendingGeneration_ == mixGeneration_ && stretchPendingBpm_ == currentBpm_) {
+        return false;
+    }
+    if (stretchCacheActive_ && cacheRetire_ == 0 &&
+        cacheMixGeneration_ == mixGeneration_ && cacheBpm_ == currentBpm_) {
+        return false;
+    }
+    uint64_t mask = 0;
+    return mixLayerMask(mask) && mask != 0;
+}
+
+bool Loop::planStretchCache(StretchCachePlan& plan) {
+    if (!needsStretchCache()) return false;
+
+    uint64_t mask = 0;
+    mixLayerMask(mask);
+    MixCachePlan& mix = plan.mix;
+    mix.generation = mixGeneration_;
+    mix.layerMask = mask;
+    mix.length = loopLength_;
+    mix.numLayers = 0;
+
+    // The source is whatever playback reads: the single mix buffer if there
+    // is one, otherwise every contributing layer
+    mix.base = mixSource_;
+    if (!mixSource_) {
+        uint64_t remaining = mask;
+        while (remaining != 0) {
+            int i = std::countr_zero(remaining);
+            remaining &= remaining - 1;
+            const auto& layer = layers_[static_cast<size_t>(i)];
+            mix.layers[static_cast<size_t>(mix.numLayers++)] = {layer.audio.data(), layer.gain};
+        }
+    }
+
+    plan.contentGeneration = contentGeneration_;
+    plan.recordedBpm = recordedBpm_;
+    plan.currentBpm = currentBpm_;
+    plan.crossfadeSamples = crossfadeSamples_;
+
+    stretchPendingGeneration_ = mixGeneration_;
+    stretchPendingBpm_ = currentBpm_;
+    return true;
+}
+
+void Loop::cancelStretchCachePlan(const StretchCachePlan& plan) {
+    if (stretchPendingGeneration_ == plan.mix.generation &&
+        stretchPendingBpm_ == plan.currentBpm) {
+        stretchPendingGeneration_ = kNoGeneration;
+    }
+}
+
+bool Loop::stretchPlanCurrent(const StretchCachePlan& plan) const {
+    return isTimeStretchActive() &&
+           plan.contentGeneration == contentGeneration_ &&
+           plan.mix.generation == mixGeneration_ &&
+           plan.mix.length == loopLength_ &&
+           plan.recordedBpm == recordedBpm_ &&
+           plan.currentBpm == currentBpm_;
+}
+
+std::vector<float> Loop::buildStretchSource(const StretchCachePlan& plan) {
+    std::vector<float> source = buildMixCache(plan.mix);
+    applyBoundaryCrossfade(source.data(), 0, plan.mix.length, plan.mix.length,
+                           plan.crossfadeSamples);
+    return source;
+}
+
+bool Loop::renderStretchCache(std::vector<float>& audio, const StretchCachePlan& plan,
+                              TimeStretcher& stretcher,
+                              const std::atomic<uint64_t>& tempoGeneration) {
+    int64_t length = static_cast<int64_t>(audio.size());
+    if (length <= 0 || plan.recordedBpm <= 0.0 || plan.currentBpm <= 0.0) return false;
+    if (!stretcher.isConfigured()) return false;
+
+    double ratio = std::clamp(plan.currentBpm / plan.recordedBpm, 0.25, 4.0);
+    int64_t outLength = std::max<int64_t>(1, std::llround(static_cast<double>(length) / ratio));
+
+    // Output sample j comes from input j * ratio - latency. The stream starts
+    // far enough before position 0 (on the loop's tail, as it would live) for
+    // the stretcher to have settled by the first sample kept, and the first
+    // `skip` output samples are dropped so the cache starts on position 0.
+    stretcher.reset();
+    double latency = stretcher.inputLatency() + stretcher.outputLatency() * ratio;
+    int64_t skip = static_cast<int64_t>(std::ceil((latency + stretcher.inputLatency()) / ratio));
+    int64_t readPos = std::llround(latency - static_cast<double>(skip) * ratio) % length;
+    if (readPos < 0) readPos += length;
+
+    std::vector<float> result(static_cast<size_t>(outLength), 0.0f);
+    std::vector<float> input(static_cast<size_t>(kMaxStretchInput), 0.0f);
+    std::vector<float> output(static_cast<size_t>(kStretchBlockSize), 0.0f);
+    int64_t total = skip + outLength;
+    int64_t produced = 0;
+    int64_t fed = 0;
+    for (int block = 0; produced < total; ++block) {
+        if ((block & 15) == 15 &&
+            tempoGeneration.load(std::memory_order_relaxed) != plan.tempoGeneration) {
+            return false;
+        }
+
+        // Exact input count so far, rather than the live stretcher's
+        // per-block ceiling, so the cache wraps where the loop does
+        int64_t wanted = std::llround(static_cast<double>(produced + kStretchBlockSize) * ratio);
+        int inputCount = static_cast<int>(std::clamp<int64_t>(wanted - fed, 1, kMaxStretchInput));
+        for (int i = 0; i < inputCount; ++i) {
+            input[static_cast<size_t>(i)] = audio[static_cast<size_t>(readPos)];
+            if (++readPos == length) readPos = 0;
+        }
+        fed += inputCount;
+
+        stretcher.process(input.data(), inputCount, output.data(), kStretchBlockSize);
+        for (int i = 0; i < kStretchBlockSize; ++i) {
+            int64_t j = produced + i - skip;
+            if (j >= 0 && j < outLength) {
+                result[static_cast<size_t>(j)] = output[static_cast<size_t>(i)];
+            }
+        }
+        produced += kStretchBlockSize;
+    }
+
+    audio = std::move(result);
+    return true;
+}
+
+std::vector<float> Loop::installStretchCache(const StretchCachePlan& plan,
+                                             std::vector<float> cache) {
+    // While a retired cache hands over, the live stretcher is still warming
+    // up; the engine asks again once it has taken over
+    if (!stretchPlanCurrent(plan) || cache.empty() || cacheRetire_ > 0) return cache;
+
+    int64_t cacheLength = static_cast<int64_t>(cache.size());
+    if (stretchCacheActive_) {
+        // An identical render of the same mix and tempo: keep the position
+        if (cacheLength == static_cast<int64_t>(stretchCache_.size())) {
+            std::swap(stretchCache_, cache);
+        }
+        return cache;
+    }
+
+    // Start where the live output is now: the raw position fed to the
+    // stretcher, less what sits in its buffer and its latency
+    double heard = static_cast<double>(playPos_);
+    if (kit_) {
+        double ratio = tempoRatio();
+        heard = static_cast<double>(stretchRawPos_) -
+                static_cast<double>(stretchBufAvail_) * ratio - stretchLatency(*kit_, ratio);
+    }
+    int64_t pos = std::llround(heard * static_cast<double>(cacheLength) /
+                               static_cast<double>(loopLength_)) % cacheLength;
+    if (pos < 0) pos += cacheLength;
+
+    std::swap(stretchCache_, cache);
+    stretchCacheActive_ = true;
+    cachePos_ = pos;
+    cacheFraction_ = 0.0;
+    cacheFadeIn_ = kStretchCacheFade;
+    cacheRetire_ = 0;
+    cacheMixGeneration_ = plan.mix.generation;
+    cacheBpm_ = plan.currentBpm;
+    return cache;
+}
+
+double Loop::tempoRatio() const {
+    return std::clamp(currentBpm_ / recordedBpm_, 0.25, 4.0);
+}
+
+int64_t Loop::cachedRawPosition() const {
+    int64_t cacheLength = static_cast<int64_t>(stretchCache_.size());
+    if (cacheLength <= 0 || loopLength_ <= 0) return 0;
+    return cachePos_ * loopLength_ / cacheLength % loopLength_;
+}
+
+void Loop::restartLiveStretch(int64_t rawPos) {
+    rawPos %= loopLength_;
+    stretchRawPos_ = rawPos < 0 ? rawPos + loopLength_ : rawPos;
+    stretchBufRead_ = 0;
+    stretchBufAvail_ = 0;
+    fractionalPos_ = 0.0;
+    if (kit_) kit_->stretcher->reset();
+}
+
+void Loop::releaseStretcher() {
+    if (!kit_) return;
+    if (stretcherPool_) stretcherPool_->release(kit_);
+    kit_ = nullptr;
+}
+
+void Loop::updateStretcherLease() {
+    if (!stretcherPool_) return;
+    if (kit_) {
+        if (!isTimeStretchActive() || isStretchCached()) releaseStretcher();
+        return;
+    }
+    // Playing unstretched for want of a stretcher: take one that has freed up
+    if (isTimeStretchActive() && !stretchCacheActive_) {
+        kit_ = stretcherPool_->lease();
+        if (kit_) restartLiveStretch(playPos_);
+    }
+}
+
+void Loop::retireStretchCache() {
+    if (!stretchCacheActive_) return;
+    int64_t raw = cachedRawPosition();
+
+    if (!isTimeStretchActive()) {
+        // Back at the recorded tempo: direct playback carries on from here
+        stretchCacheActive_ = false;
+        cacheFadeIn_ = 0;
+        cacheRetire_ = 0;
+        playPos_ = raw;
+        fractionalPos_ = 0.0;
+        releaseStretcher();
+        return;
+    }
+    if (cacheRetire_ > 0) return;
+
+    cacheFadeIn_ = 0;
+    if (!kit_ && stretcherPool_) kit_ = stretcherPool_->lease();
+    if (!kit_) {
+        // No stretcher free: fade to unstretched playback from here
+        playPos_ = raw;
+        fractionalPos_ = 0.0;
+        cacheRetire_ = kStretchCacheFade;
+        return;
+    }
+
+    // Pick the feed position so that after `warm` samples, past the
+    // stretcher's latency, the live output reaches the raw position the
+    // cache will have reached (the two may run at different tempos)
+    double cacheRatio = static_cast<double>(loopLength_) /
+                        static_cast<double>(stretchCache_.size());
+    double ratio = tempoRatio();
+    double latency = stretchLatency(*kit_, ratio);
+    int warm = static_cast<int>(std::ceil(latency / (ratio * speed_))) + kStretchBlockSize;
+    restartLiveStretch(raw + std::llround(warm * speed_ * (cacheRatio - ratio) + latency));
+    cacheRetire_ = warm + kStretchCacheFade;
 }
 
 void Loop::addLayer(std::vector<float> audio) {
@@ -35,6 +530,7 @@ void Loop::addLayer(std::vector<float> audio) {
     // Resize to match loop length
     audio.resize(static_cast<size_t>(loopLength_), 0.0f);
     layers_.push_back({std::move(audio), 1.0f, true});
+    mixChanged();
 }
 
 void Loop::undoLayer() {
@@ -42,6 +538,7 @@ void Loop::undoLayer() {
     for (int i = static_cast<int>(layers_.size()) - 1; i > 0; --i) {
         if (layers_[static_cast<size_t>(i)].active) {
             layers_[static_cast<size_t>(i)].active = false;
+            mixChanged();
             return;
         }
     }
@@ -52,13 +549,97 @@ void Loop::redoLayer() {
     for (size_t i = 1; i < layers_.size(); ++i) {
         if (!layers_[i].active) {
             layers_[i].active = true;
+            mixChanged();
             return;
         }
     }
 }
 
+bool Loop::planConsolidation(int maxLayers, MixCachePlan& plan, int& foldLayers) {
+    if (maxLayers <= 0 || consolidationPending_ || silentLayer_ >= 0 ||
+        state_ == LoopState::Empty || state_ == LoopState::Recording) {
+        return false;
+    }
+    int excess = static_cast<int>(layers_.size()) - 1 - maxLayers;
+    if (excess <= 0) return false;
+    // One plan holds at most kMaxCachedLayers layers; a longer backlog (a
+    // restored session, a lowered depth) folds over several passes
+    foldLayers = std::min(excess, kMaxCachedLayers - 1);
+
+    plan.generation = mixGeneration_;
+    plan.layerMask = 0;
+    plan.length = loopLength_;
+    plan.numLayers = 0;
+    plan.base = nullptr;
+
+    // The base is always active; sum it the way the mix cache would
+    for (int i = 0; i <= foldLayers; ++i) {
+        const auto& layer = layers_[static_cast<size_t>(i)];
+        if (!layer.active) continue;
+        plan.layerMask |= layerBit(i);
+        if (i == 0 && layer.gain == 1.0f) {
+            plan.base = layer.audio.data();
+        } else {
+            plan.layers[static_cast<size_t>(plan.numLayers++)] = {layer.audio.data(), layer.gain};
+        }
+    }
+
+    consolidationPending_ = true;
+    return true;
+}
+
+bool Loop::applyConsolidation(uint64_t generation, int foldLayers, std::vector<float>& base,
+                              std::vector<LoopLayer>& removed) {
+    consolidationPending_ = false;
+    if (generation != mixGeneration_ || silentLayer_ >= 0 || state_ == LoopState::Recording ||
+        foldLayers <= 0 || foldLayers >= static_cast<int>(layers_.size()) ||
+        static_cast<int64_t>(base.size()) != loopLength_ ||
+        removed.capacity() - removed.size() < static_cast<size_t>(foldLayers)) {
+        return false;
+    }
+
+    // The mix cache still holds the same sum if it had exactly the folded
+    // layers that played; their bits collapse into the base's
+    uint64_t folded = foldLayers + 1 >= 64 ? ~uint64_t(0)
+                                           : (uint64_t(1) << (foldLayers + 1)) - 1;
+    uint64_t playing = 0;
+    for (int i = 0; i <= foldLayers; ++i) {
+        if (layers_[static_cast<size_t>(i)].active) playing |= layerBit(i);
+    }
+    uint64_t cacheMask = 0;
+    if (layers_.size() <= static_cast<size_t>(kMaxCachedLayers) && mixCacheMask_ != 0 &&
+        (mixCacheMask_ & folded) == playing) {
+        uint64_t above = foldLayers + 1 >= 64 ? 0 : mixCacheMask_ >> (foldLayers + 1);
+        cacheMask = (above << 1) | 1;
+    }
+
+    auto& front = layers_.front();
+    std::swap(front.audio, base);
+    front.gain = 1.0f;
+    front.active = true;
+    auto first = layers_.begin() + 1;
+    auto last = first + foldLayers;
+    std::move(first, last, std::back_inserter(removed));
+    layers_.erase(first, last);
+
+    // Layer indices moved, so plans against the old layout must not land,
+    // but the audio is the same: a stretch render of it stays current
+    bool stretchCurrent = cacheMixGeneration_ == mixGeneration_;
+    mixCacheMask_ = cacheMask;
+    ++mixGeneration_;
+    refreshMixSource();
+    if (stretchCurrent) cacheMixGeneration_ = mixGeneration_;
+    return true;
+}
+
 float Loop::getMixedSample(int64_t pos) const {
     if (pos < 0 || pos >= loopLength_) return 0.0f;
+    if (mixSource_) return mixSource_[pos];
+    if (source_) {
+        float sample = 0.0f;
+        source_->read(&sample, pos, 1);
+        return sample;
+    }
 
     float mix = 0.0f;
     for (const auto& layer : layers_) {
@@ -91,10 +672,12 @@ float Loop::processSample() {
         return 0.0f;
     }
 
-    if (isTimeStretchActive()) {
-        return processStretchedSample();
-    }
-    return processDirectSample();
+    if (playsDirect()) return processDirectSample();
+    return stretchCacheActive_ ? processCachedSample() : processStretchedSample();
+}
+
+float Loop::processLiveSample() {
+    return kit_ ? processStretchedSample() : processDirectSample();
 }
 
 float Loop::processDirectSample() {
@@ -125,7 +708,7 @@ float Loop::processStretchedSample() {
     }
 
     // Read from stretch buffer
-    float sample = stretchBuf_[static_cast<size_t>(stretchBufRead_)];
+    float sample = kit_->ring[static_cast<size_t>(stretchBufRead_)];
 
     // Advance through stretch buffer at the user's speed_ rate.
     // This is where speed_ affects both speed and pitch (on top of stretching).
@@ -142,15 +725,44 @@ float Loop::processStretchedSample() {
     return sample;
 }
 
+float Loop::processCachedSample() {
+    int64_t cacheLength = static_cast<int64_t>(stretchCache_.size());
+    int64_t readPos = reversed_ ? cacheLength - 1 - cachePos_ : cachePos_;
+    float cached = stretchCache_[static_cast<size_t>(readPos)];
+
+    // Same position arithmetic as processDirectSample
+    cacheFraction_ += speed_;
+    int64_t advance = static_cast<int64_t>(cacheFraction_);
+    cacheFraction_ -= static_cast<double>(advance);
+    cachePos_ = (cachePos_ + advance) % cacheLength;
+
+    if (cacheRetire_ > 0) {
+        // The live stretcher warms up behind the stale cache, then takes over
+        float live = processLiveSample();
+        if (--cacheRetire_ == 0) stretchCacheActive_ = false;
+        if (cacheRetire_ >= kStretchCacheFade) return cached;
+        float g = static_cast<float>(cacheRetire_) / static_cast<float>(kStretchCacheFade);
+        return live + (cached - live) * g;
+    }
+    if (cacheFadeIn_ > 0) {
+        float live = processLiveSample();
+        float g = 1.0f - static_cast<float>(cacheFadeIn_) / static_cast<float>(kStretchCacheFade);
+        --cacheFadeIn_;
+        return live + (cached - live) * g;
+    }
+    return cached;
+}
+
 void Loop::fillStretchBuffer() {
-    if (!stretcher_ || !stretcher_->isConfigured()) return;
+    if (!kit_) return;
     if (recordedBpm_ <= 0.0 || currentBpm_ <= 0.0) return;
+    int64_t startNanos = monotonicNanos();
 
     // Tempo ratio: >1.0 means current tempo is faster, need more input per output
-    double tempoRatio = std::clamp(currentBpm_ / recordedBpm_, 0.25, 4.0);
+    double ratio = tempoRatio();
 
     // How many raw input samples we need to produce kStretchBlockSize output samples
-    int inputNeeded = static_cast<int>(std::ceil(kStretchBlockSize * tempoRatio));
+    int inputNeeded = static_cast<int>(std::ceil(kStretchBlockSize * ratio));
     inputNeeded = std::clamp(inputNeeded, 1, kMaxStretchInput);
 
     // Read raw samples from loop layers into pre-allocated work buffer
@@ -163,44 +775,241 @@ void Loop::fillStretchBuffer() {
         } else {
             pos = stretchRawPos_ % loopLength_;
         }
-        stretchInputWork_[static_cast<size_t>(i)] =
+        kit_->inputWork[static_cast<size_t>(i)] =
             getMixedSample(pos) * crossfadeGain(pos);
         stretchRawPos_ = (stretchRawPos_ + 1) % loopLength_;
     }
 
     // Process through stretcher (no allocation)
-    stretcher_->process(stretchInputWork_.data(), inputNeeded,
-                        stretchOutputWork_.data(), kStretchBlockSize);
+    kit_->stretcher->process(kit_->inputWork, inputNeeded,
+                             kit_->outputWork, kStretchBlockSize);
 
     // Write to circular output buffer
     for (int i = 0; i < kStretchBlockSize; ++i) {
         int writeIdx = (stretchBufRead_ + stretchBufAvail_ + i) % kStretchBufCapacity;
-        stretchBuf_[static_cast<size_t>(writeIdx)] = stretchOutputWork_[static_cast<size_t>(i)];
+        kit_->ring[static_cast<size_t>(writeIdx)] = kit_->outputWork[static_cast<size_t>(i)];
     }
     stretchBufAvail_ += kStretchBlockSize;
+    stretchNanos_ += monotonicNanos() - startNanos;
 }
 
 void Loop::processBlock(float* output, int numSamples) {
+    if (state_ == LoopState::Empty || state_ == LoopState::Muted) return;
+
+    // At unit speed each output sample advances playback by exactly one, so
+    // the loop is read in contiguous runs and mixed with the block kernels.
+    // A fraction left over from varispeed doesn't matter: adding 1.0 keeps
+    // it as it is, and reads truncate it.
+    int done = 0;
+    if (playsDirect()) {
+        while (done < numSamples && speed_ == 1.0) {
+            int n = static_cast<int>(std::min<int64_t>(
+                {numSamples - done, kRenderRun, loopLength_ - playPos_}));
+            renderRun(output + done, n);
+            playPos_ = (playPos_ + n) % loopLength_;
+            done += n;
+        }
+        // Anything left steps by a fraction: one specialised kernel per block
+        if (done < numSamples) {
+            bool fromMix = mixSource_ != nullptr;
+            if (reversed_) {
+                fromMix ? renderVarispeed<true, true>(output + done, numSamples - done)
+                        : renderVarispeed<true, false>(output + done, numSamples - done);
+            } else {
+                fromMix ? renderVarispeed<false, true>(output + done, numSamples - done)
+                        : renderVarispeed<false, false>(output + done, numSamples - done);
+            }
+            done = numSamples;
+        }
+    } else if (isStretchCached()) {
+        // A settled stretch cache reads the same way
+        int64_t cacheLength = static_cast<int64_t>(stretchCache_.size());
+        while (done < numSamples && speed_ == 1.0) {
+            int n = static_cast<int>(std::min<int64_t>(
+                {numSamples - done, kRenderRun, cacheLength - cachePos_}));
+            size_t count = static_cast<size_t>(n);
+            if (reversed_) {
+                float backwards[kRenderRun];
+                simd::copyReversed(backwards, stretchCache_.data() + (cacheLength - cachePos_ - n),
+                                   count);
+                simd::add(output + done, backwards, count);
+            } else {
+                simd::add(output + done, stretchCache_.data() + cachePos_, count);
+            }
+            cachePos_ = (cachePos_ + n) % cacheLength;
+            done += n;
+        }
+        if (done < numSamples) {
+            reversed_ ? renderCachedVarispeed<true>(output + done, numSamples - done)
+                      : renderCachedVarispeed<false>(output + done, numSamples - done);
+            done = numSamples;
+        }
+    } else if (!stretchCacheActive_) {
+        renderStretched(output, numSamples);
+        done = numSamples;
+    }
+
+    // Cache crossfades stay per sample
+    for (; done < numSamples; ++done) {
+        output[done] += processSample();
+    }
+}
+
+template <bool Reversed, bool FromMix>
+void Loop::renderVarispeed(float* output, int numSamples) {
+    // A step moves playPos_ on by at most this much
+    const int64_t maxAdvance = static_cast<int64_t>(speed_) + 1;
+    int done = 0;
+    while (done < numSamples) {
+        // Steps that can't reach the loop end skip the wrap; one that can is
+        // taken on its own and wrapped
+        int64_t safe = (loopLength_ - 1 - playPos_) / maxAdvance;
+        int n = static_cast<int>(std::min<int64_t>(numSamples - done, std::max<int64_t>(safe, 1)));
+        for (int i = done; i < done + n; ++i) {
+            int64_t readPos = Reversed ? loopLength_ - 1 - playPos_ : playPos_;
+            float mixed = FromMix ? mixSource_[readPos] : getMixedSample(readPos);
+            output[i] += mixed * crossfadeGain(readPos);
+
+            fractionalPos_ += speed_;
+            int64_t advance = static_cast<int64_t>(fractionalPos_);
+            fractionalPos_ -= static_cast<double>(advance);
+            playPos_ += advance;
+        }
+        playPos_ %= loopLength_;
+        done += n;
+    }
+}
+
+template <bool Reversed>
+void Loop::renderCachedVarispeed(float* output, int numSamples) {
+    const int64_t cacheLength = static_cast<int64_t>(stretchCache_.size());
+    const float* cache = stretchCache_.data();
+    const int64_t maxAdvance = static_cast<int64_t>(speed_) + 1;
+    int done = 0;
+    while (done < numSamples) {
+        int64_t safe = (cacheLength - 1 - cachePos_) / maxAdvance;
+        int n = static_cast<int>(std::min<int64_t>(numSamples - done, std::max<int64_t>(safe, 1)));
+        for (int i = done; i < done + n; ++i) {
+            output[i] += cache[Reversed ? cacheLength - 1 - cachePos_ : cachePos_];
+
+            cacheFraction_ += speed_;
+            int64_t advance = static_cast<int64_t>(cacheFraction_);
+            cacheFraction_ -= static_cast<double>(advance);
+            cachePos_ += advance;
+        }
+        cachePos_ %= cacheLength;
+        done += n;
+    }
+}
+
+void Loop::renderStretched(float* output, int numSamples) {
+    // Direction is applied where the stretcher is fed, so one kernel serves
+    // both; a step is at most ceil(speed_) + 1 into the ring, never past it
+    const int needed = static_cast<int>(std::ceil(speed_)) + 1;
+    const float* ring = kit_->ring;
     for (int i = 0; i < numSamples; ++i) {
-        output[i] += processSample();
+        while (stretchBufAvail_ < needed) {
+            fillStretchBuffer();
+        }
+        output[i] += ring[stretchBufRead_];
+
+        fractionalPos_ += speed_;
+        int advance = static_cast<int>(fractionalPos_);
+        fractionalPos_ -= static_cast<double>(advance);
+        stretchBufRead_ += advance;
+        if (stretchBufRead_ >= kStretchBufCapacity) stretchBufRead_ -= kStretchBufCapacity;
+        stretchBufAvail_ -= advance;
+    }
+    // Only the stretcher moves the raw position
+    playPos_ = stretchRawPos_ % loopLength_;
+}
+
+void Loop::renderRun(float* output, int numSamples) {
+    // Lowest loop position the run reads; reversed runs read it last
+    int64_t first = reversed_ ? loopLength_ - playPos_ - numSamples : playPos_;
+    size_t count = static_cast<size_t>(numSamples);
+
+    // Clear of the boundary fades, a mix buffer is added as it is (and a
+    // lone layer only needs its gain)
+    int64_t fade = crossfadeSamples_;
+    bool unfaded = fade <= 0 || loopLength_ <= fade * 2 ||
+                   (first >= fade && first + numSamples <= loopLength_ - fade);
+    if (unfaded && !reversed_) {
+        if (mixSource_) {
+            simd::add(output, mixSource_ + first, count);
+            return;
+        }
+        if (const LoopLayer* layer = loneAudibleLayer()) {
+            simd::addScaled(output, layer->audio.data() + first, layer->gain, count);
+            return;
+        }
+    }
+
+    float run[kRenderRun];
+    mixRange(run, first, numSamples);
+    applyCrossfade(run, first, numSamples);
+
+    size_t n = static_cast<size_t>(numSamples);
+    if (reversed_) {
+        float backwards[kRenderRun];
+        simd::copyReversed(backwards, run, n);
+        simd::add(output, backwards, n);
+    } else {
+        simd::add(output, run, n);
+    }
+}
+
+const LoopLayer* Loop::loneAudibleLayer() const {
+    if (source_) return nullptr;
+    const LoopLayer* lone = nullptr;
+    for (const auto& layer : layers_) {
+        if (!layer.active) continue;
+        if (lone) return nullptr;
+        lone = &layer;
+    }
+    return lone;
+}
+
+void Loop::mixRange(float* dest, int64_t first, int numSamples) const {
+    size_t n = static_cast<size_t>(numSamples);
+    if (mixSource_) {
+        std::copy(mixSource_ + first, mixSource_ + first + numSamples, dest);
+        return;
+    }
+    if (source_) {
+        source_->read(dest, first, numSamples);
+        return;
+    }
+    std::fill(dest, dest + n, 0.0f);
+    for (const auto& layer : layers_) {
+        if (layer.active) {
+            simd::addScaled(dest, layer.audio.data() + first, layer.gain, n);
+        }
     }
 }
 
+void Loop::applyCrossfade(float* data, int64_t first, int numSamples) const {
+    applyBoundaryCrossfade(data, first, numSamples, loopLength_, crossfadeSamples_);
+}
+
 void Loop::recordSample(float input) {
     if (state_ != LoopState::Recording || layers_.empty()) return;
 
     auto& recordLayer = layers_.back();
     int64_t pos;
-    if (isTimeStretchActive()) {
+    if (!playsDirect()) {
         // During overdub with stretching, record at the raw position the
         // stretcher is consuming from, so the overdub aligns with the raw loop data
-        int64_t rawMod = stretchRawPos_ % loopLength_;
+        int64_t rawMod = stretchCacheActive_ ? cachedRawPosition() : stretchRawPos_ % loopLength_;
         pos = reversed_ ? (loopLength_ - 1 - rawMod) : rawMod;
     } else {
         pos = reversed_ ? (loopLength_ - 1 - playPos_) : playPos_;
     }
     if (pos >= 0 && pos < loopLength_) {
         recordLayer.audio[static_cast<size_t>(pos)] += input;
+        int index = static_cast<int>(layers_.size()) - 1;
+        if (silentLayer_ == index) silentLayer_ = -1;
+        layerContentChanged(index);
     }
 }
 
@@ -224,12 +1033,16 @@ void Loop::toggleMute() {
     }
 }
 
-void Loop::startOverdub() {
+void Loop::startOverdub(std::vector<float> layerAudio) {
     if (state_ == LoopState::Empty || loopLength_ == 0) return;
-    // Create a new empty layer for recording
-    std::vector<float> newLayer(static_cast<size_t>(loopLength_), 0.0f);
-    layers_.push_back({std::move(newLayer), 1.0f, true});
+    // The new layer records into the caller's zeroed buffer
+    layerAudio.resize(static_cast<size_t>(loopLength_), 0.0f);
+    layers_.push_back({std::move(layerAudio), 1.0f, true});
     state_ = LoopState::Recording;
+
+    // The new layer stays out of the mix until its audio is swapped in
+    silentLayer_ = static_cast<int>(layers_.size()) - 1;
+    refreshMixSource();
 }
 
 void Loop::stopOverdub() {
@@ -251,17 +1064,23 @@ void Loop::setCurrentBpm(double bpm) {
     currentBpm_ = bpm;
     bool nowActive = isTimeStretchActive();
 
+    if (stretchCacheActive_ && bpm != cacheBpm_) {
+        // The cache is at the old tempo: hand over to the live stretcher,
+        // or straight to direct playback
+        retireStretchCache();
+        return;
+    }
+
     if (!wasActive && nowActive) {
-        // Transitioning from direct to stretched mode
-        stretchRawPos_ = playPos_;
-        stretchBufRead_ = 0;
-        stretchBufAvail_ = 0;
-        fractionalPos_ = 0.0;
-        if (stretcher_) stretcher_->reset();
-    } else if (wasActive && !nowActive) {
+        // Transitioning from direct to stretched mode. Without a free
+        // stretcher the loop plays on unstretched until one frees up.
+        if (!kit_ && stretcherPool_) kit_ = stretcherPool_->lease();
+        if (kit_) restartLiveStretch(playPos_);
+    } else if (wasActive && !nowActive && kit_) {
         // Transitioning back to direct mode
         playPos_ = stretchRawPos_ % loopLength_;
         fractionalPos_ = 0.0;
+        releaseStretcher();
     }
 }
 
@@ -271,14 +1090,33 @@ bool Loop::isTimeStretchActive() const {
 }
 
 int64_t Loop::playPosition() const {
-    if (isTimeStretchActive()) {
-        return stretchRawPos_ % loopLength_;
-    }
-    return playPos_;
+    if (playsDirect()) return playPos_;
+    return stretchCacheActive_ ? cachedRawPosition() : stretchRawPos_ % loopLength_;
 }
 
-void Loop::clear() {
+LoopStorage Loop::clear() {
+    LoopStorage released;
+    released.layers = std::move(layers_);
+    released.mixCache = std::move(mixCache_);
+    released.stretchCache = std::move(stretchCache_);
     layers_.clear();
+    source_ = nullptr;
+    mixCache_.clear();
+    mixCacheMask_ = 0;
+    silentLayer_ = -1;
+    consolidationPending_ = false;
+    stretchCache_.clear();
+    stretchCacheActive_ = false;
+    cachePos_ = 0;
+    cacheFraction_ = 0.0;
+    cacheFadeIn_ = 0;
+    cacheRetire_ = 0;
+    cacheMixGeneration_ = kNoGeneration;
+    cacheBpm_ = 0.0;
+    stretchPendingGeneration_ = kNoGeneration;
+    releaseStretcher();
+
+    ++contentGeneration_;
     state_ = LoopState::Empty;
     loopLength_ = 0;
     playPos_ = 0;
@@ -288,14 +1126,12 @@ void Loop::clear() {
     lengthInBars_ = 0.0;
 
     // Clear stretch state
-    stretcher_.reset();
-    stretchBuf_.clear();
-    stretchInputWork_.clear();
-    stretchOutputWork_.clear();
     stretchBufRead_ = 0;
     stretchBufAvail_ = 0;
     stretchRawPos_ = 0;
     recordedBpm_ = 0.0;
+    mixChanged();
+    return released;
 }
 
 int Loop::activeLayerCount() const {
@@ -306,4 +1142,16 @@ int Loop::activeLayerCount() const {
     return count;
 }
 
+int Loop::snapshotLayers(LayerSnapshot* out, int max) const {
+    // The layer being recorded (or waiting for its mixdown) is the last one
+    int count = static_cast<int>(layers_.size());
+    if (count > 0 && (state_ == LoopState::Recording || silentLayer_ == count - 1)) --count;
+    if (count > max) return -1;
+    for (int i = 0; i < count; ++i) {
+        const auto& layer = layers_[static_cast<size_t>(i)];
+        out[i] = {layer.audio.data(), layer.gain, layer.active};
+    }
+    return count;
+}
+
 } // namespace retrospect
@@ -1,12 +1,16 @@
 #pragma once
 
 #include "core/Metronome.h"  // For Quantize
+#include "core/StretcherPool.h"
 
 #include <vector>
 #include <cstdint>
 #include <string>
 #include <optional>
 #include <memory>
+#include <array>
+#include <atomic>
+#include <utility>
 
 namespace retrospect {
 
@@ -77,6 +81,23 @@ struct PendingState {
         return mute || overdub || reverse || undo || speed || clear || capture || record;
     }
 
+    /// Earliest executeSample across the occupied slots (INT64_MAX if none)
+    int64_t nextExecuteSample() const {
+        int64_t next = INT64_MAX;
+        auto consider = [&next](const auto& slot) {
+            if (slot && slot->executeSample < next) next = slot->executeSample;
+        };
+        consider(mute);
+        consider(overdub);
+        consider(reverse);
+        consider(undo);
+        consider(speed);
+        consider(clear);
+        consider(capture);
+        consider(record);
+        return next;
+    }
+
     void clearAll() {
         mute.reset();
         overdub.reset();
@@ -96,6 +117,75 @@ struct LoopLayer {
     bool active = true;  // Can be toggled for undo
 };
 
+/// Most layers a loop's mix cache can cover. Loops with more layers than
+/// this play by summing layers per sample.
+constexpr int kMaxCachedLayers = 64;
+
+/// One layer's samples and gain, as read by an off-thread mix cache build
+struct LayerRef {
+    const float* audio = nullptr;
+    float gain = 1.0f;
+};
+
+/// One finished layer as a session save copies it (see Loop::snapshotLayers)
+struct LayerSnapshot {
+    const float* audio = nullptr;
+    float gain = 1.0f;
+    bool active = true;
+};
+
+/// A mix cache build for the worker (see Loop::planMixCache).
+/// The result is `base` (or silence) plus each layer times its gain, summed
+/// in layer order, which is bit-identical to summing the layers live.
+struct MixCachePlan {
+    uint64_t generation = 0;         // Loop mix generation the build is for
+    uint64_t layerMask = 0;          // Layers the finished cache will cover
+    int64_t length = 0;
+    const float* base = nullptr;     // Buffer already holding the lower layers, or nullptr
+    int numLayers = 0;
+    std::array<LayerRef, kMaxCachedLayers> layers{};
+};
+
+/// A stretch cache render for the workers (see Loop::planStretchCache).
+/// The source is the loop mix with its boundary crossfade, which is what the
+/// live stretcher is fed; the result is the whole loop at the current tempo.
+struct StretchCachePlan {
+    MixCachePlan mix;                // Layers summed into the source (mix.generation keys it)
+    uint64_t contentGeneration = 0;
+    double recordedBpm = 0.0;
+    double currentBpm = 0.0;
+    int crossfadeSamples = 0;
+    uint64_t tempoGeneration = 0;    // Engine tempo changes so far (stale renders give up)
+};
+
+/// Heap storage owned by a loop: its layers and caches. Built and destroyed
+/// off the audio thread (by the EngineWorker) and moved in and out of a
+/// Loop, so swapping loop content never allocates or frees inside the audio
+/// callback. Stretchers are not part of it; loops lease them from a
+/// StretcherPool.
+struct LoopStorage {
+    LoopStorage();
+    ~LoopStorage();
+    LoopStorage(LoopStorage&&) noexcept;
+    LoopStorage& operator=(LoopStorage&&) noexcept;
+
+    std::vector<LoopLayer> layers;
+    std::vector<float> mixCache;
+    std::vector<float> stretchCache;
+
+    bool empty() const { return layers.empty() && mixCache.empty() && stretchCache.empty(); }
+};
+
+/// Supplies the mix of a loop that has no layers of its own yet (see
+/// Loop::preview). Read by whichever thread renders the loop.
+class LoopSource {
+public:
+    virtual ~LoopSource() = default;
+
+    /// Write the mix at loop positions [first, first + numSamples) to `dest`
+    virtual void read(float* dest, int64_t first, int numSamples) const = 0;
+};
+
 /// Represents a single loop with multiple layers and playback controls.
 /// The loop length is determined by the first layer captured.
 class Loop {
@@ -103,15 +193,37 @@ public:
     Loop();
     ~Loop();
 
-    // Move-only (due to unique_ptr<TimeStretcher>)
+    // Move-only (owns its layers; may hold a leased StretchKit)
     Loop(Loop&&) noexcept;
     Loop& operator=(Loop&&) noexcept;
     Loop(const Loop&) = delete;
     Loop& operator=(const Loop&) = delete;
 
-    /// Initialize the loop with audio captured from the ring buffer.
-    /// This sets the loop length and creates the first layer.
-    void loadFromCapture(std::vector<float> audio);
+    /// Build the storage for a loop whose first layer is `audio`, with layer
+    /// slots reserved for overdubs. Allocates; call off the audio thread.
+    static LoopStorage prepareStorage(std::vector<float> audio);
+
+    /// Same, for a loop restored with all its `layers` (each of the loop
+    /// length, the first being the base layer)
+    static LoopStorage prepareStorage(std::vector<LoopLayer> layers);
+
+    /// Initialize the loop from prepared storage (see prepareStorage).
+    /// This sets the loop length from the first layer and starts playback.
+    /// Returns the storage the loop held before, for disposal elsewhere.
+    LoopStorage load(LoopStorage storage);
+
+    /// Start playing `length` samples that `source` supplies, from position
+    /// 0, while the loop's own storage is still being built. The loop has no
+    /// layers until load() replaces the source; `source` must stay valid
+    /// until then (or until clear()).
+    void preview(const LoopSource* source, int64_t length);
+
+    /// Whether playback reads a LoopSource (see preview)
+    bool isPreview() const { return source_ != nullptr; }
+
+    /// Advance playback by `numSamples` without producing output. Used to
+    /// start a loop whose content arrived after its scheduled start.
+    void skipAhead(int64_t numSamples);
 
     /// Add an overdub layer. Must match the loop length.
     void addLayer(std::vector<float> audio);
@@ -122,6 +234,82 @@ public:
     /// Redo the most recently undone layer
     void redoLayer();
 
+    /// Set the playback gain of layer `index`
+    void setLayerGain(int index, float gain);
+
+    // --- Undo history ---
+    // A loop keeps a bounded number of layers above its base. Past that, the
+    // oldest are folded into the base off the audio thread: active ones are
+    // summed in, undone ones (past the redo window) are dropped. The new base
+    // sums exactly as the layers it replaces did, so playback is unchanged;
+    // only undo can no longer reach them.
+
+    /// Fill `plan` with the sum of the base and the oldest layers beyond
+    /// `maxLayers` above it, `foldLayers` of them, and mark it requested.
+    /// Returns false if nothing needs folding, a fold is in flight, or the
+    /// loop is overdubbing (its layer indices must not move under a mixdown).
+    bool planConsolidation(int maxLayers, MixCachePlan& plan, int& foldLayers);
+
+    /// Forget the outstanding fold (e.g. it could not be posted)
+    void cancelConsolidation() { consolidationPending_ = false; }
+
+    /// Replace the base and the `foldLayers` layers above it with `base`, as
+    /// summed from a plan of mix generation `generation`. On success `base`
+    /// holds the old base's buffer and the folded layers are moved to the
+    /// end of `removed` (which must have room for them, so nothing
+    /// allocates). Returns false, changing nothing, if the mix moved on.
+    bool applyConsolidation(uint64_t generation, int foldLayers, std::vector<float>& base,
+                            std::vector<LoopLayer>& removed);
+
+    // --- Mix cache ---
+    // Playback reads one pre-summed buffer instead of every layer. While the
+    // cache is out of date (after an overdub, undo, redo or gain change) the
+    // loop sums layers per sample as before, and the engine has the worker
+    // rebuild it. A layer appended above the cached ones only adds that one
+    // layer; anything else rebuilds from the layers.
+
+    /// Whether playback is reading a single buffer (cache or lone layer)
+    bool isMixCached() const { return mixSource_ != nullptr; }
+
+    /// Whether a cache build should be requested (none in flight for the
+    /// current mix). False for loops the cache can't cover.
+    bool needsMixCache() const;
+
+    /// Fill `plan` for the current mix and mark it requested. Returns false
+    /// if no build is needed.
+    bool planMixCache(MixCachePlan& plan);
+
+    /// Forget the outstanding request (e.g. it could not be posted)
+    void cancelMixCachePlan() { mixPendingGeneration_ = kNoGeneration; }
+
+    /// Sum a plan into a new buffer. Allocates; call off the audio thread.
+    static std::vector<float> buildMixCache(const MixCachePlan& plan);
+
+    /// Sum a plan into `out` (plan.length samples, any contents)
+    static void sumMix(const MixCachePlan& plan, float* out);
+
+    /// Install a finished cache built from a plan. Returns the buffer the
+    /// loop no longer needs (the previous cache, or `cache` itself if the mix
+    /// changed since the plan was made), for disposal elsewhere.
+    std::vector<float> installMixCache(uint64_t generation, uint64_t layerMask,
+                                       std::vector<float> cache);
+
+    // --- Waveform peaks ---
+    // The engine keeps a PeakPyramid of each loop's mix for displays, taken
+    // on the worker from the mix as one buffer (the cache, or a lone layer),
+    // so it follows a mix change once the cache has caught up.
+
+    /// Whether the peaks are behind the mix, and the mix can be read for them
+    bool needsPeaks() const;
+
+    /// Point `plan` at the mix to take peaks from (`base`, or silence if
+    /// null, over `length`, 0 for a loop with no content) and mark it taken.
+    /// Returns false if no update is needed yet.
+    bool planPeaks(MixCachePlan& plan);
+
+    /// Forget the outstanding update (e.g. it could not be posted)
+    void cancelPeaksPlan() { peaksGeneration_ = kNoGeneration; }
+
     /// Get the mixed output sample at the current playback position,
     /// then advance the position. Returns 0 if empty/muted.
     float processSample();
@@ -137,6 +325,14 @@ public:
     /// Used by LoopEngine to write mixed overdub audio at stop time.
     std::vector<float>& recordLayerAudio() { return layers_.back().audio; }
 
+    /// Replace the audio of layer `index` (same length), returning the old
+    /// buffer. Used to swap in an overdub layer mixed down off-thread.
+    std::vector<float> swapLayerAudio(int index, std::vector<float> audio);
+
+    /// Incremented whenever the loop's content is replaced (load/clear), so
+    /// results computed off-thread can tell whether they still apply.
+    uint64_t contentGeneration() const { return contentGeneration_; }
+
     // State
     LoopState state() const { return state_; }
     bool isEmpty() const { return state_ == LoopState::Empty; }
@@ -148,11 +344,14 @@ public:
     void play();
     void mute();
     void toggleMute();
-    void startOverdub();
+    /// Begin overdubbing into `layerAudio`, a zeroed buffer of loop length
+    void startOverdub(std::vector<float> layerAudio);
     void stopOverdub();
     void toggleReverse();
     void setSpeed(double speed);
-    void clear();
+
+    /// Empty the loop. Returns its storage, for disposal off the audio thread.
+    LoopStorage clear();
 
     // Properties
     int64_t lengthSamples() const { return loopLength_; }
@@ -161,6 +360,13 @@ public:
     double speed() const { return speed_; }
     int layerCount() const { return static_cast<int>(layers_.size()); }
     int activeLayerCount() const;
+
+    /// Point `out` at up to `max` of the loop's layers for an off-thread
+    /// copy: all of them except an overdub layer that is still being
+    /// recorded or mixed down. Returns the number filled, or -1 if there
+    /// are more than `max`. The pointers stay valid as long as the loop's
+    /// storage is only ever released on the worker, after the copy.
+    int snapshotLayers(LayerSnapshot* out, int max) const;
     int id() const { return id_; }
     void setId(int id) { id_ = id; }
 
@@ -194,13 +400,114 @@ public:
     /// Set the sample rate (needed for stretcher initialization)
     void setSampleRate(double sr) { sampleRate_ = sr; }
 
+    /// Pool the loop leases a stretcher from while it stretches live
+    /// (audio thread, like every lease and release)
+    void setStretcherPool(StretcherPool* pool) { stretcherPool_ = pool; }
+
     /// Whether time stretching is currently active
     bool isTimeStretchActive() const;
 
+    /// Whether the loop holds a leased stretcher
+    bool hasStretcher() const { return kit_ != nullptr; }
+
+    /// Lease a stretcher if the loop needs one and has none (it plays
+    /// unstretched meanwhile), or give back one it no longer needs (it plays
+    /// a settled stretch cache, or direct). Called once per block.
+    void updateStretcherLease();
+
+    // --- Stretch cache ---
+    // Once the tempo settles, playback reads the whole loop pre-stretched to
+    // the new tempo instead of running the stretcher live. The engine has
+    // the workers render it; until it arrives, and whenever the mix or the
+    // tempo moves on, the live stretcher plays. Hand-overs either way are
+    // crossfaded.
+
+    /// Whether stretched playback is reading the cache alone
+    bool isStretchCached() const {
+        return stretchCacheActive_ && cacheFadeIn_ == 0 && cacheRetire_ == 0;
+    }
+
+    /// Whether a render should be requested (stretching, and none current or
+    /// in flight for this mix and tempo)
+    bool needsStretchCache() const;
+
+    /// Fill `plan` for the current mix and tempo and mark it requested.
+    /// Returns false if no render is needed.
+    bool planStretchCache(StretchCachePlan& plan);
+
+    /// Forget the outstanding request for `plan`, if it is still the latest
+    void cancelStretchCachePlan(const StretchCachePlan& plan);
+
+    /// Whether a render for `plan` would still match the loop
+    bool stretchPlanCurrent(const StretchCachePlan& plan) const;
+
+    /// The mix a plan renders from, boundary crossfade applied. Allocates;
+    /// call off the audio thread.
+    static std::vector<float> buildStretchSource(const StretchCachePlan& plan);
+
+    /// Replace `audio` (from buildStretchSource) with the whole loop stretched
+    /// to the plan's tempo, using `stretcher` (configured, any state). Gives
+    /// up and returns false once `tempoGeneration` no longer matches the
+    /// plan. Off the audio thread.
+    static bool renderStretchCache(std::vector<float>& audio, const StretchCachePlan& plan,
+                                   TimeStretcher& stretcher,
+                                   const std::atomic<uint64_t>& tempoGeneration);
+
+    /// Start playing a finished render, crossfading from the live stretcher.
+    /// Returns the buffer the loop no longer needs (the previous cache, or
+    /// `cache` itself if the plan is stale), for disposal elsewhere.
+    std::vector<float> installStretchCache(const StretchCachePlan& plan,
+                                           std::vector<float> cache);
+
+    /// Wall time spent refilling from the stretcher since the last call, in
+    /// nanoseconds (audio thread, for DSP load stats)
+    int64_t takeStretchNanos() { return std::exchange(stretchNanos_, 0); }
+
 private:
+    static constexpr uint64_t kNoGeneration = UINT64_MAX;
+
     float getMixedSample(int64_t pos) const;
+
+    /// Layers that contribute to the mix: active ones, minus the layer being
+    /// overdubbed (still silent). Returns false if there are too many layers
+    /// for the cache.
+    bool mixLayerMask(uint64_t& mask) const;
+
+    /// Re-point mixSource_ after the layers or the cache changed
+    void refreshMixSource();
+
+    /// The mix changed: bump the generation and re-point playback
+    void mixChanged();
+
+    /// Layer `index` was given new contents or gain: drop the cache if it
+    /// includes the layer, then note the mix change
+    void layerContentChanged(int index);
     float crossfadeGain(int64_t pos) const;
 
+    /// Mix `numSamples` (<= kRenderRun) unit-speed samples from playPos_
+    /// into `output`, without advancing. The run must not cross the loop end.
+    void renderRun(float* output, int numSamples);
+
+    /// Block kernels for the playback modes that step by a fraction,
+    /// specialised so the per-sample loop has no mode branches. Each mixes
+    /// into `output` and advances exactly as the matching per-sample path
+    /// (processDirectSample, processCachedSample, processStretchedSample)
+    /// would, wrapping only where a step can reach the loop end.
+    template <bool Reversed, bool FromMix>
+    void renderVarispeed(float* output, int numSamples);
+    template <bool Reversed>
+    void renderCachedVarispeed(float* output, int numSamples);
+    void renderStretched(float* output, int numSamples);
+
+    /// The only active layer, if the mix is just that one (scaled)
+    const LoopLayer* loneAudibleLayer() const;
+
+    /// Write the mix of loop positions [first, first + numSamples) to `dest`
+    void mixRange(float* dest, int64_t first, int numSamples) const;
+
+    /// Apply the boundary crossfade to mixed positions [first, first + numSamples)
+    void applyCrossfade(float* data, int64_t first, int numSamples) const;
+
     /// Process one sample in direct (non-stretched) mode
     float processDirectSample();
 
@@ -210,7 +517,37 @@ private:
     /// Fill the stretch output buffer with another block of stretched audio
     void fillStretchBuffer();
 
+    /// Process one sample from the stretch cache (and the live stretcher,
+    /// while one hands over to the other)
+    float processCachedSample();
+
+    /// Tempo ratio the live stretcher runs at
+    double tempoRatio() const;
+
+    /// Raw loop position the stretch cache has reached (play order)
+    int64_t cachedRawPosition() const;
+
+    /// Restart the live stretcher feeding from raw position `rawPos`
+    void restartLiveStretch(int64_t rawPos);
+
+    /// Whether playback reads the loop directly: not stretching, or
+    /// stretching with neither a cache nor a leased stretcher
+    bool playsDirect() const {
+        return !isTimeStretchActive() || (!stretchCacheActive_ && !kit_);
+    }
+
+    /// Next sample without the cache: the stretcher, or direct when unleased
+    float processLiveSample();
+
+    void releaseStretcher();
+
+    /// The cache no longer matches the mix or tempo. The live stretcher
+    /// restarts so that, once past its latency, it lines up with the cache;
+    /// the cache plays until then and crossfades out.
+    void retireStretchCache();
+
     std::vector<LoopLayer> layers_;
+    const LoopSource* source_ = nullptr;  // Mix while previewing, instead of layers_
     LoopState state_ = LoopState::Empty;
     int64_t loopLength_ = 0;
     int64_t playPos_ = 0;
@@ -220,30 +557,59 @@ private:
     int crossfadeSamples_ = 256;
     double lengthInBars_ = 0.0;
     int id_ = -1;
+    uint64_t contentGeneration_ = 0;
     PendingState pending_;
 
+    // Mix cache (sum of the layers in mixCacheMask_, in layer order)
+    std::vector<float> mixCache_;
+    uint64_t mixCacheMask_ = 0;
+    uint64_t mixGeneration_ = 0;
+    uint64_t mixPendingGeneration_ = kNoGeneration;
+    const float* mixSource_ = nullptr;  // Buffer equal to the current mix, or nullptr
+    uint64_t peaksGeneration_ = 0;      // Mix the peaks were last planned for
+    int silentLayer_ = -1;              // Overdub layer still all zeros (left out of the mix)
+    bool consolidationPending_ = false; // A fold of the oldest layers is in flight
+
     // Time stretch state
     double recordedBpm_ = 0.0;
     double currentBpm_ = 0.0;
     double sampleRate_ = 44100.0;
 
-    std::unique_ptr<TimeStretcher> stretcher_;
+    // Stretcher and buffers, leased from stretcherPool_ while stretching live
+    StretcherPool* stretcherPool_ = nullptr;
+    StretchKit* kit_ = nullptr;
 
-    // Stretch output ring buffer
-    std::vector<float> stretchBuf_;
+    // Stretch output ring buffer (kit_->ring)
     int stretchBufRead_ = 0;
     int stretchBufAvail_ = 0;
 
     // Raw read position for feeding the stretcher (tracks progress through loop)
     int64_t stretchRawPos_ = 0;
 
-    // Pre-allocated work buffers (avoid allocation during processing)
-    std::vector<float> stretchInputWork_;
-    std::vector<float> stretchOutputWork_;
-
-    static constexpr int kStretchBlockSize = 512;
-    static constexpr int kStretchBufCapacity = 8192;
-    static constexpr int kMaxStretchInput = kStretchBlockSize * 4;
+    int64_t stretchNanos_ = 0;  // Time in fillStretchBuffer since takeStretchNanos
+
+    // Stretch cache: the loop rendered at cacheBpm_ (cacheLength samples)
+    std::vector<float> stretchCache_;
+    bool stretchCacheActive_ = false;
+    int64_t cachePos_ = 0;               // Play-order position in the cache
+    double cacheFraction_ = 0.0;         // cachePos_ remainder for varispeed
+    int cacheFadeIn_ = 0;                // Samples left of the live -> cache crossfade
+    int cacheRetire_ = 0;                // Samples left before the cache stops playing
+    uint64_t cacheMixGeneration_ = kNoGeneration;
+    double cacheBpm_ = 0.0;
+    uint64_t stretchPendingGeneration_ = kNoGeneration;
+    double stretchPendingBpm_ = 0.0;
+
+    /// Layer slots reserved by prepareStorage, so overdubs don't reallocate
+    static constexpr int kReservedLayers = 64;
+
+    /// Longest contiguous run processBlock renders at once (stack scratch)
+    static constexpr int kRenderRun = 256;
+
+    static constexpr int kStretchBlockSize = StretchKit::kBlockSize;
+    static constexpr int kStretchBufCapacity = StretchKit::kRingCapacity;
+    static constexpr int kMaxStretchInput = StretchKit::kMaxInput;
+    static constexpr int kStretchCacheFade = 512;
 };
 
 } // namespace retrospect
@@ -1,10 +1,12 @@
 #include "core/LoopEngine.h"
 #include "core/EngineCommand.h"
+#include "core/SimdKernels.h"
+#include "core/MonotonicClock.h"
+#include "core/TimeStretcher.h"
 #include <cstring>
 #include <algorithm>
 #include <cmath>
-#include <sstream>
-#include <iomanip>
+#include <thread>
 
 namespace retrospect {
 
@@ -28,131 +30,281 @@ std::string opTypeDescription(OpType type) {
     return "Unknown";
 }
 
+namespace {
+
+// Ring buffer size for maxLookbackBars at the slowest expected tempo.
+// At minBpm, one beat = (60/minBpm) seconds, one bar = beatsPerBar beats.
+int64_t ringCapacityFor(int maxLookbackBars, double minBpm, double sampleRate) {
+    return static_cast<int64_t>(
+        std::ceil(maxLookbackBars * 4 * (60.0 / minBpm) * sampleRate));
+}
+
+// Record pool size: a classic recording may run as long as the ring buffer
+// lookback on every input channel, and an overdub running meanwhile may take
+// as much again on a loop of that length. Only chunks in use are resident.
+int recordPoolChunks(int maxLookbackBars, double minBpm, double sampleRate,
+                     int numInputChannels, int chunkSize) {
+    int64_t perChannel = (ringCapacityFor(maxLookbackBars, minBpm, sampleRate) +
+                          chunkSize - 1) / chunkSize;
+    return static_cast<int>(2 * perChannel * std::max(1, numInputChannels));
+}
+
+// Size an overdub kit's tables for a loop length, every slot unwritten
+void prepareOverdubTables(OverdubKit& kit, int64_t length, size_t numChannels,
+                          int chunkSize) {
+    kit.length = length;
+    kit.chunksPerChannel = (length + chunkSize - 1) / chunkSize;
+    kit.chunks.assign(numChannels * static_cast<size_t>(kit.chunksPerChannel),
+                      SampleChunkPool::kNoChunk);
+    kit.chains.assign(numChannels, ChunkChain{});
+}
+
+// Ring samples read per pass when bringing input peaks up to date
+constexpr int64_t kPeakScanSamples = 4096;
+
+// The command batch a control thread has open (see LoopEngine::beginBatch)
+struct OpenBatch {
+    const LoopEngine* engine = nullptr;
+    int depth = 0;
+    int64_t dueNanos = -1;
+    std::vector<EngineCommand> commands;
+};
+thread_local OpenBatch openBatch;
+
+} // namespace
+
 LoopEngine::LoopEngine(int maxLoops, int maxLookbackBars,
                        double sampleRate, double minBpm,
                        int numInputChannels, float liveThreshold,
-                       int liveWindowMs)
+                       int liveWindowMs, const LookbackStorage& storage)
     : metronome_(120.0, 4, sampleRate)
     , click_(sampleRate)
     , midiSync_(120.0, sampleRate)
+    , loadMeter_(sampleRate)
+    , stretcherPool_(maxLoops, sampleRate)
     , loops_(static_cast<size_t>(maxLoops))
+    , recordPool_(recordPoolChunks(maxLookbackBars, minBpm, sampleRate,
+                                   numInputChannels, kRecordChunkSize),
+                  kRecordChunkSize)
+    , scheduler_(maxLoops)
     , maxLookbackBars_(maxLookbackBars)
     , sampleRate_(sampleRate)
     , liveThreshold_(liveThreshold)
+    , sessions_(sampleRate, maxLoops)
+    , worker_([this](WorkerJob& job) { runWorkerJob(job); })
+    , stretchWorker_([this](WorkerJob& job) { runWorkerJob(job); })
 {
-    // Size ring buffer for maxLookbackBars at the slowest expected tempo.
-    // At minBpm, one beat = (60/minBpm) seconds, one bar = beatsPerBar beats.
-    int64_t ringCapacity = static_cast<int64_t>(
-        std::ceil(maxLookbackBars * 4 * (60.0 / minBpm) * sampleRate));
+    cacheStretcher_ = std::make_unique<TimeStretcher>();
+    cacheStretcher_->configure(sampleRate);
+    lookbackCapacity_ = ringCapacityFor(maxLookbackBars, minBpm, sampleRate);
+    int64_t ringCapacity = lookbackCapacity_ +
+        static_cast<int64_t>(std::ceil(kCaptureHeadroomSeconds * sampleRate));
     int activityWindowSamples = static_cast<int>(
         sampleRate * static_cast<double>(liveWindowMs) / 1000.0);
 
+    // Spilling rings keep a short window in RAM and the whole ring capacity
+    // on disk. A ring that cannot get its file falls back to RAM, and so do
+    // the rest (one failure usually means the directory or disk is unusable).
+    int64_t ramCapacity = ringCapacity;
+    if (!storage.spillDirectory.empty()) {
+        ramCapacity = std::min(ringCapacity, static_cast<int64_t>(
+            std::ceil(std::max(kMinSpillRamSeconds, storage.spillRamSeconds) * sampleRate)));
+    }
     inputChannels_.reserve(static_cast<size_t>(numInputChannels));
+    std::vector<RingBuffer*> spilling;
     for (int i = 0; i < numInputChannels; ++i) {
-        inputChannels_.emplace_back(ringCapacity, activityWindowSamples);
+        bool spills = ramCapacity < ringCapacity && !lookbackSpillFailed_;
+        inputChannels_.emplace_back(spills ? ramCapacity : ringCapacity, activityWindowSamples,
+                                    storage.format);
+        RingBuffer& ring = inputChannels_.back().ringBuffer();
+        if (!spills) continue;
+        if (ring.enableSpill(storage.spillDirectory, ringCapacity)) {
+            spilling.push_back(&ring);
+        } else {
+            lookbackSpillFailed_ = true;
+            ring = RingBuffer(ringCapacity, storage.format);
+        }
     }
-    channelPeaksSnapshot_.resize(static_cast<size_t>(numInputChannels), 0.0f);
+    // Fault the rings in now rather than in the callback, in parallel since
+    // long lookback on many channels is a lot of pages. The record pool too
+    // when memory is locked; otherwise it is only backed as chunks are used.
+    std::vector<AudioMemory*> audioMemory;
+    for (auto& ch : inputChannels_) audioMemory.push_back(&ch.ringBuffer().memory());
+    if (audioMemoryLocking()) audioMemory.push_back(&recordPool_.memory());
+    prefaultAudioMemory(audioMemory);
+    mixScratch_.resize(static_cast<size_t>(kMaxSubBlock), 0.0f);
+    inputMixScratch_.resize(static_cast<size_t>(kMaxSubBlock), 0.0f);
+    silence_.resize(static_cast<size_t>(kMaxSubBlock), 0.0f);
     lastThresholdBreachSample_.resize(static_cast<size_t>(numInputChannels), INT64_MIN);
+    activeRecording_.channelChunks.resize(static_cast<size_t>(numInputChannels));
+    spareRecordChains_.resize(static_cast<size_t>(numInputChannels));
+    loopLoading_.resize(static_cast<size_t>(maxLoops), 0);
+    captureSources_.assign(static_cast<size_t>(maxLoops), CaptureSource(&inputChannels_));
+    loopPeaks_.resize(static_cast<size_t>(maxLoops));
+    inputPeaks_.resize(static_cast<size_t>(numInputChannels));
+    dueLoops_.reserve(static_cast<size_t>(maxLoops));
+    renderList_.reserve(static_cast<size_t>(maxLoops));
+    deferredRetire_.reserve(kMaxDeferredRetire);
+    sessionPlan_ = std::make_unique<SessionPlan>();
+    sessionPlan_->loops.resize(static_cast<size_t>(maxLoops));
 
     for (int i = 0; i < maxLoops; ++i) {
         loops_[static_cast<size_t>(i)].setId(i);
         loops_[static_cast<size_t>(i)].setCrossfadeSamples(crossfadeSamples_);
         loops_[static_cast<size_t>(i)].setSampleRate(sampleRate);
+        loops_[static_cast<size_t>(i)].setStretcherPool(&stretcherPool_);
     }
 
-    // Wire metronome callbacks
+    // Retrigger the click on every beat (accented on the downbeat)
     metronome_.onBeat([this](const MetronomePosition& pos) {
         click_.trigger(pos.beat == 0);
-        if (callbacks_.onBeat) callbacks_.onBeat(pos);
-    });
-    metronome_.onBar([this](const MetronomePosition& pos) {
-        if (callbacks_.onBar) callbacks_.onBar(pos);
+        signalState_ = true;
     });
+
+    if (!spilling.empty()) {
+        spiller_ = std::make_unique<RingSpiller>(std::move(spilling), kSpillInterval);
+        spiller_->start();
+    }
+
+    // Readers see a complete state before the first block
+    publishState();
+    worker_.start();
+    stretchWorker_.start();
 }
 
-void LoopEngine::processBlock(const float* const* input, int inputChannelCount,
-                              float* output, int numSamples) {
-    // Drain commands from TUI thread at the start of each block
-    drainCommands();
+LoopEngine::~LoopEngine() {
+    stretchWorker_.stop();
+    worker_.stop();
+}
 
-    int engineChannels = static_cast<int>(inputChannels_.size());
+void LoopEngine::setSynchronousWorker(bool on) {
+    if (on) {
+        stretchWorker_.stop();
+        worker_.stop();
+    } else {
+        worker_.start();
+        stretchWorker_.start();
+    }
+}
 
-    for (int i = 0; i < numSamples; ++i) {
-        // Write each input channel to its InputChannel and compute
-        // an unfiltered input mix (all channels, no threshold).
-        float inputMix = 0.0f;
-        for (int ch = 0; ch < engineChannels; ++ch) {
-            float sample = (ch < inputChannelCount && input && input[ch])
-                ? input[ch][i] : 0.0f;
-            inputChannels_[static_cast<size_t>(ch)].writeSample(sample);
-            inputMix += sample;
-        }
+void LoopEngine::setRenderThreads(int helpers) {
+    renderPool_.reset();
+    // More threads than cores would only take turns with the audio thread
+    int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    helpers = std::min(helpers, cores - 1);
+    if (helpers <= 0) return;
+    renderPool_ = std::make_unique<RenderPool>(helpers, kMaxSubBlock);
+    renderPool_->start();
+}
 
-        // Accumulate per-channel audio into active classic recording
-        if (activeRecording_) {
-            for (int ch = 0; ch < engineChannels; ++ch) {
-                float sample = (ch < inputChannelCount && input && input[ch])
-                    ? input[ch][i] : 0.0f;
-                activeRecording_->channelBuffers[static_cast<size_t>(ch)].push_back(sample);
-            }
-            // Sticky mask: once a channel breaches threshold, include it
-            for (int ch = 0; ch < engineChannels && ch < 64; ++ch) {
-                if (inputChannels_[static_cast<size_t>(ch)].isLive(liveThreshold_)) {
-                    activeRecording_->activeChannelMask |= (uint64_t(1) << ch);
-                }
-            }
-        }
+bool LoopEngine::startArchive(const ArchiveSettings& settings) {
+    archive_.reset();
+    if (settings.directory.empty()) return false;
+    auto archive = std::make_unique<AudioArchive>(
+        settings, static_cast<int>(inputChannels_.size()), sampleRate_);
+    if (!archive->start()) return false;
+    archiveInputs_.assign(inputChannels_.size(), nullptr);
+    archive_ = std::move(archive);
+    return true;
+}
+
+SessionError LoopEngine::saveSession(const std::string& path) {
+    if (!sessions_.beginSave(path)) return SessionError::Busy;
+    EngineCommand cmd;
+    cmd.commandType = CommandType::SaveSession;
+    if (!enqueueCommand(cmd)) {
+        sessions_.cancelSave();
+        return SessionError::Dropped;
+    }
+    return SessionError::None;
+}
+
+SessionError LoopEngine::loadSession(const std::string& path) {
+    return sessions_.beginLoad(path) ? SessionError::None : SessionError::Busy;
+}
+
+void LoopEngine::setStretcherCount(int count) {
+    // Assigned in place: the loops keep pointing at the same pool
+    stretcherPool_ = StretcherPool(count, sampleRate_);
+}
+
+void LoopEngine::processBlock(const float* const* input, int inputChannelCount,
+                              float* output, int numSamples,
+                              float* const* loopOutputs, int loopOutputCount) {
+    // Drain commands from the control threads at the start of each block,
+    // noting when it started so timestamped commands and MIDI clock bytes
+    // can be placed relative to it. The same clock times each stage for the
+    // DSP load stats (lapNanos is where the current stage started).
+    int64_t wallNanos = monotonicNanos();
+    loadMeter_.beginCallback(wallNanos, numSamples);
+    blockStartNanos_ = commandTimestamps() ? wallNanos : -1;
+    midiSync_.beginBlock(wallNanos, numSamples);
+    drainCommands(numSamples);
+    int64_t lapNanos = loadMeter_.lap(DspStage::Ops, wallNanos);
 
-        // Check each loop's pending state
+    int engineChannels = static_cast<int>(inputChannels_.size());
+    loopOutputs_ = loopOutputs;
+    loopOutputCount_ = loopOutputs ? std::min(loopOutputCount, static_cast<int>(loops_.size())) : 0;
+
+    // The block is rendered in sub-blocks that never straddle a pending-op
+    // execution time or a beat, so ops and click retriggers land on the same
+    // sample as a per-sample loop would place them. Within a sub-block each
+    // stage (ingest, loop render, click, mix) runs over the whole range.
+    int pos = 0;
+    while (pos < numSamples) {
         int64_t currentSample = metronome_.position().totalSamples;
-        for (auto& lp : loops_) {
-            if (lp.hasPendingOps()) {
-                flushDueOps(lp, currentSample);
-            }
+        float* inputMix = inputMixScratch_.data();
+
+        // The first sample of the sub-block is ingested before ops fire, so a
+        // capture or record boundary includes it (same ordering as per-sample).
+        uint64_t liveMask = ingestInput(input, inputChannelCount, pos, 1, inputMix);
+        lapNanos = loadMeter_.lap(DspStage::Ingest, lapNanos);
+
+        flushAllDueOps(currentSample);
+        if (applyWorkerResults()) {
+            // Ops held back while a loop was loading can fire now
+            flushAllDueOps(currentSample);
         }
 
-        // Mix output from all playing loops
-        float outSample = 0.0f;
-        for (auto& lp : loops_) {
-            if (!lp.isEmpty()) {
-                outSample += lp.processSample();
-
-                // Accumulate per-channel overdub audio
-                if (lp.isRecording() && lp.id() == overdubLoopIndex_) {
-                    int64_t pos = lp.playPosition();
-                    if (pos >= 0 && pos < lp.lengthSamples()) {
-                        for (int ch = 0; ch < engineChannels; ++ch) {
-                            float sample = (ch < inputChannelCount && input && input[ch])
-                                ? input[ch][i] : 0.0f;
-                            overdubChannelBuffers_[static_cast<size_t>(ch)][static_cast<size_t>(pos)] += sample;
-                        }
-                        // Sticky per-layer mask
-                        for (int ch = 0; ch < engineChannels && ch < 64; ++ch) {
-                            if (inputChannels_[static_cast<size_t>(ch)].isLive(liveThreshold_)) {
-                                overdubActiveChannelMask_ |= (uint64_t(1) << ch);
-                            }
-                        }
-                    }
-                }
+        int n = std::min(numSamples - pos, kMaxSubBlock);
+        if (metronome_.isRunning()) {
+            int64_t nextDue = nextPendingSample();
+            if (nextDue != INT64_MAX) {
+                n = static_cast<int>(std::min<int64_t>(n, std::max<int64_t>(1, nextDue - currentSample)));
             }
+            n = metronome_.samplesUntilNextBeat(n);
         }
+        lapNanos = loadMeter_.lap(DspStage::Ops, lapNanos);
 
-        // Mix metronome click
-        outSample += click_.nextSample();
+        liveMask |= ingestInput(input, inputChannelCount, pos + 1, n - 1, inputMix + 1);
+        lapNanos = loadMeter_.lap(DspStage::Ingest, lapNanos);
 
-        // Input monitoring (pass through all input channels)
-        if (inputMonitoring_) {
-            outSample += inputMix;
-        }
+        float* mix = mixScratch_.data();
+        int64_t stretchNanos = renderSubBlock(input, inputChannelCount, pos, n,
+                                              liveMask, inputMix, mix);
 
         if (output) {
-            output[i] = outSample;
+            std::memcpy(output + pos, mix, static_cast<size_t>(n) * sizeof(float));
         }
+        if (archive_) {
+            // The same channel sources the ingest wrote to the rings
+            for (int ch = 0; ch < engineChannels; ++ch) {
+                archiveInputs_[static_cast<size_t>(ch)] = channelInput(input, inputChannelCount, ch, pos);
+            }
+            archive_->write(archiveInputs_.data(), mix, n);
+        }
+
+        metronome_.advance(n);
+        midiSync_.advance(n);
+        pos += n;
 
-        // Advance metronome and MIDI sync by 1 sample
-        metronome_.advance(1);
-        midiSync_.advance(1);
+        // The stretcher refills ran inside the mix lap
+        lapNanos = loadMeter_.lap(DspStage::Mix, lapNanos);
+        loadMeter_.addStage(DspStage::Mix, -stretchNanos);
+        loadMeter_.addStage(DspStage::Stretch, stretchNanos);
     }
+    loopOutputs_ = nullptr;
+    loopOutputCount_ = 0;
 
     // Update live channel bitmask and threshold breach timestamps
     {
@@ -166,29 +318,266 @@ void LoopEngine::processBlock(const float* const* input, int inputChannelCount,
         }
         liveChannelMask_.store(mask, std::memory_order_relaxed);
     }
+    lapNanos = loadMeter_.lap(DspStage::Ingest, lapNanos);
+
+    // Stretchers for loops that have started or stopped stretching live,
+    // cache renders for loops whose tempo or mix has moved on (or whose
+    // retired cache has finished handing over), and peaks of settled mixes
+    for (auto& lp : loops_) {
+        lp.updateStretcherLease();
+        requestStretchCache(lp);
+        requestPeaks(lp);
+    }
+    loadMeter_.lap(DspStage::Ops, lapNanos);
+
+    // Where the metronome now stands, timed as the start of the next block
+    TimelinePoint& point = publishedTimeline_.writeBuffer();
+    MetronomePosition now = metronome_.position();
+    point.beatsPerBar = metronome_.beatsPerBar();
+    point.beat = static_cast<double>(now.bar) * point.beatsPerBar + now.beat + now.beatFraction;
+    point.bpm = metronome_.bpm();
+    point.nanos = blockStartNanos_ < 0 ? -1 : blockStartNanos_ +
+        static_cast<int64_t>(std::llround(numSamples * 1e9 / sampleRate_));
+    publishedTimeline_.publish();
+
+    // Publishing is timed too, so EngineState::perf lags one block behind
+    publishState();
+    loadMeter_.endCallback(monotonicNanos());
+}
 
-    // Update display snapshot (non-blocking)
-    {
-        std::unique_lock<std::mutex> lock(displayMutex_, std::try_to_lock);
-        if (lock.owns_lock()) {
+const float* LoopEngine::channelInput(const float* const* input, int inputChannelCount,
+                                      int ch, int offset) const {
+    if (ch < inputChannelCount && input && input[ch]) return input[ch] + offset;
+    return silence_.data();
+}
+
+uint64_t LoopEngine::ingestInput(const float* const* input, int inputChannelCount,
+                                 int offset, int numSamples, float* inputMix) {
+    if (numSamples <= 0) return 0;
+
+    int engineChannels = static_cast<int>(inputChannels_.size());
+    std::fill(inputMix, inputMix + numSamples, 0.0f);
+
+    // Write each input channel to its InputChannel and compute
+    // an unfiltered input mix (all channels, no threshold).
+    uint64_t liveMask = 0;
+    for (int ch = 0; ch < engineChannels; ++ch) {
+        const float* src = channelInput(input, inputChannelCount, ch, offset);
+        float peak = inputChannels_[static_cast<size_t>(ch)].writeBlock(src, numSamples);
+        simd::add(inputMix, src, static_cast<size_t>(numSamples));
+        if (ch < 64 && (liveThreshold_ <= 0.0f || peak > liveThreshold_)) {
+            liveMask |= (uint64_t(1) << ch);
+        }
+    }
+
+    // Accumulate per-channel audio into active classic recording.
+    // Sticky mask: once a channel breaches threshold, include it.
+    if (activeRecording_.active) {
+        appendToRecording(input, inputChannelCount, offset, numSamples);
+        if (activeRecording_.active) {
+            activeRecording_.activeChannelMask |= liveMask;
+        }
+    }
+
+    return liveMask;
+}
+
+void LoopEngine::appendToRecording(const float* const* input, int inputChannelCount,
+                                   int offset, int numSamples) {
+    auto& rec = activeRecording_;
+    int engineChannels = static_cast<int>(inputChannels_.size());
+    int chunkSize = recordPool_.chunkSize();
+
+    int written = 0;
+    while (written < numSamples) {
+        int within = static_cast<int>(rec.length % chunkSize);
+        if (within == 0) {
+            // Every channel crosses into a new chunk at the same time
             for (int ch = 0; ch < engineChannels; ++ch) {
-                channelPeaksSnapshot_[static_cast<size_t>(ch)] =
-                    inputChannels_[static_cast<size_t>(ch)].peakLevel();
+                if (!recordPool_.append(rec.channelChunks[static_cast<size_t>(ch)])) {
+                    int idx = rec.loopIndex;
+                    releaseRecording();
+                    emitEvent(EngineEventCode::RecordingCancelled, idx, -1, maxLookbackBars_);
+                    return;
+                }
             }
         }
+
+        int count = std::min(numSamples - written, chunkSize - within);
+        for (int ch = 0; ch < engineChannels; ++ch) {
+            const float* src = channelInput(input, inputChannelCount, ch, offset + written);
+            float* dst = recordPool_.chunkData(rec.channelChunks[static_cast<size_t>(ch)].tail);
+            std::memcpy(dst + within, src, static_cast<size_t>(count) * sizeof(float));
+        }
+        rec.length += count;
+        written += count;
     }
 }
 
+void LoopEngine::releaseRecording() {
+    for (auto& chain : activeRecording_.channelChunks) {
+        recordPool_.release(chain);
+    }
+    activeRecording_.active = false;
+    activeRecording_.loopIndex = -1;
+    activeRecording_.length = 0;
+    activeRecording_.activeChannelMask = 0;
+    isRecordingAtomic_.store(false, std::memory_order_relaxed);
+    recordingLoopIdxAtomic_.store(-1, std::memory_order_relaxed);
+}
+
+int64_t LoopEngine::renderSubBlock(const float* const* input, int inputChannelCount,
+                                int offset, int numSamples, uint64_t liveMask,
+                                const float* inputMix, float* mix) {
+    int engineChannels = static_cast<int>(inputChannels_.size());
+    std::fill(mix, mix + numSamples, 0.0f);
+    int64_t stretchNanos = 0;
+    size_t count = static_cast<size_t>(numSamples);
+
+    // Loop outputs start silent: loops that don't play leave them so, and
+    // the rest render into them before they are summed into the mix
+    for (int i = 0; i < loopOutputCount_; ++i) {
+        if (float* direct = loopOutput(i, offset)) std::fill(direct, direct + numSamples, 0.0f);
+    }
+
+    // Loops other than the one being overdubbed only touch their own state,
+    // so with enough of them they are spread over the render pool. Only the
+    // stretcher time spent on this thread counts towards the Stretch stage.
+    bool parallel = renderPool_ && numSamples >= kMinParallelSamples &&
+                    collectParallelLoops();
+    if (parallel) {
+        poolStretchNanos_ = 0;
+        renderOffset_ = offset;
+        renderPool_->run(&LoopEngine::renderLoopTask, this,
+                         static_cast<int>(renderList_.size()), mix, numSamples);
+        stretchNanos += poolStretchNanos_;
+        for (int idx : renderList_) {
+            if (const float* direct = loopOutput(idx, offset)) simd::add(mix, direct, count);
+        }
+    }
+
+    // Mix output from all playing loops
+    for (auto& lp : loops_) {
+        if (lp.isEmpty()) continue;
+
+        float* direct = loopOutput(lp.id(), offset);
+        if (!(lp.isRecording() && lp.id() == overdubLoopIndex_)) {
+            if (parallel) continue;
+            if (direct) {
+                lp.processBlock(direct, numSamples);
+                simd::add(mix, direct, count);
+            } else {
+                lp.processBlock(mix, numSamples);
+            }
+            stretchNanos += lp.takeStretchNanos();
+            continue;
+        }
+
+        // Overdubbing loop: per-channel input lands at the position the loop
+        // reaches after each sample, so this one is walked sample by sample.
+        // Channels that have not gone live this layer are not written at all.
+        overdubActiveChannelMask_ |= liveMask;  // Sticky per-layer mask
+        bool allChannels = liveThreshold_ <= 0.0f;
+        int64_t chunkSize = recordPool_.chunkSize();
+        for (int i = 0; i < numSamples; ++i) {
+            float sample = lp.processSample();
+            mix[i] += sample;
+            if (direct) direct[i] = sample;
+
+            int64_t pos = lp.playPosition();
+            if (pos < 0 || pos >= lp.lengthSamples() || pos >= overdubTake_.length) continue;
+            size_t slot = static_cast<size_t>(pos / chunkSize);
+            size_t within = static_cast<size_t>(pos % chunkSize);
+            for (int ch = 0; ch < engineChannels; ++ch) {
+                if (!allChannels &&
+                    (ch >= 64 || !(overdubActiveChannelMask_ & (uint64_t(1) << ch)))) {
+                    continue;
+                }
+                float* dst = overdubChunk(static_cast<size_t>(ch), slot);
+                if (!dst) continue;
+                const float* src = channelInput(input, inputChannelCount, ch, offset);
+                dst[within] += src[i];
+            }
+        }
+        stretchNanos += lp.takeStretchNanos();
+    }
+
+    // Mix metronome click
+    click_.mixInto(mix, numSamples);
+
+    // Input monitoring (pass through all input channels)
+    if (inputMonitoring_) {
+        simd::add(mix, inputMix, static_cast<size_t>(numSamples));
+    }
+    return stretchNanos;
+}
+
+bool LoopEngine::collectParallelLoops() {
+    renderList_.clear();
+    int cost = 0;
+    for (int stretched = 1; stretched >= 0; --stretched) {
+        for (const auto& lp : loops_) {
+            if (lp.isEmpty() || lp.isMuted()) continue;
+            if (lp.isRecording() && lp.id() == overdubLoopIndex_) continue;
+            bool live = lp.isTimeStretchActive() && !lp.isStretchCached();
+            if (live != (stretched == 1)) continue;
+            renderList_.push_back(lp.id());
+            cost += stretched ? kStretchedLoopCost : 1;
+        }
+    }
+    return renderList_.size() > 1 && cost >= kMinParallelCost;
+}
+
+void LoopEngine::renderLoopTask(void* context, int task, int participant,
+                                float* output, int numSamples) {
+    auto* self = static_cast<LoopEngine*>(context);
+    int index = self->renderList_[static_cast<size_t>(task)];
+    Loop& lp = self->loops_[static_cast<size_t>(index)];
+    // A loop with an output of its own is summed into the mix afterwards
+    float* direct = self->loopOutput(index, self->renderOffset_);
+    lp.processBlock(direct ? direct : output, numSamples);
+    int64_t nanos = lp.takeStretchNanos();
+    if (participant == 0) self->poolStretchNanos_ += nanos;
+}
+
+void LoopEngine::flushAllDueOps(int64_t currentSample) {
+    if (scheduler_.nextDue() > currentSample) return;
+
+    // Take every due loop off the scheduler, then flush in loop order so ops
+    // due together run in the same order whatever their due times
+    dueLoops_.clear();
+    while (scheduler_.nextDue() <= currentSample) {
+        int idx = scheduler_.nextLoop();
+        scheduler_.update(idx, OpScheduler::kNone);
+        dueLoops_.push_back(idx);
+    }
+    std::sort(dueLoops_.begin(), dueLoops_.end());
+
+    for (int idx : dueLoops_) {
+        Loop& lp = loops_[static_cast<size_t>(idx)];
+        flushDueOps(lp, currentSample);
+        requestMixCache(lp);
+        // Ops not yet due, or held back by a load that just started
+        reschedule(idx);
+    }
+}
+
+void LoopEngine::reschedule(int loopIndex) {
+    size_t i = static_cast<size_t>(loopIndex);
+    // A loading loop keeps its ops until its content has landed
+    scheduler_.update(loopIndex, loopLoading_[i] ? OpScheduler::kNone
+                                                 : loops_[i].pendingState().nextExecuteSample());
+}
+
 void LoopEngine::flushDueOps(Loop& lp, int64_t currentSample) {
     auto& ps = lp.pendingState();
 
     // Clear — if due, execute and cancel everything else
     if (ps.clear && ps.clear->executeSample <= currentSample) {
-        lp.clear();
-        lastMessage_ = "Loop " + std::to_string(lp.id()) + " cleared";
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
+        int64_t due = ps.clear->executeSample;
+        retireStorage(lp.clear());
+        emitEvent(EngineEventCode::LoopCleared, lp.id(), due);
         ps.clearAll();
-        if (callbacks_.onStateChanged) callbacks_.onStateChanged();
         return;
     }
 
@@ -196,7 +585,7 @@ void LoopEngine::flushDueOps(Loop& lp, int64_t currentSample) {
     if (ps.capture && ps.capture->executeSample <= currentSample) {
         PendingCapture cap = *ps.capture;
         ps.capture.reset();
-        fulfillCapture(lp, cap);
+        if (fulfillCapture(lp, cap)) return;
     }
 
     // Record start/stop
@@ -205,93 +594,112 @@ void LoopEngine::flushDueOps(Loop& lp, int64_t currentSample) {
         ps.record.reset();
         if (recordOp == PendingState::RecordOp::Start) {
             fulfillRecord(lp);
-        } else {
-            fulfillStopRecord(lp);
+        } else if (fulfillStopRecord(lp)) {
+            return;
         }
     }
 
     // Mute
     if (ps.mute && ps.mute->executeSample <= currentSample) {
         auto muteOp = ps.muteOp;
+        int64_t due = ps.mute->executeSample;
         ps.mute.reset();
+        bool muted = false;
         switch (muteOp) {
             case PendingState::MuteOp::Mute:
                 lp.mute();
-                lastMessage_ = "Loop " + std::to_string(lp.id()) + " muted";
+                muted = true;
                 break;
             case PendingState::MuteOp::Unmute:
                 lp.play();
-                lastMessage_ = "Loop " + std::to_string(lp.id()) + " unmuted";
                 break;
             case PendingState::MuteOp::Toggle:
                 lp.toggleMute();
-                lastMessage_ = "Loop " + std::to_string(lp.id()) +
-                              (lp.isMuted() ? " muted" : " unmuted");
+                muted = lp.isMuted();
                 break;
         }
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        if (callbacks_.onStateChanged) callbacks_.onStateChanged();
+        emitEvent(muted ? EngineEventCode::LoopMuted : EngineEventCode::LoopUnmuted,
+                  lp.id(), due);
     }
 
     // Overdub
     if (ps.overdub && ps.overdub->executeSample <= currentSample) {
         auto overdubOp = ps.overdubOp;
+        int64_t due = ps.overdub->executeSample;
         ps.overdub.reset();
         if (overdubOp == PendingState::OverdubOp::Start) {
-            lp.startOverdub();
-            // Initialize per-channel overdub buffers
-            int numCh = static_cast<int>(inputChannels_.size());
-            overdubChannelBuffers_.resize(static_cast<size_t>(numCh));
-            for (auto& buf : overdubChannelBuffers_) {
-                buf.assign(static_cast<size_t>(lp.lengthSamples()), 0.0f);
+            // Buffers of an overdub abandoned mid-way are freed on the worker
+            retireOverdubBuffers();
+
+            // The chunk tables and the new layer come from the worker-prepared
+            // kit; allocate here only if it isn't ready. Channel audio is
+            // taken from the record pool only once a channel goes live.
+            int64_t len = lp.lengthSamples();
+            if (overdubKit_.ready() && overdubKit_.length == len) {
+                lp.startOverdub(std::move(overdubKit_.layer));
+                overdubTake_ = std::move(overdubKit_);
+                overdubKit_ = OverdubKit{};
+            } else {
+                lp.startOverdub(std::vector<float>(static_cast<size_t>(len), 0.0f));
+                prepareOverdubTables(overdubTake_, len, inputChannels_.size(),
+                                     recordPool_.chunkSize());
             }
             overdubActiveChannelMask_ = 0;
+            overdubInputDropped_ = false;
             overdubLoopIndex_ = lp.id();
-            lastMessage_ = "Loop " + std::to_string(lp.id()) + " overdub started";
+            emitEvent(EngineEventCode::OverdubStarted, lp.id(), due);
         } else {
-            // Mix down active channels into the overdub layer
-            if (lp.id() == overdubLoopIndex_ && !overdubChannelBuffers_.empty()) {
-                auto& layerAudio = lp.recordLayerAudio();
-                for (size_t ch = 0; ch < overdubChannelBuffers_.size(); ++ch) {
-                    if (liveThreshold_ <= 0.0f ||
-                        (overdubActiveChannelMask_ & (uint64_t(1) << ch))) {
-                        for (size_t j = 0; j < layerAudio.size() &&
-                             j < overdubChannelBuffers_[ch].size(); ++j) {
-                            layerAudio[j] += overdubChannelBuffers_[ch][j];
-                        }
+            // Mix down the live channels into the overdub layer on the worker;
+            // the mixed layer replaces the (silent) recording layer when done.
+            // The take's chunks stay reserved until the result comes back.
+            if (lp.id() == overdubLoopIndex_ && overdubTake_.ready() &&
+                lp.layerCount() > 0) {
+                WorkerJob job;
+                job.type = WorkerJobType::OverdubMixdown;
+                job.loopIndex = lp.id();
+                job.layerIndex = lp.layerCount() - 1;
+                job.generation = lp.contentGeneration();
+                job.length = static_cast<int64_t>(lp.recordLayerAudio().size());
+                job.kit = std::move(overdubTake_);
+                overdubTake_ = OverdubKit{};
+                if (!worker_.post(std::move(job))) {
+                    // Worker queue full: mix here rather than lose the take
+                    overdubTake_ = std::move(job.kit);
+                    std::vector<float> layerAudio(static_cast<size_t>(job.length), 0.0f);
+                    if (overdubTake_.length == job.length) {
+                        mixOverdubTake(overdubTake_, layerAudio.data());
                     }
+                    WorkerJob spent;
+                    spent.audio = lp.swapLayerAudio(job.layerIndex, std::move(layerAudio));
+                    retire(std::move(spent));
                 }
             }
             // Reset per-layer overdub state
-            overdubChannelBuffers_.clear();
+            retireOverdubBuffers();
             overdubActiveChannelMask_ = 0;
             overdubLoopIndex_ = -1;
             lp.stopOverdub();
-            lastMessage_ = "Loop " + std::to_string(lp.id()) + " overdub stopped";
+            requestLayerFold(lp);  // Only if the take was mixed here
+            emitEvent(EngineEventCode::OverdubStopped, lp.id(), due);
         }
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        if (callbacks_.onStateChanged) callbacks_.onStateChanged();
     }
 
     // Reverse
     if (ps.reverse && ps.reverse->executeSample <= currentSample) {
+        int64_t due = ps.reverse->executeSample;
         ps.reverse.reset();
         lp.toggleReverse();
-        lastMessage_ = "Loop " + std::to_string(lp.id()) +
-                      (lp.isReversed() ? " reversed" : " forward");
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        if (callbacks_.onStateChanged) callbacks_.onStateChanged();
+        emitEvent(lp.isReversed() ? EngineEventCode::LoopReversed : EngineEventCode::LoopForward,
+                  lp.id(), due);
     }
 
     // Speed
     if (ps.speed && ps.speed->executeSample <= currentSample) {
         double spd = ps.speed->speed;
+        int64_t due = ps.speed->executeSample;
         ps.speed.reset();
         lp.setSpeed(spd);
-        lastMessage_ = "Loop " + std::to_string(lp.id()) + " speed: " +
-                      std::to_string(spd) + "x";
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        if (callbacks_.onStateChanged) callbacks_.onStateChanged();
+        emitEvent(EngineEventCode::SpeedChanged, lp.id(), due, 0, spd);
     }
 
     // Undo/Redo
@@ -304,15 +712,13 @@ void LoopEngine::flushDueOps(Loop& lp, int64_t currentSample) {
             else
                 lp.redoLayer();
         }
-        std::string verb = (u.direction == UndoDirection::Undo) ? "undone" : "redone";
-        lastMessage_ = "Loop " + std::to_string(lp.id()) + " " +
-                      std::to_string(u.count) + " layer(s) " + verb;
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        if (callbacks_.onStateChanged) callbacks_.onStateChanged();
+        emitEvent(u.direction == UndoDirection::Undo ? EngineEventCode::LayersUndone
+                                                     : EngineEventCode::LayersRedone,
+                  lp.id(), u.executeSample, u.count);
     }
 }
 
-void LoopEngine::fulfillCapture(Loop& lp, const PendingCapture& cap) {
+bool LoopEngine::fulfillCapture(Loop& lp, const PendingCapture& cap) {
     int idx = lp.id();
 
     int64_t lookback = cap.lookbackSamples;
@@ -321,181 +727,706 @@ void LoopEngine::fulfillCapture(Loop& lp, const PendingCapture& cap) {
             std::round(static_cast<double>(lookbackBars_) * metronome_.samplesPerBar()));
     }
 
-    // Clamp to the minimum available across all input channels
+    // Clamp to the minimum available across all input channels (the ring's
+    // worker headroom is not part of the usable lookback)
+    lookback = std::min(lookback, lookbackCapacity_);
     for (auto& ch : inputChannels_) {
         lookback = std::min(lookback, ch.ringBuffer().available());
     }
     if (lookback <= 0) {
-        lastMessage_ = "No audio to capture";
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        return;
+        emitEvent(EngineEventCode::CaptureNoAudio, idx, cap.executeSample);
+        return false;
     }
 
     int captureLen = static_cast<int>(lookback);
 
-    // Capture from each input channel and mix down to mono.
-    // A channel is included if it exceeded the live threshold at any point
-    // during the capture window (checked via lastThresholdBreachSample_,
-    // an O(1) lookup updated each processBlock). This avoids scanning the
-    // entire captured segment and ensures the full channel audio is included
-    // whenever the channel had activity during the lookback period.
+    // Pick the channels to mix down. A channel is included if it exceeded
+    // the live threshold at any point during the capture window (checked via
+    // lastThresholdBreachSample_, an O(1) lookup updated each processBlock).
+    // This avoids scanning the entire captured segment and ensures the full
+    // channel audio is included whenever the channel had activity during the
+    // lookback period.
     // Apply latency compensation: read from further back in the ring buffer
     // to align captured audio with the metronome's internal timeline.
-    int64_t samplesAgo = static_cast<int64_t>(captureLen) + latencyCompensation_;
+    int64_t samplesAgo = static_cast<int64_t>(captureLen) + latencyCompensation();
     int64_t currentSample = metronome_.position().totalSamples;
     int64_t captureStartSample = currentSample - samplesAgo;
-    std::vector<float> audio(static_cast<size_t>(captureLen), 0.0f);
+    uint64_t mask = 0;
     int liveCount = 0;
     int engineChannels = static_cast<int>(inputChannels_.size());
     for (int chIdx = 0; chIdx < engineChannels; ++chIdx) {
         bool hadActivity = (liveThreshold_ <= 0.0f) ||
             (lastThresholdBreachSample_[static_cast<size_t>(chIdx)] >= captureStartSample);
-
         if (hadActivity) {
-            std::vector<float> chAudio(static_cast<size_t>(captureLen), 0.0f);
-            inputChannels_[static_cast<size_t>(chIdx)].ringBuffer()
-                .readFromPast(chAudio.data(), captureLen, samplesAgo);
-            for (size_t j = 0; j < audio.size(); ++j) {
-                audio[j] += chAudio[j];
-            }
+            if (chIdx < 64) mask |= (uint64_t(1) << chIdx);
             ++liveCount;
         }
     }
 
     if (liveCount == 0) {
-        lastMessage_ = "No live input channels to capture";
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        return;
+        emitEvent(EngineEventCode::CaptureNoLiveChannels, idx, cap.executeSample);
+        return false;
     }
 
-    lp.loadFromCapture(std::move(audio));
-    lp.setCrossfadeSamples(crossfadeSamples_);
-
-    double bars = static_cast<double>(lookback) / metronome_.samplesPerBar();
-    lp.setLengthInBars(bars);
-
-    // Record the BPM at capture time for time stretching
-    lp.setRecordedBpm(metronome_.bpm());
-    lp.setCurrentBpm(metronome_.bpm());
+    // Copying and summing the history is the worker's job; the loop starts
+    // from this boundary once the audio lands.
+    WorkerJob job;
+    job.type = WorkerJobType::Capture;
+    job.loopIndex = idx;
+    job.boundarySample = currentSample;
+    job.bpm = metronome_.bpm();
+    job.samplesPerBar = metronome_.samplesPerBar();
+    job.liveCount = liveCount;
+    job.channelMask = mask;
+    job.allChannels = liveThreshold_ <= 0.0f;
+    job.samplesAgo = samplesAgo;
+    job.writtenAt = inputChannels_[0].ringBuffer().totalWritten();
+    job.length = captureLen;
+    job.generation = sessionLoads_;
+    int64_t historyStart = job.writtenAt - samplesAgo;
+    if (!worker_.post(std::move(job))) {
+        emitEvent(EngineEventCode::CaptureDropped, idx, cap.executeSample);
+        return false;
+    }
 
-    std::ostringstream msg;
-    msg << "Loop " << idx << " captured (" << static_cast<int>(std::round(bars))
-        << " bars, " << liveCount << " ch)";
-    lastMessage_ = msg.str();
-    if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-    if (callbacks_.onStateChanged) callbacks_.onStateChanged();
+    retireStorage(lp.clear());
+    loopLoading_[static_cast<size_t>(idx)] = 1;
+
+    // Meanwhile play the region from the rings, if it is all still in RAM
+    // (a spilling ring keeps only its recent window there). The copy takes
+    // over at the same position when it lands.
+    bool inRam = historyStart >= 0;
+    for (int chIdx = 0; chIdx < engineChannels && inRam; ++chIdx) {
+        bool included = liveThreshold_ <= 0.0f || (chIdx < 64 && (mask & (uint64_t(1) << chIdx)));
+        if (included && inputChannels_[static_cast<size_t>(chIdx)].ringBuffer().ramFrom() > historyStart) {
+            inRam = false;
+        }
+    }
+    if (inRam) {
+        CaptureSource& source = captureSources_[static_cast<size_t>(idx)];
+        source.begin(historyStart, mask, liveThreshold_ <= 0.0f);
+        lp.preview(&source, captureLen);
+        lp.setCrossfadeSamples(crossfadeSamples_);
+        lp.setLengthInBars(static_cast<double>(captureLen) / metronome_.samplesPerBar());
+        lp.setRecordedBpm(metronome_.bpm());
+        lp.setCurrentBpm(metronome_.bpm());
+    }
+    return true;
 }
 
 void LoopEngine::fulfillRecord(Loop& lp) {
     int idx = lp.id();
 
-    if (activeRecording_) {
-        lastMessage_ = "Already recording on Loop " +
-                       std::to_string(activeRecording_->loopIndex);
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
+    if (activeRecording_.active) {
+        emitEvent(EngineEventCode::AlreadyRecording, activeRecording_.loopIndex);
+        return;
+    }
+
+    // The previous recording's chains are still with the worker
+    if (spareRecordChains_.empty()) {
+        emitEvent(EngineEventCode::PreviousRecordingMixing, idx);
         return;
     }
 
     // Clear the target loop if it has content
-    lp.clear();
+    retireStorage(lp.clear());
 
-    // Start accumulating per-channel input
-    ActiveRecording rec;
-    rec.loopIndex = idx;
-    rec.startSample = metronome_.position().totalSamples;
-    int numCh = static_cast<int>(inputChannels_.size());
-    rec.channelBuffers.resize(static_cast<size_t>(numCh));
-    activeRecording_ = std::move(rec);
+    // Start accumulating per-channel input (chunks come from recordPool_)
+    activeRecording_.active = true;
+    activeRecording_.loopIndex = idx;
+    activeRecording_.startSample = metronome_.position().totalSamples;
+    activeRecording_.length = 0;
+    activeRecording_.activeChannelMask = 0;
 
     isRecordingAtomic_.store(true, std::memory_order_relaxed);
     recordingLoopIdxAtomic_.store(idx, std::memory_order_relaxed);
 
-    lastMessage_ = "Loop " + std::to_string(idx) + " recording...";
-    if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-    if (callbacks_.onStateChanged) callbacks_.onStateChanged();
+    emitEvent(EngineEventCode::RecordingStarted, idx);
 }
 
-void LoopEngine::fulfillStopRecord(Loop& lp) {
-    if (!activeRecording_) {
-        lastMessage_ = "No active recording";
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        return;
+bool LoopEngine::fulfillStopRecord(Loop& lp) {
+    if (!activeRecording_.active) {
+        emitEvent(EngineEventCode::NoActiveRecording, lp.id());
+        return false;
     }
 
-    int idx = activeRecording_->loopIndex;
+    int idx = activeRecording_.loopIndex;
 
     // Ignore if the stop targets a different loop than what's recording
     if (lp.id() != idx) {
-        lastMessage_ = "Stop ignored: recording is on Loop " + std::to_string(idx);
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        return;
+        emitEvent(EngineEventCode::StopRecordIgnored, idx);
+        return false;
     }
 
     // Mix down per-channel buffers, including only channels that breached
     // the threshold at any point during the recording (sticky inclusion).
-    auto& rec = *activeRecording_;
-    size_t len = rec.channelBuffers.empty() ? 0 : rec.channelBuffers[0].size();
+    auto& rec = activeRecording_;
+    int64_t len = rec.length;
 
-    // Apply latency compensation: trim the first latencyCompensation_ samples
+    // Apply latency compensation: trim the first latencyCompensation() samples
     // from each channel (audio from before the intended recording start).
-    size_t trimFront = 0;
-    if (latencyCompensation_ > 0 && static_cast<int64_t>(len) > latencyCompensation_) {
-        trimFront = static_cast<size_t>(latencyCompensation_);
-    }
-    size_t mixLen = len - trimFront;
-
-    if (mixLen == 0) {
-        lastMessage_ = "No audio recorded";
-        activeRecording_.reset();
-        isRecordingAtomic_.store(false, std::memory_order_relaxed);
-        recordingLoopIdxAtomic_.store(-1, std::memory_order_relaxed);
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-        return;
+    int64_t trimFront = 0;
+    int64_t compensation = latencyCompensation();
+    if (compensation > 0 && len > compensation) {
+        trimFront = compensation;
+    }
+
+    if (len - trimFront == 0) {
+        releaseRecording();
+        emitEvent(EngineEventCode::NoAudioRecorded, idx);
+        return false;
     }
 
-    std::vector<float> mixed(mixLen, 0.0f);
     int liveCount = 0;
-    for (size_t ch = 0; ch < rec.channelBuffers.size(); ++ch) {
+    for (size_t ch = 0; ch < rec.channelChunks.size(); ++ch) {
         if (liveThreshold_ <= 0.0f ||
             (rec.activeChannelMask & (uint64_t(1) << ch))) {
-            for (size_t j = 0; j < mixLen; ++j) {
-                mixed[j] += rec.channelBuffers[ch][trimFront + j];
-            }
             ++liveCount;
         }
     }
 
     if (liveCount == 0) {
-        lastMessage_ = "No active channels recorded";
-        activeRecording_.reset();
-        isRecordingAtomic_.store(false, std::memory_order_relaxed);
-        recordingLoopIdxAtomic_.store(-1, std::memory_order_relaxed);
-        if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
+        releaseRecording();
+        emitEvent(EngineEventCode::NoActiveChannelsRecorded, idx);
+        return false;
+    }
+
+    // Hand the chains to the worker for mixdown. The spare table takes their
+    // place, so the pool keeps them reserved until the result comes back.
+    WorkerJob job;
+    job.type = WorkerJobType::RecordMixdown;
+    job.loopIndex = idx;
+    job.boundarySample = metronome_.position().totalSamples;
+    job.bpm = metronome_.bpm();
+    job.samplesPerBar = metronome_.samplesPerBar();
+    job.liveCount = liveCount;
+    job.channelMask = rec.activeChannelMask;
+    job.allChannels = liveThreshold_ <= 0.0f;
+    job.length = len;
+    job.trimFront = trimFront;
+    job.chains = std::move(rec.channelChunks);
+    job.generation = sessionLoads_;
+    if (!worker_.post(std::move(job))) {
+        rec.channelChunks = std::move(job.chains);
+        emitEvent(EngineEventCode::StopRecordDropped, idx);
+        return false;
+    }
+    rec.channelChunks = std::move(spareRecordChains_);
+    spareRecordChains_.clear();
+
+    releaseRecording();
+    retireStorage(lp.clear());
+    loopLoading_[static_cast<size_t>(idx)] = 1;
+    return true;
+}
+
+void LoopEngine::runWorkerJob(WorkerJob& job) {
+    auto includes = [&job](size_t ch) {
+        return job.allChannels || (ch < 64 && (job.channelMask & (uint64_t(1) << ch)));
+    };
+
+    switch (job.type) {
+        case WorkerJobType::Capture: {
+            size_t len = static_cast<size_t>(job.length);
+            std::vector<float> audio = layerBuffers_.take(len);
+            std::vector<float> chAudio = layerBuffers_.take(len);
+            for (size_t ch = 0; ch < inputChannels_.size(); ++ch) {
+                if (!includes(ch)) continue;
+                // The audio thread (and the spiller) kept writing while we
+                // copied. If either came round to the oldest sample we read,
+                // the copy may be torn.
+                if (!inputChannels_[ch].ringBuffer().readFromPast(
+                        chAudio.data(), static_cast<int>(len), job.samplesAgo, job.writtenAt)) {
+                    job.ok = false;
+                    break;
+                }
+                simd::add(audio.data(), chAudio.data(), len);
+            }
+            layerBuffers_.give(std::move(chAudio));
+            if (!job.ok) {
+                layerBuffers_.give(std::move(audio));
+                return;
+            }
+            job.storage = Loop::prepareStorage(std::move(audio));
+            break;
+        }
+        case WorkerJobType::RecordMixdown: {
+            size_t len = static_cast<size_t>(job.length);
+            size_t trimFront = static_cast<size_t>(job.trimFront);
+            std::vector<float> mixed = layerBuffers_.take(len - trimFront);
+            size_t chunkSize = static_cast<size_t>(recordPool_.chunkSize());
+            for (size_t ch = 0; ch < job.chains.size(); ++ch) {
+                if (!includes(ch)) continue;
+                // Walk the channel's chunk chain, skipping the trimmed front
+                size_t base = 0;
+                for (uint32_t c = job.chains[ch].head;
+                     c != SampleChunkPool::kNoChunk && base < len;
+                     c = recordPool_.next(c), base += chunkSize) {
+                    const float* data = recordPool_.chunkData(c);
+                    size_t from = std::max(base, trimFront);
+                    size_t to = std::min(base + chunkSize, len);
+                    if (from < to) {
+                        simd::add(mixed.data() + (from - trimFront), data + (from - base),
+                                  to - from);
+                    }
+                }
+            }
+            job.storage = Loop::prepareStorage(std::move(mixed));
+            break;
+        }
+        case WorkerJobType::OverdubMixdown: {
+            std::vector<float> mixed = layerBuffers_.take(static_cast<size_t>(job.length));
+            if (job.kit.length == job.length) {
+                mixOverdubTake(job.kit, mixed.data());
+            }
+            job.audio = std::move(mixed);
+
+            // Clear the chunk table so the kit can serve the next overdub;
+            // the chunks go back to the pool on the audio thread
+            std::fill(job.kit.chunks.begin(), job.kit.chunks.end(), SampleChunkPool::kNoChunk);
+            job.kit.length = job.length;
+            break;
+        }
+        case WorkerJobType::PrepareOverdub:
+            prepareOverdubTables(job.kit, job.length, inputChannels_.size(),
+                                 recordPool_.chunkSize());
+            layerBuffers_.give(std::move(job.kit.layer));
+            job.kit.layer = layerBuffers_.take(static_cast<size_t>(job.length));
+            break;
+        case WorkerJobType::MixCache:
+            job.audio = layerBuffers_.take(static_cast<size_t>(job.mixPlan.length));
+            Loop::sumMix(job.mixPlan, job.audio.data());
+            break;
+        case WorkerJobType::StretchSource:
+            job.audio = Loop::buildStretchSource(job.stretchPlan);
+            break;
+        case WorkerJobType::StretchRender:
+            job.ok = Loop::renderStretchCache(job.audio, job.stretchPlan,
+                                              *cacheStretcher_, tempoGeneration_);
+            break;
+        case WorkerJobType::SessionSnapshot:
+            // Layers the audio thread retired after the snapshot are freed
+            // behind this job, so every pointer in the plan is still good
+            sessions_.save(job.session->copy());
+            break;
+        case WorkerJobType::FoldLayers:
+            // The folded layers come back in storage.layers, reserved here
+            job.audio = layerBuffers_.take(static_cast<size_t>(job.mixPlan.length));
+            Loop::sumMix(job.mixPlan, job.audio.data());
+            job.storage.layers.reserve(static_cast<size_t>(job.foldLayers));
+            break;
+        case WorkerJobType::Peaks: {
+            // Nothing goes back to the audio thread: readers take the
+            // peaks from loopPeaks_
+            std::shared_ptr<PeakPyramid> pyramid;
+            if (job.mixPlan.length > 0) {
+                pyramid = std::make_shared<PeakPyramid>(job.mixPlan.length);
+                if (job.mixPlan.base) pyramid->write(job.mixPlan.base, 0, job.mixPlan.length);
+            }
+            {
+                std::lock_guard<std::mutex> lock(peaksMutex_);
+                LoopPeaks& peaks = loopPeaks_[static_cast<size_t>(job.loopIndex)];
+                peaks.pyramid = std::move(pyramid);
+                peaks.revision = ++peaksRevision_;
+            }
+            job.type = WorkerJobType::Free;
+            break;
+        }
+        case WorkerJobType::Free:
+            // Loop-length buffers are kept for reuse; the rest is destroyed
+            // with the job
+            layerBuffers_.give(std::move(job.audio));
+            layerBuffers_.give(std::move(job.kit.layer));
+            for (auto& layer : job.storage.layers) {
+                layerBuffers_.give(std::move(layer.audio));
+            }
+            layerBuffers_.give(std::move(job.storage.mixCache));
+            break;
+    }
+}
+
+bool LoopEngine::applyWorkerResults() {
+    // Retry retirements that found the worker queue full
+    while (!deferredRetire_.empty() && worker_.post(std::move(deferredRetire_.back()))) {
+        deferredRetire_.pop_back();
+    }
+
+    bool loaded = false;
+    WorkerJob job;
+    while (worker_.poll(job) || stretchWorker_.poll(job)) {
+        switch (job.type) {
+            case WorkerJobType::Capture:
+            case WorkerJobType::RecordMixdown: {
+                int idx = job.loopIndex;
+                bool isCapture = job.type == WorkerJobType::Capture;
+                if (!isCapture) {
+                    // Chunks go back to the pool; the table becomes the spare
+                    for (auto& chain : job.chains) {
+                        recordPool_.release(chain);
+                    }
+                    spareRecordChains_ = std::move(job.chains);
+                }
+
+                // A session loaded since: the slot is the session's now
+                if (job.generation != sessionLoads_) {
+                    retireStorage(std::move(job.storage));
+                    break;
+                }
+
+                loopLoading_[static_cast<size_t>(idx)] = 0;
+                reschedule(idx);  // Its held-back ops are due again
+                loaded = true;
+
+                if (!job.ok) {
+                    // A torn copy means the preview has gone silent too
+                    Loop& failed = loops_[static_cast<size_t>(idx)];
+                    if (isCapture && failed.isPreview()) retireStorage(failed.clear());
+                    emitEvent(EngineEventCode::CaptureFailed, idx, job.boundarySample);
+                    break;
+                }
+
+                // Start playback at the phase it would have at this sample had
+                // it started on the boundary
+                Loop& lp = loops_[static_cast<size_t>(idx)];
+                retireStorage(lp.load(std::move(job.storage)));
+                lp.skipAhead(metronome_.position().totalSamples - job.boundarySample);
+                lp.setCrossfadeSamples(crossfadeSamples_);
+
+                double bars = static_cast<double>(lp.lengthSamples()) / job.samplesPerBar;
+                lp.setLengthInBars(bars);
+
+                // Record the BPM at capture time for time stretching
+                lp.setRecordedBpm(job.bpm);
+                lp.setCurrentBpm(metronome_.bpm());
+
+                emitEvent(isCapture ? EngineEventCode::LoopCaptured : EngineEventCode::LoopRecorded,
+                          idx, job.boundarySample, job.liveCount, bars);
+
+                // Have buffers ready for the overdub that usually follows
+                requestOverdubKit(lp.lengthSamples());
+                requestMixCache(lp);
+                break;
+            }
+            case WorkerJobType::OverdubMixdown: {
+                for (auto& chain : job.kit.chains) {
+                    recordPool_.release(chain);
+                }
+                Loop& lp = loops_[static_cast<size_t>(job.loopIndex)];
+                if (lp.contentGeneration() == job.generation) {
+                    // The swapped-out recording layer is silent: it becomes
+                    // the kit's layer buffer
+                    auto old = lp.swapLayerAudio(job.layerIndex, std::move(job.audio));
+                    if (old.size() == static_cast<size_t>(job.kit.length)) {
+                        job.kit.layer = std::move(old);
+                    } else {
+                        job.audio = std::move(old);
+                    }
+                }
+                if (job.kit.layer.size() == static_cast<size_t>(job.kit.length) &&
+                    !overdubKitPending_) {
+                    std::swap(overdubKit_, job.kit);
+                }
+                requestLayerFold(lp);
+                requestMixCache(lp);
+                retire(std::move(job));
+                break;
+            }
+            case WorkerJobType::MixCache: {
+                Loop& lp = loops_[static_cast<size_t>(job.loopIndex)];
+                job.audio = lp.installMixCache(job.mixPlan.generation,
+                                               job.mixPlan.layerMask,
+                                               std::move(job.audio));
+                // If the mix moved on while this was being built, try again
+                requestMixCache(lp);
+                retire(std::move(job));
+                break;
+            }
+            case WorkerJobType::StretchSource: {
+                // The source is summed; the long part runs on the stretch worker
+                Loop& lp = loops_[static_cast<size_t>(job.loopIndex)];
+                if (lp.stretchPlanCurrent(job.stretchPlan)) {
+                    job.type = WorkerJobType::StretchRender;
+                    if (stretchWorker_.post(std::move(job))) break;
+                }
+                lp.cancelStretchCachePlan(job.stretchPlan);
+                retire(std::move(job));
+                break;
+            }
+            case WorkerJobType::StretchRender: {
+                Loop& lp = loops_[static_cast<size_t>(job.loopIndex)];
+                lp.cancelStretchCachePlan(job.stretchPlan);
+                if (job.ok) {
+                    job.audio = lp.installStretchCache(job.stretchPlan, std::move(job.audio));
+                }
+                retire(std::move(job));
+                break;
+            }
+            case WorkerJobType::PrepareOverdub: {
+                overdubKitPending_ = false;
+                std::swap(overdubKit_, job.kit);
+                retire(std::move(job));
+                break;
+            }
+            case WorkerJobType::SessionSnapshot:
+                // The copy is taken; the plan serves the next save
+                sessionPlan_ = std::move(job.session);
+                break;
+            case WorkerJobType::FoldLayers: {
+                // On success job.audio holds the old base; otherwise the
+                // unused fold. Either way it goes back with the folded layers.
+                Loop& lp = loops_[static_cast<size_t>(job.loopIndex)];
+                lp.applyConsolidation(job.mixPlan.generation, job.foldLayers, job.audio,
+                                      job.storage.layers);
+                requestLayerFold(lp);  // What is left, or a retry
+                requestMixCache(lp);
+                retire(std::move(job));
+                break;
+            }
+            case WorkerJobType::Peaks:  // Ends on the worker
+            case WorkerJobType::Free:
+                break;
+        }
+    }
+
+    SessionStore::Result session;
+    while (sessions_.poll(session)) {
+        applySessionResult(session);
+    }
+    return loaded;
+}
+
+void LoopEngine::snapshotSession() {
+    auto fail = [this](SessionError error) {
+        sessions_.cancelSave();
+        emitEvent(EngineEventCode::SessionSaveFailed, -1, -1, static_cast<int>(error));
+    };
+    if (!sessionPlan_) {
+        fail(SessionError::Busy);
         return;
     }
 
-    // Load the mixed audio into the loop
-    lp.loadFromCapture(std::move(mixed));
-    lp.setCrossfadeSamples(crossfadeSamples_);
+    SessionPlan& plan = *sessionPlan_;
+    plan.sampleRate = sampleRate_;
+    plan.bpm = metronome_.bpm();
+    plan.beatsPerBar = metronome_.beatsPerBar();
+    plan.numLoops = 0;
+    for (const auto& lp : loops_) {
+        // A capture still previewing from the rings has nothing to save yet
+        if (lp.isEmpty() || lp.isPreview()) continue;
+        auto& out = plan.loops[static_cast<size_t>(plan.numLoops)];
+        out.numLayers = lp.snapshotLayers(out.layers.data(), kMaxCachedLayers);
+        if (out.numLayers < 0) {
+            fail(SessionError::TooManyLayers);
+            return;
+        }
+        out.index = lp.id();
+        out.muted = lp.isMuted();
+        out.reversed = lp.isReversed();
+        out.speed = lp.speed();
+        out.lengthInBars = lp.lengthInBars();
+        out.recordedBpm = lp.recordedBpm();
+        out.length = lp.lengthSamples();
+        ++plan.numLoops;
+    }
+
+    WorkerJob job;
+    job.type = WorkerJobType::SessionSnapshot;
+    job.session = std::move(sessionPlan_);
+    if (!worker_.post(std::move(job))) {
+        sessionPlan_ = std::move(job.session);
+        fail(SessionError::Dropped);
+    }
+}
 
-    double bars = static_cast<double>(lp.lengthSamples()) / metronome_.samplesPerBar();
-    lp.setLengthInBars(bars);
+void LoopEngine::applySessionResult(SessionStore::Result& result) {
+    using Kind = SessionStore::Result::Kind;
+    switch (result.kind) {
+        case Kind::Saved:
+            emitEvent(EngineEventCode::SessionSaved, -1, -1, result.loops);
+            break;
+        case Kind::SaveFailed:
+            emitEvent(EngineEventCode::SessionSaveFailed, -1, -1, static_cast<int>(result.error));
+            break;
+        case Kind::LoadStarted: {
+            // The session replaces every loop, in its own tempo and metre
+            // (saved lengths in bars only hold in it). A recording
+            // or overdub under way is abandoned, and captures and recordings
+            // still with the worker are dropped when they come back.
+            if (activeRecording_.active) releaseRecording();
+            retireOverdubBuffers();
+            overdubActiveChannelMask_ = 0;
+            overdubLoopIndex_ = -1;
+            ++sessionLoads_;
+            for (auto& lp : loops_) {
+                retireStorage(lp.clear());
+                lp.clearPendingOps();
+                loopLoading_[static_cast<size_t>(lp.id())] = 0;
+                reschedule(lp.id());
+            }
+            metronome_.setBeatsPerBar(result.beatsPerBar);
+            if (beatsPerBarChangedCallback_) beatsPerBarChangedCallback_(metronome_.beatsPerBar());
+            applyBpm(result.bpm);
+
+            // Loops play from the start of this bar, as if loaded on it
+            MetronomePosition pos = metronome_.position();
+            sessionAnchor_ = pos.totalSamples - static_cast<int64_t>(std::llround(
+                (pos.beat + pos.beatFraction) * metronome_.samplesPerBeat()));
+            break;
+        }
+        case Kind::LoopLoaded: {
+            Loop& lp = loops_[static_cast<size_t>(result.loop.index)];
+            const SessionLoop& saved = result.loop;
+            retireStorage(lp.load(std::move(result.storage)));
+            lp.setCrossfadeSamples(crossfadeSamples_);
+            lp.setLengthInBars(saved.lengthInBars);
+            lp.setRecordedBpm(saved.recordedBpm);
+            lp.setCurrentBpm(metronome_.bpm());
+            lp.setSpeed(saved.speed);
+            if (saved.reversed) lp.toggleReverse();
+            if (saved.muted) lp.mute();
+            lp.skipAhead(metronome_.position().totalSamples - sessionAnchor_);
+            requestLayerFold(lp);
+            requestMixCache(lp);
+            break;
+        }
+        case Kind::Loaded:
+            emitEvent(EngineEventCode::SessionLoaded, -1, -1, result.loops, result.bpm);
+            break;
+        case Kind::LoadFailed:
+            emitEvent(EngineEventCode::SessionLoadFailed, -1, -1, static_cast<int>(result.error));
+            break;
+    }
+}
 
-    // Record the BPM at recording time for time stretching
-    lp.setRecordedBpm(metronome_.bpm());
-    lp.setCurrentBpm(metronome_.bpm());
+void LoopEngine::retire(WorkerJob job) {
+    job.type = WorkerJobType::Free;
+    if (worker_.post(std::move(job))) return;
+    if (deferredRetire_.size() < kMaxDeferredRetire) {
+        deferredRetire_.push_back(std::move(job));
+    }
+    // Otherwise `job` is destroyed here
+}
 
-    activeRecording_.reset();
-    isRecordingAtomic_.store(false, std::memory_order_relaxed);
-    recordingLoopIdxAtomic_.store(-1, std::memory_order_relaxed);
+void LoopEngine::retireStorage(LoopStorage storage) {
+    if (storage.empty()) return;
+    WorkerJob job;
+    job.storage = std::move(storage);
+    retire(std::move(job));
+}
 
-    std::ostringstream msg;
-    msg << "Loop " << idx << " recorded ("
-        << std::fixed << std::setprecision(1) << bars << " bars, "
-        << liveCount << " ch)";
-    lastMessage_ = msg.str();
-    if (callbacks_.onMessage) callbacks_.onMessage(lastMessage_);
-    if (callbacks_.onStateChanged) callbacks_.onStateChanged();
+void LoopEngine::retireOverdubBuffers() {
+    if (!overdubTake_.ready()) return;
+    for (auto& chain : overdubTake_.chains) {
+        recordPool_.release(chain);
+    }
+    WorkerJob job;
+    job.kit = std::move(overdubTake_);
+    overdubTake_ = OverdubKit{};
+    retire(std::move(job));
+}
+
+float* LoopEngine::overdubChunk(size_t ch, size_t slot) {
+    uint32_t& chunk = overdubTake_.chunks[ch * static_cast<size_t>(overdubTake_.chunksPerChannel) + slot];
+    if (chunk != SampleChunkPool::kNoChunk) return recordPool_.chunkData(chunk);
+
+    ChunkChain& chain = overdubTake_.chains[ch];
+    float* data = recordPool_.append(chain);
+    if (!data) {
+        if (!overdubInputDropped_) {
+            overdubInputDropped_ = true;
+            emitEvent(EngineEventCode::OverdubInputDropped, overdubLoopIndex_);
+        }
+        return nullptr;
+    }
+    std::fill(data, data + recordPool_.chunkSize(), 0.0f);
+    chunk = chain.tail;
+    return data;
+}
+
+void LoopEngine::mixOverdubTake(const OverdubKit& take, float* out) const {
+    size_t chunkSize = static_cast<size_t>(recordPool_.chunkSize());
+    size_t len = static_cast<size_t>(take.length);
+    size_t perChannel = static_cast<size_t>(take.chunksPerChannel);
+    for (size_t ch = 0; ch < take.chains.size(); ++ch) {
+        if (take.chains[ch].empty()) continue;  // Never went live
+        const uint32_t* row = take.chunks.data() + ch * perChannel;
+        for (size_t slot = 0; slot < perChannel; ++slot) {
+            if (row[slot] == SampleChunkPool::kNoChunk) continue;
+            size_t base = slot * chunkSize;
+            simd::add(out + base, recordPool_.chunkData(row[slot]),
+                      std::min(chunkSize, len - base));
+        }
+    }
+}
+
+void LoopEngine::requestMixCache(Loop& lp) {
+    if (!lp.needsMixCache()) return;
+
+    WorkerJob job;
+    job.type = WorkerJobType::MixCache;
+    job.loopIndex = lp.id();
+    lp.planMixCache(job.mixPlan);
+    if (!worker_.post(std::move(job))) {
+        // Playback keeps summing layers; ask again on the next change
+        lp.cancelMixCachePlan();
+    }
+}
+
+void LoopEngine::requestStretchCache(Loop& lp) {
+    if (!stretchCacheEnabled_ || !lp.needsStretchCache()) return;
+
+    WorkerJob job;
+    job.type = WorkerJobType::StretchSource;
+    job.loopIndex = lp.id();
+    lp.planStretchCache(job.stretchPlan);
+    job.stretchPlan.tempoGeneration = tempoGeneration_.load(std::memory_order_relaxed);
+    if (!worker_.post(std::move(job))) {
+        // The live stretcher keeps playing; the next block asks again
+        lp.cancelStretchCachePlan(job.stretchPlan);
+    }
+}
+
+void LoopEngine::requestPeaks(Loop& lp) {
+    if (!lp.needsPeaks()) return;
+
+    WorkerJob job;
+    job.type = WorkerJobType::Peaks;
+    job.loopIndex = lp.id();
+    lp.planPeaks(job.mixPlan);
+    if (!worker_.post(std::move(job))) {
+        // The old peaks stay up; the next block asks again
+        lp.cancelPeaksPlan();
+    }
+}
+
+void LoopEngine::requestOverdubKit(int64_t length) {
+    if (length <= 0 || overdubKitPending_) return;
+    if (overdubKit_.ready() && overdubKit_.length == length) return;
+
+    // The stale kit rides along and is freed on the worker
+    WorkerJob job;
+    job.type = WorkerJobType::PrepareOverdub;
+    job.length = length;
+    job.kit = std::move(overdubKit_);
+    overdubKit_ = OverdubKit{};
+    if (worker_.post(std::move(job))) {
+        overdubKitPending_ = true;
+    } else {
+        overdubKit_ = std::move(job.kit);
+    }
+}
+
+void LoopEngine::requestLayerFold(Loop& lp) {
+    if (undoDepth_ <= 0) return;
+
+    WorkerJob job;
+    job.type = WorkerJobType::FoldLayers;
+    job.loopIndex = lp.id();
+    if (!lp.planConsolidation(undoDepth_, job.mixPlan, job.foldLayers)) return;
+    if (!worker_.post(std::move(job))) {
+        // The layers stay; the next overdub asks again
+        lp.cancelConsolidation();
+    }
 }
 
 void LoopEngine::scheduleOp(OpType type, int loopIndex, Quantize quantize) {
@@ -505,15 +1436,6 @@ void LoopEngine::scheduleOp(OpType type, int loopIndex, Quantize quantize) {
     cmd.loopIndex = loopIndex;
     cmd.quantize = quantize;
     enqueueCommand(cmd);
-
-    // Generate message on TUI thread
-    std::string msg = opTypeDescription(type);
-    if (quantize != Quantize::Free) {
-        msg += " (pending: ";
-        msg += (quantize == Quantize::Beat ? "next beat" : "next bar");
-        msg += ")";
-    }
-    if (callbacks_.onMessage) callbacks_.onMessage(msg);
 }
 
 void LoopEngine::scheduleCaptureLoop(int loopIndex, Quantize quantize,
@@ -529,13 +1451,6 @@ void LoopEngine::scheduleCaptureLoop(int loopIndex, Quantize quantize,
     cmd.quantize = quantize;
     cmd.lookbackBars = bars;
     enqueueCommand(cmd);
-
-    std::ostringstream msg;
-    msg << "Capture " << bars << " bar(s) -> Loop " << targetLoop;
-    if (quantize != Quantize::Free) {
-        msg << " (pending: " << (quantize == Quantize::Beat ? "next beat" : "next bar") << ")";
-    }
-    if (callbacks_.onMessage) callbacks_.onMessage(msg.str());
 }
 
 void LoopEngine::scheduleSetSpeed(int loopIndex, double speed, Quantize quantize) {
@@ -555,13 +1470,6 @@ void LoopEngine::scheduleRecord(int loopIndex, Quantize quantize) {
     cmd.loopIndex = targetLoop;
     cmd.quantize = quantize;
     enqueueCommand(cmd);
-
-    std::ostringstream msg;
-    msg << "Record -> Loop " << targetLoop;
-    if (quantize != Quantize::Free) {
-        msg << " (pending: " << (quantize == Quantize::Beat ? "next beat" : "next bar") << ")";
-    }
-    if (callbacks_.onMessage) callbacks_.onMessage(msg.str());
 }
 
 void LoopEngine::scheduleStopRecord(int loopIndex, Quantize quantize) {
@@ -570,14 +1478,15 @@ void LoopEngine::scheduleStopRecord(int loopIndex, Quantize quantize) {
     cmd.loopIndex = loopIndex;
     cmd.quantize = quantize;
     enqueueCommand(cmd);
+}
 
-    std::string msg = "Stop Record";
-    if (quantize != Quantize::Free) {
-        msg += " (pending: ";
-        msg += (quantize == Quantize::Beat ? "next beat" : "next bar");
-        msg += ")";
-    }
-    if (callbacks_.onMessage) callbacks_.onMessage(msg);
+void LoopEngine::setLayerGain(int loopIndex, int layerIndex, float gain) {
+    EngineCommand cmd;
+    cmd.commandType = CommandType::SetLayerGain;
+    cmd.loopIndex = loopIndex;
+    cmd.layerIndex = layerIndex;
+    cmd.value = gain;
+    enqueueCommand(cmd);
 }
 
 void LoopEngine::executeOpNow(OpType type, int loopIndex) {
@@ -592,15 +1501,13 @@ void LoopEngine::cancelPending() {
     EngineCommand cmd;
     cmd.commandType = CommandType::CancelPending;
     enqueueCommand(cmd);
-
-    if (callbacks_.onMessage) callbacks_.onMessage("All pending ops cancelled");
 }
 
 void LoopEngine::cancelPending(int loopIndex) {
-    if (loopIndex >= 0 && loopIndex < maxLoops()) {
-        loops_[static_cast<size_t>(loopIndex)].clearPendingOps();
-    }
-    if (callbacks_.onStateChanged) callbacks_.onStateChanged();
+    EngineCommand cmd;
+    cmd.commandType = CommandType::CancelPending;
+    cmd.loopIndex = loopIndex;
+    enqueueCommand(cmd);
 }
 
 int LoopEngine::activeLoopCount() const {
@@ -623,30 +1530,125 @@ int LoopEngine::setLookbackBars(int bars) {
     return lookbackBars_;
 }
 
+uint64_t LoopEngine::loopPeaks(int index, int columns, std::vector<Peak>& out) {
+    out.clear();
+    if (index < 0 || index >= maxLoops() || columns <= 0) return 0;
+
+    LoopPeaks peaks;
+    {
+        std::lock_guard<std::mutex> lock(peaksMutex_);
+        peaks = loopPeaks_[static_cast<size_t>(index)];
+    }
+    if (!peaks.pyramid) return 0;
+    out.resize(static_cast<size_t>(columns));
+    peaks.pyramid->summarize(0, peaks.pyramid->length(), columns, out.data());
+    return peaks.revision;
+}
+
+bool LoopEngine::inputPeaks(int channel, int64_t samples, int columns, std::vector<Peak>& out) {
+    out.clear();
+    if (channel < 0 || channel >= numInputChannels() || columns <= 0) return false;
+
+    const RingBuffer& ring = inputChannels_[static_cast<size_t>(channel)].ringBuffer();
+    int64_t history = ring.historyCapacity();
+    std::lock_guard<std::mutex> lock(inputPeaksMutex_);
+    InputPeaks& peaks = inputPeaks_[static_cast<size_t>(channel)];
+    if (!peaks.pyramid) {
+        // Whole buckets, so ring positions map onto the pyramid lap after lap
+        int64_t bucket = PeakPyramid::kBucketSamples;
+        peaks.pyramid = std::make_unique<PeakPyramid>((history + bucket - 1) / bucket * bucket);
+    }
+    PeakPyramid& pyramid = *peaks.pyramid;
+    int64_t length = pyramid.length();
+
+    // Only history the ring still holds is read. Starting from a bucket edge
+    // replaces that bucket rather than widening what it held a lap ago.
+    int64_t written = ring.publishedWritten();
+    int64_t from = peaks.scanned;
+    if (from < written - history) {
+        int64_t bucket = PeakPyramid::kBucketSamples;
+        from = (written - history + bucket - 1) / bucket * bucket;
+    }
+    inputPeaksScratch_.resize(static_cast<size_t>(kPeakScanSamples));
+    for (int64_t pos = from; pos < written;) {
+        int64_t at = pos % length;
+        int64_t n = std::min({written - pos, kPeakScanSamples, length - at});
+        // If the writer laps the oldest samples mid-read they may be torn,
+        // but they are the next to be replaced anyway
+        (void)ring.readFromPast(inputPeaksScratch_.data(), static_cast<int>(n),
+                                written - pos, written);
+        pyramid.write(inputPeaksScratch_.data(), at, n);
+        pos += n;
+    }
+    peaks.scanned = std::max(peaks.scanned, written);
+
+    int64_t span = std::clamp<int64_t>(samples, 0, std::min(written, history));
+    out.resize(static_cast<size_t>(columns));
+    pyramid.summarize((written - span) % length, span, columns, out.data());
+    return true;
+}
+
 int LoopEngine::recordingLoopIndex() const {
-    if (activeRecording_) return activeRecording_->loopIndex;
+    if (activeRecording_.active) return activeRecording_.loopIndex;
     return -1;
 }
 
-void LoopEngine::setCallbacks(EngineCallbacks cb) {
-    callbacks_ = std::move(cb);
+void LoopEngine::emitEvent(EngineEventCode code, int loopIndex, int64_t scheduledSample,
+                           int detail, double value, Quantize quantize) {
+    EngineEvent ev;
+    ev.code = code;
+    ev.quantize = quantize;
+    ev.loopIndex = loopIndex;
+    ev.detail = detail;
+    ev.value = value;
+    ev.sampleTime = metronome_.position().totalSamples;
+    ev.scheduledSample = scheduledSample;
+    events_.push(ev);
+    signalState_ = true;
+}
 
-    // Re-wire metronome callbacks to include the new ones
-    metronome_.onBeat([this](const MetronomePosition& pos) {
-        click_.trigger(pos.beat == 0);
-        if (callbacks_.onBeat) callbacks_.onBeat(pos);
-    });
-    metronome_.onBar([this](const MetronomePosition& pos) {
-        if (callbacks_.onBar) callbacks_.onBar(pos);
-    });
+bool LoopEngine::enqueueCommand(const EngineCommand& cmd) {
+    if (openBatch.engine == this) {
+        // Stamped when the batch goes
+        openBatch.commands.push_back(cmd);
+        return true;
+    }
+    EngineCommand stamped = cmd;
+    if (stamped.timestamp < 0 && commandTimestamps()) stamped.timestamp = monotonicNanos();
+    if (!commandQueue_.push(stamped)) {
+        droppedCommands_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
 }
 
-std::string LoopEngine::statusMessage() const {
-    return lastMessage_;
+void LoopEngine::beginBatch(int64_t dueNanos) {
+    if (openBatch.engine == this) {
+        ++openBatch.depth;
+        return;
+    }
+    openBatch.engine = this;
+    openBatch.depth = 1;
+    openBatch.dueNanos = dueNanos;
+    openBatch.commands.clear();
 }
 
-void LoopEngine::enqueueCommand(const EngineCommand& cmd) {
-    commandQueue_.push(cmd);
+bool LoopEngine::endBatch() {
+    if (openBatch.engine != this || --openBatch.depth > 0) return true;
+    openBatch.engine = nullptr;
+
+    int64_t now = commandTimestamps() ? monotonicNanos() : -1;
+    for (auto& cmd : openBatch.commands) {
+        if (cmd.timestamp < 0) cmd.timestamp = now;
+        cmd.dueNanos = openBatch.dueNanos;
+    }
+    if (!commandQueue_.pushBatch(openBatch.commands.data(), openBatch.commands.size())) {
+        droppedCommands_.fetch_add(openBatch.commands.size(), std::memory_order_relaxed);
+        openBatch.commands.clear();
+        return false;
+    }
+    openBatch.commands.clear();
+    return true;
 }
 
 int64_t LoopEngine::computeExecuteSample(Quantize quantize) const {
@@ -657,16 +1659,45 @@ int64_t LoopEngine::computeExecuteSample(Quantize quantize) const {
            metronome_.samplesUntilBoundary(quantize);
 }
 
-void LoopEngine::drainCommands() {
+int64_t LoopEngine::commandExecuteSample(const EngineCommand& cmd, int numSamples) const {
+    if (cmd.dueNanos >= 0 && blockStartNanos_ >= 0 && metronome_.isRunning()) {
+        // A due time is placed on its own sample, and quantized ops take the
+        // first boundary from there. One already past acts as if sent now.
+        int64_t now = metronome_.position().totalSamples;
+        double aheadSeconds = static_cast<double>(cmd.dueNanos - blockStartNanos_) * 1e-9;
+        int64_t due = now + static_cast<int64_t>(std::llround(aheadSeconds * sampleRate_));
+        if (due > now) return metronome_.boundaryAtOrAfter(cmd.quantize, due);
+        return computeExecuteSample(cmd.quantize);
+    }
+    // Quantized ops already land on an exact boundary; only free ops suffer
+    // from being drained up to a block after they were issued
+    if (cmd.quantize != Quantize::Free || cmd.timestamp < 0 || blockStartNanos_ < 0 ||
+        !metronome_.isRunning()) {
+        return computeExecuteSample(cmd.quantize);
+    }
+    // Where the command was issued on the sample timeline, then delayed by
+    // one block: a command issued during the previous block lands at the
+    // same offset in this one, for a constant latency instead of jitter.
+    // Commands held up longer than that (a stalled callback) run right away.
+    int64_t now = metronome_.position().totalSamples;
+    double agoSeconds = static_cast<double>(blockStartNanos_ - cmd.timestamp) * 1e-9;
+    int64_t issued = now - static_cast<int64_t>(std::llround(agoSeconds * sampleRate_));
+    return std::max(now, issued + numSamples);
+}
+
+void LoopEngine::drainCommands(int numSamples) {
     EngineCommand cmd;
     while (commandQueue_.pop(cmd)) {
+        signalState_ = true;
         switch (cmd.commandType) {
             case CommandType::ScheduleOp: {
+                emitEvent(EngineEventCode::OpScheduled, cmd.loopIndex, -1,
+                          static_cast<int>(cmd.opType), 0.0, cmd.quantize);
                 int idx = cmd.loopIndex;
                 if (idx < 0 || idx >= maxLoops()) break;
                 Loop& lp = loops_[static_cast<size_t>(idx)];
                 auto& ps = lp.pendingState();
-                int64_t execSample = computeExecuteSample(cmd.quantize);
+                int64_t execSample = commandExecuteSample(cmd, numSamples);
 
                 switch (cmd.opType) {
                     case OpType::Mute:
@@ -687,6 +1718,8 @@ void LoopEngine::drainCommands() {
                     case OpType::StartOverdub:
                         ps.overdub = PendingTimedOp{execSample, cmd.quantize};
                         ps.overdubOp = PendingState::OverdubOp::Start;
+                        // Give the worker until the boundary to get buffers ready
+                        if (!lp.isEmpty()) requestOverdubKit(lp.lengthSamples());
                         break;
                     case OpType::StopOverdub:
                         ps.overdub = PendingTimedOp{execSample, cmd.quantize};
@@ -719,12 +1752,14 @@ void LoopEngine::drainCommands() {
                 break;
             }
             case CommandType::CaptureLoop: {
+                emitEvent(EngineEventCode::CaptureScheduled, cmd.loopIndex, -1,
+                          cmd.lookbackBars, 0.0, cmd.quantize);
                 int idx = cmd.loopIndex;
                 if (idx < 0 || idx >= maxLoops()) break;
                 Loop& lp = loops_[static_cast<size_t>(idx)];
                 auto& ps = lp.pendingState();
                 PendingCapture cap;
-                cap.executeSample = computeExecuteSample(cmd.quantize);
+                cap.executeSample = commandExecuteSample(cmd, numSamples);
                 cap.quantize = cmd.quantize;
                 cap.lookbackSamples = static_cast<int64_t>(
                     std::round(static_cast<double>(cmd.lookbackBars) *
@@ -733,20 +1768,23 @@ void LoopEngine::drainCommands() {
                 break;
             }
             case CommandType::Record: {
+                emitEvent(EngineEventCode::RecordScheduled, cmd.loopIndex, -1, 0, 0.0, cmd.quantize);
                 int idx = cmd.loopIndex;
                 if (idx < 0 || idx >= maxLoops()) break;
                 Loop& lp = loops_[static_cast<size_t>(idx)];
                 auto& ps = lp.pendingState();
-                ps.record = PendingTimedOp{computeExecuteSample(cmd.quantize), cmd.quantize};
+                ps.record = PendingTimedOp{commandExecuteSample(cmd, numSamples), cmd.quantize};
                 ps.recordOp = PendingState::RecordOp::Start;
                 break;
             }
             case CommandType::StopRecord: {
+                emitEvent(EngineEventCode::StopRecordScheduled, cmd.loopIndex, -1, 0, 0.0,
+                          cmd.quantize);
                 int idx = cmd.loopIndex;
                 if (idx < 0 || idx >= maxLoops()) break;
                 Loop& lp = loops_[static_cast<size_t>(idx)];
                 auto& ps = lp.pendingState();
-                ps.record = PendingTimedOp{computeExecuteSample(cmd.quantize), cmd.quantize};
+                ps.record = PendingTimedOp{commandExecuteSample(cmd, numSamples), cmd.quantize};
                 ps.recordOp = PendingState::RecordOp::Stop;
                 break;
             }
@@ -755,36 +1793,186 @@ void LoopEngine::drainCommands() {
                 if (idx < 0 || idx >= maxLoops()) break;
                 Loop& lp = loops_[static_cast<size_t>(idx)];
                 auto& ps = lp.pendingState();
-                ps.speed = PendingSpeed{computeExecuteSample(cmd.quantize),
+                ps.speed = PendingSpeed{commandExecuteSample(cmd, numSamples),
                                         cmd.quantize, cmd.value};
                 break;
             }
-            case CommandType::SetBpm: {
-                metronome_.setBpm(cmd.value);
-                midiSync_.setBpm(cmd.value);
-                if (bpmChangedCallback_) bpmChangedCallback_(cmd.value);
-                // Propagate BPM change to all loops for time stretching
-                double newBpm = metronome_.bpm();
-                for (auto& lp : loops_) {
-                    if (!lp.isEmpty()) {
-                        lp.setCurrentBpm(newBpm);
-                    }
-                }
+            case CommandType::SetBpm:
+                applyBpm(cmd.value);
+                break;
+            case CommandType::SetLayerGain: {
+                int idx = cmd.loopIndex;
+                if (idx < 0 || idx >= maxLoops()) break;
+                Loop& lp = loops_[static_cast<size_t>(idx)];
+                lp.setLayerGain(cmd.layerIndex, static_cast<float>(cmd.value));
+                requestMixCache(lp);
                 break;
             }
             case CommandType::CancelPending: {
+                int idx = cmd.loopIndex;
+                if (idx >= maxLoops()) break;
                 for (auto& lp : loops_) {
+                    if (idx >= 0 && lp.id() != idx) continue;
                     lp.clearPendingOps();
+                    reschedule(lp.id());
                 }
+                emitEvent(EngineEventCode::PendingCancelled, idx);
                 break;
             }
+            case CommandType::SaveSession:
+                snapshotSession();
+                break;
+            case CommandType::SyncTimeline:
+                followTimeline(cmd.beat, cmd.value, cmd.dueNanos);
+                break;
+        }
+
+        // The command may have filled or replaced one of the loop's slots
+        if (cmd.loopIndex >= 0 && cmd.loopIndex < maxLoops()) reschedule(cmd.loopIndex);
+    }
+}
+
+void LoopEngine::applyBpm(double bpm) {
+    metronome_.setBpm(bpm);
+    midiSync_.setBpm(bpm);
+    if (bpmChangedCallback_) bpmChangedCallback_(bpm);
+    // Propagate BPM change to all loops for time stretching
+    double newBpm = metronome_.bpm();
+    tempoGeneration_.fetch_add(1, std::memory_order_relaxed);
+    for (auto& lp : loops_) {
+        if (!lp.isEmpty()) {
+            lp.setCurrentBpm(newBpm);
         }
     }
 }
 
-std::vector<float> LoopEngine::channelPeaksSnapshot() const {
-    std::lock_guard<std::mutex> lock(displayMutex_);
-    return channelPeaksSnapshot_;
+bool LoopEngine::syncTimeline(double beat, double bpm, int64_t atNanos) {
+    EngineCommand cmd;
+    cmd.commandType = CommandType::SyncTimeline;
+    cmd.beat = beat;
+    cmd.value = bpm;
+    cmd.dueNanos = atNanos;
+    return enqueueCommand(cmd);
+}
+
+void LoopEngine::followTimeline(double beat, double bpm, int64_t atNanos) {
+    if (atNanos < 0 || blockStartNanos_ < 0 || !metronome_.isRunning()) return;
+    if (std::abs(bpm - metronome_.bpm()) > 1e-9) applyBpm(bpm);
+
+    // Where the other timeline stands at the start of this block, against
+    // where this one does. Only the phase in the bar has to agree: bar
+    // numbers differ between instances that started at different times.
+    double beatsPerSecond = metronome_.bpm() / 60.0;
+    double target = beat + static_cast<double>(blockStartNanos_ - atNanos) * 1e-9 * beatsPerSecond;
+    MetronomePosition pos = metronome_.position();
+    int beatsPerBar = metronome_.beatsPerBar();
+    double local = static_cast<double>(pos.bar) * beatsPerBar + pos.beat + pos.beatFraction;
+    double error = std::remainder(target - local, static_cast<double>(beatsPerBar));
+
+    double errorSamples = error * metronome_.samplesPerBeat();
+    double shift = errorSamples * kSyncSlewGain;
+    if (std::abs(errorSamples) > kSyncJumpSeconds * sampleRate_) {
+        shift = errorSamples;
+        emitEvent(EngineEventCode::TimelineJumped, -1, -1, 0, errorSamples * 1000.0 / sampleRate_);
+    }
+    metronome_.shiftPhase(shift);
+    midiSync_.shiftPhase(shift);
+}
+
+void LoopEngine::publishState() {
+    EngineState& st = publishedState_[static_cast<size_t>(StateReader::Control)].writeBuffer();
+    st.sequence = ++publishedSequence_;
+
+    auto pos = metronome_.position();
+    st.metronome.bar = pos.bar;
+    st.metronome.beat = pos.beat;
+    st.metronome.beatFraction = pos.beatFraction;
+    st.metronome.totalSamples = pos.totalSamples;
+    st.metronome.bpm = metronome_.bpm();
+    st.metronome.beatsPerBar = metronome_.beatsPerBar();
+    st.metronome.running = metronome_.isRunning();
+
+    st.numLoops = std::min(maxLoops(), EngineState::kMaxLoops);
+    st.activeLoopCount = 0;
+    for (int i = 0; i < st.numLoops; ++i) {
+        const Loop& lp = loops_[static_cast<size_t>(i)];
+        LoopStatus& ls = st.loops[static_cast<size_t>(i)];
+        ls.state = lp.state();
+        ls.lengthInBars = lp.lengthInBars();
+        ls.layers = lp.layerCount();
+        ls.activeLayers = lp.activeLayerCount();
+        ls.speed = lp.speed();
+        ls.reversed = lp.isReversed();
+        ls.timeStretchActive = lp.isTimeStretchActive();
+        ls.playPosition = lp.playPosition();
+        ls.lengthSamples = lp.lengthSamples();
+        ls.recordedBpm = lp.recordedBpm();
+        if (!lp.isEmpty()) ++st.activeLoopCount;
+
+        // Pending ops, in display order
+        ls.numPending = 0;
+        auto add = [&ls](PendingOpKind kind, Quantize q, int64_t executeSample, int count = 1) {
+            ls.pending[static_cast<size_t>(ls.numPending++)] = {kind, q, count, executeSample};
+        };
+        const PendingState& ps = lp.pendingState();
+        if (ps.capture) add(PendingOpKind::Capture, ps.capture->quantize, ps.capture->executeSample);
+        if (ps.record) {
+            add(ps.recordOp == PendingState::RecordOp::Start ? PendingOpKind::Record
+                                                             : PendingOpKind::StopRecord,
+                ps.record->quantize, ps.record->executeSample);
+        }
+        if (ps.mute) {
+            PendingOpKind kind = PendingOpKind::ToggleMute;
+            if (ps.muteOp == PendingState::MuteOp::Mute) kind = PendingOpKind::Mute;
+            else if (ps.muteOp == PendingState::MuteOp::Unmute) kind = PendingOpKind::Unmute;
+            add(kind, ps.mute->quantize, ps.mute->executeSample);
+        }
+        if (ps.overdub) {
+            add(ps.overdubOp == PendingState::OverdubOp::Start ? PendingOpKind::StartOverdub
+                                                               : PendingOpKind::StopOverdub,
+                ps.overdub->quantize, ps.overdub->executeSample);
+        }
+        if (ps.reverse) add(PendingOpKind::Reverse, ps.reverse->quantize, ps.reverse->executeSample);
+        if (ps.speed) add(PendingOpKind::SetSpeed, ps.speed->quantize, ps.speed->executeSample);
+        if (ps.undo) {
+            add(ps.undo->direction == UndoDirection::Undo ? PendingOpKind::UndoLayer
+                                                          : PendingOpKind::RedoLayer,
+                ps.undo->quantize, ps.undo->executeSample, ps.undo->count);
+        }
+        if (ps.clear) add(PendingOpKind::Clear, ps.clear->quantize, ps.clear->executeSample);
+    }
+
+    st.numChannels = std::min(numInputChannels(), EngineState::kMaxChannels);
+    st.liveChannelMask = liveChannelMask_.load(std::memory_order_relaxed);
+    for (int ch = 0; ch < st.numChannels; ++ch) {
+        st.channelPeaks[static_cast<size_t>(ch)] =
+            inputChannels_[static_cast<size_t>(ch)].peakLevel();
+    }
+
+    st.isRecording = activeRecording_.active;
+    st.recordingLoopIndex = recordingLoopIndex();
+
+    st.defaultQuantize = defaultQuantize_;
+    st.lookbackBars = lookbackBars_;
+    st.maxLookbackBars = maxLookbackBars_;
+    st.clickEnabled = click_.isEnabled();
+    st.midiSyncEnabled = midiSync_.isEnabled();
+    st.midiOutputAvailable = midiSync_.hasOutput();
+    st.liveThreshold = liveThreshold_;
+    st.sampleRate = sampleRate_;
+    st.perf = loadMeter_.status();
+
+    publishedState_[static_cast<size_t>(StateReader::Control)].publish();
+    if (publisherReading_.load(std::memory_order_relaxed)) {
+        auto& publisher = publishedState_[static_cast<size_t>(StateReader::Publisher)];
+        publisher.writeBuffer() = st;
+        publisher.publish();
+    }
+
+    if (signalState_) {
+        signalState_ = false;
+        stateSignal_.notify();
+    }
 }
 
 } // namespace retrospect
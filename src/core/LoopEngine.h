@@ -1,11 +1,27 @@
 #pragma once
 
+#include "core/AudioArchive.h"
+#include "core/BufferPool.h"
+#include "core/CaptureSource.h"
 #include "core/Metronome.h"
 #include "core/MetronomeClick.h"
 #include "core/MidiSync.h"
+#include "core/DspLoadMeter.h"
 #include "core/InputChannel.h"
 #include "core/Loop.h"
-#include "core/SpscQueue.h"
+#include "core/MpscQueue.h"
+#include "core/OpScheduler.h"
+#include "core/PeakPyramid.h"
+#include "core/RenderPool.h"
+#include "core/RingSpiller.h"
+#include "core/SessionStore.h"
+#include "core/StretcherPool.h"
+#include "core/SampleChunkPool.h"
+#include "core/EngineWorker.h"
+#include "core/EngineState.h"
+#include "core/EngineEventLog.h"
+#include "core/TripleBuffer.h"
+#include "core/WakeSignal.h"
 
 #include <vector>
 #include <memory>
@@ -37,22 +53,34 @@ enum class OpType {
 /// Human-readable description for an OpType
 std::string opTypeDescription(OpType type);
 
-/// Callback for engine state changes (used by TUI)
-struct EngineCallbacks {
-    std::function<void()> onStateChanged;
-    std::function<void(const std::string&)> onMessage;
-    std::function<void(const MetronomePosition&)> onBeat;
-    std::function<void(const MetronomePosition&)> onBar;
-};
-
-/// An in-progress classic recording (accumulating per-channel input)
+/// An in-progress classic recording (accumulating per-channel input).
+/// Audio lands in chunks from the engine's record pool, so recording never
+/// allocates on the audio thread.
 struct ActiveRecording {
+    bool active = false;
     int loopIndex = -1;
-    std::vector<std::vector<float>> channelBuffers; // per input channel
-    uint64_t activeChannelMask = 0;                 // sticky: set when channel breaches threshold
+    std::vector<ChunkChain> channelChunks;  // per input channel, sized at engine construction
+    int64_t length = 0;                     // samples recorded on every channel
+    uint64_t activeChannelMask = 0;         // sticky: set when channel breaches threshold
     int64_t startSample = 0;
 };
 
+/// How the input rings store lookback history.
+///
+/// A compact format shrinks every ring (and spill file): int24 takes 3/4 of
+/// the memory of float32, float16 half. Samples are encoded as the audio
+/// thread writes them and decoded when a capture copies them out.
+///
+/// With a spill directory, history is kept on disk instead of in RAM. Each
+/// input ring then holds only the last spillRamSeconds, and the full lookback
+/// lives in a memory-mapped file per channel that a background thread keeps
+/// up to date.
+struct LookbackStorage {
+    SampleFormat format = SampleFormat::Float32;
+    std::string spillDirectory;     // Where the spill files go ("" keeps all lookback in RAM)
+    double spillRamSeconds = 8.0;   // In-RAM window per channel when spilling
+};
+
 /// Command types for the TUI→Audio SPSC queue
 enum class CommandType {
     ScheduleOp,     // Generic op (mute, reverse, overdub, undo, redo, clear)
@@ -61,7 +89,10 @@ enum class CommandType {
     StopRecord,     // Stop classic recording
     SetSpeed,       // Change loop playback speed
     SetBpm,         // Change metronome BPM
-    CancelPending   // Cancel all pending ops
+    SetLayerGain,   // Change one layer's playback gain (applied immediately)
+    CancelPending,  // Cancel pending ops (loopIndex, or -1 for all loops)
+    SaveSession,    // Snapshot the loops for the session save begun (see saveSession)
+    SyncTimeline    // Follow another instance's timeline (see syncTimeline)
 };
 
 /// Command sent from TUI thread to audio thread
@@ -71,7 +102,20 @@ struct EngineCommand {
     int loopIndex = -1;
     Quantize quantize = Quantize::Bar;
     double value = 0.0;                 // Speed or BPM
+    double beat = 0.0;                  // For SyncTimeline: leader's beat at dueNanos
     int lookbackBars = 1;               // For CaptureLoop
+    int layerIndex = -1;                // For SetLayerGain
+    int64_t timestamp = -1;             // Steady-clock ns when issued, or -1
+                                        // to act when drained (see enqueueCommand)
+    int64_t dueNanos = -1;              // Steady-clock ns to act at, or -1 (see beginBatch)
+};
+
+/// A point on the engine's timeline: where the metronome stood, and when
+struct TimelinePoint {
+    double beat = 0.0;          // Beats from the start: bar * beatsPerBar + beat + fraction
+    double bpm = 120.0;
+    int beatsPerBar = 4;
+    int64_t nanos = -1;         // Steady clock at that point, or -1 (no timestamps)
 };
 
 /// Central engine managing loops, ring buffer, metronome, and quantized operations.
@@ -89,18 +133,36 @@ public:
     /// @param numInputChannels Number of input channels (each gets a ring buffer)
     /// @param liveThreshold Activity threshold (0 = disabled, all channels pass)
     /// @param liveWindowMs Activity detection window in milliseconds
+    /// @param storage Lookback sample format, and optional spilling to disk
     LoopEngine(int maxLoops = 8, int maxLookbackBars = 8,
                double sampleRate = 44100.0, double minBpm = 60.0,
                int numInputChannels = 1, float liveThreshold = 0.0f,
-               int liveWindowMs = 500);
+               int liveWindowMs = 500, const LookbackStorage& storage = {});
+    ~LoopEngine();
+
+    LoopEngine(const LoopEngine&) = delete;
+    LoopEngine& operator=(const LoopEngine&) = delete;
 
     /// Process a block of multi-channel audio.
     /// @param input Array of per-channel input buffers (may be nullptr for missing channels)
     /// @param numInputChannels Number of input channel pointers
     /// @param output Output audio buffer (mono, will be summed into)
     /// @param numSamples Number of samples in this block
+    /// @param loopOutputs Optional per-loop output buffers, indexed by loop
+    ///        (entries may be nullptr). Each is overwritten with that loop's
+    ///        own playback, which is still summed into `output` too.
+    /// @param loopOutputCount Number of loop output pointers
     void processBlock(const float* const* input, int inputChannelCount,
-                      float* output, int numSamples);
+                      float* output, int numSamples,
+                      float* const* loopOutputs = nullptr, int loopOutputCount = 0);
+
+    /// Report how long the whole device callback around the last
+    /// processBlock took, and the device's xrun count if it keeps one (-1
+    /// otherwise). Audio thread, right after processBlock returns; feeds the
+    /// host figures and missed deadlines in EngineState::perf.
+    void noteHostCallback(int64_t callbackNanos, int64_t deviceXruns = -1) {
+        loadMeter_.noteHostCallback(callbackNanos, deviceXruns);
+    }
 
     /// Schedule a quantized operation. The operation will be executed
     /// at the next quantization boundary (beat or bar).
@@ -121,13 +183,16 @@ public:
     /// Schedule classic record stop (quantized to boundary)
     void scheduleStopRecord(int loopIndex, Quantize quantize);
 
+    /// Set the playback gain of one layer of a loop (unquantized)
+    void setLayerGain(int loopIndex, int layerIndex, float gain);
+
     /// Execute an operation immediately (no quantization)
     void executeOpNow(OpType type, int loopIndex = -1);
 
     /// Cancel all pending operations
     void cancelPending();
 
-    /// Cancel pending operations for a specific loop
+    /// Cancel pending operations for a specific loop (-1 for all loops)
     void cancelPending(int loopIndex);
 
     // Accessors
@@ -147,8 +212,51 @@ public:
     int maxLoops() const { return static_cast<int>(loops_.size()); }
     int activeLoopCount() const;
 
-    /// Enqueue a command from the TUI thread (lock-free)
-    void enqueueCommand(const EngineCommand& cmd);
+    /// Enqueue a command (lock-free; safe from any number of threads).
+    /// Unless command timestamps are off, an unstamped command is stamped
+    /// with the current time. A full queue drops the command, counts it and
+    /// returns false.
+    bool enqueueCommand(const EngineCommand& cmd);
+
+    /// Collect the commands this thread issues (schedule*, enqueueCommand,
+    /// ...) until endBatch(), to hand them to the audio thread as one. A
+    /// batch is drained whole in one block, stamped with one issue time, so
+    /// its quantized ops land on the same boundary and its free ops on the
+    /// same sample however the queue and the blocks fall. With `dueNanos`
+    /// (steady clock, e.g. an OSC bundle timetag) it acts then instead: free
+    /// ops on that sample, quantized ops on the first boundary at or after
+    /// it, and a time already past as if the batch were sent now. Due times
+    /// need command timestamps on. A batch begun inside another joins it.
+    void beginBatch(int64_t dueNanos = -1);
+
+    /// Send the batch this thread began. Returns false if the queue hasn't
+    /// room for all of it, in which case the whole batch is dropped and
+    /// counted.
+    bool endBatch();
+
+    /// Follow another instance's timeline (network sync, see TimelineSync):
+    /// at `atNanos` (steady clock) it stood `beat` beats in at `bpm`. The
+    /// audio thread takes the tempo, then moves the metronome's phase in the
+    /// bar onto it, in one step if it is out by more than kSyncJumpSeconds
+    /// and otherwise by kSyncSlewGain of the error each time, so network
+    /// jitter doesn't reach the click. Bar numbers are left alone. Needs
+    /// command timestamps on. Returns false if the queue is full.
+    bool syncTimeline(double beat, double bpm, int64_t atNanos);
+
+    /// Where the metronome stood at the end of the last block (one reader
+    /// thread only, e.g. a timeline sync leader). Wait-free.
+    const TimelinePoint& readTimeline() { return publishedTimeline_.read(); }
+
+    /// Commands dropped because the queue was full
+    uint64_t droppedCommands() const { return droppedCommands_.load(std::memory_order_relaxed); }
+
+    /// Place timestamped commands at the sample they were issued at, delayed
+    /// by one block, instead of at the start of the block that drains them.
+    /// Free ops then land with a constant one-block latency rather than
+    /// anywhere from zero to one block late. On by default; turn off for
+    /// offline rendering, where wall-clock time is meaningless.
+    bool commandTimestamps() const { return commandTimestamps_.load(std::memory_order_relaxed); }
+    void setCommandTimestamps(bool on) { commandTimestamps_.store(on, std::memory_order_relaxed); }
 
     /// Atomic recording state accessors (safe to read from TUI thread)
     bool isRecordingAtomic() const { return isRecordingAtomic_.load(std::memory_order_relaxed); }
@@ -174,9 +282,12 @@ public:
 
     /// Latency compensation in samples (round-trip: output + input).
     /// When set, capture and recording operations offset their read positions
-    /// to align recorded audio with the metronome's internal timeline.
-    int64_t latencyCompensation() const { return latencyCompensation_; }
-    void setLatencyCompensation(int64_t samples) { latencyCompensation_ = std::max(int64_t(0), samples); }
+    /// to align recorded audio with the metronome's internal timeline. Can
+    /// be changed while audio runs (e.g. after a JACK period change).
+    int64_t latencyCompensation() const { return latencyCompensation_.load(std::memory_order_relaxed); }
+    void setLatencyCompensation(int64_t samples) {
+        latencyCompensation_.store(std::max(int64_t(0), samples), std::memory_order_relaxed);
+    }
 
     /// Monitoring: pass-through input to output
     bool inputMonitoring() const { return inputMonitoring_; }
@@ -191,8 +302,22 @@ public:
     /// Bit N is set if channel N is live.
     uint64_t liveChannelMask() const { return liveChannelMask_.load(std::memory_order_relaxed); }
 
-    /// Per-channel peak levels snapshot (mutex-protected, updated from audio thread)
-    std::vector<float> channelPeaksSnapshot() const;
+    /// Latest engine state published by the audio thread (once per block).
+    /// Wait-free. Each reader has a buffer of its own, and all callers for
+    /// one reader must be on the same thread; the returned state stays
+    /// unchanged until that thread's next call.
+    const EngineState& readState(StateReader reader = StateReader::Control) {
+        if (reader == StateReader::Publisher) {
+            publisherReading_.store(true, std::memory_order_relaxed);
+        }
+        return publishedState_[static_cast<size_t>(reader)].read();
+    }
+
+    /// Bumped by the audio thread after a block in which something a remote
+    /// client should hear about at once happened: an engine event, a beat, or
+    /// a command drained. Wait on it to push state as it changes; notify it
+    /// to wake such a waiter (e.g. to stop it).
+    WakeSignal& stateSignal() { return stateSignal_; }
 
     /// Metronome click (audible beat indicator)
     bool metronomeClickEnabled() const { return click_.isEnabled(); }
@@ -206,82 +331,418 @@ public:
     bool midiSyncEnabled() const { return midiSync_.isEnabled(); }
     void setMidiSyncEnabled(bool on) { midiSync_.setEnabled(on); }
 
+    /// Run background work (capture copies, mixdowns, buffer allocation and
+    /// deallocation) inline on the audio thread instead of on the worker
+    /// thread. Results then land at the quantization boundary itself, which
+    /// makes offline rendering deterministic. Call before audio starts.
+    void setSynchronousWorker(bool on);
+
+    /// Render loops on `helpers` extra threads alongside the audio thread
+    /// (0, the default, renders serially). Sub-blocks with too little loop
+    /// work to pay for the hand-off still render serially, as does the loop
+    /// being overdubbed. At most one fewer than the core count is used.
+    /// Call before audio starts.
+    void setRenderThreads(int helpers);
+    int renderThreads() const { return renderPool_ ? renderPool_->numWorkers() : 0; }
+
+    /// Pre-render time-stretched loops at the new tempo in the background
+    /// and play those renders instead of stretching live (on by default).
+    /// Off, stretched loops always run their stretcher. Call before audio
+    /// starts.
+    void setStretchCache(bool on) { stretchCacheEnabled_ = on; }
+    bool stretchCacheEnabled() const { return stretchCacheEnabled_; }
+
+    /// Build `count` stretchers for live time stretching (maxLoops by
+    /// default). Loops lease one while they stretch without a cache; a loop
+    /// that finds none free plays unstretched until one frees up or its
+    /// cache arrives. Call before audio starts.
+    void setStretcherCount(int count);
+    int stretcherCount() const { return stretcherPool_.size(); }
+
+    /// Keep at most `layers` overdub layers above each loop's base (0 keeps
+    /// them all). Older ones are folded into the base in the background:
+    /// active layers are mixed in, undone ones are dropped, and undo no
+    /// longer reaches them. Call before audio starts.
+    void setUndoDepth(int layers) { undoDepth_ = std::max(0, layers); }
+    int undoDepth() const { return undoDepth_; }
+
+    /// Whether lookback spilling was asked for but a spill file could not be
+    /// created, so the lookback stayed in RAM
+    bool lookbackSpillFailed() const { return lookbackSpillFailed_; }
+
+    /// Archive every input channel and the output to WAV files in
+    /// settings.directory (see AudioArchive). Call before audio starts.
+    /// Returns false, leaving the archive off, if no file can be created.
+    bool startArchive(const ArchiveSettings& settings);
+
+    /// The running archive (for its stats), or null
+    const AudioArchive* archive() const { return archive_.get(); }
+
+    /// Save every loop (layers, gains, speed, direction, mute state) and
+    /// the tempo to a session file at `path`, in the background: the audio
+    /// thread snapshots the loops at its next block, the worker copies them
+    /// and the session thread writes the file. An overdub still being
+    /// recorded is left out. Control thread; returns why the save could not
+    /// start, or SessionError::None (the outcome arrives as an engine event).
+    SessionError saveSession(const std::string& path);
+
+    /// Replace every loop with the session saved at `path`, and take its
+    /// tempo and beats per bar. The file is read in the background and loops start as soon as
+    /// each is in memory, in phase with the bar the load started in. Control
+    /// thread; returns SessionError::Busy while a save or load is in
+    /// progress, otherwise None (the outcome arrives as an engine event).
+    SessionError loadSession(const std::string& path);
+
+    /// Whether a loop is waiting for its content from the worker
+    bool isLoopLoading(int index) const { return loopLoading_[static_cast<size_t>(index)] != 0; }
+
     /// Whether a classic recording is in progress
-    bool isRecording() const { return activeRecording_.has_value(); }
+    bool isRecording() const { return activeRecording_.active; }
     int recordingLoopIndex() const;
 
-    /// Set callbacks
-    void setCallbacks(EngineCallbacks cb);
+    /// Append engine events after `cursor` to `out`, advancing `cursor`
+    /// (control threads; each reader keeps its own cursor, starting at 0).
+    /// Format them with formatEngineEvent.
+    void readEvents(uint64_t& cursor, std::vector<EngineEvent>& out) { events_.read(cursor, out); }
+
+    /// Waveform overview of a loop's mix as `columns` min/max pairs over its
+    /// length, in buffer order (control threads). The peaks are taken on the
+    /// worker each time the mix settles. Returns their revision, which
+    /// changes whenever they do, or 0 (and `out` empty) for a loop with none.
+    uint64_t loopPeaks(int index, int columns, std::vector<Peak>& out);
+
+    /// Waveform overview of the last `samples` of an input channel's ring
+    /// (clamped to its history) as `columns` min/max pairs, oldest first
+    /// (control threads). The channel's peaks are brought up to date from
+    /// the ring on the call, so only what arrived since the last one is read.
+    /// Returns false (and `out` empty) for a channel that doesn't exist.
+    bool inputPeaks(int channel, int64_t samples, int columns, std::vector<Peak>& out);
+
+    /// Events lost because the control thread fell behind
+    uint64_t droppedEvents() const { return events_.dropped(); }
 
     /// Register a callback that fires when BPM changes at the audio level.
     /// Useful for propagating tempo changes to external systems (e.g. JACK transport).
     void setBpmChangedCallback(std::function<void(double)> cb) { bpmChangedCallback_ = std::move(cb); }
 
+    /// Likewise for beats per bar, which only a session load changes
+    void setBeatsPerBarChangedCallback(std::function<void(int)> cb) {
+        beatsPerBarChangedCallback_ = std::move(cb);
+    }
+
     /// Find the next available (empty) loop slot. Returns -1 if all full.
     int nextEmptySlot() const;
 
-    /// Status message for TUI
-    std::string statusMessage() const;
 
 private:
+    /// Largest sub-block processed in one pass (sizes the scratch buffers)
+    static constexpr int kMaxSubBlock = 512;
+
+    // Parallel render thresholds. A loop stretching live costs about as much
+    // as kStretchedLoopCost direct (or stretch-cached) ones; a sub-block goes to the render pool
+    // only with kMinParallelCost of work and at least kMinParallelSamples.
+    static constexpr int kStretchedLoopCost = 8;
+    static constexpr int kMinParallelCost = 16;
+    static constexpr int kMinParallelSamples = 32;
+
+    /// Input for channel `ch` starting at `offset`, or silence if the device
+    /// did not provide that channel.
+    const float* channelInput(const float* const* input, int inputChannelCount,
+                              int ch, int offset) const;
+
+    /// Write input samples [offset, offset + numSamples) of every channel to
+    /// its InputChannel, sum them into inputMix, and append them to the active
+    /// classic recording. Returns a bitmask of the channels that were live at
+    /// any sample in the range.
+    uint64_t ingestInput(const float* const* input, int inputChannelCount,
+                         int offset, int numSamples, float* inputMix);
+
+    /// Render every loop, the click and input monitoring for one sub-block
+    /// into mix (numSamples long, zeroed here). liveMask is the set of
+    /// channels live during the sub-block, for the overdub channel mask.
+    /// Loops with an output of their own are rendered into it first.
+    /// Returns the nanoseconds of that spent in time stretchers.
+    int64_t renderSubBlock(const float* const* input, int inputChannelCount,
+                        int offset, int numSamples, uint64_t liveMask,
+                        const float* inputMix, float* mix);
+
+    /// Fill renderList_ with the loops the render pool can take this
+    /// sub-block (stretched ones first, so they are claimed first). Returns
+    /// false if they are not worth handing off.
+    bool collectParallelLoops();
+
+    /// The current block's output for loop `index` from sample `offset`,
+    /// or nullptr if it has none
+    float* loopOutput(int index, int offset) const {
+        if (index >= loopOutputCount_ || !loopOutputs_[index]) return nullptr;
+        return loopOutputs_[index] + offset;
+    }
+
+    /// RenderPool task: render loop renderList_[task] into `output`, or
+    /// into its own loop output if it has one
+    static void renderLoopTask(void* context, int task, int participant,
+                               float* output, int numSamples);
+
+    /// Execute due ops on every loop that has any due at currentSample
+    void flushAllDueOps(int64_t currentSample);
+
+    /// Earliest executeSample across all loops' pending ops (INT64_MAX if none)
+    int64_t nextPendingSample() const { return scheduler_.nextDue(); }
+
+    /// Re-key a loop in the scheduler after its pending state or loading
+    /// status changed (a loading loop is not due until its content lands)
+    void reschedule(int loopIndex);
+
     /// Execute pending ops for a loop that are due at currentSample
     void flushDueOps(Loop& lp, int64_t currentSample);
 
-    /// Fulfill a capture operation (reads from ring buffer)
-    void fulfillCapture(Loop& lp, const PendingCapture& cap);
+    /// Fulfill a capture operation: picks the channels and ring buffer region
+    /// and hands the copy to the worker. Returns true if the loop is now
+    /// loading (its remaining ops wait for the content to land).
+    bool fulfillCapture(Loop& lp, const PendingCapture& cap);
 
     /// Start a classic recording into a loop
     void fulfillRecord(Loop& lp);
 
-    /// Stop a classic recording
-    void fulfillStopRecord(Loop& lp);
+    /// Stop a classic recording and hand the mixdown to the worker.
+    /// Returns true if the loop is now loading.
+    bool fulfillStopRecord(Loop& lp);
+
+    /// Background job handler (worker thread, or inline when synchronous)
+    void runWorkerJob(WorkerJob& job);
+
+    /// Swap in finished worker results (audio thread). Returns true if a
+    /// loop finished loading, so its deferred ops can be flushed.
+    bool applyWorkerResults();
+
+    /// Hand a job's payload to the worker for deallocation. If the worker
+    /// queue is full it waits in deferredRetire_ (still behind any job that
+    /// may read it); only if that is full too is it freed inline.
+    void retire(WorkerJob job);
+    void retireStorage(LoopStorage storage);
+    /// Return the overdub take's chunks to the pool and free its tables
+    void retireOverdubBuffers();
+
+    /// Storage for overdub channel `ch` at chunk `slot` of the loop, taken
+    /// from the record pool (zeroed) on first use. nullptr if the pool is dry.
+    float* overdubChunk(size_t ch, size_t slot);
 
-    /// Drain commands from the SPSC queue into loop pending state (audio thread)
-    void drainCommands();
+    /// Sum every channel of an overdub take into `out` (take.length samples,
+    /// zeroed). Only chunks that were written are read (any thread).
+    void mixOverdubTake(const OverdubKit& take, float* out) const;
+
+    /// Snapshot every loop into sessionPlan_ and hand it to the worker for
+    /// the save begun by saveSession (audio thread)
+    void snapshotSession();
+
+    /// Apply a step of a session save or load (audio thread)
+    void applySessionResult(SessionStore::Result& result);
+
+    /// Set the metronome tempo, and follow it with the loops and MIDI sync
+    void applyBpm(double bpm);
+
+    /// Move onto another timeline, as syncTimeline() describes (audio thread)
+    void followTimeline(double beat, double bpm, int64_t atNanos);
+
+    static constexpr double kSyncJumpSeconds = 0.02;
+    static constexpr double kSyncSlewGain = 0.25;
+
+    /// Ask the worker to rebuild a loop's mix cache if it is out of date
+    void requestMixCache(Loop& lp);
+
+    /// Start a stretch cache render for a loop if it is stretching without
+    /// a current one: the worker sums the mix (it may read layers the audio
+    /// thread retires behind it), then the stretch worker renders it
+    void requestStretchCache(Loop& lp);
+
+    /// Ask the worker for a zeroed overdub kit of `length` samples, unless
+    /// one is ready or already on its way
+    void requestOverdubKit(int64_t length);
+
+    /// Have the worker take a loop's peaks if its mix has moved on since
+    void requestPeaks(Loop& lp);
+
+    /// Have the worker fold a loop's layers beyond the undo depth into its
+    /// base, unless it is within the depth or a fold is on its way
+    void requestLayerFold(Loop& lp);
+
+    /// Return the active recording's chunks to the pool and mark it inactive
+    void releaseRecording();
+
+    /// Append samples [offset, offset + numSamples) of every channel to the
+    /// active recording. Cancels the recording if the record pool runs out.
+    void appendToRecording(const float* const* input, int inputChannelCount,
+                           int offset, int numSamples);
+
+    /// Drain commands from the MPSC queue into loop pending state (audio
+    /// thread). `numSamples` is the block about to be rendered.
+    void drainCommands(int numSamples);
 
     /// Compute executeSample for a given quantize mode (audio thread)
     int64_t computeExecuteSample(Quantize quantize) const;
 
+    /// executeSample for a command drained at the start of a `numSamples`
+    /// block, honouring its timestamp (audio thread)
+    int64_t commandExecuteSample(const EngineCommand& cmd, int numSamples) const;
+
+    /// Fill and publish the next EngineState (audio thread)
+    void publishState();
+
+    /// Record an event stamped with the current metronome sample (audio thread)
+    void emitEvent(EngineEventCode code, int loopIndex = -1, int64_t scheduledSample = -1,
+                   int detail = 0, double value = 0.0, Quantize quantize = Quantize::Free);
+
     Metronome metronome_;
     MetronomeClick click_;
     MidiSync midiSync_;
+    DspLoadMeter loadMeter_;            // Audio thread; published in EngineState::perf
     std::vector<InputChannel> inputChannels_;
     /// Per-channel: metronome sample when the threshold was last exceeded.
     /// Updated once per processBlock. Used by fulfillCapture to decide
     /// channel inclusion in O(1) instead of scanning the captured segment.
     std::vector<int64_t> lastThresholdBreachSample_;
+    StretcherPool stretcherPool_;       // Audio thread; loops hold leases into it
     std::vector<Loop> loops_;
 
-    std::optional<ActiveRecording> activeRecording_;
-
-    /// Per-channel overdub accumulation (scoped per overdub layer)
-    std::vector<std::vector<float>> overdubChannelBuffers_;
+    /// Chunk size for the classic recording pool (samples)
+    static constexpr int kRecordChunkSize = 4096;
+
+    /// Backing store for classic recordings and overdub takes: every channel
+    /// can hold maxLookbackBars at minBpm for each, reserved up front.
+    SampleChunkPool recordPool_;
+    ActiveRecording activeRecording_;
+    /// Chain table swapped in when a finished recording's chains go to the
+    /// worker; empty while that mixdown is in flight.
+    std::vector<ChunkChain> spareRecordChains_;
+
+    /// Ring history a capture may use. The ring (or, when lookback spills,
+    /// its file) is larger by kCaptureHeadroomSeconds so the worker can copy
+    /// before it is overwritten.
+    int64_t lookbackCapacity_ = 0;
+    static constexpr double kCaptureHeadroomSeconds = 1.0;
+    /// Spilling rings: the smallest RAM window, and how often the spiller
+    /// copies (the window must cover many passes plus slow disk writes)
+    static constexpr double kMinSpillRamSeconds = 2.0;
+    static constexpr std::chrono::milliseconds kSpillInterval{50};
+    bool lookbackSpillFailed_ = false;
+
+    /// Per loop: content is being prepared by the worker
+    std::vector<uint8_t> loopLoading_;
+    /// Session loads started; captures and recordings posted before the
+    /// latest one come back stale
+    uint64_t sessionLoads_ = 0;
+    /// Per loop: what a capture plays from the rings until its copy lands
+    std::vector<CaptureSource> captureSources_;
+    OpScheduler scheduler_;             // Next-due pending op per loop
+    std::vector<int> dueLoops_;         // flushAllDueOps scratch, one slot per loop
+
+    /// Retired payloads waiting for room in the worker queue
+    static constexpr size_t kMaxDeferredRetire = 32;
+    std::vector<WorkerJob> deferredRetire_;
+
+    /// Loop-length buffers retired to the worker, reused for new layers and
+    /// mix caches (worker only)
+    BufferPool layerBuffers_;
+    int undoDepth_ = 16;
+
+    /// Spare overdub buffers for the next StartOverdub
+    OverdubKit overdubKit_;
+    bool overdubKitPending_ = false;
+
+    /// Per-channel overdub accumulation (scoped per overdub layer). A
+    /// channel is written from the sub-block it first goes live in (every
+    /// channel when the threshold is off); its layer buffer is in the loop.
+    OverdubKit overdubTake_;
     uint64_t overdubActiveChannelMask_ = 0;
     int overdubLoopIndex_ = -1;
+    bool overdubInputDropped_ = false;  // OverdubInputDropped sent this take
+
+    // Stretch cache renders. cacheStretcher_ is used only by the stretch
+    // worker; tempoGeneration_ counts tempo changes so it can abandon renders
+    // for a tempo that has already gone.
+    bool stretchCacheEnabled_ = true;
+    std::unique_ptr<TimeStretcher> cacheStretcher_;
+    std::atomic<uint64_t> tempoGeneration_{0};
+
+    // Waveform peaks (worker and control threads, never the audio thread).
+    // Loop peaks are replaced whole by the worker, so a reader only holds
+    // the lock to take a reference; input peaks follow their ring lazily.
+    struct LoopPeaks {
+        std::shared_ptr<const PeakPyramid> pyramid;
+        uint64_t revision = 0;
+    };
+    struct InputPeaks {
+        std::unique_ptr<PeakPyramid> pyramid;  // Ring history, wrapping like the ring
+        int64_t scanned = 0;                   // Ring samples summarised so far
+    };
+    std::mutex peaksMutex_;
+    std::vector<LoopPeaks> loopPeaks_;
+    uint64_t peaksRevision_ = 0;
+    std::mutex inputPeaksMutex_;
+    std::vector<InputPeaks> inputPeaks_;
+    std::vector<float> inputPeaksScratch_;
+
+    // Parallel rendering (audio thread; the pool is set up before audio starts)
+    std::unique_ptr<RenderPool> renderPool_;
+    std::vector<int> renderList_;       // Loops handed to the pool this sub-block
+    int64_t poolStretchNanos_ = 0;      // Stretcher time of tasks run on the audio thread
+    int renderOffset_ = 0;              // Block offset of the sub-block handed out
+
+    // Per-loop outputs of the block being processed (processBlock arguments)
+    float* const* loopOutputs_ = nullptr;
+    int loopOutputCount_ = 0;
+
+    // Per-sub-block scratch (kMaxSubBlock samples each, allocated once)
+    std::vector<float> mixScratch_;
+    std::vector<float> inputMixScratch_;
+    std::vector<float> silence_;
 
     Quantize defaultQuantize_ = Quantize::Bar;
     int lookbackBars_ = 1;
     int maxLookbackBars_;
     int crossfadeSamples_ = 256;
     double sampleRate_;
-    int64_t latencyCompensation_ = 0;
+    std::atomic<int64_t> latencyCompensation_{0};
     bool inputMonitoring_ = false;
     float liveThreshold_ = 0.0f;
 
-    EngineCallbacks callbacks_;
-    std::string lastMessage_;
+    // Thread safety: Audio -> control thread events
+    EngineEventLog events_;
 
     std::function<void(double)> bpmChangedCallback_;
-
-    // Thread safety: TUI -> Audio command queue
-    SpscQueue<EngineCommand, 256> commandQueue_;
-
-    // Thread safety: Audio -> TUI display snapshot
-    mutable std::mutex displayMutex_;
-    std::vector<float> channelPeaksSnapshot_;
+    std::function<void(int)> beatsPerBarChangedCallback_;
+
+    // Thread safety: TUI/OSC -> Audio command queue
+    MpscQueue<EngineCommand, 256> commandQueue_;
+    std::atomic<uint64_t> droppedCommands_{0};
+    std::atomic<bool> commandTimestamps_{true};
+    int64_t blockStartNanos_ = -1;      // Audio thread: clock at block start, or -1
+    TripleBuffer<TimelinePoint> publishedTimeline_;  // Audio -> timeline sync leader
+
+    // Thread safety: Audio -> TUI display state, one buffer per StateReader
+    std::array<TripleBuffer<EngineState>, kStateReaders> publishedState_;
+    uint64_t publishedSequence_ = 0;
+    std::atomic<bool> publisherReading_{false};  // Fill the publisher's buffer too
+    WakeSignal stateSignal_;
+    bool signalState_ = false;          // Audio thread: notify after this block
     std::atomic<bool> isRecordingAtomic_{false};
     std::atomic<int> recordingLoopIdxAtomic_{-1};
     std::atomic<uint64_t> liveChannelMask_{0};
+
+    // Declared last: the worker threads use the members above, so they must
+    // be stopped before any of them are destroyed. The stretch worker only
+    // runs StretchRender jobs, which can take a while, so short jobs on the
+    // main worker never queue behind them. The spiller (if lookback spills)
+    // copies ring history to disk, the archive streams input and output to
+    // files, and the session store saves and loads sessions.
+    std::unique_ptr<RingSpiller> spiller_;
+    std::unique_ptr<AudioArchive> archive_;
+    std::vector<const float*> archiveInputs_;  // Audio thread: channel pointers for archive_
+    SessionStore sessions_;
+    std::unique_ptr<SessionPlan> sessionPlan_;  // Audio thread; with the worker during a snapshot
+    int64_t sessionAnchor_ = 0;                 // Audio thread: bar start loaded loops play from
+    EngineWorker worker_;
+    EngineWorker stretchWorker_;
 };
 
 } // namespace retrospect
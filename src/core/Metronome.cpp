@@ -24,24 +24,58 @@ MetronomePosition Metronome::position() const {
     return pos;
 }
 
+int64_t Metronome::samplesToBeat() const {
+    // Start from the analytic answer, then settle it against the same
+    // comparison advance() makes so rounding can't move a beat by a sample
+    int64_t i = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(samplesPerBeat_ - sampleInBeat_)));
+    while (i > 1 && sampleInBeat_ + static_cast<double>(i - 1) >= samplesPerBeat_) --i;
+    while (sampleInBeat_ + static_cast<double>(i) < samplesPerBeat_) ++i;
+    return i;
+}
+
 void Metronome::advance(int numSamples) {
     if (!running_ || numSamples <= 0) return;
 
-    for (int i = 0; i < numSamples; ++i) {
-        totalSamples_++;
-        sampleInBeat_ += 1.0;
-
-        if (sampleInBeat_ >= samplesPerBeat_) {
-            sampleInBeat_ -= samplesPerBeat_;
-            currentBeat_++;
-            if (currentBeat_ >= beatsPerBar_) {
-                currentBeat_ = 0;
-                currentBar_++;
-            }
-
-            MetronomePosition pos = position();
-            if (beatCallback_) beatCallback_(pos);
-            if (pos.beat == 0 && barCallback_) barCallback_(pos);
+    int64_t remaining = numSamples;
+    for (;;) {
+        int64_t toBeat = samplesToBeat();
+        if (toBeat > remaining) {
+            totalSamples_ += remaining;
+            sampleInBeat_ += static_cast<double>(remaining);
+            return;
+        }
+
+        totalSamples_ += toBeat;
+        sampleInBeat_ = (sampleInBeat_ + static_cast<double>(toBeat)) - samplesPerBeat_;
+        remaining -= toBeat;
+        currentBeat_++;
+        if (currentBeat_ >= beatsPerBar_) {
+            currentBeat_ = 0;
+            currentBar_++;
+        }
+
+        MetronomePosition pos = position();
+        if (beatCallback_) beatCallback_(pos);
+        if (pos.beat == 0 && barCallback_) barCallback_(pos);
+    }
+}
+
+void Metronome::shiftPhase(double samples) {
+    sampleInBeat_ += samples;
+    while (sampleInBeat_ >= samplesPerBeat_) {
+        sampleInBeat_ -= samplesPerBeat_;
+        if (++currentBeat_ >= beatsPerBar_) {
+            currentBeat_ = 0;
+            currentBar_++;
+        }
+    }
+    while (sampleInBeat_ < 0.0) {
+        sampleInBeat_ += samplesPerBeat_;
+        if (--currentBeat_ < 0) {
+            // Bar numbers stay non-negative; only the phase within the bar
+            // has to match
+            currentBeat_ = beatsPerBar_ - 1;
+            currentBar_ = std::max(0, currentBar_ - 1);
         }
     }
 }
@@ -76,6 +110,36 @@ int64_t Metronome::samplesUntilBoundary(Quantize q) const {
     return 0;
 }
 
+int64_t Metronome::boundaryAtOrAfter(Quantize q, int64_t sample) const {
+    if (q == Quantize::Free) return sample;
+    if (sample <= totalSamples_) return totalSamples_ + samplesUntilBoundary(q);
+
+    // The next boundary, as nextBeatSample()/nextBarSample() place it, then
+    // as many periods on as it takes to reach `sample`
+    double first = samplesPerBeat_ - sampleInBeat_;
+    double period = samplesPerBeat_;
+    if (q == Quantize::Bar) {
+        first = (beatsPerBar_ - currentBeat_) * samplesPerBeat_ - sampleInBeat_;
+        period = samplesPerBar_;
+    }
+    double ahead = static_cast<double>(sample - totalSamples_);
+    double periods = std::max(0.0, std::ceil((ahead - first) / period));
+    int64_t at = totalSamples_ + static_cast<int64_t>(std::round(first + periods * period));
+    // Rounding can leave it a sample short
+    if (at < sample) {
+        at = totalSamples_ + static_cast<int64_t>(std::round(first + (periods + 1.0) * period));
+    }
+    return at;
+}
+
+int Metronome::samplesUntilNextBeat(int limit) const {
+    if (!running_) return limit;
+
+    // Same computation advance() uses, so the split lands on the sample the
+    // callback fires on
+    return static_cast<int>(std::min<int64_t>(limit, samplesToBeat()));
+}
+
 double Metronome::samplesPerBeat() const {
     return samplesPerBeat_;
 }
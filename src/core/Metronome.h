@@ -24,8 +24,8 @@ struct MetronomePosition {
 };
 
 /// Internal metronome that tracks tempo and provides beat/bar positions.
-/// Designed to be advanced sample-by-sample from an audio callback or
-/// simulation loop.
+/// Advanced by whole blocks from an audio callback or simulation loop; beat
+/// boundaries inside a block are computed, not found by stepping per sample.
 class Metronome {
 public:
     using BeatCallback = std::function<void(const MetronomePosition&)>;
@@ -37,6 +37,12 @@ public:
     /// beat and bar boundaries crossed during this advance.
     void advance(int numSamples);
 
+    /// Move the beat phase by `samples` (later in the beat if positive)
+    /// without moving the sample counter or firing callbacks: beats crossed
+    /// this way are carried into the count, not clicked. Used to follow
+    /// another timeline (see LoopEngine::syncTimeline).
+    void shiftPhase(double samples);
+
     /// Reset to the beginning
     void reset();
 
@@ -52,6 +58,17 @@ public:
     /// Returns samples remaining until the next quantization boundary
     int64_t samplesUntilBoundary(Quantize q) const;
 
+    /// Returns the sample index of the first quantization boundary at or
+    /// after `sample`, a sample ahead of the current position, assuming the
+    /// tempo holds until then (`sample` itself for Free)
+    int64_t boundaryAtOrAfter(Quantize q, int64_t sample) const;
+
+    /// Number of samples advance() can consume up to and including the one
+    /// that fires the next beat callback. Looks at most `limit` samples ahead
+    /// and returns `limit` if no beat falls within that range. Used to split
+    /// audio blocks so the click retriggers on the exact sample.
+    int samplesUntilNextBeat(int limit) const;
+
     /// Number of samples per beat at current tempo
     double samplesPerBeat() const;
 
@@ -78,6 +95,10 @@ public:
 private:
     void recalculate();
 
+    /// Samples until the next beat fires: the i >= 1 at which the beat
+    /// accumulator first reaches samplesPerBeat_
+    int64_t samplesToBeat() const;
+
     double bpm_;
     int beatsPerBar_;
     double sampleRate_;
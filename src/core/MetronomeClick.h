@@ -1,46 +1,55 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <atomic>
+#include <vector>
 
 namespace retrospect {
 
 /// Synthesizes a short percussive click for the metronome.
 /// Produces a decaying sine wave (~30ms) — higher pitch on downbeats.
+///
+/// Both clicks are rendered once into wavetables at the sample rate, so
+/// playing one is a table read and a gain rather than an exp and a sin per
+/// sample.
 class MetronomeClick {
 public:
-    explicit MetronomeClick(double sampleRate = 44100.0)
-        : sampleRate_(sampleRate) {}
+    explicit MetronomeClick(double sampleRate = 44100.0) {
+        setSampleRate(sampleRate);
+    }
 
     /// Start a click. Downbeats get higher frequency and slightly more volume.
     void trigger(bool isDownbeat) {
         if (!enabled_) return;
-        phase_ = 0.0;
+        downbeat_ = isDownbeat;
         sampleIndex_ = 0;
         active_ = true;
-        freq_ = isDownbeat ? 1000.0 : 800.0;
         clickGain_ = isDownbeat ? 1.0f : 0.75f;
     }
 
     /// Return the next sample of the click (0.0f when inactive).
     float nextSample() {
         if (!active_) return 0.0f;
-
-        double t = static_cast<double>(sampleIndex_) / sampleRate_;
-        if (t >= duration_) {
+        const std::vector<float>& table = downbeat_ ? downbeatTable_ : beatTable_;
+        if (sampleIndex_ >= table.size()) {
             active_ = false;
             return 0.0f;
         }
+        return table[sampleIndex_++] * volume_ * clickGain_;
+    }
 
-        // Exponential decay envelope
-        float envelope = std::exp(static_cast<float>(-t / decayTau_));
-
-        // Sine oscillator
-        float sample = std::sin(static_cast<float>(phase_)) * envelope;
-        phase_ += 2.0 * M_PI * freq_ / sampleRate_;
-
-        ++sampleIndex_;
-        return sample * volume_ * clickGain_;
+    /// Add the next `numSamples` of the click to `output`
+    void mixInto(float* output, int numSamples) {
+        if (!active_) return;
+        const std::vector<float>& click = downbeat_ ? downbeatTable_ : beatTable_;
+        size_t n = std::min(static_cast<size_t>(numSamples), click.size() - sampleIndex_);
+        const float* table = click.data() + sampleIndex_;
+        for (size_t i = 0; i < n; ++i) {
+            output[i] += table[i] * volume_ * clickGain_;
+        }
+        sampleIndex_ += n;
+        if (n < static_cast<size_t>(numSamples)) active_ = false;
     }
 
     void setEnabled(bool on) { enabled_ = on; }
@@ -49,19 +58,41 @@ public:
     void setVolume(float v) { volume_ = v; }
     float volume() const { return volume_; }
 
-    void setSampleRate(double sr) { sampleRate_ = sr; }
+    /// Re-render the wavetables (allocates; not while a click plays)
+    void setSampleRate(double sr) {
+        sampleRate_ = sr;
+        render(downbeatTable_, 1000.0);
+        render(beatTable_, 800.0);
+        active_ = false;
+    }
 
 private:
-    double sampleRate_;
+    /// The click at `freq`: every sample before `duration_`
+    void render(std::vector<float>& table, double freq) const {
+        table.clear();
+        double phase = 0.0;
+        for (int i = 0;; ++i) {
+            double t = static_cast<double>(i) / sampleRate_;
+            if (t >= duration_) break;
+            // Exponential decay envelope over a sine oscillator
+            float envelope = std::exp(static_cast<float>(-t / decayTau_));
+            table.push_back(std::sin(static_cast<float>(phase)) * envelope);
+            phase += 2.0 * M_PI * freq / sampleRate_;
+        }
+    }
+
+    double sampleRate_ = 44100.0;
     bool enabled_ = true;
     float volume_ = 0.5f;
 
+    std::vector<float> downbeatTable_;
+    std::vector<float> beatTable_;
+
     // Click state
     bool active_ = false;
-    double phase_ = 0.0;
-    double freq_ = 1000.0;
+    bool downbeat_ = true;
     float clickGain_ = 1.0f;
-    int sampleIndex_ = 0;
+    size_t sampleIndex_ = 0;
 
     // ~30ms click duration, fast exponential decay
     static constexpr double duration_ = 0.03;
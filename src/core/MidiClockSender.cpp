@@ -0,0 +1,68 @@
+#include "core/MidiClockSender.h"
+
+#include <chrono>
+
+namespace retrospect {
+
+MidiClockSender::MidiClockSender(MidiSync& sync, SendFunction send)
+    : sync_(sync), send_(std::move(send))
+{
+}
+
+MidiClockSender::~MidiClockSender() {
+    stop();
+}
+
+void MidiClockSender::start() {
+    if (thread_.joinable()) return;
+    stopping_.store(false, std::memory_order_relaxed);
+    sync_.setOutputAttached(true);
+    thread_ = std::thread([this] { run(); });
+}
+
+void MidiClockSender::stop() {
+    if (!thread_.joinable()) return;
+    sync_.setOutputAttached(false);
+    stopping_.store(true, std::memory_order_release);
+    sync_.wakeSender();
+    thread_.join();
+
+    // Anything left is past due: send it now
+    MidiClockEvent ev;
+    while (sync_.popEvent(ev)) {
+        ev.dueNanos = -1;
+        send(ev);
+    }
+    if (clockRunning_) {
+        ev.status = MidiSync::kStop;
+        send(ev);
+    }
+}
+
+void MidiClockSender::run() {
+    using Clock = std::chrono::steady_clock;
+    MidiClockEvent ev;
+    for (;;) {
+        uint32_t seen = sync_.eventSignal();
+        while (!stopping_.load(std::memory_order_acquire) && sync_.popEvent(ev)) {
+            if (ev.dueNanos >= 0) {
+                std::this_thread::sleep_until(Clock::time_point(
+                    std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(ev.dueNanos))));
+            }
+            send(ev);
+        }
+        if (stopping_.load(std::memory_order_acquire)) break;
+        sync_.waitForEvents(seen);
+    }
+}
+
+void MidiClockSender::send(const MidiClockEvent& ev) {
+    if (ev.status == MidiSync::kStart || ev.status == MidiSync::kContinue) {
+        clockRunning_ = true;
+    } else if (ev.status == MidiSync::kStop) {
+        clockRunning_ = false;
+    }
+    if (send_) send_(ev.status);
+}
+
+} // namespace retrospect
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "core/MidiSync.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+namespace retrospect {
+
+/// Sends the MIDI bytes a MidiSync queues, each at its due time.
+///
+/// Runs its own thread: it sleeps until the audio thread signals new events,
+/// then sleeps until each event's steady-clock due time and hands the byte
+/// to the send function. Because MidiSync stamps events one block ahead,
+/// they arrive here before they are due and go out evenly spaced instead of
+/// in a burst per audio buffer.
+class MidiClockSender {
+public:
+    /// Receives a single MIDI status byte (0xF8 clock, 0xFA start, etc.)
+    using SendFunction = std::function<void(uint8_t statusByte)>;
+
+    MidiClockSender(MidiSync& sync, SendFunction send);
+    ~MidiClockSender();
+
+    MidiClockSender(const MidiClockSender&) = delete;
+    MidiClockSender& operator=(const MidiClockSender&) = delete;
+
+    /// Attach to the MidiSync and start sending (no-op if already running)
+    void start();
+
+    /// Send what is queued, then Stop (0xFC) if the clock was left running
+    /// so downstream gear doesn't hang, and join the thread
+    void stop();
+
+    bool isRunning() const { return thread_.joinable(); }
+
+private:
+    void run();
+    void send(const MidiClockEvent& ev);
+
+    MidiSync& sync_;
+    SendFunction send_;
+    bool clockRunning_ = false;   // Sender thread: Start sent, Stop not yet
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+} // namespace retrospect
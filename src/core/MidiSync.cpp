@@ -1,8 +1,23 @@
 #include "core/MidiSync.h"
 #include <algorithm>
+#include <cmath>
 
 namespace retrospect {
 
+namespace {
+
+// Samples until an accumulator gaining 1.0 per sample reaches `period`: the
+// smallest i >= 1 with acc + i >= period, settled against that exact
+// comparison so rounding can't move a tick by a sample
+int64_t samplesUntilWrap(double acc, double period) {
+    int64_t i = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(period - acc)));
+    while (i > 1 && acc + static_cast<double>(i - 1) >= period) --i;
+    while (acc + static_cast<double>(i) < period) ++i;
+    return i;
+}
+
+} // namespace
+
 MidiSync::MidiSync(double bpm, double sampleRate)
     : bpm_(bpm), sampleRate_(sampleRate)
 {
@@ -15,17 +30,65 @@ void MidiSync::recalculate() {
     samplesPerTick_ = samplesPerBeat / kPPQN;
 }
 
+void MidiSync::beginBlock(int64_t wallNanos, int numSamples) {
+    blockStartSample_ = position_;
+    blockWallNanos_ = wallNanos;
+    blockLength_ = numSamples;
+}
+
 void MidiSync::advance(int numSamples) {
-    if (!enabled_ || numSamples <= 0) return;
+    if (numSamples <= 0) return;
+    bool emitted = false;
 
-    for (int i = 0; i < numSamples; ++i) {
-        sampleInTick_ += 1.0;
+    // Start/Stop requested since the last advance go out on its first sample
+    bool want = isEnabled() && hasOutput();
+    if (want != running_) {
+        running_ = want;
+        if (want) {
+            sampleInTick_ = 0.0;
+            emit(kStart, 0);
+            emitted = true;
+        } else if (hasOutput()) {
+            emit(kStop, 0);
+            emitted = true;
+        }
+    }
 
-        if (sampleInTick_ >= samplesPerTick_) {
-            sampleInTick_ -= samplesPerTick_;
-            sendByte(kClockTick);
+    if (running_) {
+        int64_t done = 0;
+        for (;;) {
+            int64_t toTick = samplesUntilWrap(sampleInTick_, samplesPerTick_);
+            if (done + toTick > numSamples) {
+                sampleInTick_ += static_cast<double>(numSamples - done);
+                break;
+            }
+            sampleInTick_ = (sampleInTick_ + static_cast<double>(toTick)) - samplesPerTick_;
+            done += toTick;
+            // The tick belongs to the sample that completed it
+            emit(kClockTick, done - 1);
+            emitted = true;
         }
     }
+
+    position_ += numSamples;
+    if (emitted) wakeSender();
+}
+
+void MidiSync::emit(uint8_t status, int64_t offset) {
+    MidiClockEvent ev;
+    ev.sampleTime = position_ + offset;
+    ev.status = status;
+    if (blockWallNanos_ >= 0) {
+        double samplesLater = static_cast<double>(ev.sampleTime - blockStartSample_ + blockLength_);
+        ev.dueNanos = blockWallNanos_ +
+            static_cast<int64_t>(std::llround(samplesLater * 1e9 / sampleRate_));
+    }
+    if (!events_.push(ev)) dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MidiSync::wakeSender() {
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_one();
 }
 
 void MidiSync::setBpm(double bpm) {
@@ -35,6 +98,12 @@ void MidiSync::setBpm(double bpm) {
     sampleInTick_ = fraction * samplesPerTick_;
 }
 
+void MidiSync::shiftPhase(double samples) {
+    if (samplesPerTick_ <= 0) return;
+    sampleInTick_ = std::fmod(sampleInTick_ + samples, samplesPerTick_);
+    if (sampleInTick_ < 0.0) sampleInTick_ += samplesPerTick_;
+}
+
 void MidiSync::setSampleRate(double rate) {
     double fraction = (samplesPerTick_ > 0) ? sampleInTick_ / samplesPerTick_ : 0.0;
     sampleRate_ = rate;
@@ -42,19 +111,4 @@ void MidiSync::setSampleRate(double rate) {
     sampleInTick_ = fraction * samplesPerTick_;
 }
 
-void MidiSync::setEnabled(bool on) {
-    if (on == enabled_) return;
-    enabled_ = on;
-    if (on) {
-        sampleInTick_ = 0.0;
-        sendByte(kStart);
-    } else {
-        sendByte(kStop);
-    }
-}
-
-void MidiSync::sendByte(uint8_t b) {
-    if (sendCallback_) sendCallback_(b);
-}
-
 } // namespace retrospect
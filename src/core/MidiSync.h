@@ -1,21 +1,39 @@
 #pragma once
 
+#include "core/SpscQueue.h"
+
+#include <atomic>
 #include <cstdint>
-#include <functional>
 
 namespace retrospect {
 
+/// A MIDI real-time status byte and when it should go out
+struct MidiClockEvent {
+    int64_t sampleTime = 0;     // MidiSync sample clock at the event
+    int64_t dueNanos = -1;      // Steady-clock send time, or -1 for right away
+    uint8_t status = 0;
+};
+
 /// Generates MIDI clock sync messages (24 PPQN) in sync with the metronome.
-/// Uses a callback to send raw MIDI bytes, keeping the core library
-/// independent of any MIDI framework.
+///
+/// The audio thread advances it by whole blocks; tick positions inside a
+/// block are computed rather than counted out per sample. Each byte becomes
+/// a timestamped MidiClockEvent in a lock-free ring, which a MidiClockSender
+/// thread drains and sends at its due time. That keeps MIDI I/O off the
+/// audio thread and takes the clock jitter from a whole buffer down to the
+/// sender's wakeup accuracy. The core library stays independent of any MIDI
+/// framework.
 class MidiSync {
 public:
-    /// Callback receives a single MIDI status byte (0xF8 clock, 0xFA start, etc.)
-    using SendCallback = std::function<void(uint8_t statusByte)>;
-
     MidiSync(double bpm = 120.0, double sampleRate = 44100.0);
 
-    /// Advance by numSamples, emitting clock ticks (0xF8) as needed
+    /// Start of an audio block (audio thread). Events emitted until the next
+    /// call are due one block after their sample's place in this one:
+    /// wallNanos + (offset + numSamples) / sampleRate. Pass wallNanos = -1
+    /// when there is no wall clock (offline rendering).
+    void beginBlock(int64_t wallNanos, int numSamples);
+
+    /// Advance by numSamples, emitting clock ticks (0xF8) as needed (audio thread)
     void advance(int numSamples);
 
     /// Set BPM (recalculates tick interval, preserves fractional position)
@@ -24,17 +42,37 @@ public:
     /// Set sample rate
     void setSampleRate(double rate);
 
-    /// Enable/disable MIDI sync output.
-    /// When enabled, sends Start (0xFA) and begins clock ticks.
-    /// When disabled, sends Stop (0xFC) and stops clock ticks.
-    void setEnabled(bool on);
-    bool isEnabled() const { return enabled_; }
+    /// Move the tick phase by `samples` along with the metronome's (see
+    /// Metronome::shiftPhase). Kept within the current tick, so no tick is
+    /// skipped or sent twice.
+    void shiftPhase(double samples);
+
+    /// Enable/disable MIDI sync output (any thread). The audio thread sends
+    /// Start (0xFA) and begins clock ticks, or sends Stop (0xFC), at the
+    /// start of its next advance.
+    void setEnabled(bool on) { enabled_.store(on, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    /// Whether a sender is draining events (i.e. a MIDI output device is
+    /// available). Nothing is emitted without one.
+    bool hasOutput() const { return outputAttached_.load(std::memory_order_acquire); }
+    void setOutputAttached(bool on) { outputAttached_.store(on, std::memory_order_release); }
 
-    /// Set the callback for sending MIDI bytes
-    void setSendCallback(SendCallback cb) { sendCallback_ = std::move(cb); }
+    /// Take the next event (sender thread only)
+    bool popEvent(MidiClockEvent& ev) { return events_.pop(ev); }
 
-    /// Whether a send callback is wired up (i.e. a MIDI output device is available)
-    bool hasOutput() const { return sendCallback_ != nullptr; }
+    /// Counter bumped after each block that emitted events; a sender waits
+    /// on it with waitForEvents
+    uint32_t eventSignal() const { return signal_.load(std::memory_order_acquire); }
+
+    /// Block until eventSignal() differs from `seen` (sender thread)
+    void waitForEvents(uint32_t seen) const { signal_.wait(seen, std::memory_order_acquire); }
+
+    /// Wake a sender blocked in waitForEvents (e.g. to stop it)
+    void wakeSender();
+
+    /// Events dropped because the ring was full
+    uint64_t droppedEvents() const { return dropped_.load(std::memory_order_relaxed); }
 
     // MIDI system real-time status bytes
     static constexpr uint8_t kClockTick = 0xF8;
@@ -45,16 +83,31 @@ public:
     static constexpr int kPPQN = 24;  // Pulses per quarter note
 
 private:
+    static constexpr size_t kRingCapacity = 1024;
+
     void recalculate();
-    void sendByte(uint8_t b);
+
+    /// Queue a byte for the sample `offset` samples into the current advance
+    void emit(uint8_t status, int64_t offset);
 
     double bpm_;
     double sampleRate_;
     double samplesPerTick_ = 0;   // samples per MIDI clock tick
     double sampleInTick_ = 0.0;   // accumulator within current tick
-    bool enabled_ = false;
 
-    SendCallback sendCallback_;
+    std::atomic<bool> enabled_{false};        // Requested by the control thread
+    std::atomic<bool> outputAttached_{false};
+    bool running_ = false;                    // Audio thread: Start sent, Stop not yet
+
+    // Audio thread sample clock, and the block it maps to wall time through
+    int64_t position_ = 0;
+    int64_t blockStartSample_ = 0;
+    int64_t blockWallNanos_ = -1;
+    int blockLength_ = 0;
+
+    SpscQueue<MidiClockEvent, kRingCapacity> events_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint32_t> signal_{0};
 };
 
 } // namespace retrospect
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace retrospect {
+
+/// Monotonic wall clock in nanoseconds, safe to call on the audio thread.
+///
+/// steady_clock is a vDSO read on Linux and mach_absolute_time on macOS: no
+/// syscall, no lock, tens of nanoseconds. Every engine timestamp (command
+/// stamps, MIDI clock due times, DSP load timing) comes from this one clock
+/// so they can be compared with each other.
+inline int64_t monotonicNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// System (calendar) clock in nanoseconds since the Unix epoch. Only for
+/// time shared with other machines (OSC timetags, network timeline sync);
+/// it can step, so nothing on one host is timed by it.
+inline int64_t systemNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace retrospect
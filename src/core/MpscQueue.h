@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace retrospect {
+
+/// Bounded lock-free multi-producer single-consumer queue.
+/// Fixed capacity (a power of two), no dynamic allocation.
+///
+/// Each slot carries a sequence number (Vyukov's bounded queue): producers
+/// claim a position with a CAS on head_, write the item, then publish it by
+/// bumping the slot's sequence. The consumer only ever touches tail_, so
+/// pop() never contends with producers. A producer that has claimed a slot
+/// but not yet published it makes pop() report empty until it finishes.
+/// pushBatch() claims a run of slots at once and publishes its first slot
+/// last, so the consumer takes either none of a batch or all of it.
+template <typename T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two >= 2");
+
+public:
+    MpscQueue() {
+        for (size_t i = 0; i < Capacity; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /// Push an item (any thread).
+    /// Returns false if the queue is full.
+    bool push(const T& item) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots_[pos & kMask];
+            const size_t seq = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = item;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Push `count` items as one run (any thread): they take consecutive
+    /// positions, with no other producer's items between them, and pop()
+    /// sees none of them until it can see them all. Returns false, pushing
+    /// nothing, if the queue hasn't room for every one.
+    bool pushBatch(const T* items, size_t count) {
+        if (count == 0) return true;
+        if (count > Capacity) return false;
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            const size_t seq = slots_[pos & kMask].sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // The consumer pops in order, so if the run's last slot is
+                // free, so is every slot before it
+                const size_t last = pos + count - 1;
+                const size_t lastSeq = slots_[last & kMask].sequence.load(std::memory_order_acquire);
+                const auto lastDiff = static_cast<intptr_t>(lastSeq) - static_cast<intptr_t>(last);
+                if (lastDiff < 0) return false; // full
+                if (lastDiff == 0 &&
+                    head_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+                    break;
+                if (lastDiff > 0) pos = head_.load(std::memory_order_relaxed);
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < count; ++i) slots_[(pos + i) & kMask].value = items[i];
+        // The first slot goes last: pop() stops at it until then, and once
+        // it sees it, it sees the rest
+        for (size_t i = count; i-- > 0;) {
+            slots_[(pos + i) & kMask].sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    /// Pop an item (consumer/audio thread only).
+    /// Returns false if the queue is empty.
+    bool pop(T& item) {
+        Slot& slot = slots_[tail_ & kMask];
+        if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1)
+            return false; // empty, or the next item is still being written
+        item = std::move(slot.value);
+        slot.sequence.store(tail_ + Capacity, std::memory_order_release);
+        ++tail_;
+        return true;
+    }
+
+private:
+    static constexpr size_t kMask = Capacity - 1;
+
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::array<Slot, Capacity> slots_;
+    alignas(64) std::atomic<size_t> head_{0};  // Next position to claim (producers)
+    alignas(64) size_t tail_ = 0;              // Next position to pop (consumer)
+};
+
+} // namespace retrospect
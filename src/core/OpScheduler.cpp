@@ -0,0 +1,83 @@
+#include "core/OpScheduler.h"
+
+namespace retrospect {
+
+OpScheduler::OpScheduler(int numLoops)
+    : slot_(static_cast<size_t>(numLoops < 0 ? 0 : numLoops), -1)
+{
+    heap_.reserve(slot_.size());
+}
+
+void OpScheduler::update(int loop, int64_t dueSample) {
+    if (loop < 0 || static_cast<size_t>(loop) >= slot_.size()) return;
+    int at = slot_[static_cast<size_t>(loop)];
+
+    if (dueSample == kNone) {
+        if (at >= 0) remove(static_cast<size_t>(at));
+        return;
+    }
+
+    if (at < 0) {
+        heap_.push_back(Entry{dueSample, loop});
+        slot_[static_cast<size_t>(loop)] = static_cast<int>(heap_.size() - 1);
+        siftUp(heap_.size() - 1);
+        return;
+    }
+
+    size_t i = static_cast<size_t>(at);
+    int64_t old = heap_[i].due;
+    heap_[i].due = dueSample;
+    if (dueSample < old) {
+        siftUp(i);
+    } else if (dueSample > old) {
+        siftDown(i);
+    }
+}
+
+void OpScheduler::place(size_t i, const Entry& e) {
+    heap_[i] = e;
+    slot_[static_cast<size_t>(e.loop)] = static_cast<int>(i);
+}
+
+void OpScheduler::siftUp(size_t i) {
+    Entry e = heap_[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!before(e, heap_[parent])) break;
+        place(i, heap_[parent]);
+        i = parent;
+    }
+    place(i, e);
+}
+
+void OpScheduler::siftDown(size_t i) {
+    Entry e = heap_[i];
+    const size_t n = heap_.size();
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= n) break;
+        if (child + 1 < n && before(heap_[child + 1], heap_[child])) ++child;
+        if (!before(heap_[child], e)) break;
+        place(i, heap_[child]);
+        i = child;
+    }
+    place(i, e);
+}
+
+void OpScheduler::remove(size_t i) {
+    slot_[static_cast<size_t>(heap_[i].loop)] = -1;
+    Entry last = heap_.back();
+    heap_.pop_back();
+    if (i == heap_.size()) return;
+
+    // Move the last entry into the hole and restore order in whichever
+    // direction it violates
+    place(i, last);
+    if (i > 0 && before(last, heap_[(i - 1) / 2])) {
+        siftUp(i);
+    } else {
+        siftDown(i);
+    }
+}
+
+} // namespace retrospect
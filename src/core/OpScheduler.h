@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace retrospect {
+
+/// Which loop has the next pending op due, without scanning every loop.
+///
+/// An indexed binary min-heap with one entry per loop, keyed by the loop's
+/// earliest pending executeSample (ties go to the lower loop index). The
+/// engine re-keys a loop whenever its PendingState changes, so the per-slot
+/// last-wins semantics stay in PendingState and the heap never holds stale
+/// or duplicate entries. All storage is sized at construction; audio thread
+/// only.
+class OpScheduler {
+public:
+    static constexpr int64_t kNone = INT64_MAX;
+
+    explicit OpScheduler(int numLoops);
+
+    /// Set when `loop` is next due; kNone removes it. O(log loops).
+    void update(int loop, int64_t dueSample);
+
+    /// Earliest due sample across all loops (kNone if nothing is pending)
+    int64_t nextDue() const { return heap_.empty() ? kNone : heap_.front().due; }
+
+    /// Loop holding the earliest due sample (only valid if nextDue() != kNone)
+    int nextLoop() const { return heap_.front().loop; }
+
+private:
+    struct Entry {
+        int64_t due;
+        int loop;
+    };
+
+    static bool before(const Entry& a, const Entry& b) {
+        return a.due < b.due || (a.due == b.due && a.loop < b.loop);
+    }
+
+    void siftUp(size_t i);
+    void siftDown(size_t i);
+    void place(size_t i, const Entry& e);
+    void remove(size_t i);
+
+    std::vector<Entry> heap_;   // Capacity reserved for every loop
+    std::vector<int> slot_;     // Heap index of each loop, -1 if absent
+};
+
+} // namespace retrospect
@@ -0,0 +1,123 @@
+#include "core/PeakPyramid.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace retrospect {
+
+namespace {
+
+void merge(Peak& into, const Peak& peak, bool& any) {
+    if (!any) {
+        into = peak;
+        any = true;
+        return;
+    }
+    into.min = std::min(into.min, peak.min);
+    into.max = std::max(into.max, peak.max);
+}
+
+} // namespace
+
+PeakPyramid::PeakPyramid(int64_t length)
+    : length_(std::max<int64_t>(0, length))
+{
+    size_t buckets = static_cast<size_t>((length_ + kBucketSamples - 1) / kBucketSamples);
+    while (buckets > 0) {
+        levels_.emplace_back(buckets);
+        if (buckets == 1) break;
+        buckets = (buckets + 1) / 2;
+    }
+}
+
+void PeakPyramid::write(const float* samples, int64_t first, int64_t numSamples) {
+    if (numSamples <= 0 || first < 0 || first + numSamples > length_) return;
+
+    std::vector<Peak>& base = levels_[0];
+    int64_t end = first + numSamples;
+    for (int64_t pos = first; pos < end;) {
+        int64_t bucket = pos / kBucketSamples;
+        int64_t stop = std::min(end, (bucket + 1) * kBucketSamples);
+        const float* p = samples + (pos - first);
+        float lo = p[0];
+        float hi = p[0];
+        for (int64_t i = 1; i < stop - pos; ++i) {
+            lo = std::min(lo, p[i]);
+            hi = std::max(hi, p[i]);
+        }
+        Peak& peak = base[static_cast<size_t>(bucket)];
+        if (pos % kBucketSamples == 0) {
+            peak = {lo, hi};
+        } else {
+            peak.min = std::min(peak.min, lo);
+            peak.max = std::max(peak.max, hi);
+        }
+        pos = stop;
+    }
+    updateParents(first / kBucketSamples, (end - 1) / kBucketSamples);
+}
+
+void PeakPyramid::updateParents(int64_t from, int64_t to) {
+    for (size_t level = 1; level < levels_.size(); ++level) {
+        from /= 2;
+        to /= 2;
+        const std::vector<Peak>& below = levels_[level - 1];
+        std::vector<Peak>& here = levels_[level];
+        for (int64_t i = from; i <= to; ++i) {
+            size_t left = static_cast<size_t>(2 * i);
+            Peak peak = below[left];
+            if (left + 1 < below.size()) {
+                peak.min = std::min(peak.min, below[left + 1].min);
+                peak.max = std::max(peak.max, below[left + 1].max);
+            }
+            here[static_cast<size_t>(i)] = peak;
+        }
+    }
+}
+
+void PeakPyramid::mergeBuckets(int64_t from, int64_t to, Peak& peak, bool& any) const {
+    // Bottom-up over the levels: an odd edge bucket is taken on its own,
+    // the rest are covered by the level above
+    for (size_t level = 0; level < levels_.size() && from < to; ++level) {
+        const std::vector<Peak>& here = levels_[level];
+        if (from & 1) merge(peak, here[static_cast<size_t>(from++)], any);
+        if (to & 1) merge(peak, here[static_cast<size_t>(--to)], any);
+        from /= 2;
+        to /= 2;
+    }
+}
+
+void PeakPyramid::summarize(int64_t first, int64_t span, int columns, Peak* out) const {
+    if (columns <= 0) return;
+    if (length_ == 0 || span <= 0) {
+        std::fill(out, out + columns, Peak{});
+        return;
+    }
+    span = std::min(span, length_);
+    first = ((first % length_) + length_) % length_;
+    auto buckets = [](int64_t from, int64_t to) {
+        return std::pair{from / kBucketSamples, (to + kBucketSamples - 1) / kBucketSamples};
+    };
+
+    for (int c = 0; c < columns; ++c) {
+        int64_t from = first + span * c / columns;
+        int64_t to = std::max(from + 1, first + span * (c + 1) / columns);
+        if (from >= length_) {
+            from -= length_;
+            to -= length_;
+        }
+
+        Peak peak;
+        bool any = false;
+        // A column running past the end wraps round to the start
+        auto [fromBucket, toBucket] = buckets(from, std::min(to, length_));
+        mergeBuckets(fromBucket, toBucket, peak, any);
+        if (to > length_) {
+            auto [wrapFrom, wrapTo] = buckets(0, to - length_);
+            mergeBuckets(wrapFrom, wrapTo, peak, any);
+        }
+        out[c] = peak;
+    }
+}
+
+} // namespace retrospect
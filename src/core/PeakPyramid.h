@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace retrospect {
+
+/// One column of a waveform overview: the lowest and highest sample in it
+struct Peak {
+    float min = 0.0f;
+    float max = 0.0f;
+};
+
+/// Multi-resolution min/max summary of a run of audio, for waveform displays.
+///
+/// Level 0 holds the peaks of each kBucketSamples samples, and each level
+/// above the peaks of pairs from the one below, so any span reduces to a
+/// couple of buckets per level and an overview of a whole loop costs
+/// O(columns log length) however long the loop is. write() only redoes the
+/// buckets it touches and their parents, so the pyramid of a ring buffer
+/// follows the writer incrementally. Not thread-safe; owners lock around it.
+class PeakPyramid {
+public:
+    static constexpr int64_t kBucketSamples = 64;
+
+    PeakPyramid() = default;
+
+    /// A silent pyramid over `length` samples
+    explicit PeakPyramid(int64_t length);
+
+    int64_t length() const { return length_; }
+    int levels() const { return static_cast<int>(levels_.size()); }
+
+    /// Write samples [first, first + numSamples), which must lie within the
+    /// length. Writes run forward: a bucket starts over when written from
+    /// its first sample and otherwise widens, so writing audio over older
+    /// audio in order (a ring's next lap) replaces the older peaks.
+    void write(const float* samples, int64_t first, int64_t numSamples);
+
+    /// Summarise [first, first + span) as `columns` equal columns into `out`.
+    /// Positions wrap at length() (for ring buffers). Columns cover whole
+    /// level-0 buckets, so their edges are exact to kBucketSamples.
+    void summarize(int64_t first, int64_t span, int columns, Peak* out) const;
+
+private:
+    /// Peaks of level-0 buckets [from, to)
+    void mergeBuckets(int64_t from, int64_t to, Peak& peak, bool& any) const;
+
+    /// Refresh the parents of level-0 buckets [from, to]
+    void updateParents(int64_t from, int64_t to);
+
+    int64_t length_ = 0;
+    std::vector<std::vector<Peak>> levels_;  // levels_[0]: one per bucket
+};
+
+} // namespace retrospect
@@ -0,0 +1,191 @@
+#include "core/RenderPool.h"
+#include "core/MonotonicClock.h"
+#include "core/SimdKernels.h"
+
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace retrospect {
+
+namespace {
+
+// How long an idle worker keeps polling before it sleeps. Sub-blocks of one
+// callback follow each other within this; callbacks usually do not.
+constexpr int64_t kSpinNanos = 200000;
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Name the thread and give it a core of its own (Linux only)
+void setUpWorkerThread(int core) {
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "retro-render");
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(static_cast<unsigned>(core) % cores, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+#endif
+}
+
+} // namespace
+
+RenderPool::RenderPool(int numWorkers, int maxSamples)
+    : maxSamples_(maxSamples)
+    , workers_(static_cast<size_t>(std::max(0, numWorkers)))
+{
+    for (auto& w : workers_) {
+        w.scratch.assign(static_cast<size_t>(maxSamples), 0.0f);
+    }
+}
+
+RenderPool::~RenderPool() {
+    stop();
+}
+
+void RenderPool::start() {
+    if (running_) return;
+    stopping_.store(false, std::memory_order_relaxed);
+    for (int i = 0; i < numWorkers(); ++i) {
+        workers_[static_cast<size_t>(i)].thread = std::thread([this, i] { workerLoop(i); });
+    }
+    running_ = true;
+}
+
+void RenderPool::stop() {
+    if (!running_) return;
+    stopping_.store(true, std::memory_order_release);
+    generation_.fetch_add(1, std::memory_order_release);
+    generation_.notify_all();
+    for (auto& w : workers_) {
+        w.thread.join();
+    }
+    running_ = false;
+}
+
+void RenderPool::run(TaskFn fn, void* context, int numTasks, float* output, int numSamples) {
+    numTasks = std::min(numTasks, kMaxTasks);
+    numSamples = std::min(numSamples, maxSamples_);
+
+    if (!running_ || workers_.empty()) {
+        for (int t = 0; t < numTasks; ++t) fn(context, t, 0, output, numSamples);
+        return;
+    }
+
+    if (!schedulingCaptured_) {
+        // Once, so workers wake as promptly as the thread waiting on them
+        sched_param param{};
+        int policy = SCHED_OTHER;
+        if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+            schedPolicy_.store(policy, std::memory_order_relaxed);
+            schedPriority_.store(param.sched_priority, std::memory_order_relaxed);
+            schedVersion_.fetch_add(1, std::memory_order_release);
+        }
+        schedulingCaptured_ = true;
+    }
+
+    fn_ = fn;
+    context_ = context;
+    numSamples_ = numSamples;
+    tasksDone_.store(0, std::memory_order_relaxed);
+    for (auto& w : workers_) w.used.store(false, std::memory_order_relaxed);
+
+    uint32_t generation = generation_.load(std::memory_order_relaxed) + 1;
+    claim_.store(claimWord(generation, 0, numTasks), std::memory_order_release);
+    generation_.store(generation, std::memory_order_release);
+    generation_.notify_all();
+
+    renderTasks(generation, 0, output);
+
+    // Only tasks a worker has claimed are outstanding now
+    while (tasksDone_.load(std::memory_order_acquire) < numTasks) {
+        cpuRelax();
+    }
+
+    for (auto& w : workers_) {
+        if (w.used.load(std::memory_order_relaxed)) {
+            simd::add(output, w.scratch.data(), static_cast<size_t>(numSamples));
+        }
+    }
+}
+
+void RenderPool::renderTasks(uint32_t generation, int participant, float* output) {
+    bool rendered = false;
+    uint64_t word = claim_.load(std::memory_order_acquire);
+    for (;;) {
+        if (static_cast<uint32_t>(word >> 32) != generation) return;
+        int next = static_cast<int>((word >> 16) & 0xffff);
+        int numTasks = static_cast<int>(word & 0xffff);
+        if (next >= numTasks) return;
+        if (!claim_.compare_exchange_weak(word, word + (uint64_t(1) << 16),
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire)) {
+            continue;
+        }
+
+        if (!rendered && participant > 0) {
+            // First task of this job on a worker: start from silence
+            Worker& w = workers_[static_cast<size_t>(participant - 1)];
+            std::fill(w.scratch.begin(), w.scratch.begin() + numSamples_, 0.0f);
+            w.used.store(true, std::memory_order_relaxed);
+        }
+        rendered = true;
+
+        float* dest = participant > 0
+            ? workers_[static_cast<size_t>(participant - 1)].scratch.data() : output;
+        fn_(context_, next, participant, dest, numSamples_);
+        tasksDone_.fetch_add(1, std::memory_order_release);
+        word = claim_.load(std::memory_order_acquire);
+    }
+}
+
+void RenderPool::adoptScheduling(int& seenVersion) {
+    int version = schedVersion_.load(std::memory_order_acquire);
+    if (version == seenVersion) return;
+    seenVersion = version;
+    sched_param param{};
+    param.sched_priority = schedPriority_.load(std::memory_order_relaxed);
+    // Best effort: without real-time permissions the worker stays as it is
+    pthread_setschedparam(pthread_self(), schedPolicy_.load(std::memory_order_relaxed), &param);
+}
+
+void RenderPool::workerLoop(int index) {
+    // Cores from 1 up, so with fewer workers than cores one is left for the
+    // audio thread and the rest of the system
+    setUpWorkerThread(index + 1);
+
+    int schedSeen = 0;
+    uint32_t seen = generation_.load(std::memory_order_acquire);
+    for (;;) {
+        // Spin briefly for the next job, then sleep until it comes
+        uint32_t generation = generation_.load(std::memory_order_acquire);
+        int64_t spinStart = monotonicNanos();
+        while (generation == seen) {
+            if (monotonicNanos() - spinStart < kSpinNanos) {
+                cpuRelax();
+            } else {
+                generation_.wait(seen, std::memory_order_acquire);
+            }
+            generation = generation_.load(std::memory_order_acquire);
+        }
+        seen = generation;
+        if (stopping_.load(std::memory_order_acquire)) return;
+
+        adoptScheduling(schedSeen);
+        renderTasks(generation, index + 1, nullptr);
+    }
+}
+
+} // namespace retrospect
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace retrospect {
+
+/// Helper threads that render independent tasks alongside the audio thread.
+///
+/// run() hands out task indices one at a time to the calling thread and the
+/// workers, so a few expensive tasks spread out instead of landing on one
+/// thread. The caller renders straight into the output; each worker sums its
+/// tasks into its own scratch buffer, which run() then adds to the output.
+///
+/// Nothing allocates or locks after start(). Workers spin for a short while
+/// after each job (the next sub-block usually follows within microseconds)
+/// and then sleep on an atomic wait. A wake-up that comes late does not hold
+/// up the caller: it takes the remaining tasks itself and only waits for
+/// tasks that were actually claimed. Workers are pinned to a core each (on
+/// Linux) and take on the calling thread's real-time scheduling the first
+/// time it runs a job.
+class RenderPool {
+public:
+    /// Render task `task` into `output` (numSamples long, accumulate into
+    /// it). `participant` is 0 on the calling thread, 1..numWorkers on workers.
+    using TaskFn = void (*)(void* context, int task, int participant,
+                            float* output, int numSamples);
+
+    /// Largest number of tasks in one run()
+    static constexpr int kMaxTasks = 0xffff;
+
+    /// @param numWorkers Helper threads (the calling thread also renders)
+    /// @param maxSamples Longest run() (sizes the scratch buffers)
+    RenderPool(int numWorkers, int maxSamples);
+    ~RenderPool();
+
+    RenderPool(const RenderPool&) = delete;
+    RenderPool& operator=(const RenderPool&) = delete;
+
+    /// Start and stop the worker threads (control thread)
+    void start();
+    void stop();
+
+    int numWorkers() const { return static_cast<int>(workers_.size()); }
+
+    /// Run tasks [0, numTasks) and add all their output to `output`. Returns
+    /// once every task has finished. Single calling thread (audio thread).
+    void run(TaskFn fn, void* context, int numTasks, float* output, int numSamples);
+
+private:
+    struct alignas(64) Worker {
+        std::thread thread;
+        std::vector<float> scratch;
+        std::atomic<bool> used{false};  // Scratch holds output of the current job
+    };
+
+    // The claim word packs the job generation, the next task and the task
+    // count, so a worker holding a stale generation can never claim a task
+    // of a newer job.
+    static uint64_t claimWord(uint32_t generation, int next, int numTasks) {
+        return (uint64_t(generation) << 32) | (uint64_t(next) << 16) | uint64_t(numTasks);
+    }
+
+    void workerLoop(int index);
+
+    /// Claim and render tasks of `generation` until none are left
+    /// (participant 0 is the caller)
+    void renderTasks(uint32_t generation, int participant, float* output);
+
+    /// Apply the caller's scheduling to the current worker, if it changed
+    void adoptScheduling(int& seenVersion);
+
+    int maxSamples_;
+    std::vector<Worker> workers_;
+    bool running_ = false;
+
+    // Current job: written by run() before the claim word is published, and
+    // stable until every claimed task has finished
+    TaskFn fn_ = nullptr;
+    void* context_ = nullptr;
+    int numSamples_ = 0;
+
+    alignas(64) std::atomic<uint64_t> claim_{0};
+    alignas(64) std::atomic<int> tasksDone_{0};
+    alignas(64) std::atomic<uint32_t> generation_{0};  // Workers wait on this
+    std::atomic<bool> stopping_{false};
+
+    // Scheduling to copy from the audio thread (policy, priority)
+    bool schedulingCaptured_ = false;
+    std::atomic<int> schedVersion_{0};
+    std::atomic<int> schedPolicy_{0};
+    std::atomic<int> schedPriority_{0};
+};
+
+} // namespace retrospect
@@ -2,40 +2,122 @@
 #include <algorithm>
 #include <cstring>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 namespace retrospect {
 
-RingBuffer::RingBuffer(int64_t capacitySamples)
-    : buffer_(static_cast<size_t>(capacitySamples), 0.0f)
+namespace {
+
+// Decode `count` samples starting at absolute sample `from` out of a
+// circular buffer of `size` samples stored as `format`
+void copyFromCircular(float* dest, const uint8_t* ring, SampleFormat format, int64_t size,
+                      int64_t from, int64_t count) {
+    const int64_t stride = bytesPerSample(format);
+    while (count > 0) {
+        int64_t pos = from % size;
+        int64_t n = std::min(count, size - pos);
+        decodeSamples(format, dest, ring + pos * stride, static_cast<size_t>(n));
+        dest += n;
+        from += n;
+        count -= n;
+    }
+}
+
+} // namespace
+
+/// The memory-mapped file behind a spilling ring. Sample s of the history
+/// lives at s % capacity, stored in the ring's format. Only the spill thread
+/// writes it.
+struct RingBuffer::SpillFile {
+    int fd = -1;
+    uint8_t* data = nullptr;
+    size_t bytes = 0;
+    int64_t capacity = 0;
+
+    // spilledTo: history in the file ends here. validFrom: nothing before
+    // it is trustworthy (it was lost or torn). guard: where the copy in
+    // progress will end, raised before the copy starts, as writeGuard_.
+    std::atomic<int64_t> spilledTo{0};
+    std::atomic<int64_t> validFrom{0};
+    std::atomic<int64_t> guard{0};
+
+    ~SpillFile() {
+        if (data) munmap(data, bytes);
+        if (fd >= 0) close(fd);
+    }
+};
+
+RingBuffer::RingBuffer(int64_t capacitySamples, SampleFormat format)
+    : buffer_(static_cast<size_t>(capacitySamples) * static_cast<size_t>(bytesPerSample(format)))
+    , capacity_(capacitySamples)
+    , format_(format)
+{
+}
+
+RingBuffer::~RingBuffer() = default;
+
+RingBuffer::RingBuffer(RingBuffer&& other) noexcept
+    : buffer_(std::move(other.buffer_))
+    , capacity_(other.capacity_)
+    , format_(other.format_)
+    , writePos_(other.writePos_)
+    , totalWritten_(other.totalWritten_)
+    , writeGuard_(other.writeGuard_.load(std::memory_order_relaxed))
+    , published_(other.published_.load(std::memory_order_relaxed))
+    , spill_(std::move(other.spill_))
 {
 }
 
+RingBuffer& RingBuffer::operator=(RingBuffer&& other) noexcept {
+    buffer_ = std::move(other.buffer_);
+    capacity_ = other.capacity_;
+    format_ = other.format_;
+    writePos_ = other.writePos_;
+    totalWritten_ = other.totalWritten_;
+    writeGuard_.store(other.writeGuard_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    published_.store(other.published_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    spill_ = std::move(other.spill_);
+    return *this;
+}
+
 void RingBuffer::write(const float* data, int numSamples) {
     if (numSamples <= 0) return;
 
-    int64_t cap = capacity();
+    int64_t cap = capacity_;
+    const int64_t stride = bytesPerSample(format_);
+
+    // Readers on other threads check this after copying (see writeGuard_)
+    writeGuard_.store(totalWritten_ + numSamples, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
 
-    if (numSamples >= cap) {
+    // writePos_ always equals totalWritten_ % cap, so readers can locate
+    // history from a sample count alone.
+    int64_t count = numSamples;
+    if (count > cap) {
         // Writing more than the buffer can hold: only keep the tail
-        const float* start = data + (numSamples - cap);
-        std::memcpy(buffer_.data(), start, static_cast<size_t>(cap) * sizeof(float));
-        writePos_ = 0;
+        data += count - cap;
+        writePos_ = (writePos_ + count - cap) % cap;
+        count = cap;
+    }
+
+    int64_t spaceToEnd = cap - writePos_;
+    if (count <= spaceToEnd) {
+        encodeSamples(format_, buffer_.data() + writePos_ * stride, data,
+                      static_cast<size_t>(count));
     } else {
-        int64_t spaceToEnd = cap - writePos_;
-        if (numSamples <= spaceToEnd) {
-            std::memcpy(buffer_.data() + writePos_, data,
-                        static_cast<size_t>(numSamples) * sizeof(float));
-        } else {
-            // Wrap around
-            std::memcpy(buffer_.data() + writePos_, data,
-                        static_cast<size_t>(spaceToEnd) * sizeof(float));
-            int64_t remaining = numSamples - spaceToEnd;
-            std::memcpy(buffer_.data(), data + spaceToEnd,
-                        static_cast<size_t>(remaining) * sizeof(float));
-        }
-        writePos_ = (writePos_ + numSamples) % cap;
+        // Wrap around
+        encodeSamples(format_, buffer_.data() + writePos_ * stride, data,
+                      static_cast<size_t>(spaceToEnd));
+        int64_t remaining = count - spaceToEnd;
+        encodeSamples(format_, buffer_.data(), data + spaceToEnd,
+                      static_cast<size_t>(remaining));
     }
+    writePos_ = (writePos_ + count) % cap;
 
     totalWritten_ += numSamples;
+    published_.store(totalWritten_, std::memory_order_release);
 }
 
 void RingBuffer::readMostRecent(float* dest, int numSamples) const {
@@ -43,10 +125,16 @@ void RingBuffer::readMostRecent(float* dest, int numSamples) const {
 }
 
 void RingBuffer::readFromPast(float* dest, int numSamples, int64_t samplesAgo) const {
-    if (numSamples <= 0) return;
+    // The writer's own thread: nothing can move underneath the copy
+    (void)readFromPast(dest, numSamples, samplesAgo, totalWritten_);
+}
 
-    int64_t cap = capacity();
-    int64_t avail = available();
+bool RingBuffer::readFromPast(float* dest, int numSamples, int64_t samplesAgo,
+                              int64_t writtenAt) const {
+    if (numSamples <= 0) return true;
+
+    int64_t cap = capacity_;
+    int64_t avail = std::min(writtenAt, historyCapacity());
 
     // Clamp to available data
     if (samplesAgo > avail) samplesAgo = avail;
@@ -58,20 +146,65 @@ void RingBuffer::readFromPast(float* dest, int numSamples, int64_t samplesAgo) c
         numSamples = static_cast<int>(samplesAgo);
     }
 
-    // Start reading from (writePos_ - samplesAgo), wrapping around
-    int64_t readStart = (writePos_ - samplesAgo + cap * 2) % cap;
+    // History [fileFrom, spilledTo) comes from the spill file and the rest
+    // from the ring, which holds [ramFrom, writtenAt). Anything in neither
+    // was lost and reads as silence.
+    int64_t ramFrom = std::max<int64_t>(0, writtenAt - cap);
+    int64_t fileFrom = 0;
+    int64_t spilledTo = 0;
+    if (spill_) {
+        spilledTo = std::min(spill_->spilledTo.load(std::memory_order_acquire), writtenAt);
+        fileFrom = std::max(spill_->validFrom.load(std::memory_order_relaxed),
+                            spilledTo - spill_->capacity);
+    }
+    bool fromFile = fileFrom < spilledTo;
 
-    int64_t spaceToEnd = cap - readStart;
-    if (numSamples <= spaceToEnd) {
-        std::memcpy(dest, buffer_.data() + readStart,
-                    static_cast<size_t>(numSamples) * sizeof(float));
-    } else {
-        std::memcpy(dest, buffer_.data() + readStart,
-                    static_cast<size_t>(spaceToEnd) * sizeof(float));
-        int64_t remaining = numSamples - spaceToEnd;
-        std::memcpy(dest + spaceToEnd, buffer_.data(),
-                    static_cast<size_t>(remaining) * sizeof(float));
+    int64_t pos = writtenAt - samplesAgo;
+    int64_t end = pos + numSamples;
+    int64_t oldestRam = INT64_MAX;
+    int64_t oldestFile = INT64_MAX;
+    while (pos < end) {
+        int64_t n;
+        if (fromFile && pos >= fileFrom && pos < spilledTo) {
+            n = std::min(end, spilledTo) - pos;
+            copyFromCircular(dest, spill_->data, format_, spill_->capacity, pos, n);
+            oldestFile = std::min(oldestFile, pos);
+        } else if (pos >= ramFrom) {
+            int64_t until = (fromFile && pos < fileFrom) ? fileFrom : end;
+            n = std::min(end, until) - pos;
+            copyFromCircular(dest, buffer_.data(), format_, cap, pos, n);
+            oldestRam = std::min(oldestRam, pos);
+        } else {
+            int64_t next = ramFrom;
+            if (fromFile && fileFrom > pos) next = std::min(next, fileFrom);
+            n = std::min(end, next) - pos;
+            std::memset(dest, 0, static_cast<size_t>(n) * sizeof(float));
+        }
+        dest += n;
+        pos += n;
+    }
+
+    // Whoever was writing must not have reached the oldest sample copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool intact = true;
+    if (oldestRam != INT64_MAX) {
+        intact = writeGuard_.load(std::memory_order_relaxed) - oldestRam <= cap;
     }
+    if (oldestFile != INT64_MAX) {
+        intact = intact &&
+                 spill_->guard.load(std::memory_order_relaxed) - oldestFile <= spill_->capacity;
+    }
+    return intact;
+}
+
+bool RingBuffer::readRam(float* dest, int64_t from, int numSamples) const {
+    if (numSamples <= 0) return true;
+    if (from < ramFrom() || from + numSamples > totalWritten_) {
+        std::memset(dest, 0, static_cast<size_t>(numSamples) * sizeof(float));
+        return false;
+    }
+    copyFromCircular(dest, buffer_.data(), format_, capacity_, from, numSamples);
+    return true;
 }
 
 std::vector<float> RingBuffer::capture(int numSamples) const {
@@ -80,10 +213,97 @@ std::vector<float> RingBuffer::capture(int numSamples) const {
     return result;
 }
 
+bool RingBuffer::enableSpill(const std::string& directory, int64_t spillCapacity) {
+    if (spillCapacity <= 0) return false;
+
+    auto file = std::make_unique<SpillFile>();
+    std::string path = directory + "/retrospect-lookback-XXXXXX";
+    file->fd = mkstemp(path.data());
+    if (file->fd < 0) return false;
+    unlink(path.c_str());
+
+    // Reserve the blocks now: running out of disk under a mapping would
+    // fault the spill thread mid-copy
+    auto bytes = static_cast<size_t>(spillCapacity) * static_cast<size_t>(bytesPerSample(format_));
+    if (posix_fallocate(file->fd, 0, static_cast<off_t>(bytes)) != 0) return false;
+    void* map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (map == MAP_FAILED) return false;
+    // With memory locking on, mlockall would pin every page the spill
+    // thread touches; the file is only worth having if they can drop
+    munlock(map, bytes);
+    file->data = static_cast<uint8_t*>(map);
+    file->bytes = bytes;
+    file->capacity = spillCapacity;
+
+    int64_t written = totalWritten_;
+    file->spilledTo.store(written, std::memory_order_relaxed);
+    file->validFrom.store(written, std::memory_order_relaxed);
+    file->guard.store(written, std::memory_order_relaxed);
+    spill_ = std::move(file);
+    return true;
+}
+
+void RingBuffer::spill() {
+    if (!spill_) return;
+    SpillFile& file = *spill_;
+
+    int64_t cap = capacity_;
+    const int64_t stride = bytesPerSample(format_);
+    int64_t written = published_.load(std::memory_order_acquire);
+    int64_t spilledTo = file.spilledTo.load(std::memory_order_relaxed);
+    int64_t validFrom = file.validFrom.load(std::memory_order_relaxed);
+    if (written <= spilledTo) return;
+
+    // Only what the ring (and the file) still hold can be copied. Skipping
+    // ahead leaves a gap, and the file slots before it hold older history
+    // that no longer lines up, so nothing before the skip stays valid.
+    int64_t from = std::max({spilledTo, written - cap, written - file.capacity});
+    if (from > spilledTo) validFrom = from;
+
+    file.guard.store(written, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int64_t pos = from; pos < written;) {
+        int64_t src = pos % cap;
+        int64_t dst = pos % file.capacity;
+        int64_t n = std::min({written - pos, cap - src, file.capacity - dst});
+        // Both hold the same format, so the bytes copy as they are
+        std::memcpy(file.data + dst * stride, buffer_.data() + src * stride,
+                    static_cast<size_t>(n * stride));
+#if defined(__linux__)
+        // Start write-back now, so the pages are clean (and can be dropped
+        // from RAM) long before they are read again
+        sync_file_range(file.fd, static_cast<off_t>(dst * stride), static_cast<off_t>(n * stride),
+                        SYNC_FILE_RANGE_WRITE);
+#endif
+        pos += n;
+    }
+
+    // Samples the writer reached while we copied them are torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    int64_t lappedTo = writeGuard_.load(std::memory_order_relaxed) - cap;
+    if (lappedTo > from) validFrom = std::max(validFrom, lappedTo);
+
+    file.validFrom.store(validFrom, std::memory_order_relaxed);
+    file.spilledTo.store(written, std::memory_order_release);
+}
+
+int64_t RingBuffer::historyCapacity() const {
+    return spill_ ? spill_->capacity : capacity_;
+}
+
 void RingBuffer::clear() {
-    std::fill(buffer_.begin(), buffer_.end(), 0.0f);
+    // All-zero bytes are silence in every format
+    std::fill(buffer_.data(), buffer_.data() + buffer_.size(), uint8_t{0});
     writePos_ = 0;
     totalWritten_ = 0;
+    writeGuard_.store(0, std::memory_order_relaxed);
+    published_.store(0, std::memory_order_relaxed);
+    if (spill_) {
+        spill_->spilledTo.store(0, std::memory_order_relaxed);
+        spill_->validFrom.store(0, std::memory_order_relaxed);
+        spill_->guard.store(0, std::memory_order_relaxed);
+    }
 }
 
 } // namespace retrospect
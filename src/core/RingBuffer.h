@@ -1,18 +1,36 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <string>
 #include <algorithm>
 
+#include "core/AudioMemory.h"
+#include "core/SampleFormat.h"
+
 namespace retrospect {
 
 /// Circular buffer for continuous audio recording.
-/// Stores mono float samples. Continuously overwrites oldest data.
+/// Stores mono samples, as floats or in a compact SampleFormat (encoded on
+/// write, decoded on read). Continuously overwrites oldest data.
+///
+/// Optionally the ring is only a short window in RAM and history goes on in
+/// a memory-mapped spill file (enableSpill()). A background thread copies
+/// samples into the file with spill() before the writer laps them, and
+/// readers take whatever has been spilled from the file, so the ring only has
+/// to stay ahead of that thread, not hold the whole lookback.
 class RingBuffer {
 public:
     /// Create a ring buffer with the given capacity in samples
-    explicit RingBuffer(int64_t capacitySamples);
+    explicit RingBuffer(int64_t capacitySamples, SampleFormat format = SampleFormat::Float32);
+    ~RingBuffer();
+
+    /// Moves are for setup, while no other thread uses either ring
+    RingBuffer(RingBuffer&& other) noexcept;
+    RingBuffer& operator=(RingBuffer&& other) noexcept;
 
     /// Write samples into the ring buffer
     void write(const float* data, int numSamples);
@@ -25,26 +43,84 @@ public:
     /// samplesAgo=0 means the most recently written sample.
     void readFromPast(float* dest, int numSamples, int64_t samplesAgo) const;
 
+    /// Same as readFromPast(), but relative to the write head as it stood
+    /// when totalWritten() was `writtenAt`. Reads only buffer contents (never
+    /// the live write position), so a non-realtime thread can copy history
+    /// while the audio thread keeps writing. Returns false if the writer (or
+    /// the spill thread) came round to part of the region while it was being
+    /// copied, in which case `dest` may be torn.
+    [[nodiscard]] bool readFromPast(float* dest, int numSamples, int64_t samplesAgo,
+                                    int64_t writtenAt) const;
+
+    /// Decode history samples [from, from + numSamples), counted from the
+    /// first sample ever written, straight out of the RAM ring (the writer's
+    /// thread, or while it waits). Returns false, zero-filling `dest`, if
+    /// part of the range has been overwritten in RAM or is not written yet.
+    bool readRam(float* dest, int64_t from, int numSamples) const;
+
+    /// Oldest sample (counted as for readRam) the RAM ring still holds
+    int64_t ramFrom() const { return std::max<int64_t>(0, totalWritten_ - capacity_); }
+
     /// Copy a range of the ring buffer into a new vector.
     /// Captures the most recent `numSamples` samples.
     std::vector<float> capture(int numSamples) const;
 
+    /// Keep `spillCapacity` samples of history in a memory-mapped file in
+    /// `directory` (unlinked as soon as it is open, so it goes away with the
+    /// process). Call before the first write. Returns false, leaving the
+    /// ring RAM-only, if the file cannot be created or reserved.
+    bool enableSpill(const std::string& directory, int64_t spillCapacity);
+    bool hasSpill() const { return spill_ != nullptr; }
+
+    /// Copy everything written since the last call into the spill file
+    /// (spill thread only). History the writer lapped before it could be
+    /// copied reads back as silence.
+    void spill();
+
     /// Total samples written since creation/reset
     int64_t totalWritten() const { return totalWritten_; }
 
+    /// totalWritten() as of the last finished write, for other threads
+    int64_t publishedWritten() const { return published_.load(std::memory_order_acquire); }
+
     /// Capacity in samples
-    int64_t capacity() const { return static_cast<int64_t>(buffer_.size()); }
+    int64_t capacity() const { return capacity_; }
 
-    /// How many valid samples are available (min of totalWritten and capacity)
-    int64_t available() const { return std::min(totalWritten_, capacity()); }
+    SampleFormat format() const { return format_; }
 
-    /// Clear the buffer
+    /// RAM the ring itself takes, in bytes
+    size_t storageBytes() const { return buffer_.size(); }
+
+    /// The ring's RAM, for faulting in at startup (see prefaultAudioMemory).
+    /// Until then pages are backed as the writer first reaches them.
+    AudioMemory& memory() { return buffer_; }
+
+    /// History a read can reach: the spill file when there is one
+    int64_t historyCapacity() const;
+
+    /// How many valid samples are available (min of totalWritten and historyCapacity)
+    int64_t available() const { return std::min(totalWritten_, historyCapacity()); }
+
+    /// Clear the buffer (while no other thread reads or spills it)
     void clear();
 
 private:
-    std::vector<float> buffer_;
+    struct SpillFile;
+
+    AudioMemory buffer_;  // capacity_ samples of format_ (zeroed)
+    int64_t capacity_ = 0;
+    SampleFormat format_ = SampleFormat::Float32;
     int64_t writePos_ = 0;
     int64_t totalWritten_ = 0;
+
+    // For threads other than the writer. writeGuard_ is raised to where the
+    // write in progress will end before it touches the buffer, so a reader
+    // that finds it more than a ring behind the oldest sample it copied knows
+    // the copy held up. published_ is totalWritten_ after the last write.
+    std::atomic<int64_t> writeGuard_{0};
+    std::atomic<int64_t> published_{0};
+
+    std::unique_ptr<SpillFile> spill_;
 };
 
 } // namespace retrospect
@@ -0,0 +1,49 @@
+#include "core/RingSpiller.h"
+
+#include <pthread.h>
+
+namespace retrospect {
+
+RingSpiller::RingSpiller(std::vector<RingBuffer*> rings, std::chrono::milliseconds interval)
+    : rings_(std::move(rings))
+    , interval_(interval)
+{
+}
+
+RingSpiller::~RingSpiller() {
+    stop();
+}
+
+void RingSpiller::start() {
+    if (thread_.joinable()) return;
+    stopping_ = false;
+    thread_ = std::thread([this] { run(); });
+}
+
+void RingSpiller::stop() {
+    if (!thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void RingSpiller::run() {
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "retro-spill");
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        bool stopping = wake_.wait_for(lock, interval_, [this] { return stopping_; });
+        lock.unlock();
+        for (RingBuffer* ring : rings_) {
+            ring->spill();
+        }
+        if (stopping) return;
+        lock.lock();
+    }
+}
+
+} // namespace retrospect
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "core/RingBuffer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace retrospect {
+
+/// Background thread that copies new ring buffer history into the rings'
+/// spill files (RingBuffer::spill()) every `interval`.
+///
+/// The rings only need to hold a few intervals of audio beyond what the
+/// spill thread has copied, so the thread runs at normal priority and may
+/// block on the disk; the audio thread never waits for it.
+class RingSpiller {
+public:
+    /// @param rings    Rings with a spill file (must outlive the spiller)
+    /// @param interval Time between passes
+    RingSpiller(std::vector<RingBuffer*> rings, std::chrono::milliseconds interval);
+    ~RingSpiller();
+
+    RingSpiller(const RingSpiller&) = delete;
+    RingSpiller& operator=(const RingSpiller&) = delete;
+
+    /// Start and stop the thread (control thread). stop() makes a last pass.
+    void start();
+    void stop();
+
+private:
+    void run();
+
+    std::vector<RingBuffer*> rings_;
+    std::chrono::milliseconds interval_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+} // namespace retrospect
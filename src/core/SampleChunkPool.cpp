@@ -0,0 +1,49 @@
+#include "core/SampleChunkPool.h"
+
+#include <algorithm>
+
+namespace retrospect {
+
+SampleChunkPool::SampleChunkPool(int numChunks, int chunkSize)
+    : storage_(static_cast<size_t>(std::max(0, numChunks)) *
+               static_cast<size_t>(std::max(1, chunkSize)) * sizeof(float))
+    , next_(static_cast<size_t>(std::max(0, numChunks)), kNoChunk)
+    , chunkSize_(std::max(1, chunkSize))
+{
+    // Thread every chunk onto the free list in index order
+    for (size_t i = 0; i + 1 < next_.size(); ++i) {
+        next_[i] = static_cast<uint32_t>(i + 1);
+    }
+    freeHead_ = next_.empty() ? kNoChunk : 0;
+    freeCount_ = static_cast<int>(next_.size());
+}
+
+float* SampleChunkPool::append(ChunkChain& chain) {
+    if (freeHead_ == kNoChunk) return nullptr;
+
+    uint32_t chunk = freeHead_;
+    freeHead_ = next_[chunk];
+    --freeCount_;
+    next_[chunk] = kNoChunk;
+
+    if (chain.empty()) {
+        chain.head = chunk;
+    } else {
+        next_[chain.tail] = chunk;
+    }
+    chain.tail = chunk;
+    ++chain.count;
+    return chunkData(chunk);
+}
+
+void SampleChunkPool::release(ChunkChain& chain) {
+    if (chain.empty()) return;
+
+    // Splice the whole chain onto the front of the free list
+    next_[chain.tail] = freeHead_;
+    freeHead_ = chain.head;
+    freeCount_ += static_cast<int>(chain.count);
+    chain = ChunkChain{};
+}
+
+} // namespace retrospect
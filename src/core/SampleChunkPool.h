@@ -0,0 +1,73 @@
+#pragma once
+
+#include "core/AudioMemory.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace retrospect {
+
+/// A singly-linked run of pool chunks (e.g. one channel of a recording).
+struct ChunkChain {
+    uint32_t head = UINT32_MAX;
+    uint32_t tail = UINT32_MAX;
+    uint32_t count = 0;
+
+    bool empty() const { return count == 0; }
+};
+
+/// Fixed pool of equally sized float chunks, allocated once at construction.
+/// The storage is mapped but not faulted in, so pages are only backed once a
+/// chunk is first written: resident memory follows the chunks actually used
+/// rather than the pool's capacity. With memory locking on, the engine faults
+/// it all in and locks it at startup instead (see memory()).
+///
+/// Chunks are linked into chains through a parallel next-index table, so
+/// growing a chain or returning a whole chain to the free list never touches
+/// the heap. Acquire/release must happen on a single owning thread (the audio
+/// thread); a chain's contents may be read elsewhere once it has been handed
+/// off through a queue.
+class SampleChunkPool {
+public:
+    static constexpr uint32_t kNoChunk = UINT32_MAX;
+
+    /// @param numChunks  Number of chunks to reserve
+    /// @param chunkSize  Samples per chunk
+    SampleChunkPool(int numChunks, int chunkSize);
+
+    /// Append a chunk to the end of `chain`.
+    /// Returns the new chunk's storage, or nullptr if the pool is exhausted.
+    float* append(ChunkChain& chain);
+
+    /// Return every chunk of `chain` to the free list (O(1)) and reset it.
+    void release(ChunkChain& chain);
+
+    float* chunkData(uint32_t chunk) {
+        return reinterpret_cast<float*>(storage_.data()) +
+               static_cast<size_t>(chunk) * static_cast<size_t>(chunkSize_);
+    }
+    const float* chunkData(uint32_t chunk) const {
+        return reinterpret_cast<const float*>(storage_.data()) +
+               static_cast<size_t>(chunk) * static_cast<size_t>(chunkSize_);
+    }
+
+    /// Next chunk in the chain after `chunk` (kNoChunk at the end)
+    uint32_t next(uint32_t chunk) const { return next_[static_cast<size_t>(chunk)]; }
+
+    int chunkSize() const { return chunkSize_; }
+    int capacityChunks() const { return static_cast<int>(next_.size()); }
+    int freeChunks() const { return freeCount_; }
+
+    /// The chunks' storage, for faulting in (see prefaultAudioMemory)
+    AudioMemory& memory() { return storage_; }
+
+private:
+    AudioMemory storage_;
+    std::vector<uint32_t> next_;
+    int chunkSize_;
+    uint32_t freeHead_ = kNoChunk;
+    int freeCount_ = 0;
+};
+
+} // namespace retrospect
@@ -0,0 +1,256 @@
+#include "core/SampleFormat.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define RETROSPECT_SIMD_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RETROSPECT_SIMD_NEON 1
+#endif
+
+namespace retrospect {
+
+namespace {
+
+constexpr float kInt24Scale = 8388608.0f;  // 2^23
+
+// --- Int24 (little-endian, two's complement) ---
+
+void packInt24(uint8_t* dst, int32_t v) {
+    auto u = static_cast<uint32_t>(v);
+    dst[0] = static_cast<uint8_t>(u);
+    dst[1] = static_cast<uint8_t>(u >> 8);
+    dst[2] = static_cast<uint8_t>(u >> 16);
+}
+
+void encodeInt24(uint8_t* dst, const float* src, size_t n) {
+    size_t i = 0;
+#if defined(RETROSPECT_SIMD_X86)
+    // Same clamping and rounding as the scalar loop, four at a time (NaNs
+    // are zeroed first, as min/max would pass them through as a bound)
+    const __m128 scale = _mm_set1_ps(kInt24Scale);
+    const __m128 hi = _mm_set1_ps(kInt24Scale - 1.0f);
+    const __m128 lo = _mm_set1_ps(-kInt24Scale);
+    alignas(16) int32_t v[4];
+    for (; i + 4 <= n; i += 4) {
+        __m128 s = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        s = _mm_and_ps(s, _mm_cmpord_ps(s, s));
+        s = _mm_max_ps(_mm_min_ps(s, hi), lo);
+        _mm_store_si128(reinterpret_cast<__m128i*>(v), _mm_cvtps_epi32(s));
+        // Little-endian: each 4-byte store's top byte is overwritten by the
+        // next sample, and the last one stays inside the group
+        uint8_t* out = dst + 3 * i;
+        std::memcpy(out, &v[0], 4);
+        std::memcpy(out + 3, &v[1], 4);
+        std::memcpy(out + 6, &v[2], 4);
+        packInt24(out + 9, v[3]);
+    }
+#endif
+    for (; i < n; ++i) {
+        float s = src[i] * kInt24Scale;
+        s = s > kInt24Scale - 1.0f ? kInt24Scale - 1.0f : s;
+        s = s < -kInt24Scale ? -kInt24Scale : s;
+        if (s != s) s = 0.0f;
+#if defined(RETROSPECT_SIMD_X86)
+        int32_t v = _mm_cvtss_si32(_mm_set_ss(s));
+#else
+        auto v = static_cast<int32_t>(std::lrintf(s));
+#endif
+        packInt24(dst + 3 * i, v);
+    }
+}
+
+void decodeInt24(float* dst, const uint8_t* src, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t u = uint32_t(src[3 * i]) | (uint32_t(src[3 * i + 1]) << 8) |
+                     (uint32_t(src[3 * i + 2]) << 16);
+        int32_t v = static_cast<int32_t>(u << 8) >> 8;
+        dst[i] = static_cast<float>(v) * (1.0f / kInt24Scale);
+    }
+}
+
+// --- Float16 (scalar versions produce the same bits as F16C and NEON) ---
+
+uint16_t floatToHalf(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    auto sign = static_cast<uint16_t>((x >> 16) & 0x8000u);
+    uint32_t a = x & 0x7fffffffu;
+
+    if (a >= 0x7f800000u) {
+        // Infinity, or NaN made quiet with the top of its payload
+        uint32_t nan = a > 0x7f800000u ? 0x200u | ((a >> 13) & 0x3ffu) : 0u;
+        return static_cast<uint16_t>(sign | 0x7c00u | nan);
+    }
+    if (a >= 0x477ff000u) return static_cast<uint16_t>(sign | 0x7c00u);  // Rounds past 65504
+    if (a < 0x38800000u) {
+        // Below the smallest normal half: a multiple of 2^-24, or zero
+        uint32_t e = a >> 23;
+        if (e < 102) return sign;
+        uint32_t m = (a & 0x7fffffu) | 0x800000u;
+        uint32_t shift = 126 - e;
+        uint32_t q = m >> shift;
+        uint32_t rem = m & ((1u << shift) - 1u);
+        uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (q & 1u))) ++q;
+        return static_cast<uint16_t>(sign | q);
+    }
+    uint32_t h = (a - 0x38000000u) >> 13;
+    uint32_t rem = a & 0x1fffu;
+    if (rem > 0x1000u || (rem == 0x1000u && (h & 1u))) ++h;
+    return static_cast<uint16_t>(sign | h);
+}
+
+float halfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000u) << 16;
+    uint32_t e = (h >> 10) & 0x1fu;
+    uint32_t m = h & 0x3ffu;
+    uint32_t x;
+    if (e == 0x1f) {
+        x = sign | 0x7f800000u | (m << 13) | (m ? 0x400000u : 0u);  // NaNs come back quiet
+    } else if (e != 0) {
+        x = sign | ((e + 112) << 23) | (m << 13);
+    } else if (m == 0) {
+        x = sign;
+    } else {
+        // Subnormal half: normalize into a float exponent
+        uint32_t shift = 0;
+        while (!(m & 0x400u)) {
+            m <<= 1;
+            ++shift;
+        }
+        x = sign | ((113 - shift) << 23) | ((m & 0x3ffu) << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+void encodeHalfTail(uint8_t* dst, const float* src, size_t n, size_t from) {
+    for (size_t i = from; i < n; ++i) {
+        uint16_t h = floatToHalf(src[i]);
+        std::memcpy(dst + 2 * i, &h, sizeof(h));
+    }
+}
+
+void decodeHalfTail(float* dst, const uint8_t* src, size_t n, size_t from) {
+    for (size_t i = from; i < n; ++i) {
+        uint16_t h;
+        std::memcpy(&h, src + 2 * i, sizeof(h));
+        dst[i] = halfToFloat(h);
+    }
+}
+
+#if defined(RETROSPECT_SIMD_X86)
+
+__attribute__((target("f16c")))
+void encodeHalfF16c(uint8_t* dst, const float* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), h);
+    }
+    encodeHalfTail(dst, src, n, i);
+}
+
+__attribute__((target("f16c")))
+void decodeHalfF16c(float* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    decodeHalfTail(dst, src, n, i);
+}
+
+bool hasF16c() {
+    static const bool supported = __builtin_cpu_supports("f16c");
+    return supported;
+}
+
+#elif defined(RETROSPECT_SIMD_NEON)
+
+void encodeHalfNeon(uint8_t* dst, const float* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float16x4_t h = vcvt_f16_f32(vld1q_f32(src + i));
+        vst1_u16(reinterpret_cast<uint16_t*>(dst + 2 * i), vreinterpret_u16_f16(h));
+    }
+    encodeHalfTail(dst, src, n, i);
+}
+
+void decodeHalfNeon(float* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint16x4_t h = vld1_u16(reinterpret_cast<const uint16_t*>(src + 2 * i));
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(h)));
+    }
+    decodeHalfTail(dst, src, n, i);
+}
+
+#endif
+
+void encodeHalf(uint8_t* dst, const float* src, size_t n) {
+#if defined(RETROSPECT_SIMD_X86)
+    if (hasF16c()) {
+        encodeHalfF16c(dst, src, n);
+        return;
+    }
+#elif defined(RETROSPECT_SIMD_NEON)
+    encodeHalfNeon(dst, src, n);
+    return;
+#endif
+    encodeHalfTail(dst, src, n, 0);
+}
+
+void decodeHalf(float* dst, const uint8_t* src, size_t n) {
+#if defined(RETROSPECT_SIMD_X86)
+    if (hasF16c()) {
+        decodeHalfF16c(dst, src, n);
+        return;
+    }
+#elif defined(RETROSPECT_SIMD_NEON)
+    decodeHalfNeon(dst, src, n);
+    return;
+#endif
+    decodeHalfTail(dst, src, n, 0);
+}
+
+} // namespace
+
+const char* sampleFormatName(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::Float32: return "float32";
+        case SampleFormat::Int24:   return "int24";
+        case SampleFormat::Float16: return "float16";
+    }
+    return "";
+}
+
+std::optional<SampleFormat> sampleFormatFromName(const std::string& name) {
+    if (name == "float32") return SampleFormat::Float32;
+    if (name == "int24") return SampleFormat::Int24;
+    if (name == "float16") return SampleFormat::Float16;
+    return std::nullopt;
+}
+
+void encodeSamples(SampleFormat format, uint8_t* dst, const float* src, size_t n) {
+    switch (format) {
+        case SampleFormat::Float32: std::memcpy(dst, src, n * sizeof(float)); return;
+        case SampleFormat::Int24:   encodeInt24(dst, src, n); return;
+        case SampleFormat::Float16: encodeHalf(dst, src, n); return;
+    }
+}
+
+void decodeSamples(SampleFormat format, float* dst, const uint8_t* src, size_t n) {
+    switch (format) {
+        case SampleFormat::Float32: std::memcpy(dst, src, n * sizeof(float)); return;
+        case SampleFormat::Int24:   decodeInt24(dst, src, n); return;
+        case SampleFormat::Float16: decodeHalf(dst, src, n); return;
+    }
+}
+
+} // namespace retrospect
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace retrospect {
+
+/// How a buffer stores its samples. Float32 keeps them as they are; the
+/// compact formats trade precision for memory:
+///  - Int24: 24-bit signed PCM, 3 bytes. Lossless for input from 24-bit
+///    converters; clips outside [-1, 1).
+///  - Float16: IEEE half precision, 2 bytes. About 11 bits of precision at
+///    any level, range to 65504.
+enum class SampleFormat : uint8_t {
+    Float32,
+    Int24,
+    Float16,
+};
+
+/// Bytes per stored sample
+inline int bytesPerSample(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::Float32: return 4;
+        case SampleFormat::Int24:   return 3;
+        case SampleFormat::Float16: return 2;
+    }
+    return 4;
+}
+
+/// Config name of a format ("float32", "int24", "float16")
+const char* sampleFormatName(SampleFormat format);
+
+/// Format for a config name, if it is one
+std::optional<SampleFormat> sampleFormatFromName(const std::string& name);
+
+/// Store n samples from `src` at `dst` (n * bytesPerSample bytes). Rounds to
+/// nearest, ties to even. Audio thread safe: no allocation or locking.
+void encodeSamples(SampleFormat format, uint8_t* dst, const float* src, size_t n);
+
+/// Read n stored samples at `src` back into floats (exact for every value
+/// the format can hold)
+void decodeSamples(SampleFormat format, float* dst, const uint8_t* src, size_t n);
+
+} // namespace retrospect
@@ -0,0 +1,351 @@
+#include "core/SessionFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace retrospect {
+
+namespace {
+
+constexpr char kMagic[8] = {'R', 'E', 'T', 'R', 'O', 'S', 'E', 'S'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kPageBytes = 4096;
+
+// Sanity limits, so a damaged header cannot make sizes overflow
+constexpr uint32_t kMaxRecords = 1u << 20;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numLoops;
+    uint32_t numLayers;     // Layer records, all loops together
+    int32_t beatsPerBar;
+    double sampleRate;
+    double bpm;
+    uint64_t fileBytes;     // Whole file, to catch truncation
+};
+
+struct FileLoop {
+    int32_t index;
+    uint32_t firstLayer;    // First of this loop's layer records
+    uint32_t numLayers;
+    uint8_t muted;
+    uint8_t reversed;
+    uint8_t pad[2];
+    double speed;
+    double lengthInBars;
+    double recordedBpm;
+    int64_t length;         // Samples in every layer
+};
+
+struct FileLayer {
+    uint64_t offset;        // Page-aligned start of the layer's samples
+    float gain;
+    uint8_t active;
+    uint8_t pad[3];
+};
+
+static_assert(std::is_trivially_copyable_v<FileHeader> && sizeof(FileHeader) == 48);
+static_assert(std::is_trivially_copyable_v<FileLoop> && sizeof(FileLoop) == 48);
+static_assert(std::is_trivially_copyable_v<FileLayer> && sizeof(FileLayer) == 16);
+
+size_t pageAlign(size_t bytes) {
+    return (bytes + kPageBytes - 1) & ~(kPageBytes - 1);
+}
+
+size_t recordBytes(size_t numLoops, size_t numLayers) {
+    return sizeof(FileHeader) + numLoops * sizeof(FileLoop) + numLayers * sizeof(FileLayer);
+}
+
+// Records are read by copy: the mapping's alignment is the page's, but the
+// compiler is not told so
+template <typename T>
+T recordAt(const uint8_t* data, size_t offset) {
+    T record;
+    std::memcpy(&record, data + offset, sizeof(T));
+    return record;
+}
+
+bool writeAll(int fd, const void* data, size_t bytes) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    while (bytes > 0) {
+        ssize_t n = ::write(fd, p, bytes);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Make a rename in `path`'s directory durable
+void syncDirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    fsync(fd);
+    ::close(fd);
+}
+
+bool finitePositive(double v) {
+    return std::isfinite(v) && v > 0.0;
+}
+
+} // namespace
+
+const char* sessionErrorText(SessionError error) {
+    switch (error) {
+        case SessionError::None:          return "ok";
+        case SessionError::Busy:          return "another save or load is in progress";
+        case SessionError::Dropped:       return "engine busy, try again";
+        case SessionError::TooManyLayers: return "a loop has too many layers";
+        case SessionError::Open:          return "cannot open the file";
+        case SessionError::Write:         return "write failed";
+        case SessionError::Format:        return "not a valid session file";
+        case SessionError::SampleRate:    return "saved at a different sample rate";
+    }
+    return "unknown error";
+}
+
+Session SessionPlan::copy() const {
+    Session session;
+    session.sampleRate = sampleRate;
+    session.bpm = bpm;
+    session.beatsPerBar = beatsPerBar;
+    session.loops.reserve(static_cast<size_t>(numLoops));
+    for (int i = 0; i < numLoops; ++i) {
+        const LoopPlan& plan = loops[static_cast<size_t>(i)];
+        SessionLoop lp;
+        lp.index = plan.index;
+        lp.muted = plan.muted;
+        lp.reversed = plan.reversed;
+        lp.speed = plan.speed;
+        lp.lengthInBars = plan.lengthInBars;
+        lp.recordedBpm = plan.recordedBpm;
+        lp.layers.reserve(static_cast<size_t>(plan.numLayers));
+        for (int l = 0; l < plan.numLayers; ++l) {
+            const LayerSnapshot& layer = plan.layers[static_cast<size_t>(l)];
+            lp.layers.push_back({std::vector<float>(layer.audio, layer.audio + plan.length),
+                                 layer.gain, layer.active});
+        }
+        session.loops.push_back(std::move(lp));
+    }
+    return session;
+}
+
+SessionError writeSessionFile(const std::string& path, const Session& session) {
+    size_t numLayers = 0;
+    for (const auto& lp : session.loops) numLayers += lp.layers.size();
+
+    // Header and records, then the layers, each from a page boundary
+    std::vector<uint8_t> head(pageAlign(recordBytes(session.loops.size(), numLayers)), 0);
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.numLoops = static_cast<uint32_t>(session.loops.size());
+    header.numLayers = static_cast<uint32_t>(numLayers);
+    header.beatsPerBar = session.beatsPerBar;
+    header.sampleRate = session.sampleRate;
+    header.bpm = session.bpm;
+
+    size_t loopRecordAt = sizeof(FileHeader);
+    size_t layerRecordAt = recordBytes(session.loops.size(), 0);
+    uint64_t dataAt = head.size();
+    uint32_t layerIndex = 0;
+    for (const auto& lp : session.loops) {
+        FileLoop loop{};
+        loop.index = lp.index;
+        loop.firstLayer = layerIndex;
+        loop.numLayers = static_cast<uint32_t>(lp.layers.size());
+        loop.muted = lp.muted ? 1 : 0;
+        loop.reversed = lp.reversed ? 1 : 0;
+        loop.speed = lp.speed;
+        loop.lengthInBars = lp.lengthInBars;
+        loop.recordedBpm = lp.recordedBpm;
+        loop.length = lp.layers.empty() ? 0 : static_cast<int64_t>(lp.layers.front().audio.size());
+        std::memcpy(head.data() + loopRecordAt, &loop, sizeof(loop));
+        loopRecordAt += sizeof(loop);
+
+        for (const auto& layer : lp.layers) {
+            FileLayer rec{};
+            rec.offset = dataAt;
+            rec.gain = layer.gain;
+            rec.active = layer.active ? 1 : 0;
+            std::memcpy(head.data() + layerRecordAt, &rec, sizeof(rec));
+            layerRecordAt += sizeof(rec);
+            dataAt += pageAlign(static_cast<size_t>(loop.length) * sizeof(float));
+            ++layerIndex;
+        }
+    }
+    header.fileBytes = dataAt;
+    std::memcpy(head.data(), &header, sizeof(header));
+
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return SessionError::Open;
+
+    static const uint8_t zeros[kPageBytes] = {};
+    bool ok = writeAll(fd, head.data(), head.size());
+    for (const auto& lp : session.loops) {
+        for (const auto& layer : lp.layers) {
+            if (!ok) break;
+            size_t bytes = layer.audio.size() * sizeof(float);
+            ok = writeAll(fd, layer.audio.data(), bytes) &&
+                 writeAll(fd, zeros, pageAlign(bytes) - bytes);
+        }
+    }
+    ok = ok && fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return SessionError::Write;
+    }
+    syncDirectoryOf(path);
+    return SessionError::None;
+}
+
+SessionFileReader::~SessionFileReader() {
+    unmap();
+}
+
+void SessionFileReader::unmap() {
+    if (data_) munmap(const_cast<uint8_t*>(data_), bytes_);
+    data_ = nullptr;
+    bytes_ = 0;
+}
+
+SessionError SessionFileReader::open(const std::string& path) {
+    unmap();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return SessionError::Open;
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return SessionError::Open;
+    }
+    auto bytes = static_cast<size_t>(st.st_size);
+    if (bytes < sizeof(FileHeader)) {
+        ::close(fd);
+        return SessionError::Format;
+    }
+    void* map = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // The mapping keeps the file open
+    if (map == MAP_FAILED) return SessionError::Open;
+    data_ = static_cast<const uint8_t*>(map);
+    bytes_ = bytes;
+
+    // Not pinned by mlockall: the loops are copied out of it and it is
+    // unmapped when the load ends, so its pages can go as they are read
+    munlock(map, bytes);
+    // Loops are read in file order, each straight after the previous one
+    madvise(map, bytes, MADV_SEQUENTIAL);
+    if (!valid()) {
+        unmap();
+        return SessionError::Format;
+    }
+    prefetchLoop(0);
+    return SessionError::None;
+}
+
+bool SessionFileReader::valid() const {
+    auto header = recordAt<FileHeader>(data_, 0);
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.fileBytes != bytes_ || header.numLoops > kMaxRecords ||
+        header.numLayers > kMaxRecords || !finitePositive(header.sampleRate) ||
+        !finitePositive(header.bpm) || header.beatsPerBar < 1) {
+        return false;
+    }
+    size_t records = recordBytes(header.numLoops, header.numLayers);
+    if (records > bytes_) return false;
+    size_t dataFrom = pageAlign(records);
+
+    for (uint32_t i = 0; i < header.numLoops; ++i) {
+        auto loop = recordAt<FileLoop>(data_, sizeof(FileHeader) + i * sizeof(FileLoop));
+        if (loop.index < 0 || loop.numLayers == 0 || loop.firstLayer > header.numLayers ||
+            loop.numLayers > header.numLayers - loop.firstLayer || loop.length <= 0 ||
+            static_cast<uint64_t>(loop.length) > bytes_ / sizeof(float) ||
+            !(loop.speed >= 0.25 && loop.speed <= 4.0) || !std::isfinite(loop.lengthInBars) ||
+            !std::isfinite(loop.recordedBpm)) {
+            return false;
+        }
+        size_t layerBytes = static_cast<size_t>(loop.length) * sizeof(float);
+        for (uint32_t l = loop.firstLayer; l < loop.firstLayer + loop.numLayers; ++l) {
+            auto layer = recordAt<FileLayer>(data_, recordBytes(header.numLoops, l));
+            if (layer.offset % kPageBytes != 0 || layer.offset < dataFrom ||
+                layer.offset > bytes_ || layerBytes > bytes_ - layer.offset ||
+                !std::isfinite(layer.gain)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+double SessionFileReader::sampleRate() const {
+    return recordAt<FileHeader>(data_, 0).sampleRate;
+}
+
+double SessionFileReader::bpm() const {
+    return recordAt<FileHeader>(data_, 0).bpm;
+}
+
+int SessionFileReader::beatsPerBar() const {
+    return recordAt<FileHeader>(data_, 0).beatsPerBar;
+}
+
+int SessionFileReader::numLoops() const {
+    return data_ ? static_cast<int>(recordAt<FileHeader>(data_, 0).numLoops) : 0;
+}
+
+void SessionFileReader::prefetchLoop(int i) const {
+    if (i >= numLoops()) return;
+    auto header = recordAt<FileHeader>(data_, 0);
+    auto loop = recordAt<FileLoop>(data_, sizeof(FileHeader) + static_cast<size_t>(i) * sizeof(FileLoop));
+    auto first = recordAt<FileLayer>(data_, recordBytes(header.numLoops, loop.firstLayer));
+    auto last = recordAt<FileLayer>(data_, recordBytes(header.numLoops,
+                                                       loop.firstLayer + loop.numLayers - 1));
+    size_t from = std::min(first.offset, last.offset);
+    size_t to = std::max(first.offset, last.offset) +
+                static_cast<size_t>(loop.length) * sizeof(float);
+    madvise(const_cast<uint8_t*>(data_) + from, pageAlign(to - from), MADV_WILLNEED);
+}
+
+SessionLoop SessionFileReader::readLoop(int i) const {
+    prefetchLoop(i + 1);
+
+    auto header = recordAt<FileHeader>(data_, 0);
+    auto loop = recordAt<FileLoop>(data_, sizeof(FileHeader) + static_cast<size_t>(i) * sizeof(FileLoop));
+    SessionLoop lp;
+    lp.index = loop.index;
+    lp.muted = loop.muted != 0;
+    lp.reversed = loop.reversed != 0;
+    lp.speed = loop.speed;
+    lp.lengthInBars = loop.lengthInBars;
+    lp.recordedBpm = loop.recordedBpm;
+    lp.layers.resize(loop.numLayers);
+    for (uint32_t l = 0; l < loop.numLayers; ++l) {
+        auto layer = recordAt<FileLayer>(data_, recordBytes(header.numLoops, loop.firstLayer + l));
+        // Samples start on a page boundary, so they can be read in place
+        const auto* samples = reinterpret_cast<const float*>(data_ + layer.offset);
+        auto& out = lp.layers[l];
+        out.audio.assign(samples, samples + loop.length);
+        out.gain = layer.gain;
+        out.active = layer.active != 0;
+    }
+    return lp;
+}
+
+} // namespace retrospect
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "core/Loop.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace retrospect {
+
+/// Why a session save or load failed
+enum class SessionError : uint8_t {
+    None,
+    Busy,           // Another save or load is in progress
+    Dropped,        // The engine's queues were full
+    TooManyLayers,  // A loop has more layers than a save can snapshot
+    Open,           // The file could not be opened, created or mapped
+    Write,          // Writing or syncing the file failed (e.g. disk full)
+    Format,         // Not a session file, a newer version, or damaged
+    SampleRate      // Saved at a different sample rate
+};
+
+/// Short description of a SessionError
+const char* sessionErrorText(SessionError error);
+
+/// One layer of a saved loop
+struct SessionLayer {
+    std::vector<float> audio;
+    float gain = 1.0f;
+    bool active = true;
+};
+
+/// A saved loop: its layers and what it needs to play as it did
+struct SessionLoop {
+    int index = 0;               // Loop slot
+    bool muted = false;
+    bool reversed = false;
+    double speed = 1.0;
+    double lengthInBars = 0.0;
+    double recordedBpm = 0.0;
+    std::vector<SessionLayer> layers;  // All of one length; the first is the base
+};
+
+/// Everything a session file holds
+struct Session {
+    double sampleRate = 0.0;
+    double bpm = 0.0;
+    int beatsPerBar = 4;
+    std::vector<SessionLoop> loops;
+};
+
+/// A session save as the audio thread snapshots it: loop metadata and
+/// pointers to the layers, for the worker to copy (see Loop::snapshotLayers).
+/// Allocated once and reused, so taking a snapshot never allocates.
+struct SessionPlan {
+    struct LoopPlan {
+        int index = 0;
+        bool muted = false;
+        bool reversed = false;
+        double speed = 1.0;
+        double lengthInBars = 0.0;
+        double recordedBpm = 0.0;
+        int64_t length = 0;
+        int numLayers = 0;
+        std::array<LayerSnapshot, kMaxCachedLayers> layers{};
+    };
+
+    double sampleRate = 0.0;
+    double bpm = 0.0;
+    int beatsPerBar = 4;
+    int numLoops = 0;
+    std::vector<LoopPlan> loops;  // Sized to the engine's loop count
+
+    /// Copy the snapshotted layers into a Session (allocates; worker only)
+    Session copy() const;
+};
+
+/// Write `session` to `path`. The file is written next to it under a
+/// temporary name, synced and renamed over `path`, so a crash or full disk
+/// never leaves a half-written session in its place.
+///
+/// Layout (native byte order): a header with the session and per-loop and
+/// per-layer records, padded to a page, then each layer's float samples
+/// starting on a page boundary. A reader can map the file and use the
+/// samples where they lie.
+SessionError writeSessionFile(const std::string& path, const Session& session);
+
+/// A session file mapped for reading. open() checks the whole header, so
+/// once it succeeds every loop reads without further errors.
+class SessionFileReader {
+public:
+    SessionFileReader() = default;
+    ~SessionFileReader();
+
+    SessionFileReader(const SessionFileReader&) = delete;
+    SessionFileReader& operator=(const SessionFileReader&) = delete;
+
+    SessionError open(const std::string& path);
+
+    double sampleRate() const;
+    double bpm() const;
+    int beatsPerBar() const;
+    int numLoops() const;
+
+    /// Copy loop `i` out of the mapping, and ask the kernel to start
+    /// reading the next loop's pages meanwhile
+    SessionLoop readLoop(int i) const;
+
+private:
+    bool valid() const;
+    void prefetchLoop(int i) const;
+    void unmap();
+
+    const uint8_t* data_ = nullptr;
+    size_t bytes_ = 0;
+};
+
+} // namespace retrospect
@@ -0,0 +1,166 @@
+#include "core/SessionStore.h"
+
+#include <chrono>
+#include <utility>
+
+#include <pthread.h>
+
+namespace retrospect {
+
+SessionStore::SessionStore(double sampleRate, int maxLoops)
+    : sampleRate_(sampleRate)
+    , maxLoops_(maxLoops)
+{
+}
+
+SessionStore::~SessionStore() {
+    stop();
+}
+
+void SessionStore::start() {
+    if (thread_.joinable()) return;
+    stopping_ = false;
+    thread_ = std::thread([this] { run(); });
+}
+
+void SessionStore::stop() {
+    if (!thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+bool SessionStore::beginSave(const std::string& path) {
+    bool idle = false;
+    if (!busy_.compare_exchange_strong(idle, true, std::memory_order_acq_rel)) return false;
+    start();
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    return true;
+}
+
+void SessionStore::save(Session session) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        session_ = std::move(session);
+        request_ = Request::Save;
+    }
+    wake_.notify_one();
+}
+
+bool SessionStore::beginLoad(const std::string& path) {
+    bool idle = false;
+    if (!busy_.compare_exchange_strong(idle, true, std::memory_order_acq_rel)) return false;
+    start();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path_ = path;
+        request_ = Request::Load;
+    }
+    wake_.notify_one();
+    return true;
+}
+
+void SessionStore::run() {
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "retro-session");
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this] { return stopping_ || request_ != Request::None; });
+        // A save already handed over is still written
+        if (stopping_ && request_ != Request::Save) return;
+
+        Request request = std::exchange(request_, Request::None);
+        std::string path = path_;
+        Session session = std::move(session_);
+        session_ = Session{};
+        lock.unlock();
+
+        if (request == Request::Save) {
+            runSave(path, session);
+        } else {
+            runLoad(path);
+        }
+        // The session's buffers are freed here too, off the audio thread
+        session = Session{};
+        busy_.store(false, std::memory_order_release);
+        lock.lock();
+    }
+}
+
+void SessionStore::runSave(const std::string& path, const Session& session) {
+    Result result;
+    result.error = writeSessionFile(path, session);
+    result.kind = result.error == SessionError::None ? Result::Kind::Saved
+                                                     : Result::Kind::SaveFailed;
+    result.loops = static_cast<int>(session.loops.size());
+    push(std::move(result));
+}
+
+void SessionStore::runLoad(const std::string& path) {
+    SessionFileReader reader;
+    SessionError error = reader.open(path);
+    if (error == SessionError::None && reader.sampleRate() != sampleRate_) {
+        error = SessionError::SampleRate;
+    }
+    if (error != SessionError::None) {
+        Result failed;
+        failed.kind = Result::Kind::LoadFailed;
+        failed.error = error;
+        push(std::move(failed));
+        return;
+    }
+
+    Result started;
+    started.kind = Result::Kind::LoadStarted;
+    started.bpm = reader.bpm();
+    started.beatsPerBar = reader.beatsPerBar();
+    if (!push(std::move(started))) return;
+
+    int loaded = 0;
+    for (int i = 0; i < reader.numLoops(); ++i) {
+        SessionLoop lp = reader.readLoop(i);
+        if (lp.index >= maxLoops_) continue;
+
+        std::vector<LoopLayer> layers;
+        layers.reserve(lp.layers.size());
+        for (auto& layer : lp.layers) {
+            layers.push_back({std::move(layer.audio), layer.gain, layer.active});
+        }
+        lp.layers = {};
+
+        Result result;
+        result.kind = Result::Kind::LoopLoaded;
+        result.storage = Loop::prepareStorage(std::move(layers));
+        result.loop = std::move(lp);
+        if (!push(std::move(result))) return;
+        ++loaded;
+    }
+
+    Result done;
+    done.kind = Result::Kind::Loaded;
+    done.loops = loaded;
+    done.bpm = reader.bpm();
+    push(std::move(done));
+}
+
+bool SessionStore::push(Result&& result) {
+    // The audio thread drains results every sub-block, so a full queue
+    // only means it hasn't run yet
+    while (!results_.push(std::move(result))) {
+        if (stopping()) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+bool SessionStore::stopping() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stopping_;
+}
+
+} // namespace retrospect
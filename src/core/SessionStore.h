@@ -0,0 +1,103 @@
+#pragma once
+
+#include "core/SessionFile.h"
+#include "core/SpscQueue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace retrospect {
+
+/// Saves and loads sessions (see SessionFile) on a thread of its own, so the
+/// audio and control threads never wait for the disk.
+///
+/// One save or load runs at a time. A save is begun on the control thread,
+/// gets its copy of the loops from the engine worker (save()) and is written
+/// here. A load is begun on the control thread too; the file is mapped and
+/// the loops are read one after another, each handed to the audio thread as
+/// soon as it is in memory, so the first loops play while later ones are
+/// still being read. Everything for the audio thread comes through an SPSC
+/// queue it polls.
+class SessionStore {
+public:
+    /// A step of a save or load, for the audio thread
+    struct Result {
+        enum class Kind : uint8_t {
+            Saved,        // loops
+            SaveFailed,   // error
+            LoadStarted,  // bpm, beatsPerBar: replace every loop, in this tempo and metre
+            LoopLoaded,   // loop (metadata; its layers are in storage)
+            Loaded,       // loops, bpm
+            LoadFailed    // error (nothing was changed)
+        };
+        Kind kind = Kind::Saved;
+        SessionError error = SessionError::None;
+        int loops = 0;
+        double bpm = 0.0;
+        int beatsPerBar = 0;
+        SessionLoop loop;
+        LoopStorage storage;
+    };
+
+    /// @param sampleRate Sessions saved at another rate do not load
+    /// @param maxLoops   Loops in slots beyond this are skipped on load
+    SessionStore(double sampleRate, int maxLoops);
+    ~SessionStore();
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    /// Reserve the store for a save to `path` (control thread). Returns
+    /// false if a save or load is already in progress.
+    bool beginSave(const std::string& path);
+
+    /// Give up a save whose snapshot will not come (any thread)
+    void cancelSave() { busy_.store(false, std::memory_order_release); }
+
+    /// The loops for the save begun (engine worker); written in the background
+    void save(Session session);
+
+    /// Start loading `path` (control thread). Returns false if a save or
+    /// load is already in progress.
+    bool beginLoad(const std::string& path);
+
+    /// Take the next result (audio thread only)
+    bool poll(Result& result) { return results_.pop(result); }
+
+    /// Stop the thread (control thread). A save being written is finished;
+    /// a load stops after the current loop.
+    void stop();
+
+private:
+    enum class Request : uint8_t { None, Save, Load };
+
+    void start();
+    void run();
+    void runSave(const std::string& path, const Session& session);
+    void runLoad(const std::string& path);
+
+    /// Queue a result, waiting while the audio thread catches up. Returns
+    /// false if the store stopped first.
+    bool push(Result&& result);
+    bool stopping();
+
+    double sampleRate_;
+    int maxLoops_;
+    std::atomic<bool> busy_{false};
+
+    // Requests (control thread / worker -> session thread)
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    Request request_ = Request::None;
+    std::string path_;
+    Session session_;
+    bool stopping_ = false;
+
+    SpscQueue<Result, 16> results_;  // Session thread -> audio thread
+    std::thread thread_;
+};
+
+} // namespace retrospect
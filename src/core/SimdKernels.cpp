@@ -0,0 +1,303 @@
+#include "core/SimdKernels.h"
+
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define RETROSPECT_SIMD_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RETROSPECT_SIMD_NEON 1
+#endif
+
+namespace retrospect::simd {
+
+namespace {
+
+// --- Scalar (fallback, and the tail of every vector loop) ---
+
+void addScalar(float* dst, const float* src, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+void addScaledScalar(float* dst, const float* src, float gain, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] += src[i] * gain;
+    }
+}
+
+void multiplyRampTail(float* data, size_t n, float start, float step, float divisor,
+                      size_t from) {
+    for (size_t i = from; i < n; ++i) {
+        data[i] *= (start + step * static_cast<float>(i)) / divisor;
+    }
+}
+
+[[maybe_unused]]
+void multiplyRampScalar(float* data, size_t n, float start, float step, float divisor) {
+    multiplyRampTail(data, n, start, step, divisor, 0);
+}
+
+void copyReversedTail(float* dst, const float* src, size_t n, size_t from) {
+    for (size_t i = from; i < n; ++i) {
+        dst[i] = src[n - 1 - i];
+    }
+}
+
+[[maybe_unused]]
+void copyReversedScalar(float* dst, const float* src, size_t n) {
+    copyReversedTail(dst, src, n, 0);
+}
+
+// Max is exact, so the vector versions only need to skip NaNs the same way
+float absMaxTail(const float* src, size_t n, size_t from, float peak) {
+    for (size_t i = from; i < n; ++i) {
+        float a = std::fabs(src[i]);
+        if (a > peak) peak = a;
+    }
+    return peak;
+}
+
+[[maybe_unused]]
+float absMaxScalar(const float* src, size_t n) {
+    return absMaxTail(src, n, 0, 0.0f);
+}
+
+#if defined(RETROSPECT_SIMD_X86)
+
+// --- SSE2 (always present on x86-64) ---
+
+void addSse2(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+    }
+    addScalar(dst + i, src + i, n - i);
+}
+
+void addScaledSse2(float* dst, const float* src, float gain, size_t n) {
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 scaled = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), scaled));
+    }
+    addScaledScalar(dst + i, src + i, gain, n - i);
+}
+
+void multiplyRampSse2(float* data, size_t n, float start, float step, float divisor) {
+    const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128 s = _mm_set1_ps(start);
+    const __m128 st = _mm_set1_ps(step);
+    const __m128 d = _mm_set1_ps(divisor);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 idx = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+        __m128 gain = _mm_div_ps(_mm_add_ps(s, _mm_mul_ps(st, idx)), d);
+        _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), gain));
+    }
+    multiplyRampTail(data, n, start, step, divisor, i);
+}
+
+void copyReversedSse2(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(src + n - 4 - i);
+        _mm_storeu_ps(dst + i, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+    copyReversedTail(dst, src, n, i);
+}
+
+float absMaxSse2(const float* src, size_t n) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 peak = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // maxps returns its second operand when either is NaN
+        peak = _mm_max_ps(_mm_andnot_ps(sign, _mm_loadu_ps(src + i)), peak);
+    }
+    peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(1, 0, 3, 2)));
+    peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(2, 3, 0, 1)));
+    return absMaxTail(src, n, i, _mm_cvtss_f32(peak));
+}
+
+// --- AVX2 (selected at runtime) ---
+
+__attribute__((target("avx2")))
+void addAvx2(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i,
+                         _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    }
+    addScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void addScaledAvx2(float* dst, const float* src, float gain, size_t n) {
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), scaled));
+    }
+    addScaledScalar(dst + i, src + i, gain, n - i);
+}
+
+__attribute__((target("avx2")))
+void multiplyRampAvx2(float* data, size_t n, float start, float step, float divisor) {
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 s = _mm256_set1_ps(start);
+    const __m256 st = _mm256_set1_ps(step);
+    const __m256 d = _mm256_set1_ps(divisor);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 idx = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+        __m256 gain = _mm256_div_ps(_mm256_add_ps(s, _mm256_mul_ps(st, idx)), d);
+        _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), gain));
+    }
+    multiplyRampTail(data, n, start, step, divisor, i);
+}
+
+__attribute__((target("avx2")))
+void copyReversedAvx2(float* dst, const float* src, size_t n) {
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(src + n - 8 - i);
+        _mm256_storeu_ps(dst + i, _mm256_permutevar8x32_ps(v, reverse));
+    }
+    copyReversedTail(dst, src, n, i);
+}
+
+__attribute__((target("avx2")))
+float absMaxAvx2(const float* src, size_t n) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 peak = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        peak = _mm256_max_ps(_mm256_andnot_ps(sign, _mm256_loadu_ps(src + i)), peak);
+    }
+    __m128 half = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+    half = _mm_max_ps(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_max_ps(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return absMaxTail(src, n, i, _mm_cvtss_f32(half));
+}
+
+#elif defined(RETROSPECT_SIMD_NEON)
+
+// --- NEON (always present on aarch64) ---
+
+void addNeon(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+    }
+    addScalar(dst + i, src + i, n - i);
+}
+
+void addScaledNeon(float* dst, const float* src, float gain, size_t n) {
+    const float32x4_t g = vdupq_n_f32(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t scaled = vmulq_f32(vld1q_f32(src + i), g);
+        vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), scaled));
+    }
+    addScaledScalar(dst + i, src + i, gain, n - i);
+}
+
+void multiplyRampNeon(float* data, size_t n, float start, float step, float divisor) {
+    static const float kLanes[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    const float32x4_t lanes = vld1q_f32(kLanes);
+    const float32x4_t s = vdupq_n_f32(start);
+    const float32x4_t st = vdupq_n_f32(step);
+    const float32x4_t d = vdupq_n_f32(divisor);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t idx = vaddq_f32(vdupq_n_f32(static_cast<float>(i)), lanes);
+        float32x4_t gain = vdivq_f32(vaddq_f32(s, vmulq_f32(st, idx)), d);
+        vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i), gain));
+    }
+    multiplyRampTail(data, n, start, step, divisor, i);
+}
+
+void copyReversedNeon(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // [a b c d] -> [b a d c] -> [d c b a]
+        float32x4_t v = vrev64q_f32(vld1q_f32(src + n - 4 - i));
+        vst1q_f32(dst + i, vcombine_f32(vget_high_f32(v), vget_low_f32(v)));
+    }
+    copyReversedTail(dst, src, n, i);
+}
+
+float absMaxNeon(const float* src, size_t n) {
+    float32x4_t peak = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // The maxNum form returns the number when one operand is NaN
+        peak = vmaxnmq_f32(peak, vabsq_f32(vld1q_f32(src + i)));
+    }
+    return absMaxTail(src, n, i, vmaxnmvq_f32(peak));
+}
+
+#endif
+
+struct Kernels {
+    void (*add)(float*, const float*, size_t);
+    void (*addScaled)(float*, const float*, float, size_t);
+    void (*multiplyRamp)(float*, size_t, float, float, float);
+    void (*copyReversed)(float*, const float*, size_t);
+    float (*absMax)(const float*, size_t);
+    const char* isa;
+};
+
+Kernels selectKernels() {
+#if defined(RETROSPECT_SIMD_X86)
+    if (__builtin_cpu_supports("avx2")) {
+        return {addAvx2, addScaledAvx2, multiplyRampAvx2, copyReversedAvx2, absMaxAvx2,
+                "avx2"};
+    }
+    return {addSse2, addScaledSse2, multiplyRampSse2, copyReversedSse2, absMaxSse2, "sse2"};
+#elif defined(RETROSPECT_SIMD_NEON)
+    return {addNeon, addScaledNeon, multiplyRampNeon, copyReversedNeon, absMaxNeon, "neon"};
+#else
+    return {addScalar, addScaledScalar, multiplyRampScalar, copyReversedScalar, absMaxScalar,
+            "scalar"};
+#endif
+}
+
+const Kernels& kernels() {
+    static const Kernels selected = selectKernels();
+    return selected;
+}
+
+} // namespace
+
+void add(float* dst, const float* src, size_t n) {
+    kernels().add(dst, src, n);
+}
+
+void addScaled(float* dst, const float* src, float gain, size_t n) {
+    kernels().addScaled(dst, src, gain, n);
+}
+
+void multiplyRamp(float* data, size_t n, float start, float step, float divisor) {
+    kernels().multiplyRamp(data, n, start, step, divisor);
+}
+
+void copyReversed(float* dst, const float* src, size_t n) {
+    kernels().copyReversed(dst, src, n);
+}
+
+float absMax(const float* src, size_t n) {
+    return kernels().absMax(src, n);
+}
+
+const char* activeIsa() {
+    return kernels().isa;
+}
+
+} // namespace retrospect::simd
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+namespace retrospect::simd {
+
+// Block DSP kernels shared by loop playback and the mixdown paths.
+//
+// Each kernel has SSE2 and AVX2 versions on x86 (AVX2 picked at runtime
+// when the CPU has it) and a NEON version on aarch64, with a scalar
+// fallback elsewhere. Every version performs the same IEEE operations in the
+// same order per element as the plain scalar loop, so results are
+// bit-identical whichever one runs (the core library is built with
+// -ffp-contract=off so no multiply-add gets fused).
+
+/// dst[i] += src[i]
+void add(float* dst, const float* src, size_t n);
+
+/// dst[i] += src[i] * gain
+void addScaled(float* dst, const float* src, float gain, size_t n);
+
+/// data[i] *= (start + step * i) / divisor. With integer start and step of
+/// +/-1 this is the loop-boundary crossfade ramp.
+void multiplyRamp(float* data, size_t n, float start, float step, float divisor);
+
+/// dst[i] = src[n - 1 - i] (dst and src must not overlap)
+void copyReversed(float* dst, const float* src, size_t n);
+
+/// Largest |src[i]|, or 0 for an empty block (NaNs are skipped)
+float absMax(const float* src, size_t n);
+
+/// Instruction set the kernels run with: "avx2", "sse2", "neon" or "scalar"
+const char* activeIsa();
+
+} // namespace retrospect::simd
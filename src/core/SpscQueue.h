@@ -3,6 +3,7 @@
 #include <atomic>
 #include <array>
 #include <cstddef>
+#include <utility>
 
 namespace retrospect {
 
@@ -25,13 +26,31 @@ public:
         return true;
     }
 
+    /// Push an item by move, for payloads that own heap storage.
+    /// Returns false (leaving `item` untouched) if the queue is full.
+    bool push(T&& item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t next = (head + 1) % (Capacity + 1);
+        if (next == tail_.load(std::memory_order_acquire))
+            return false; // full
+        buf_[head] = std::move(item);
+        head_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /// Whether a push would fail (producer thread only).
+    bool full() const {
+        const size_t next = (head_.load(std::memory_order_relaxed) + 1) % (Capacity + 1);
+        return next == tail_.load(std::memory_order_acquire);
+    }
+
     /// Pop an item (consumer/audio thread only).
     /// Returns false if the queue is empty.
     bool pop(T& item) {
         const size_t tail = tail_.load(std::memory_order_relaxed);
         if (tail == head_.load(std::memory_order_acquire))
             return false; // empty
-        item = buf_[tail];
+        item = std::move(buf_[tail]);
         tail_.store((tail + 1) % (Capacity + 1), std::memory_order_release);
         return true;
     }
@@ -0,0 +1,48 @@
+#include "core/StretcherPool.h"
+#include "core/TimeStretcher.h"
+
+#include <algorithm>
+
+namespace retrospect {
+
+StretchKit::StretchKit() = default;
+StretchKit::~StretchKit() = default;
+StretchKit::StretchKit(StretchKit&&) noexcept = default;
+StretchKit& StretchKit::operator=(StretchKit&&) noexcept = default;
+
+StretcherPool::StretcherPool(int numStretchers, double sampleRate)
+    : memory_(static_cast<size_t>(std::max(0, numStretchers)) *
+              static_cast<size_t>(StretchKit::kFloats) * sizeof(float))
+    , kits_(static_cast<size_t>(std::max(0, numStretchers)))
+{
+    memory_.prefault();
+    free_.reserve(kits_.size());
+    float* next = reinterpret_cast<float*>(memory_.data());
+    for (auto& kit : kits_) {
+        kit.stretcher = std::make_unique<TimeStretcher>();
+        kit.stretcher->configure(sampleRate);
+        kit.ring = next;
+        kit.inputWork = kit.ring + StretchKit::kRingCapacity;
+        kit.outputWork = kit.inputWork + StretchKit::kMaxInput;
+        next = kit.outputWork + StretchKit::kBlockSize;
+        free_.push_back(&kit);
+    }
+}
+
+StretcherPool::~StretcherPool() = default;
+StretcherPool::StretcherPool(StretcherPool&&) noexcept = default;
+StretcherPool& StretcherPool::operator=(StretcherPool&&) noexcept = default;
+
+StretchKit* StretcherPool::lease() {
+    if (free_.empty()) return nullptr;
+    StretchKit* kit = free_.back();
+    free_.pop_back();
+    return kit;
+}
+
+void StretcherPool::release(StretchKit* kit) {
+    // free_ has room for every kit, so this never reallocates
+    if (kit && free_.size() < kits_.size()) free_.push_back(kit);
+}
+
+} // namespace retrospect
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "core/AudioMemory.h"
+
+#include <memory>
+#include <vector>
+
+namespace retrospect {
+
+class TimeStretcher;
+
+/// A configured time stretcher with the buffers a loop needs to run it live
+struct StretchKit {
+    static constexpr int kBlockSize = 512;            // Stretcher output per refill
+    static constexpr int kRingCapacity = 8192;        // Stretched output ring
+    static constexpr int kMaxInput = kBlockSize * 4;  // Input per refill at the 4x tempo limit
+
+    StretchKit();
+    ~StretchKit();
+    StretchKit(StretchKit&&) noexcept;
+    StretchKit& operator=(StretchKit&&) noexcept;
+
+    static constexpr int kFloats = kRingCapacity + kMaxInput + kBlockSize;
+
+    std::unique_ptr<TimeStretcher> stretcher;
+    // Into the pool's memory
+    float* ring = nullptr;          // kRingCapacity
+    float* inputWork = nullptr;     // kMaxInput
+    float* outputWork = nullptr;    // kBlockSize
+};
+
+/// Fixed set of StretchKits, built once at startup and leased to loops while
+/// they stretch live.
+///
+/// Nothing is allocated or freed after construction, so what the stretchers
+/// cost in memory is known up front and a capture never touches the
+/// allocator for them. The kits' buffers share one AudioMemory block,
+/// faulted in (and locked, if locking is on) as the pool is built. lease() and release() are O(1) pushes and pops on a
+/// reserved free list, owned by a single thread (the audio thread).
+class StretcherPool {
+public:
+    /// @param numStretchers Kits to build (each allocates a stretcher)
+    /// @param sampleRate    Rate the stretchers are configured for
+    StretcherPool(int numStretchers, double sampleRate);
+    ~StretcherPool();
+
+    StretcherPool(StretcherPool&&) noexcept;
+    StretcherPool& operator=(StretcherPool&&) noexcept;
+
+    /// Take a kit, or nullptr if all are leased. The stretcher's state is
+    /// whatever its last user left; reset it before use.
+    StretchKit* lease();
+
+    /// Hand a leased kit back
+    void release(StretchKit* kit);
+
+    int size() const { return static_cast<int>(kits_.size()); }
+    int available() const { return static_cast<int>(free_.size()); }
+
+private:
+    AudioMemory memory_;
+    std::vector<StretchKit> kits_;
+    std::vector<StretchKit*> free_;
+};
+
+} // namespace retrospect
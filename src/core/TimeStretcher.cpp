@@ -30,4 +30,12 @@ void TimeStretcher::reset() {
     impl_->stretch.reset();
 }
 
+int TimeStretcher::inputLatency() const {
+    return impl_->stretch.inputLatency();
+}
+
+int TimeStretcher::outputLatency() const {
+    return impl_->stretch.outputLatency();
+}
+
 } // namespace retrospect
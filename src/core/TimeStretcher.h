@@ -32,6 +32,11 @@ public:
     /// (e.g., loop wrap-around or stretch activation).
     void reset();
 
+    /// Delay through the stretcher: output lags the input it was made from
+    /// by inputLatency() input samples plus outputLatency() output samples
+    int inputLatency() const;
+    int outputLatency() const;
+
     /// Whether configure() has been called
     bool isConfigured() const { return configured_; }
 
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+namespace retrospect {
+
+/// Lock-free triple buffer for publishing a value from one thread to another.
+/// Fixed storage, no dynamic allocation, and neither side ever waits.
+///
+/// The writer fills writeBuffer() and calls publish(); the reader calls
+/// read() to get the most recently published value, which stays valid and
+/// unchanged until its next read(). Intermediate values the reader never
+/// saw are simply overwritten. The writer's buffer is stale after each
+/// publish (it holds an older value), so it must be filled completely.
+template <typename T>
+class TripleBuffer {
+public:
+    /// Buffer to fill before the next publish() (writer/audio thread only)
+    T& writeBuffer() { return buffers_[write_]; }
+
+    /// Make the write buffer the latest value (writer/audio thread only)
+    void publish() {
+        uint8_t previous = middle_.exchange(static_cast<uint8_t>(write_ | kFresh),
+                                            std::memory_order_acq_rel);
+        write_ = previous & kIndexMask;
+    }
+
+    /// Latest published value (reader thread only). Never blocks.
+    const T& read() {
+        if (middle_.load(std::memory_order_relaxed) & kFresh) {
+            uint8_t previous = middle_.exchange(read_, std::memory_order_acq_rel);
+            read_ = previous & kIndexMask;
+        }
+        return buffers_[read_];
+    }
+
+private:
+    static constexpr uint8_t kIndexMask = 0x3;
+    static constexpr uint8_t kFresh = 0x4;   // Middle buffer not yet read
+
+    std::array<T, 3> buffers_{};
+    uint8_t write_ = 0;                      // Owned by the writer
+    std::atomic<uint8_t> middle_{1};         // Handed between the two
+    uint8_t read_ = 2;                       // Owned by the reader
+};
+
+} // namespace retrospect
@@ -0,0 +1,62 @@
+#include "core/WakeSignal.h"
+
+#include <algorithm>
+#include <climits>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace retrospect {
+
+#if defined(__linux__)
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+              std::atomic<uint32_t>::is_always_lock_free,
+              "the futex word is the atomic itself");
+#endif
+
+void WakeSignal::notify() {
+    count_.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__linux__)
+    // Skip the system call when nobody waits (the common case on the audio
+    // thread); seq_cst pairs the count with the waiter's registration
+    if (waiters_.load(std::memory_order_seq_cst) == 0) return;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&count_), FUTEX_WAKE_PRIVATE, INT_MAX,
+            nullptr, nullptr, 0);
+#endif
+}
+
+bool WakeSignal::waitUntil(uint32_t seen, std::chrono::steady_clock::time_point deadline) const {
+#if defined(__linux__)
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    bool changed = false;
+    while (!(changed = count_.load(std::memory_order_seq_cst) != seen)) {
+        auto left = deadline - std::chrono::steady_clock::now();
+        if (left <= std::chrono::steady_clock::duration::zero()) break;
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+        timespec timeout{};
+        timeout.tv_sec = static_cast<time_t>(nanos / 1000000000);
+        timeout.tv_nsec = static_cast<long>(nanos % 1000000000);
+        // Returns at once if the count has moved on from `seen` already
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(const_cast<std::atomic<uint32_t>*>(&count_)),
+                FUTEX_WAIT_PRIVATE, seen, &timeout, nullptr, 0);
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return changed;
+#else
+    // No timed wait on this platform: poll
+    while (value() == seen) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) return false;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            deadline - now, std::chrono::milliseconds(1)));
+    }
+    return true;
+#endif
+}
+
+} // namespace retrospect
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace retrospect {
+
+/// A counter one thread bumps to wake another, which waits for it to change
+/// with a deadline.
+///
+/// notify() never blocks or allocates (on Linux it is a futex wake, a system
+/// call only while someone is waiting), so the audio thread can signal a
+/// control thread with it. std::atomic::wait has no timeout, hence this.
+class WakeSignal {
+public:
+    uint32_t value() const { return count_.load(std::memory_order_acquire); }
+
+    /// Bump the counter and wake every waiter (any thread, audio included)
+    void notify();
+
+    /// Block until value() differs from `seen` or `deadline` passes.
+    /// Returns whether it changed.
+    bool waitUntil(uint32_t seen, std::chrono::steady_clock::time_point deadline) const;
+
+private:
+    std::atomic<uint32_t> count_{0};
+    mutable std::atomic<uint32_t> waiters_{0};
+};
+
+} // namespace retrospect
@@ -1,10 +1,146 @@
 #include "server/OscServer.h"
+#include "core/AudioMemory.h"
+#include "core/MonotonicClock.h"
 #include <cstdio>
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 
+#include <pthread.h>
+
 namespace retrospect {
 
+namespace {
+
+// Keep each bundle within one Wi-Fi frame, so losing a fragment never
+// takes a whole push with it
+constexpr size_t kMaxBundleBytes = 1400;
+
+// Steady-clock ns for an OSC timetag, or -1 for "immediately". Timetags are
+// NTP time (seconds since 1900 and a 32-bit fraction), read off a system
+// clock `clockOffset` ahead of this host's and carried over to the engine's.
+int64_t timetagNanos(lo_timetag time, int64_t clockOffset) {
+    if (time.sec == 0) return -1;
+    constexpr int64_t kNtpToUnixSeconds = 2208988800LL;
+    int64_t unixNanos = (static_cast<int64_t>(time.sec) - kNtpToUnixSeconds) * 1000000000LL +
+                        ((static_cast<int64_t>(time.frac) * 1000000000LL) >> 32);
+    return monotonicNanos() + (unixNanos - clockOffset - systemNanos());
+}
+
+// Peaks go out as int8 min/max pairs, full scale at 127
+lo_blob peaksBlob(const std::vector<Peak>& peaks) {
+    std::vector<int8_t> bytes;
+    bytes.reserve(peaks.size() * 2);
+    auto quantize = [](float v) {
+        return static_cast<int8_t>(std::lround(std::clamp(v, -1.0f, 1.0f) * 127.0f));
+    };
+    for (const Peak& peak : peaks) {
+        bytes.push_back(quantize(peak.min));
+        bytes.push_back(quantize(peak.max));
+    }
+    return lo_blob_new(static_cast<int32_t>(bytes.size()), bytes.data());
+}
+
+// Send `msg` to host:port and free it
+void sendReply(const char* host, int port, const char* path, lo_message msg) {
+    lo_address addr = lo_address_new(host, std::to_string(port).c_str());
+    if (addr) {
+        lo_send_message(addr, path, msg);
+        lo_address_free(addr);
+    }
+    lo_message_free(msg);
+}
+
+OscField intField(int value) { return {'i', value, 0.0}; }
+OscField int64Field(int64_t value) { return {'h', value, 0.0}; }
+OscField doubleField(double value) { return {'d', 0, value}; }
+
+void addField(lo_message msg, const OscField& field) {
+    switch (field.type) {
+        case 'i': lo_message_add_int32(msg, static_cast<int32_t>(field.i)); break;
+        case 'h': lo_message_add_int64(msg, field.i); break;
+        default:  lo_message_add_double(msg, field.d); break;
+    }
+}
+
+// A loop's /retro/state/loop arguments after the index
+OscFields loopFields(const LoopStatus& lp) {
+    double playPosPct = 0.0;
+    if (lp.lengthSamples > 0) {
+        playPosPct = static_cast<double>(lp.playPosition) /
+                     static_cast<double>(lp.lengthSamples);
+    }
+    return {intField(loopStateToInt(lp.state)), doubleField(lp.lengthInBars),
+            intField(lp.layers), intField(lp.activeLayers), doubleField(lp.speed),
+            intField(lp.reversed ? 1 : 0), doubleField(playPosPct),
+            int64Field(static_cast<int64_t>(lp.lengthSamples))};
+}
+
+// Packs one push's messages into as few bundles as fit kMaxBundleBytes,
+// sending each as it fills
+class BundleWriter {
+public:
+    explicit BundleWriter(lo_address addr) : addr_(addr) {}
+    ~BundleWriter() { flush(); }
+
+    BundleWriter(const BundleWriter&) = delete;
+    BundleWriter& operator=(const BundleWriter&) = delete;
+
+    /// Add `msg` (the bundle takes ownership)
+    void add(const char* path, lo_message msg) {
+        size_t bytes = lo_message_length(msg, path) + 4;  // Plus its size prefix
+        if (bundle_ && bundleBytes_ + bytes > kMaxBundleBytes) flush();
+        if (!bundle_) {
+            bundle_ = lo_bundle_new(LO_TT_IMMEDIATE);
+            bundleBytes_ = 16;  // "#bundle" and the timetag
+        }
+        lo_bundle_add_message(bundle_, path, msg);
+        bundleBytes_ += bytes;
+    }
+
+    void flush() {
+        if (!bundle_) return;
+        lo_send_bundle(addr_, bundle_);
+        lo_bundle_free_recursive(bundle_);
+        bundle_ = nullptr;
+    }
+
+private:
+    lo_address addr_;
+    lo_bundle bundle_ = nullptr;
+    size_t bundleBytes_ = 0;
+};
+
+// Send `fields` under `path` (after `index`, if not -1) if they differ from
+// what was `sent`. On a keyframe, or without a `deltaPath`, the whole
+// message goes; otherwise `deltaPath` carries the index, a mask of the
+// fields that changed (bit n = field n) and just those fields.
+void sendFields(BundleWriter& out, const char* path, const char* deltaPath, int index,
+                OscFields fields, OscFields& sent, bool keyframe) {
+    if (!keyframe && fields == sent) return;
+    bool whole = keyframe || !deltaPath || sent.size() != fields.size();
+
+    lo_message msg = lo_message_new();
+    if (index >= 0) lo_message_add_int32(msg, index);
+    if (whole) {
+        for (const auto& field : fields) addField(msg, field);
+        out.add(path, msg);
+    } else {
+        int32_t mask = 0;
+        for (size_t f = 0; f < fields.size(); ++f) {
+            if (fields[f] != sent[f]) mask |= int32_t(1) << f;
+        }
+        lo_message_add_int32(msg, mask);
+        for (size_t f = 0; f < fields.size(); ++f) {
+            if (mask & (int32_t(1) << f)) addField(msg, fields[f]);
+        }
+        out.add(deltaPath, msg);
+    }
+    sent = std::move(fields);
+}
+
+} // namespace
+
 OscServer::OscServer(LoopEngine& engine, const std::string& port)
     : engine_(engine)
     , port_(port)
@@ -61,28 +197,43 @@ bool OscServer::start() {
                                 handleLookbackBars, this);
     lo_server_thread_add_method(serverThread_, "/retro/cancel_pending", "",
                                 handleCancelPending, this);
+    lo_server_thread_add_method(serverThread_, "/retro/session/save", "s",
+                                handleSessionSave, this);
+    lo_server_thread_add_method(serverThread_, "/retro/session/load", "s",
+                                handleSessionLoad, this);
     lo_server_thread_add_method(serverThread_, "/retro/client/subscribe", "si",
                                 handleSubscribe, this);
+    lo_server_thread_add_method(serverThread_, "/retro/client/subscribe", "sid",
+                                handleSubscribe, this);
     lo_server_thread_add_method(serverThread_, "/retro/client/unsubscribe", "si",
                                 handleUnsubscribe, this);
-
-    // Wire engine message callback to buffer for state pushes
-    EngineCallbacks callbacks;
-    callbacks.onMessage = [this](const std::string& msg) {
-        std::lock_guard<std::mutex> lock(msgMutex_);
-        pendingMessages_.push_back(msg);
-    };
-    callbacks.onStateChanged = []() {};
-    callbacks.onBeat = [](const MetronomePosition&) {};
-    callbacks.onBar = [](const MetronomePosition&) {};
-    engine_.setCallbacks(std::move(callbacks));
+    lo_server_thread_add_method(serverThread_, "/retro/query/loop_peaks", "siii",
+                                handleLoopPeaks, this);
+    lo_server_thread_add_method(serverThread_, "/retro/query/input_peaks", "siiid",
+                                handleInputPeaks, this);
+
+    // Bundles reach the engine as one batch, at their timetag. liblo would
+    // hold a bundle back until its time; handed over early, the engine
+    // places it on the exact sample instead.
+    lo_server server = lo_server_thread_get_server(serverThread_);
+    lo_server_enable_queue(server, 0, 1);
+    lo_server_add_bundle_handlers(server, handleBundleStart, handleBundleEnd, this);
 
     lo_server_thread_start(serverThread_);
     fprintf(stderr, "OscServer: listening on port %s\n", port_.c_str());
+
+    stopping_.store(false, std::memory_order_relaxed);
+    publisher_ = std::thread([this] { runPublisher(); });
     return true;
 }
 
 void OscServer::stop() {
+    if (publisher_.joinable()) {
+        stopping_.store(true, std::memory_order_release);
+        engine_.stateSignal().notify();
+        publisher_.join();
+    }
+
     if (serverThread_) {
         lo_server_thread_stop(serverThread_);
         lo_server_thread_free(serverThread_);
@@ -97,101 +248,151 @@ void OscServer::stop() {
     subscribers_.clear();
 }
 
-void OscServer::pushState() {
+void OscServer::runPublisher() {
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "retro-osc-push");
+#endif
+    WakeSignal& signal = engine_.stateSignal();
+    bool changed = true;
+    for (;;) {
+        // Taken before the push, so a change during it wakes the wait at once
+        uint32_t seen = signal.value();
+        if (stopping_.load(std::memory_order_acquire)) break;
+        auto next = pushState(changed);
+        changed = signal.waitUntil(seen, next);
+    }
+}
+
+std::chrono::steady_clock::time_point OscServer::pushState(bool changed) {
     pruneSubscribers();
+    auto now = std::chrono::steady_clock::now();
+
+    // One published state and one batch of log lines for every subscriber
+    const EngineState& st = engine_.readState(StateReader::Publisher);
 
+    events_.clear();
+    engine_.readEvents(eventCursor_, events_);
+    std::vector<std::string> log;
+    for (const auto& ev : events_) {
+        log.push_back(formatEngineEvent(ev));
+    }
+    {
+        std::lock_guard<std::mutex> lock(msgMutex_);
+        log.insert(log.end(), pendingMessages_.begin(), pendingMessages_.end());
+        pendingMessages_.clear();
+    }
+
+    // With nobody due, wake now and then anyway to prune
+    auto next = now + std::chrono::seconds(1);
     std::lock_guard<std::mutex> lock(subMutex_);
-    for (const auto& sub : subscribers_) {
-        pushStateTo(sub.addr);
+    for (auto& sub : subscribers_) {
+        // Log lines are read once, so everyone gets them now
+        if (changed || !log.empty() || sub.needsKeyframe || now >= sub.nextPush) {
+            pushStateTo(sub, st, log, now);
+            sub.nextPush = now + sub.interval;
+        }
+        next = std::min(next, sub.nextPush);
     }
+    return next;
 }
 
-void OscServer::pushStateTo(lo_address addr) {
-    const auto& met = engine_.metronome();
-    auto pos = met.position();
+void OscServer::pushStateTo(OscSubscriber& sub, const EngineState& st,
+                            const std::vector<std::string>& log,
+                            std::chrono::steady_clock::time_point now) {
+    bool keyframe = sub.needsKeyframe || now - sub.lastKeyframe >= kKeyframeInterval;
+    if (keyframe) {
+        sub.needsKeyframe = false;
+        sub.lastKeyframe = now;
+    }
+    BundleWriter out(sub.addr);
+
+    // A keyframe starts with the loop count; the client resets every slot
+    // to empty, so empty ones need not follow
+    if (keyframe) {
+        lo_message msg = lo_message_new();
+        lo_message_add_int32(msg, st.numLoops);
+        out.add("/retro/state/keyframe", msg);
+    }
 
     // Metronome: iiddii
-    lo_send(addr, "/retro/state/metronome", "iiddii",
-            pos.bar, pos.beat, pos.beatFraction,
-            met.bpm(), met.beatsPerBar(),
-            met.isRunning() ? 1 : 0);
-
-    // Loops: one message per loop
-    for (int i = 0; i < engine_.maxLoops(); ++i) {
-        const auto& lp = engine_.loop(i);
-        double playPosPct = 0.0;
-        if (lp.lengthSamples() > 0) {
-            playPosPct = static_cast<double>(lp.playPosition()) /
-                         static_cast<double>(lp.lengthSamples());
+    const auto& met = st.metronome;
+    sendFields(out, "/retro/state/metronome", "/retro/state/metronome/delta", -1,
+               {intField(met.bar), intField(met.beat), doubleField(met.beatFraction),
+                doubleField(met.bpm), intField(met.beatsPerBar), intField(met.running ? 1 : 0)},
+               sub.metronome, keyframe);
+
+    // Loops: iidiididh, index first
+    const OscFields emptyLoop = loopFields(LoopStatus{});
+    sub.loops.resize(static_cast<size_t>(st.numLoops));
+    for (int i = 0; i < st.numLoops; ++i) {
+        OscFields fields = loopFields(st.loops[static_cast<size_t>(i)]);
+        OscFields& sent = sub.loops[static_cast<size_t>(i)];
+        if (keyframe && fields == emptyLoop) {
+            sent = fields;
+            continue;
         }
-
-        lo_send(addr, "/retro/state/loop", "iidiiddih",
-                i,
-                loopStateToInt(lp.state()),
-                lp.lengthInBars(),
-                lp.layerCount(),
-                lp.activeLayerCount(),
-                lp.speed(),
-                lp.isReversed() ? 1 : 0,
-                playPosPct,
-                static_cast<int64_t>(lp.lengthSamples()));
+        sendFields(out, "/retro/state/loop", "/retro/state/loop/delta", i,
+                   std::move(fields), sent, keyframe);
     }
 
-    // Recording state
-    lo_send(addr, "/retro/state/recording", "ii",
-            engine_.isRecordingAtomic() ? 1 : 0,
-            engine_.recordingLoopIdxAtomic());
-
-    // Settings
-    lo_send(addr, "/retro/state/settings", "iiiiii",
-            quantizeToInt(engine_.defaultQuantize()),
-            engine_.lookbackBars(),
-            engine_.metronomeClickEnabled() ? 1 : 0,
-            static_cast<int>(engine_.sampleRate()),
-            engine_.midiSyncEnabled() ? 1 : 0,
-            engine_.midiSync().hasOutput() ? 1 : 0);
-
-    // Pending ops: send clear first, then each op from loop-level state
-    lo_send(addr, "/retro/state/pending_clear", "");
-
-    for (int i = 0; i < engine_.maxLoops(); ++i) {
-        const auto& lp = engine_.loop(i);
-        const auto& ps = lp.pendingState();
-        auto sendOp = [&](const char* desc, Quantize q) {
-            lo_send(addr, "/retro/state/pending_op", "iis",
-                    i, quantizeToInt(q), desc);
-        };
-        if (ps.capture) sendOp("Capture Loop", ps.capture->quantize);
-        if (ps.record) {
-            const char* desc = (ps.recordOp == PendingState::RecordOp::Start) ? "Record" : "Stop Record";
-            sendOp(desc, ps.record->quantize);
-        }
-        if (ps.mute) {
-            const char* desc = "Toggle Mute";
-            if (ps.muteOp == PendingState::MuteOp::Mute) desc = "Mute";
-            else if (ps.muteOp == PendingState::MuteOp::Unmute) desc = "Unmute";
-            sendOp(desc, ps.mute->quantize);
+    // Small whole messages, resent only when something in them changed
+    sendFields(out, "/retro/state/recording", nullptr, -1,
+               {intField(st.isRecording ? 1 : 0), intField(st.recordingLoopIndex)},
+               sub.recording, keyframe);
+    sendFields(out, "/retro/state/settings", nullptr, -1,
+               {intField(quantizeToInt(st.defaultQuantize)), intField(st.lookbackBars),
+                intField(st.clickEnabled ? 1 : 0), intField(static_cast<int>(st.sampleRate)),
+                intField(st.midiSyncEnabled ? 1 : 0), intField(st.midiOutputAvailable ? 1 : 0)},
+               sub.settings, keyframe);
+
+    // Callback timing: dddddddddddddhhhhhh (times in microseconds, loads as
+    // fractions of the buffer period, then lifetime counters and memory)
+    const auto& perf = st.perf;
+    auto us = [](int64_t nanos) { return doubleField(static_cast<double>(nanos) / 1000.0); };
+    AudioMemoryStats memory = audioMemoryStats();
+    sendFields(out, "/retro/state/perf", nullptr, -1,
+               {us(perf.periodNanos),
+                us(perf.meanNanos), us(perf.p99Nanos), us(perf.maxNanos),
+                doubleField(perf.meanLoad), doubleField(perf.p99Load), doubleField(perf.maxLoad),
+                us(perf.stageMeanNanos[static_cast<size_t>(DspStage::Ingest)]),
+                us(perf.stageMeanNanos[static_cast<size_t>(DspStage::Ops)]),
+                us(perf.stageMeanNanos[static_cast<size_t>(DspStage::Mix)]),
+                us(perf.stageMeanNanos[static_cast<size_t>(DspStage::Stretch)]),
+                us(perf.hostMeanNanos), us(perf.hostMaxNanos),
+                int64Field(static_cast<int64_t>(perf.callbacks)),
+                int64Field(static_cast<int64_t>(perf.missedDeadlines)),
+                int64Field(static_cast<int64_t>(perf.lateCallbacks)),
+                int64Field(perf.deviceXruns),
+                int64Field(memory.bytes), int64Field(memory.lockedBytes)},
+               sub.perf, keyframe);
+
+    // Pending ops: clear first, then each op from loop-level state, whenever
+    // the list changed
+    std::vector<OscPendingOp> pending;
+    for (int i = 0; i < st.numLoops; ++i) {
+        const auto& lp = st.loops[static_cast<size_t>(i)];
+        for (int p = 0; p < lp.numPending; ++p) {
+            const auto& op = lp.pending[static_cast<size_t>(p)];
+            pending.push_back({i, quantizeToInt(op.quantize), op.kind});
         }
-        if (ps.overdub) {
-            const char* desc = (ps.overdubOp == PendingState::OverdubOp::Start) ? "Start Overdub" : "Stop Overdub";
-            sendOp(desc, ps.overdub->quantize);
-        }
-        if (ps.reverse) sendOp("Reverse", ps.reverse->quantize);
-        if (ps.speed) sendOp("Set Speed", ps.speed->quantize);
-        if (ps.undo) {
-            const char* desc = (ps.undo->direction == UndoDirection::Undo) ? "Undo Layer" : "Redo Layer";
-            sendOp(desc, ps.undo->quantize);
+    }
+    if (keyframe || pending != sub.pending) {
+        out.add("/retro/state/pending_clear", lo_message_new());
+        for (const auto& op : pending) {
+            lo_message msg = lo_message_new();
+            lo_message_add_int32(msg, op.loopIndex);
+            lo_message_add_int32(msg, op.quantize);
+            lo_message_add_string(msg, pendingOpName(op.kind));
+            out.add("/retro/state/pending_op", msg);
         }
-        if (ps.clear) sendOp("Clear", ps.clear->quantize);
+        sub.pending = std::move(pending);
     }
 
     // Log messages
-    {
-        std::lock_guard<std::mutex> lock(msgMutex_);
-        for (const auto& msg : pendingMessages_) {
-            lo_send(addr, "/retro/state/log", "s", msg.c_str());
-        }
-        pendingMessages_.clear();
+    for (const auto& line : log) {
+        lo_message msg = lo_message_new();
+        lo_message_add_string(msg, line.c_str());
+        out.add("/retro/state/log", msg);
     }
 }
 
@@ -332,10 +533,8 @@ int OscServer::handleLookbackBars(const char*, const char*, lo_arg** argv,
     int requested = argv[0]->i;
     int actual = self->engine_.setLookbackBars(requested);
     if (actual != requested) {
-        std::lock_guard<std::mutex> lock(self->msgMutex_);
-        self->pendingMessages_.push_back(
-            "Lookback clamped to " + std::to_string(actual) + " bar(s) (max " +
-            std::to_string(self->engine_.maxLookbackBars()) + ")");
+        self->postMessage("Lookback clamped to " + std::to_string(actual) + " bar(s) (max " +
+                          std::to_string(self->engine_.maxLookbackBars()) + ")");
     }
     return 0;
 }
@@ -347,10 +546,30 @@ int OscServer::handleCancelPending(const char*, const char*, lo_arg**,
     return 0;
 }
 
+int OscServer::handleSessionSave(const char*, const char*, lo_arg** argv,
+                                  int, lo_message, void* user) {
+    auto* self = static_cast<OscServer*>(user);
+    SessionError error = self->engine_.saveSession(&argv[0]->s);
+    if (error != SessionError::None) {
+        self->postMessage(std::string("Session save failed: ") + sessionErrorText(error));
+    }
+    return 0;
+}
+
+int OscServer::handleSessionLoad(const char*, const char*, lo_arg** argv,
+                                  int, lo_message, void* user) {
+    auto* self = static_cast<OscServer*>(user);
+    SessionError error = self->engine_.loadSession(&argv[0]->s);
+    if (error != SessionError::None) {
+        self->postMessage(std::string("Session load failed: ") + sessionErrorText(error));
+    }
+    return 0;
+}
+
 int OscServer::handleSubscribe(const char*, const char*, lo_arg** argv,
-                                int, lo_message, void* user) {
+                                int argc, lo_message, void* user) {
     auto* self = static_cast<OscServer*>(user);
-    self->addSubscriber(&argv[0]->s, argv[1]->i);
+    self->addSubscriber(&argv[0]->s, argv[1]->i, argc > 2 ? argv[2]->d : 0.0);
     return 0;
 }
 
@@ -361,6 +580,56 @@ int OscServer::handleUnsubscribe(const char*, const char*, lo_arg** argv,
     return 0;
 }
 
+int OscServer::handleBundleStart(lo_timetag time, void* user) {
+    auto* self = static_cast<OscServer*>(user);
+    const TimelineSync* sync = self->timelineSync_.load(std::memory_order_acquire);
+    self->engine_.beginBatch(timetagNanos(time, sync ? sync->leaderOffsetNanos() : 0));
+    return 0;
+}
+
+int OscServer::handleBundleEnd(void* user) {
+    auto* self = static_cast<OscServer*>(user);
+    if (!self->engine_.endBatch()) {
+        self->postMessage("Bundle dropped: command queue full");
+    }
+    return 0;
+}
+
+int OscServer::handleLoopPeaks(const char*, const char*, lo_arg** argv,
+                                int, lo_message, void* user) {
+    auto* self = static_cast<OscServer*>(user);
+    int loopIdx = argv[2]->i;
+    int columns = std::clamp(argv[3]->i, 1, kMaxPeakColumns);
+    uint64_t revision = self->engine_.loopPeaks(loopIdx, columns, self->peaks_);
+
+    lo_message msg = lo_message_new();
+    lo_message_add_int32(msg, loopIdx);
+    lo_message_add_int64(msg, static_cast<int64_t>(revision));
+    lo_blob blob = peaksBlob(self->peaks_);
+    lo_message_add_blob(msg, blob);
+    sendReply(&argv[0]->s, argv[1]->i, "/retro/peaks/loop", msg);
+    lo_blob_free(blob);
+    return 0;
+}
+
+int OscServer::handleInputPeaks(const char*, const char*, lo_arg** argv,
+                                 int, lo_message, void* user) {
+    auto* self = static_cast<OscServer*>(user);
+    int channel = argv[2]->i;
+    int columns = std::clamp(argv[3]->i, 1, kMaxPeakColumns);
+    double seconds = std::max(0.0, argv[4]->d);
+    auto samples = static_cast<int64_t>(seconds * self->engine_.sampleRate());
+    self->engine_.inputPeaks(channel, samples, columns, self->peaks_);
+
+    lo_message msg = lo_message_new();
+    lo_message_add_int32(msg, channel);
+    lo_blob blob = peaksBlob(self->peaks_);
+    lo_message_add_blob(msg, blob);
+    sendReply(&argv[0]->s, argv[1]->i, "/retro/peaks/input", msg);
+    lo_blob_free(blob);
+    return 0;
+}
+
 void OscServer::errorHandler(int num, const char* msg, const char* path) {
     fprintf(stderr, "OscServer error %d: %s (path: %s)\n",
             num, msg, path ? path : "null");
@@ -372,29 +641,53 @@ void OscServer::handleSimpleOp(OpType type, lo_arg** argv) {
     engine_.scheduleOp(type, loopIdx, q);
 }
 
-void OscServer::addSubscriber(const char* url, int port) {
+void OscServer::postMessage(std::string message) {
+    {
+        std::lock_guard<std::mutex> lock(msgMutex_);
+        pendingMessages_.push_back(std::move(message));
+    }
+    engine_.stateSignal().notify();
+}
+
+void OscServer::addSubscriber(const char* url, int port, double rateHz) {
     std::string portStr = std::to_string(port);
     auto now = std::chrono::steady_clock::now();
+    auto interval = [](double hz) {
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / std::clamp(hz, kMinRateHz, kMaxRateHz)));
+    };
 
-    std::lock_guard<std::mutex> lock(subMutex_);
+    {
+        std::lock_guard<std::mutex> lock(subMutex_);
+
+        // Check if already subscribed (refresh timestamp)
+        bool found = false;
+        for (auto& sub : subscribers_) {
+            const char* existingUrl = lo_address_get_hostname(sub.addr);
+            const char* existingPort = lo_address_get_port(sub.addr);
+            if (std::strcmp(existingUrl, url) == 0 &&
+                std::strcmp(existingPort, portStr.c_str()) == 0) {
+                sub.lastSeen = now;
+                sub.needsKeyframe = true;  // It may have restarted on the same port
+                if (rateHz > 0.0) sub.interval = interval(rateHz);
+                found = true;
+                break;
+            }
+        }
 
-    // Check if already subscribed (refresh timestamp)
-    for (auto& sub : subscribers_) {
-        const char* existingUrl = lo_address_get_hostname(sub.addr);
-        const char* existingPort = lo_address_get_port(sub.addr);
-        if (std::strcmp(existingUrl, url) == 0 &&
-            std::strcmp(existingPort, portStr.c_str()) == 0) {
+        if (!found) {
+            OscSubscriber sub;
+            sub.addr = lo_address_new(url, portStr.c_str());
             sub.lastSeen = now;
-            return;
+            sub.interval = interval(rateHz > 0.0 ? rateHz : kDefaultRateHz);
+            sub.nextPush = now;
+            subscribers_.push_back(sub);
+            fprintf(stderr, "OscServer: client subscribed %s:%d\n", url, port);
         }
     }
 
-    // New subscriber
-    OscSubscriber sub;
-    sub.addr = lo_address_new(url, portStr.c_str());
-    sub.lastSeen = now;
-    subscribers_.push_back(sub);
-    fprintf(stderr, "OscServer: client subscribed %s:%d\n", url, port);
+    // Its keyframe goes out now rather than at the next routine push
+    engine_.stateSignal().notify();
 }
 
 void OscServer::removeSubscriber(const char* url, int port) {
@@ -2,41 +2,94 @@
 
 #include "core/LoopEngine.h"
 #include "client/EngineClient.h"
+#include "server/TimelineSync.h"
 #include <lo/lo.h>
 
 #include <vector>
 #include <mutex>
 #include <string>
 #include <chrono>
+#include <thread>
+#include <atomic>
 
 namespace retrospect {
 
-/// A subscribed OSC client that receives state pushes
+/// One argument of a state message, as it goes on the wire
+struct OscField {
+    char type = 'i';    // 'i', 'h' (in i) or 'd' (in d)
+    int64_t i = 0;
+    double d = 0.0;
+
+    bool operator==(const OscField&) const = default;
+};
+using OscFields = std::vector<OscField>;
+
+/// A pending op as pushed in /retro/state/pending_op
+struct OscPendingOp {
+    int loopIndex = 0;
+    int quantize = 0;
+    PendingOpKind kind = PendingOpKind::Capture;
+
+    bool operator==(const OscPendingOp&) const = default;
+};
+
+/// A subscribed OSC client that receives state pushes, at its own rate,
+/// with what it was last sent so each push carries only what changed
 struct OscSubscriber {
     lo_address addr = nullptr;
     std::chrono::steady_clock::time_point lastSeen;
+    std::chrono::steady_clock::duration interval;     // Between routine pushes
+    std::chrono::steady_clock::time_point nextPush;   // Next routine push
+
+    bool needsKeyframe = true;      // Send everything on the next push
+    std::chrono::steady_clock::time_point lastKeyframe;
+    OscFields metronome;
+    std::vector<OscFields> loops;   // Fields after the index, per slot
+    OscFields recording;
+    OscFields settings;
+    OscFields perf;
+    std::vector<OscPendingOp> pending;
 };
 
 /// OSC server that wraps a LoopEngine, receives commands via OSC,
-/// and pushes state to subscribed clients at ~30Hz.
+/// and pushes state to subscribed clients from a publisher thread of its own.
+///
+/// The publisher sleeps on the engine's state signal: an engine event, a
+/// beat or a drained command pushes to every subscriber at once (so remote
+/// beat lights flash on the beat), and otherwise each subscriber gets a push
+/// at the rate it asked for at subscribe (kDefaultRateHz if it didn't).
+///
+/// Each push to a subscriber is packed into OSC bundles and carries only
+/// what changed since the previous one: a loop or the metronome as a
+/// .../delta message with a mask of the changed fields, other messages when
+/// anything in them changed. Every kKeyframeInterval (and on the first
+/// push) a keyframe resends everything, so a client recovers from lost
+/// packets within about a second.
+///
+/// The commands in an OSC bundle go to the engine as one batch (see
+/// LoopEngine::beginBatch), timed by the bundle's timetag: on the sync
+/// leader's clock when following one (see setTimelineSync).
+///
+/// Waveform queries (/retro/query/...) are answered on the listener thread,
+/// to the host and port named in the query.
 class OscServer {
 public:
     OscServer(LoopEngine& engine, const std::string& port = "7770");
     ~OscServer();
 
-    /// Start the OSC listener thread
+    /// Start the OSC listener and publisher threads
     bool start();
 
-    /// Stop the OSC listener thread
+    /// Stop the OSC listener and publisher threads
     void stop();
 
-    /// Push current engine state to all subscribed clients.
-    /// Call this from the main loop at ~30Hz.
-    void pushState();
-
     /// Get the port the server is listening on
     std::string port() const { return port_; }
 
+    /// Read bundle timetags on the clock of `sync`'s leader (nullptr: this
+    /// host's clock). `sync` must outlive the server or be unset first.
+    void setTimelineSync(const TimelineSync* sync) { timelineSync_.store(sync, std::memory_order_release); }
+
 private:
     // OSC handler callbacks (static trampolines)
     static int handleCaptureLoop(const char* path, const char* types,
@@ -77,17 +130,31 @@ private:
                                   lo_arg** argv, int argc, lo_message msg, void* user);
     static int handleCancelPending(const char* path, const char* types,
                                    lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleSessionSave(const char* path, const char* types,
+                                 lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleSessionLoad(const char* path, const char* types,
+                                 lo_arg** argv, int argc, lo_message msg, void* user);
     static int handleSubscribe(const char* path, const char* types,
                                lo_arg** argv, int argc, lo_message msg, void* user);
     static int handleUnsubscribe(const char* path, const char* types,
                                  lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleLoopPeaks(const char* path, const char* types,
+                               lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleInputPeaks(const char* path, const char* types,
+                                lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleBundleStart(lo_timetag time, void* user);
+    static int handleBundleEnd(void* user);
     static void errorHandler(int num, const char* msg, const char* path);
 
     /// Schedule a simple 2-arg op (loopIdx, quantize)
     void handleSimpleOp(OpType type, lo_arg** argv);
 
-    /// Add or refresh a subscriber
-    void addSubscriber(const char* url, int port);
+    /// Queue a log line for the next push (any thread)
+    void postMessage(std::string message);
+
+    /// Add or refresh a subscriber. A rate (pushes per second) of 0 keeps
+    /// the one it has, or kDefaultRateHz for a new subscriber.
+    void addSubscriber(const char* url, int port, double rateHz = 0.0);
 
     /// Remove a subscriber
     void removeSubscriber(const char* url, int port);
@@ -95,18 +162,44 @@ private:
     /// Prune subscribers that haven't been seen recently
     void pruneSubscribers();
 
-    /// Send state to a single subscriber
-    void pushStateTo(lo_address addr);
+    /// Publisher thread: push as state changes or pushes fall due
+    void runPublisher();
+
+    /// Push published engine state and new log lines to every subscriber
+    /// due a push (all of them if `changed`). Returns when the next
+    /// routine push is due.
+    std::chrono::steady_clock::time_point pushState(bool changed);
+
+    /// Send published engine state and log lines to a single subscriber
+    void pushStateTo(OscSubscriber& sub, const EngineState& st,
+                     const std::vector<std::string>& log,
+                     std::chrono::steady_clock::time_point now);
 
     LoopEngine& engine_;
     std::string port_;
     lo_server_thread serverThread_ = nullptr;
+    std::atomic<const TimelineSync*> timelineSync_{nullptr};
 
     std::mutex subMutex_;
     std::vector<OscSubscriber> subscribers_;
     static constexpr double kSubscriberTimeoutSec = 30.0;
+    static constexpr std::chrono::seconds kKeyframeInterval{1};
+    static constexpr double kDefaultRateHz = 30.0;
+    static constexpr double kMinRateHz = 1.0;
+    static constexpr double kMaxRateHz = 200.0;
+
+    // Peak queries (server thread). Replies stay within one frame.
+    static constexpr int kMaxPeakColumns = 512;
+    std::vector<Peak> peaks_;
+
+    std::thread publisher_;
+    std::atomic<bool> stopping_{false};
+
+    // Engine events read so far (publisher thread)
+    uint64_t eventCursor_ = 0;
+    std::vector<EngineEvent> events_;
 
-    // Message buffer for pushing log messages
+    // Server-side log messages (from OSC handlers) for the next push
     std::mutex msgMutex_;
     std::vector<std::string> pendingMessages_;
 };
@@ -0,0 +1,271 @@
+#include "server/TimelineSync.h"
+#include "core/MonotonicClock.h"
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+
+#include <pthread.h>
+
+namespace retrospect {
+
+namespace {
+
+std::string addressName(lo_address addr) {
+    return std::string(lo_address_get_hostname(addr)) + ":" + lo_address_get_port(addr);
+}
+
+} // namespace
+
+TimelineSync::TimelineSync(LoopEngine& engine, Settings settings)
+    : engine_(engine), settings_(std::move(settings)),
+      outputLatencyNanos_(settings_.outputLatencyNanos) {}
+
+TimelineSync::~TimelineSync() {
+    stop();
+}
+
+bool TimelineSync::start() {
+    // A follower listens on any free port: the leader replies to wherever
+    // its pings come from
+    bool leading = settings_.role == Role::Leader;
+    serverThread_ = lo_server_thread_new(leading ? settings_.port.c_str() : nullptr, errorHandler);
+    if (!serverThread_) {
+        fprintf(stderr, "TimelineSync: failed to create server%s%s\n",
+                leading ? " on port " : "", leading ? settings_.port.c_str() : "");
+        return false;
+    }
+    if (leading) {
+        lo_server_thread_add_method(serverThread_, "/retro/sync/ping", "ih", handlePing, this);
+    } else {
+        leader_ = lo_address_new(settings_.leaderHost.c_str(), settings_.leaderPort.c_str());
+        if (!leader_) {
+            fprintf(stderr, "TimelineSync: bad leader address %s:%s\n",
+                    settings_.leaderHost.c_str(), settings_.leaderPort.c_str());
+            lo_server_thread_free(serverThread_);
+            serverThread_ = nullptr;
+            return false;
+        }
+        lo_server_thread_add_method(serverThread_, "/retro/sync/pong", "ihhh", handlePong, this);
+        lo_server_thread_add_method(serverThread_, "/retro/sync/timeline", "hddih",
+                                    handleTimeline, this);
+    }
+
+    lo_server_thread_start(serverThread_);
+    if (leading) {
+        fprintf(stderr, "TimelineSync: leading on port %s\n", settings_.port.c_str());
+    } else {
+        fprintf(stderr, "TimelineSync: following %s\n", addressName(leader_).c_str());
+    }
+
+    stopping_.store(false, std::memory_order_relaxed);
+    sender_ = std::thread([this] { run(); });
+    return true;
+}
+
+void TimelineSync::stop() {
+    if (sender_.joinable()) {
+        stopping_.store(true, std::memory_order_release);
+        wake_.notify();
+        sender_.join();
+    }
+
+    if (serverThread_) {
+        lo_server_thread_stop(serverThread_);
+        lo_server_thread_free(serverThread_);
+        serverThread_ = nullptr;
+    }
+    if (leader_) {
+        lo_address_free(leader_);
+        leader_ = nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(followerMutex_);
+    for (auto& follower : followers_) lo_address_free(follower.addr);
+    followers_.clear();
+}
+
+TimelineSync::Status TimelineSync::status() const {
+    Status st;
+    st.locked = locked_.load(std::memory_order_acquire);
+    st.offsetNanos = offsetNanos_.load(std::memory_order_relaxed);
+    st.rttNanos = rttNanos_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(followerMutex_);
+    st.followers = static_cast<int>(followers_.size());
+    return st;
+}
+
+int64_t TimelineSync::leaderOffsetNanos() const {
+    if (settings_.role != Role::Follower || !locked_.load(std::memory_order_acquire)) return 0;
+    return offsetNanos_.load(std::memory_order_relaxed);
+}
+
+std::vector<std::string> TimelineSync::takeMessages() {
+    std::lock_guard<std::mutex> lock(msgMutex_);
+    std::vector<std::string> messages;
+    messages.swap(pendingMessages_);
+    return messages;
+}
+
+void TimelineSync::postMessage(std::string message) {
+    std::lock_guard<std::mutex> lock(msgMutex_);
+    pendingMessages_.push_back(std::move(message));
+}
+
+void TimelineSync::run() {
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), "retro-sync");
+#endif
+    for (;;) {
+        uint32_t seen = wake_.value();
+        if (stopping_.load(std::memory_order_acquire)) break;
+
+        std::chrono::steady_clock::duration interval = kTimelineInterval;
+        if (settings_.role == Role::Leader) {
+            broadcastTimeline();
+        } else {
+            pingLeader();
+            interval = locked_.load(std::memory_order_relaxed) ? kPingInterval : kFastPingInterval;
+        }
+        wake_.waitUntil(seen, std::chrono::steady_clock::now() + interval);
+    }
+}
+
+// --- Leader ---
+
+int TimelineSync::handlePing(const char*, const char*, lo_arg** argv,
+                             int, lo_message msg, void* user) {
+    auto* self = static_cast<TimelineSync*>(user);
+    int64_t received = systemNanos();
+    lo_address source = lo_message_get_source(msg);
+    if (!source) return 0;
+
+    // Answered first so the follower's round trip holds as little as possible
+    lo_server server = lo_server_thread_get_server(self->serverThread_);
+    lo_send_from(source, server, LO_TT_IMMEDIATE, "/retro/sync/pong", "ihhh",
+                 argv[0]->i, argv[1]->h, received, systemNanos());
+
+    const char* host = lo_address_get_hostname(source);
+    const char* port = lo_address_get_port(source);
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(self->followerMutex_);
+    for (auto& follower : self->followers_) {
+        if (std::strcmp(lo_address_get_hostname(follower.addr), host) == 0 &&
+            std::strcmp(lo_address_get_port(follower.addr), port) == 0) {
+            follower.lastSeen = now;
+            return 0;
+        }
+    }
+    Follower follower;
+    follower.addr = lo_address_new(host, port);
+    if (!follower.addr) return 0;
+    follower.lastSeen = now;
+    self->followers_.push_back(follower);
+    self->postMessage("Sync: " + addressName(follower.addr) + " following");
+    return 0;
+}
+
+void TimelineSync::broadcastTimeline() {
+    // Where the engine's clock has the timeline, on this host's system clock
+    const TimelinePoint& point = engine_.readTimeline();
+    if (point.nanos < 0) return;
+    int64_t at = point.nanos + (systemNanos() - monotonicNanos());
+
+    lo_server server = lo_server_thread_get_server(serverThread_);
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(followerMutex_);
+    auto gone = std::remove_if(followers_.begin(), followers_.end(), [&](Follower& follower) {
+        if (now - follower.lastSeen <= kPeerTimeout) return false;
+        postMessage("Sync: " + addressName(follower.addr) + " stopped following");
+        lo_address_free(follower.addr);
+        return true;
+    });
+    followers_.erase(gone, followers_.end());
+
+    for (auto& follower : followers_) {
+        lo_send_from(follower.addr, server, LO_TT_IMMEDIATE, "/retro/sync/timeline", "hddih",
+                     at, point.beat, point.bpm, point.beatsPerBar,
+                     outputLatencyNanos_.load(std::memory_order_relaxed));
+    }
+}
+
+// --- Follower ---
+
+void TimelineSync::pingLeader() {
+    int64_t heard = lastHeardNanos_.load(std::memory_order_relaxed);
+    int64_t timeout = std::chrono::nanoseconds(kPeerTimeout).count();
+    if (heard >= 0 && monotonicNanos() - heard > timeout &&
+        locked_.exchange(false, std::memory_order_acq_rel)) {
+        postMessage("Sync: lost the leader at " + addressName(leader_));
+    }
+
+    lo_server server = lo_server_thread_get_server(serverThread_);
+    lo_send_from(leader_, server, LO_TT_IMMEDIATE, "/retro/sync/ping", "ih",
+                 ++pingSequence_, systemNanos());
+}
+
+int TimelineSync::handlePong(const char*, const char*, lo_arg** argv,
+                             int, lo_message, void* user) {
+    auto* self = static_cast<TimelineSync*>(user);
+    int64_t received = systemNanos();
+
+    // Exchanges from before the leader went quiet (it may have restarted,
+    // or the network changed) say nothing about the clocks now
+    int64_t now = monotonicNanos();
+    int64_t heard = self->lastHeardNanos_.exchange(now, std::memory_order_relaxed);
+    if (heard < 0 || now - heard > std::chrono::nanoseconds(kPeerTimeout).count()) {
+        self->clock_.reset();
+    }
+    if (!self->clock_.addExchange(argv[1]->h, argv[2]->h, argv[3]->h, received)) return 0;
+
+    self->offsetNanos_.store(self->clock_.offsetNanos(), std::memory_order_relaxed);
+    self->rttNanos_.store(self->clock_.rttNanos(), std::memory_order_relaxed);
+    if (self->clock_.locked() && !self->locked_.exchange(true, std::memory_order_acq_rel)) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "Sync: locked to %s (round trip %.2f ms)",
+                 addressName(self->leader_).c_str(), self->clock_.rttNanos() * 1e-6);
+        self->postMessage(buf);
+    }
+    return 0;
+}
+
+int TimelineSync::handleTimeline(const char*, const char*, lo_arg** argv,
+                                 int, lo_message, void* user) {
+    auto* self = static_cast<TimelineSync*>(user);
+    if (!self->locked_.load(std::memory_order_acquire)) return 0;
+
+    int64_t leaderAt = argv[0]->h;
+    double beat = argv[1]->d;
+    double bpm = argv[2]->d;
+    int beatsPerBar = argv[3]->i;
+    int64_t leaderLatencyNanos = argv[4]->h;
+
+    // Bars can only line up if they are as long
+    if (beatsPerBar != self->engine_.readTimeline().beatsPerBar) {
+        if (!self->beatsPerBarWarned_) {
+            self->beatsPerBarWarned_ = true;
+            self->postMessage("Sync: leader has " + std::to_string(beatsPerBar) +
+                              " beats per bar; set metronome.beats_per_bar to match");
+        }
+        return 0;
+    }
+    self->beatsPerBarWarned_ = false;
+
+    // The leader's moment on this host's engine clock
+    int64_t at = self->clock_.toLocal(leaderAt) + (monotonicNanos() - systemNanos());
+
+    // Heard together at the speakers: a longer output path than the
+    // leader's has to run that much ahead of it
+    double latencySeconds = static_cast<double>(
+        self->outputLatencyNanos_.load(std::memory_order_relaxed) - leaderLatencyNanos) * 1e-9;
+    beat += latencySeconds * bpm / 60.0;
+
+    self->engine_.syncTimeline(beat, bpm, at);
+    return 0;
+}
+
+void TimelineSync::errorHandler(int num, const char* msg, const char* path) {
+    fprintf(stderr, "TimelineSync error %d: %s (path: %s)\n",
+            num, msg, path ? path : "null");
+}
+
+} // namespace retrospect
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "core/ClockSync.h"
+#include "core/LoopEngine.h"
+#include "core/WakeSignal.h"
+#include <lo/lo.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace retrospect {
+
+/// Shares one tempo and beat phase between instances on a network, over
+/// OSC on a port of its own, so quantized ops (and OSC bundles sent to
+/// every instance with one timetag) land on the same bar everywhere.
+///
+/// One instance leads; the others follow it. A follower pings the leader
+/// (/retro/sync/ping) and times the reply (/retro/sync/pong) to estimate
+/// how far the leader's system clock is from its own (ClockSync), all the
+/// time, so the estimate tracks clock drift. The leader sends every
+/// follower that has pinged it where its timeline stands
+/// (/retro/sync/timeline) every kTimelineInterval; the follower carries
+/// that over to its own clock and hands it to LoopEngine::syncTimeline.
+///
+/// Timelines are matched at the speakers, not at the engines: each side's
+/// output latency goes into the comparison the way latency compensation
+/// goes into capture, so a follower with a longer output path runs that
+/// much ahead.
+///
+/// A follower also reads OSC bundle timetags on the leader's clock (see
+/// OscServer::setTimelineSync), so one timetag means one moment on every
+/// instance whatever their system clocks say.
+class TimelineSync {
+public:
+    enum class Role { Leader, Follower };
+
+    struct Settings {
+        Role role = Role::Leader;
+        std::string port = "7771";      // Leader: port to listen on
+        std::string leaderHost;         // Follower: where the leader listens
+        std::string leaderPort = "7771";
+        int64_t outputLatencyNanos = 0; // This instance's output latency
+    };
+
+    /// How the sync stands (any thread)
+    struct Status {
+        bool locked = false;            // Follower: clock offset known, leader heard from
+        int64_t offsetNanos = 0;        // Follower: leader's clock minus this one's
+        int64_t rttNanos = 0;           // Follower: round trip to the leader
+        int followers = 0;              // Leader: followers heard from recently
+    };
+
+    TimelineSync(LoopEngine& engine, Settings settings);
+    ~TimelineSync();
+
+    TimelineSync(const TimelineSync&) = delete;
+    TimelineSync& operator=(const TimelineSync&) = delete;
+
+    /// Start the listener and the ping (follower) or timeline (leader)
+    /// thread. Returns false if the port can't be opened.
+    bool start();
+
+    /// Stop both threads
+    void stop();
+
+    Role role() const { return settings_.role; }
+    Status status() const;
+
+    /// This instance's output latency changed (e.g. a new JACK period)
+    void setOutputLatencyNanos(int64_t nanos) { outputLatencyNanos_.store(nanos, std::memory_order_relaxed); }
+
+    /// Add to a time read off this host's system clock to get the same
+    /// moment on the leader's (0 on the leader, or before a follower locks)
+    int64_t leaderOffsetNanos() const;
+
+    /// Warnings and state changes for the log, since the last call (any thread)
+    std::vector<std::string> takeMessages();
+
+    static constexpr std::chrono::milliseconds kTimelineInterval{100};
+    static constexpr std::chrono::milliseconds kPingInterval{250};
+    static constexpr std::chrono::milliseconds kFastPingInterval{50};  // Until locked
+    static constexpr std::chrono::seconds kPeerTimeout{3};
+
+private:
+    static int handlePing(const char* path, const char* types,
+                          lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handlePong(const char* path, const char* types,
+                          lo_arg** argv, int argc, lo_message msg, void* user);
+    static int handleTimeline(const char* path, const char* types,
+                              lo_arg** argv, int argc, lo_message msg, void* user);
+    static void errorHandler(int num, const char* msg, const char* path);
+
+    /// Leader: send where the timeline stands to every live follower
+    void broadcastTimeline();
+
+    /// Follower: ping the leader, and drop the lock if it has gone quiet
+    void pingLeader();
+
+    /// Thread sending timelines (leader) or pings (follower)
+    void run();
+
+    void postMessage(std::string message);
+
+    struct Follower {
+        lo_address addr = nullptr;
+        std::chrono::steady_clock::time_point lastSeen;
+    };
+
+    LoopEngine& engine_;
+    Settings settings_;
+    lo_server_thread serverThread_ = nullptr;
+    lo_address leader_ = nullptr;
+    std::atomic<int64_t> outputLatencyNanos_;
+
+    // Leader: followers that have pinged (server thread adds, sender prunes)
+    mutable std::mutex followerMutex_;
+    std::vector<Follower> followers_;
+
+    // Follower: the clock estimate (server thread only), published for others
+    ClockSync clock_;
+    int32_t pingSequence_ = 0;                      // Sender thread
+    std::atomic<bool> locked_{false};
+    std::atomic<int64_t> offsetNanos_{0};
+    std::atomic<int64_t> rttNanos_{0};
+    std::atomic<int64_t> lastHeardNanos_{-1};       // Steady clock of the last pong
+    bool beatsPerBarWarned_ = false;                // Server thread
+
+    std::thread sender_;
+    std::atomic<bool> stopping_{false};
+    WakeSignal wake_;
+
+    std::mutex msgMutex_;
+    std::vector<std::string> pendingMessages_;
+};
+
+} // namespace retrospect
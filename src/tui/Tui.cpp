@@ -112,8 +112,11 @@ void Tui::draw() {
     drawPendingOps(row);
     row += static_cast<int>(std::min(snap.pendingOps.size(), size_t(3))) + 2;
 
+    drawPerf(row);
+    row += 3;
+
     drawControls(row);
-    row += 7;
+    row += 8;
 
     drawMessages(row);
 
@@ -356,6 +359,47 @@ void Tui::drawPendingOps(int startRow) {
     }
 }
 
+void Tui::drawPerf(int startRow) {
+    const auto& perf = client_.snapshot().perf;
+
+    attron(A_BOLD);
+    mvprintw(startRow, 0, "DSP");
+    attroff(A_BOLD);
+
+    if (!perf.valid) {
+        mvprintw(startRow, 10, "(measuring)");
+        return;
+    }
+
+    // Worst-case load decides the colour: green, yellow past half the
+    // buffer period, red once a callback comes near the deadline
+    int color = perf.maxLoad >= 0.8 ? 3 : (perf.maxLoad >= 0.5 ? 2 : 1);
+    attron(COLOR_PAIR(color));
+    mvprintw(startRow, 10, "load %5.1f%% avg  %5.1f%% p99  %5.1f%% max",
+             perf.meanLoad * 100.0, perf.p99Load * 100.0, perf.maxLoad * 100.0);
+    attroff(COLOR_PAIR(color));
+    mvprintw(startRow, 56, "period %.0fus", perf.periodUs);
+
+    mvprintw(startRow + 1, 2, "ingest %.0fus  ops %.0fus  mix %.0fus  stretch %.0fus  (max %.0fus)",
+             perf.ingestUs, perf.opsUs, perf.mixUs, perf.stretchUs, perf.maxUs);
+
+    std::ostringstream counts;
+    counts << "missed " << perf.missedDeadlines << "  late " << perf.lateCallbacks
+           << "  xruns ";
+    if (perf.deviceXruns >= 0) counts << perf.deviceXruns;
+    else counts << "n/a";
+    if (perf.hostMaxUs > 0.0) {
+        counts << std::fixed << std::setprecision(0)
+               << "  host " << perf.hostMeanUs << "us avg " << perf.hostMaxUs << "us max";
+    }
+    counts << std::fixed << std::setprecision(0)
+           << "  locked " << static_cast<double>(perf.lockedBytes) / 1048576.0
+           << "/" << static_cast<double>(perf.audioMemoryBytes) / 1048576.0 << "MB";
+    if (perf.missedDeadlines > 0) attron(COLOR_PAIR(3) | A_BOLD);
+    mvprintw(startRow + 2, 2, "%s", counts.str().c_str());
+    if (perf.missedDeadlines > 0) attroff(COLOR_PAIR(3) | A_BOLD);
+}
+
 void Tui::drawControls(int startRow) {
     attron(A_BOLD);
     mvprintw(startRow, 0, "CONTROLS");
@@ -367,6 +411,7 @@ void Tui::drawControls(int startRow) {
     mvprintw(startRow + 4, 2, "[/]: Speed -/+      Tab: Quantize mode     +/-: BPM +/-5");
     mvprintw(startRow + 5, 2, "B/b: Lookback +/-   M: Click on/off        t: Tap tempo");
     mvprintw(startRow + 6, 2, "S: MIDI sync on/off Esc: Cancel pending    q: Quit");
+    mvprintw(startRow + 7, 2, "a: Mute all playing (or unmute all) together");
 }
 
 void Tui::drawMessages(int startRow) {
@@ -421,6 +466,23 @@ void Tui::handleKey(int key) {
             client_.scheduleOp(OpType::ToggleMute, selectedLoop_, q);
             break;
 
+        // Mute every playing loop, or if none is playing unmute every muted
+        // one, all on the same boundary
+        case 'a': {
+            bool anyPlaying = std::any_of(snap.loops.begin(), snap.loops.end(),
+                                          [](const LoopSnapshot& lp) { return lp.isPlaying(); });
+            client_.beginBatch();
+            for (size_t i = 0; i < snap.loops.size(); ++i) {
+                const auto& lp = snap.loops[i];
+                if (anyPlaying ? lp.isPlaying() : lp.isMuted()) {
+                    client_.scheduleOp(anyPlaying ? OpType::Mute : OpType::Unmute,
+                                       static_cast<int>(i), q);
+                }
+            }
+            client_.endBatch();
+            break;
+        }
+
         // Toggle metronome click
         case 'M': {
             bool on = !snap.clickEnabled;
@@ -40,6 +40,7 @@ private:
     void drawInputChannels(int startRow);
     void drawLoops(int startRow);
     void drawPendingOps(int startRow);
+    void drawPerf(int startRow);
     void drawControls(int startRow);
     void drawMessages(int startRow);
     void handleKey(int key);